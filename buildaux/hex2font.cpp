@@ -0,0 +1,54 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include "../include/library/framebuffer-fontbin.hpp"
+
+//Converts .hex font to binary font (see framebuffer::font in include/library/framebuffer.hpp) as C++ source, so
+//the font does not need to be parsed at startup.
+
+int main(int argc, char** argv)
+{
+	if(argc != 3) {
+		std::cerr << "Usage: hex2font <symbol> <file>" << std::endl;
+		return 1;
+	}
+	std::ifstream in(argv[2], std::ios::binary);
+	if(!in) {
+		std::cerr << "Can't open " << argv[2] << std::endl;
+		return 1;
+	}
+	std::map<uint32_t, std::vector<uint32_t>> glyphs;
+	std::string line;
+	unsigned lineno = 0;
+	while(std::getline(in, line)) {
+		lineno++;
+		while(line.length() && (line[line.length() - 1] == '\r' || line[line.length() - 1] == '\n'))
+			line = line.substr(0, line.length() - 1);
+		if(!line.length() || line[0] == '#')
+			continue;
+		if(!fontbin::parse_hex_line(line, glyphs)) {
+			std::cerr << argv[2] << ":" << lineno << ": Invalid line '" << line << "'" << std::endl;
+			return 1;
+		}
+	}
+	std::vector<uint32_t> bin = fontbin::make_binary(glyphs);
+
+	std::cout << "#include <cstdint>" << std::endl;
+	std::cout << "#include <cstdlib>" << std::endl;
+	std::cout << "extern const uint32_t " << argv[1] << "[];" << std::endl;
+	std::cout << "extern const size_t " << argv[1] << "_words;" << std::endl;
+	std::cout << "const uint32_t " << argv[1] << "[] = {";
+	for(size_t i = 0; i < bin.size(); i++) {
+		if(i % 8 == 0)
+			std::cout << std::endl;
+		std::cout << "0x" << std::hex << bin[i] << std::dec << ",";
+	}
+	std::cout << std::endl << "};" << std::endl;
+	std::cout << "const size_t " << argv[1] << "_words = " << bin.size() << ";" << std::endl;
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef _autosave__hpp__included__
+#define _autosave__hpp__included__
+
+#include <string>
+
+struct moviefile;
+struct project_info;
+
+/**
+ * Append the input and metadata changed since the last autosave to the journal of the current project, if the
+ * autosave interval has elapsed. If the journal has grown too large, it is compacted by saving state.
+ *
+ * Only call in emulator thread at frame boundary.
+ *
+ * Parameter force: Sync even if the interval has not elapsed.
+ */
+void autosave_journal_tick(bool force = false);
+/**
+ * Start a new autosave journal for the current project after it has been saved in full.
+ *
+ * Parameter savefile: The file that was saved.
+ */
+void autosave_journal_reset(const std::string& savefile);
+/**
+ * Replay the autosave journal of project onto movie loaded from its last save. Appending continues to the journal
+ * once autosave_journal_finish_switch(true) is called, until then the current journal stays in use.
+ *
+ * Parameter p: The project.
+ * Parameter savefile: The file the movie was loaded from, or empty string if none.
+ * Parameter mv: The loaded movie. Updated to the state in journal.
+ * Returns: True if anything was recovered.
+ */
+bool autosave_journal_recover(project_info& p, const std::string& savefile, moviefile& mv);
+/**
+ * Close the autosave journal.
+ *
+ * Parameter sync: If true, append the last changes first.
+ */
+void autosave_journal_close(bool sync = true);
+/**
+ * Finish switching projects.
+ *
+ * Parameter switched: If true, the current journal is closed and the one recovered by autosave_journal_recover() is
+ *	used from now on. If false, the recovered journal is closed and the current one stays in use.
+ */
+void autosave_journal_finish_switch(bool switched);
+
+#endif
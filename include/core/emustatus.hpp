@@ -6,6 +6,7 @@
 #include <set>
 #include <map>
 #include "library/command.hpp"
+#include "library/dispatch.hpp"
 #include "library/triplebuffer.hpp"
 
 class movie_logic;
@@ -22,9 +23,26 @@ class lua_state;
 class loaded_rom;
 class memwatch_set;
 class emulator_dispatch;
+class slotinfo_cache_listener;
+namespace settingvar { class group; }
 
 struct _lsnes_status
 {
+	//Groups of fields, for change tracking.
+	enum field_group
+	{
+		F_COUNTERS,				//movie_valid, curframe, length, lag, subframe.
+		F_STATE,				//dumping, speed, pause, mode.
+		F_SLOT,					//saveslot_valid, saveslot, slotinfo, branch_valid, branch.
+		F_MBRANCH,				//mbranch_valid, mbranch.
+		F_RTC,					//rtc_valid, rtc.
+		F_MACROS,				//macros.
+		F_INPUTS,				//inputs.
+		F_MVARS,				//mvars.
+		F_LVARS,				//lvars.
+		F_COUNT
+	};
+	_lsnes_status();
 	const static int pause_none;			//pause: No pause.
 	const static int pause_normal;			//pause: Normal pause.
 	const static int pause_break;			//pause: Break pause.
@@ -54,19 +72,31 @@ struct _lsnes_status
 	std::vector<std::u32string> inputs;		//Input display.
 	std::map<std::string, std::u32string> mvars;	//Memory watches.
 	std::map<std::string, std::u32string> lvars;	//Lua variables.
+	uint64_t versions[F_COUNT];			//Version of each field group. Bumped when group changes.
+/**
+ * Get field groups that have changed.
+ *
+ * Parameter seen: Versions of field groups seen. Updated to current versions.
+ * Returns: Bitmask of (1 << field_group) for groups that have different version.
+ */
+	uint32_t changed_since(uint64_t* seen) const;
 };
 
 struct slotinfo_cache
 {
-	slotinfo_cache(movie_logic& _mlogic, command::group& _cmd);
+	slotinfo_cache(movie_logic& _mlogic, settingvar::group& _settings, command::group& _cmd);
+	~slotinfo_cache();
 	std::string get(const std::string& _filename);
 	void flush(const std::string& _filename);
 	void flush();
+	uint64_t get_generation() { return generation; }
 private:
 	std::map<std::string, std::string> cache;
+	uint64_t generation;
 	movie_logic& mlogic;
 	command::group& cmd;
 	command::_fnptr<> flushcmd;
+	slotinfo_cache_listener* listener;
 };
 
 struct status_updater
@@ -76,9 +106,20 @@ public:
 	triplebuffer::triplebuffer<_lsnes_status>& _status, emulator_runmode& _runmode, master_dumper& _mdumper,
 	save_jukebox& _jukebox, slotinfo_cache& _slotcache, framerate_regulator& _framerate,
 	controller_state& _controls, multitrack_edit& _mteditor, lua_state& _lua2, loaded_rom& _rom,
-	memwatch_set& _mwatch, emulator_dispatch& _dispatch);
+	memwatch_set& _mwatch, emulator_dispatch& _dispatch, command::group& _cmd);
 	void update();
 private:
+	void do_update();
+	template<typename T> void set_field(_lsnes_status::field_group g, T& field, const T& value)
+	{
+		if(field == value)
+			return;
+		field = value;
+		model.versions[g] = ++version_counter;
+	}
+	void update_slot();
+	void update_rtc();
+	void show_cost();
 	project_state& project;
 	movie_logic& mlogic;
 	voice_commentary& commentary;
@@ -94,6 +135,28 @@ private:
 	loaded_rom& rom;
 	memwatch_set& mwatch;
 	emulator_dispatch& dispatch;
+	command::group& cmd;
+	command::_fnptr<> costcmd;
+	//The current status. Copied to the triple buffer field group by field group.
+	_lsnes_status model;
+	uint64_t version_counter;
+	//The sources slow fields were computed from.
+	bool slot_dirty;
+	const void* slot_project;
+	uint64_t slot_branch;
+	size_t slot_number;
+	uint64_t slot_generation;
+	std::string slot_projectid;
+	std::string mbranch_name;
+	bool rtc_known;
+	int64_t rtc_second;
+	std::set<std::string> macro_set;
+	struct dispatch::target<> branchchange;
+	//Cost accounting.
+	uint64_t update_count;
+	uint64_t update_usecs;
+	uint64_t slot_recomputes;
+	uint64_t rtc_recomputes;
 };
 
 #endif
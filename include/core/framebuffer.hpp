@@ -5,6 +5,7 @@
 #include "core/queue.hpp"
 #include "library/command.hpp"
 #include "library/framebuffer.hpp"
+#include "library/settingvar.hpp"
 #include "library/triplebuffer.hpp"
 
 #include <stdexcept>
@@ -15,10 +16,6 @@ class emulator_dispatch;
 class lua_state;
 class loaded_rom;
 class status_updater;
-namespace settingvar
-{
-	class group;
-}
 namespace keyboard
 {
 	class keyboard;
@@ -59,6 +56,10 @@ public:
  * Redraw the framebuffer, reusing contents from last redraw. Runs lua hooks if last redraw ran them.
  */
 	void redraw_framebuffer();
+/**
+ * Run Lua paint hooks for frame that is not shown (e.g. while seeking), discarding anything they draw.
+ */
+	void paint_skipped_frame(framebuffer::raw& torender);
 /**
  * Return last complete framebuffer.
  */
@@ -101,9 +102,15 @@ private:
 	render_info buffer2;
 	render_info buffer3;
 	triplebuffer::triplebuffer<render_info> buffering;
+	framebuffer::queue skipped_rq;
 	bool last_redraw_no_lua;
 	subtitle_commentary& subtitles;
 	settingvar::group& settings;
+	settingvar::handle<settingvar::model_int<0, 8191>> dtb;
+	settingvar::handle<settingvar::model_int<0, 8191>> dbb;
+	settingvar::handle<settingvar::model_int<0, 8191>> dlb;
+	settingvar::handle<settingvar::model_int<0, 8191>> drb;
+	settingvar::handle<settingvar::model_int<0, 64>> render_threads;
 	memwatch_set& mwatch;
 	keyboard::keyboard& keyboard;
 	emulator_dispatch& edispatch;
@@ -5,6 +5,7 @@
 #include "rom.hpp"
 #include "moviefile.hpp"
 #include "movie.hpp"
+#include <functional>
 
 /**
  * \brief Emulator main loop.
@@ -25,6 +26,14 @@ extern std::string msu1_base_path;
 void mainloop_signal_need_rewind(void* ptr);
 
 void set_stop_at_frame(uint64_t frame = 0);
+/**
+ * Quit the main loop after given movie frame has been emulated. Output of frames up to that is skipped if the core can
+ * do so and seek-skip-output is set.
+ *
+ * Parameter frame: The last frame to emulate (0 => don't quit).
+ * Parameter on_reached: Called in emulator thread once the frame has been emulated, before the ROM is closed.
+ */
+void set_quit_at_frame(uint64_t frame, std::function<void()> on_reached = std::function<void()>());
 void switch_projects(const std::string& newproj);
 void close_rom();
 void load_new_rom(const romload_request& req);
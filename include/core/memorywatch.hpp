@@ -7,6 +7,7 @@
 #include <functional>
 #include "library/memorywatch.hpp"
 #include "library/json.hpp"
+#include "library/json-document.hpp"
 
 class memory_space;
 class project_state;
@@ -30,7 +31,7 @@ struct memwatch_printer
 /**
  * Unserialize the printer from JSON value.
  */
-	void unserialize(const JSON::node& node);
+	void unserialize(const JSON::document::value& node);
 /**
  * Get a printer object corresponding to this object.
  */
@@ -72,7 +73,7 @@ struct memwatch_item
 /**
  * Unserialize the item from JSON value.
  */
-	void unserialize(const JSON::node& node);
+	void unserialize(const JSON::document::value& node);
 /**
  * Get memory read operator.
  *
@@ -25,7 +25,9 @@ enum lsnes_movie_tags
 	TAG_RAMCONTENT = 0xd3ec3770,
 	TAG_ROMHINT = 0x6f715830,
 	TAG_BRANCH = 0xf2e60707,
-	TAG_BRANCH_NAME = 0x6dcb2155
+	TAG_BRANCH_NAME = 0x6dcb2155,
+	TAG_MOVIE_CHUNKED = 0x8b1d5e36,
+	TAG_BRANCH_CHUNKED = 0x53c0e9a2
 };
 
 #endif
@@ -133,6 +133,10 @@ struct moviefile
  * Identify if file is movie/savestate file or not.
  */
 	static bool is_movie_or_savestate(const std::string& filename);
+/**
+ * Check if first 5 bytes of file are magic of binary movie/savestate (any version).
+ */
+	static bool is_binary_magic(const char* buf);
 /**
  * This constructor construct movie structure with default settings.
  *
@@ -168,11 +172,12 @@ struct moviefile
  * parameter compression: The compression level 0-9. 0 is uncompressed.
  * parameter binary: Save in binary form if true.
  * parameter rrd: The rerecords data.
+ * parameter chunked: If saving in binary form, use version 2, with input in compressed chunks.
  * throws std::bad_alloc: Not enough memory.
  * throws std::runtime_error: Can't save the movie file.
  */
-	void save(const std::string& filename, unsigned compression, bool binary, rrdata_set& rrd, bool as_state)
-		throw(std::bad_alloc, std::runtime_error);
+	void save(const std::string& filename, unsigned compression, bool binary, rrdata_set& rrd, bool as_state,
+		bool chunked = false) throw(std::bad_alloc, std::runtime_error);
 /**
  * Reads this movie structure and saves it to stream (uncompressed ZIP).
  */
@@ -318,7 +323,8 @@ struct moviefile
 private:
 	moviefile(const moviefile&);
 	moviefile& operator=(const moviefile&);
-	void binary_io(int stream, rrdata_set& rrd, bool as_state) throw(std::bad_alloc, std::runtime_error);
+	void binary_io(int stream, rrdata_set& rrd, bool as_state, bool chunked, unsigned compression)
+		throw(std::bad_alloc, std::runtime_error);
 	void binary_io(int stream, struct core_type& romtype) throw(std::bad_alloc, std::runtime_error);
 	void save(zip::writer& w, rrdata_set& rrd, bool as_state) throw(std::bad_alloc, std::runtime_error);
 	void load(zip::reader& r, core_type& romtype) throw(std::bad_alloc, std::runtime_error);
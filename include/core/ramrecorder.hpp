@@ -0,0 +1,146 @@
+#ifndef _ramrecorder__hpp__included__
+#define _ramrecorder__hpp__included__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <list>
+#include <stdexcept>
+#include "library/columnlog.hpp"
+#include "library/command.hpp"
+
+class memory_space;
+class memwatch_set;
+
+/**
+ * Records values of memory locations every frame.
+ *
+ * Each location is a column stored as column_log. Samples are indexed by frame; rewinding (e.g. loading a state)
+ * discards the samples from the frame rewound to onwards.
+ */
+class ram_recorder
+{
+public:
+/**
+ * Ctor.
+ */
+	ram_recorder(memory_space& _memory, memwatch_set& _mwatch, command::group& _cmd);
+/**
+ * Dtor.
+ */
+	~ram_recorder();
+/**
+ * Add a column.
+ *
+ * Parameter name: Name of column.
+ * Parameter addr: The address to record.
+ * Parameter type: Type as memory_struct format with one field (e.g. "W" or ">d").
+ * Throws std::runtime_error: Bad type or column already exists.
+ */
+	void add(const std::string& name, uint64_t addr, const std::string& type);
+/**
+ * Add a column recording a memory watch. The watch has to read a fixed address.
+ *
+ * Parameter name: Name of the memory watch (also used as column name).
+ * Throws std::runtime_error: No such watch, or the watch is not a plain memory read.
+ */
+	void add_watch(const std::string& name);
+/**
+ * Remove a column.
+ */
+	void remove(const std::string& name);
+/**
+ * Get names of columns.
+ */
+	std::list<std::string> get_columns();
+/**
+ * Start or stop recording.
+ */
+	void set_active(bool enable) { active = enable; }
+/**
+ * Is recording?
+ */
+	bool is_active() { return active; }
+/**
+ * Discard all samples.
+ */
+	void clear();
+/**
+ * Record values for frame. Called by main loop after each frame.
+ *
+ * Parameter frame: The frame that was just emulated.
+ */
+	void sample(uint64_t frame);
+/**
+ * Get number of samples.
+ */
+	uint64_t get_samples() { return samples; }
+/**
+ * Get number of bytes used for samples.
+ */
+	size_t get_bytes();
+/**
+ * Get recorded values of column.
+ *
+ * Parameter name: Name of column.
+ * Parameter first: First frame to get.
+ * Parameter last: Last frame to get.
+ * Returns: (frame, value) pairs. Frames not recorded are missing.
+ */
+	std::vector<std::pair<uint64_t, double>> query(const std::string& name, uint64_t first, uint64_t last);
+/**
+ * Write recorded values as CSV, one line per frame, one column per location.
+ */
+	void export_csv(const std::string& filename, uint64_t first = 0, uint64_t last = 0xFFFFFFFFFFFFFFFFULL);
+/**
+ * Write recorded values in binary.
+ *
+ * The file starts with "lsnesram", followed by little-endian fields:
+ * - u32: Number of columns.
+ * - u64: Number of samples.
+ * - For each column: u32 length of name, name, u64 address, u8 type character.
+ * - u64 for each sample: The frame number.
+ * - For each column, for each sample: u64 (f64 for float types) value.
+ */
+	void export_binary(const std::string& filename);
+private:
+	struct column
+	{
+		std::string name;
+		uint64_t addr;
+		char type;
+		unsigned size;
+		int endian;
+		column_log log;
+	};
+	struct range
+	{
+		uint64_t frame;
+		uint64_t index;
+		uint64_t count;
+	};
+	column& find(const std::string& name);
+	void add_column(const std::string& name, uint64_t addr, char type, int endian);
+	void truncate(uint64_t frame);
+	std::vector<range> find_ranges(uint64_t first, uint64_t last);
+	static double to_double(char type, int64_t raw);
+	memory_space& memory;
+	memwatch_set& mwatch;
+	std::list<column> columns;
+	std::vector<std::pair<uint64_t, uint64_t>> segments;	//(frame, index) of each run of consecutive frames.
+	uint64_t samples;
+	uint64_t last_frame;
+	bool active;
+	command::group& cmd;
+	command::_fnptr<const std::string&> addcmd;
+	command::_fnptr<const std::string&> watchcmd;
+	command::_fnptr<const std::string&> removecmd;
+	command::_fnptr<> startcmd;
+	command::_fnptr<> stopcmd;
+	command::_fnptr<> clearcmd;
+	command::_fnptr<> statuscmd;
+	command::_fnptr<const std::string&> csvcmd;
+	command::_fnptr<const std::string&> bincmd;
+};
+
+#endif
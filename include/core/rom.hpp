@@ -48,6 +48,14 @@ struct loaded_rom
  * throws std::bad_alloc: Not enough memory.
  */
 	std::vector<char> save_core_state(bool nochecksum = false) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Saves core state into caller-owned buffer, reusing its storage. WARNING: This takes emulated time.
+ *
+ * parameter out: The buffer to save the state to. Capacity is preserved between calls.
+ * throws std::bad_alloc: Not enough memory.
+ */
+	void save_core_state(std::vector<char>& out, bool nochecksum = false) throw(std::bad_alloc,
+		std::runtime_error);
 
 /**
  * Loads core state from buffer.
@@ -56,6 +64,14 @@ struct loaded_rom
  * throws std::runtime_error: Loading state failed.
  */
 	void load_core_state(const std::vector<char>& buf, bool nochecksum = false) throw(std::runtime_error);
+/**
+ * Loads core state from memory, without copying it.
+ *
+ * parameter buf: The state.
+ * parameter size: Size of state.
+ * throws std::runtime_error: Loading state failed.
+ */
+	void load_core_state(const char* buf, size_t size, bool nochecksum = false) throw(std::runtime_error);
 
 /**
  * Get internal type representation.
@@ -139,7 +155,8 @@ struct loaded_rom
 	framebuffer::raw& draw_cover() { return rtype().draw_cover(); }
 	int reset_action(bool hard) { return rtype().reset_action(hard); }
 	void pre_emulate_frame(portctrl::frame& cf) { return rtype().pre_emulate_frame(cf); }
-	void emulate() { rtype().emulate(); }
+	void emulate(bool skip_output = false) { rtype().emulate(skip_output); }
+	bool can_skip_output() { return rtype().can_skip_output(); }
 	void runtosave() { rtype().runtosave(); }
 	std::pair<uint32_t, uint32_t> get_audio_rate() { return rtype().get_audio_rate(); }
 	void set_debug_flags(uint64_t addr, unsigned flags_set, unsigned flags_clear)
@@ -119,6 +119,8 @@ public:
 private:
 	rom_image(const rom_image&);
 	rom_image& operator=(const rom_image&);
+	//Hash images loaded with deferred hashing.
+	void hash_loaded_images();
 	//Account images.
 	void account_images();
 	//Static NULL image.
@@ -221,6 +223,9 @@ private:
 
 void record_filehash(const std::string& file, uint64_t prefix, const std::string& hash);
 void set_hasher_callback(std::function<void(uint64_t, uint64_t)> cb);
+//Attach the persistent hash index (rom.idx in config directory) to the main hasher. Call once at startup, so
+//hashes computed before any ROM guessing are saved too.
+void open_rom_hash_index();
 rom_image_handle construct_rom(const std::string& movie_filename, const std::vector<std::string>& cmdline);
 
 //Map of preferred cores for each extension and type.
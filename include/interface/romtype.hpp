@@ -328,13 +328,15 @@ struct core_core
 	void load_sram(std::map<std::string, std::vector<char>>& sram) throw(std::bad_alloc);
 	void serialize(std::vector<char>& out);
 	void unserialize(const char* in, size_t insize);
+	size_t serialize_size_hint();
 	core_region& get_region();
 	void power();
 	void unload_cartridge();
 	std::pair<uint32_t, uint32_t> get_scale_factors(uint32_t width, uint32_t height);
 	void install_handler();
 	void uninstall_handler();
-	void emulate();
+	void emulate(bool skip_output = false);
+	bool can_skip_output();
 	void runtosave();
 	bool get_pflag();
 	void set_pflag(bool pflag);
@@ -408,6 +410,12 @@ protected:
  * Unserialize the system state.
  */
 	virtual void c_unserialize(const char* in, size_t insize) = 0;
+/**
+ * Get expected size of serialized state, used to preallocate buffers (0 if unknown).
+ *
+ * Note: c_serialize() must not shrink the capacity of its output buffer, so buffers can be reused.
+ */
+	virtual size_t c_serialize_size_hint();
 /**
  * Get current region.
  */
@@ -436,6 +444,18 @@ protected:
  * Emulate one frame.
  */
 	virtual void c_emulate() = 0;
+/**
+ * Can the core skip output-only work for frames whose output is going to be discarded?
+ */
+	virtual bool c_can_skip_output();
+/**
+ * Emulate one frame, skipping video composition and audio output where possible. Only called if
+ * c_can_skip_output() returns true.
+ *
+ * Note: The resulting state must be identical to one c_emulate() would produce. Calls to timer_tick() and
+ * output_frame() must still be made, but contents of the framebuffer passed to output_frame() do not matter.
+ */
+	virtual void c_emulate_skip_output();
 /**
  * Get core into state where saving is possible. Must run less than one frame.
  */
@@ -585,6 +605,7 @@ public:
 	}
 	void serialize(std::vector<char>& out) { core->serialize(out); }
 	void unserialize(const char* in, size_t insize) { core->unserialize(in, insize); }
+	size_t serialize_size_hint() { return core->serialize_size_hint(); }
 	core_region& get_region() { return core->get_region(); }
 	void power() { core->power(); }
 	void unload_cartridge() { core->unload_cartridge(); }
@@ -594,7 +615,8 @@ public:
 	}
 	void install_handler() { core->install_handler(); }
 	void uninstall_handler() { core->uninstall_handler(); }
-	void emulate() { core->emulate(); }
+	void emulate(bool skip_output = false) { core->emulate(skip_output); }
+	bool can_skip_output() { return core->can_skip_output(); }
 	void runtosave() { core->runtosave(); }
 	bool get_pflag() { return core->get_pflag(); }
 	void set_pflag(bool pflag) { core->set_pflag(pflag); }
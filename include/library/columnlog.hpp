@@ -0,0 +1,67 @@
+#ifndef _library__columnlog__hpp__included__
+#define _library__columnlog__hpp__included__
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * Append-only column of integers, stored compressed.
+ *
+ * Each value is stored as zigzag varint of difference to previous value, so slowly changing values take about one
+ * byte each. Every block_size values start from zero instead of previous value, so a range can be decoded without
+ * decoding everything before it.
+ */
+class column_log
+{
+public:
+/**
+ * Number of values in a block.
+ */
+	static const uint64_t block_size = 256;
+/**
+ * Create empty column.
+ */
+	column_log() throw();
+/**
+ * Append value.
+ *
+ * Parameter value: The value to append.
+ */
+	void append(int64_t value) throw(std::bad_alloc);
+/**
+ * Get number of values.
+ */
+	uint64_t size() const throw() { return count; }
+/**
+ * Get number of bytes used for storing the values.
+ */
+	size_t get_bytes() const throw() { return data.size() + blocks.size() * sizeof(size_t); }
+/**
+ * Read range of values.
+ *
+ * Parameter first: Index of first value to read.
+ * Parameter n: Number of values to read. Values past the end read as zero.
+ * Parameter out: Buffer to store the values to.
+ */
+	void read(uint64_t first, uint64_t n, int64_t* out) const throw();
+/**
+ * Discard values from the end.
+ *
+ * Parameter n: Number of values to keep.
+ */
+	void truncate(uint64_t n) throw();
+/**
+ * Discard all values.
+ */
+	void clear() throw();
+private:
+	size_t skip(size_t pos, uint64_t n, int64_t& value) const throw();
+	std::vector<uint8_t> data;
+	std::vector<size_t> blocks;
+	uint64_t count;
+	int64_t last;
+};
+
+#endif
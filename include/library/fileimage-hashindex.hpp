@@ -0,0 +1,101 @@
+#ifndef _library__fileimage_hashindex__hpp__included__
+#define _library__fileimage_hashindex__hpp__included__
+
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include "threads.hpp"
+
+namespace fileimage
+{
+/**
+ * Persistent index of file hashes.
+ *
+ * Entries are keyed by (absolute path, prefix) and are only trusted if file size and modification time still
+ * match. Updates are appended to the backing file one line at a time, and the file is periodically compacted
+ * by writing a new copy and renaming it over the old one.
+ */
+class hashindex
+{
+public:
+/**
+ * Create a new index, initially not backed by any file.
+ */
+	hashindex();
+/**
+ * Dtor.
+ */
+	~hashindex();
+/**
+ * Set the backing file. Entries in the file are merged with ones already in memory, and the merged set is
+ * written back.
+ *
+ * Parameter filename: The file to use.
+ */
+	void set_backing_file(const std::string& filename);
+/**
+ * Is there a backing file?
+ */
+	bool has_backing_file();
+/**
+ * Import entries from old-style database (lines of <hash>:<prefix>|<filename>). Since these have no size
+ * or timestamp, they are only used for finding files by hash, not for skipping rehashing.
+ *
+ * Parameter filename: The database to import.
+ */
+	void import_legacy(const std::string& filename);
+/**
+ * Look up hash of file.
+ *
+ * Parameter filename: The file to look up.
+ * Parameter prefix: The number of bytes skipped from start of file.
+ * Returns: The hash, or "" if not known or file has changed.
+ */
+	std::string lookup(const std::string& filename, uint64_t prefix);
+/**
+ * Record hash of file. The current size and timestamp of file are recorded too.
+ *
+ * Parameter filename: The file.
+ * Parameter prefix: The number of bytes skipped from start of file.
+ * Parameter hash: The hash. If "", the entry is removed.
+ */
+	void store(const std::string& filename, uint64_t prefix, const std::string& hash);
+/**
+ * Remove all entries for file.
+ */
+	void forget(const std::string& filename);
+/**
+ * Find files with given hash.
+ *
+ * Parameter hash: The hash to search for.
+ * Returns: List of (filename, prefix) pairs. These might be stale.
+ */
+	std::list<std::pair<std::string, uint64_t>> files_by_hash(const std::string& hash);
+/**
+ * Rewrite the backing file with only the current entries.
+ */
+	void compact();
+private:
+	hashindex(const hashindex&);
+	hashindex& operator=(const hashindex&);
+	struct entry
+	{
+		uint64_t size;
+		time_t mtime;
+		std::string hash;
+	};
+	typedef std::pair<std::string, uint64_t> key_t;
+	void set_entry(const key_t& key, const entry* e);
+	void read_file(const std::string& filename, bool legacy);
+	void append_record(const key_t& key, const entry* e);
+	void compact_unlocked();
+	threads::lock mlock;
+	std::map<key_t, entry> entries;
+	std::multimap<std::string, key_t> by_hash;
+	std::string backingfile;
+	uint64_t log_records;
+};
+}
+#endif
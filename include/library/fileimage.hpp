@@ -6,6 +6,8 @@
 #include <list>
 #include <vector>
 #include "threads.hpp"
+#include "threads-pool.hpp"
+#include "fileimage-hashindex.hpp"
 
 namespace fileimage
 {
@@ -74,13 +76,13 @@ private:
 };
 
 /**
- * Class performing SHA-256 hashing.
+ * Class performing SHA-256 hashing. Files are hashed concurrently by a pool of worker threads.
  */
 class hash
 {
 public:
 /**
- * Create a new SHA-256 hasher.
+ * Create a new SHA-256 hasher. Files are hashed on the global task pool.
  */
 	hash();
 /**
@@ -100,13 +102,22 @@ public:
  */
 	hashval operator()(const std::string& filename, std::function<uint64_t(uint64_t)> prefixlen);
 /**
- * Thread entrypoint.
+ * Compute SHA-256 of file in background, just to record it into index. Files already in index are skipped.
+ */
+	void prefetch(const std::string& filename, std::function<uint64_t(uint64_t)> prefixlen);
+/**
+ * Get the index of known hashes. Hashes computed are recorded there, and files already there are not
+ * rehashed.
+ */
+	hashindex& get_index() { return index; }
+/**
+ * Task entrypoint. Hashes one queued file.
  */
 	void entrypoint();
 private:
 	void link(hashval& future);
 	void unlink(hashval& future);
-	void send_callback(uint64_t this_completed);
+	void send_callback();
 	void send_idle();
 
 	friend class hashval;
@@ -115,23 +126,27 @@ private:
 		std::string filename;
 		uint64_t prefix;
 		uint64_t size;
+		uint64_t progress;
 		unsigned cbid;
+		bool claimed;
+		bool background;
 		volatile unsigned interested;
 	};
+	hashval queue_file(queue_job& j);
 	hash(const hash&);
 	hash& operator=(const hash&);
-	threads::thread* hash_thread;
+	std::list<threads::future<void>> tasks;
 	threads::lock mlock;
-	threads::cv condition;
 	std::list<queue_job> queue;
-	std::list<queue_job>::iterator current_job;
 	hashval* first_future;
 	hashval* last_future;
 	unsigned next_cbid;
 	std::function<void(uint64_t, uint64_t)> progresscb;
 	bool quitting;
 	uint64_t total_work;
+	uint64_t total_progress;	//Sum of progress of jobs in queue.
 	uint64_t work_size;
+	hashindex index;
 };
 
 /**
@@ -170,11 +185,21 @@ struct image
  * parameter filename: The filename to read. If "", empty slot is constructed.
  * parameter base: Base filename to interpret the filename against. If "", no base filename is used.
  * parameter imginfo: Image information.
+ * parameter defer_hash: If true, hash of memory or markup image is not computed, call hash_deferred() later.
  * throws std::bad_alloc: Not enough memory.
  * throws std::runtime_error: Can't load the data.
  */
 	image(hash& hasher, const std::string& filename, const std::string& base,
-		const struct info& imginfo) throw(std::bad_alloc, std::runtime_error);
+		const struct info& imginfo, bool defer_hash = false) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Compute the hashes of images constructed with defer_hash set. The images are hashed together, which is faster
+ * than one by one if multi-buffer hashing is available.
+ *
+ * parameter images: The images. Images that already have hashes are skipped.
+ * parameter count: Number of images.
+ * throws std::bad_alloc: Not enough memory.
+ */
+	static void hash_deferred(image* const* images, size_t count) throw(std::bad_alloc);
 
 /**
  * This method patches this slot using specified IPS patch.
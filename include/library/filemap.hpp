@@ -0,0 +1,50 @@
+#ifndef _library__filemap__hpp__included__
+#define _library__filemap__hpp__included__
+
+#include <cstdlib>
+#include <string>
+#include <stdexcept>
+#include <vector>
+
+namespace filemap
+{
+/**
+ * Read-only memory mapping of whole file.
+ *
+ * On systems without usable mapping support, the file is read into memory instead.
+ */
+class mapping
+{
+public:
+/**
+ * Map a file.
+ *
+ * Parameter filename: The file to map.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Can't open or map the file.
+ */
+	mapping(const std::string& filename) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Unmap the file.
+ */
+	~mapping() throw();
+/**
+ * Get the mapped data.
+ */
+	const char* data() const throw() { return base; }
+/**
+ * Get size of mapped data.
+ */
+	size_t size() const throw() { return length; }
+private:
+	mapping(const mapping&);
+	mapping& operator=(const mapping&);
+	const char* base;
+	size_t length;
+	void* handle;
+	bool mapped;
+	std::vector<char> fallback;
+};
+}
+
+#endif
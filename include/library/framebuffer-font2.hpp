@@ -31,6 +31,7 @@ public:
 	font2();
 	font2(const std::string& file);
 	font2(struct font& bfont);
+	~font2() throw();
 	void add(const std::u32string& key, const glyph& fglyph) throw(std::bad_alloc);
 	std::u32string best_ligature_match(const std::u32string& codepoints, size_t start) const
 		throw(std::bad_alloc);
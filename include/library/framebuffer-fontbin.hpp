@@ -0,0 +1,85 @@
+#ifndef _library__framebuffer_fontbin__hpp__included__
+#define _library__framebuffer_fontbin__hpp__included__
+
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Conversion of .hex fonts to binary font form (see framebuffer::font).
+ *
+ * This is shared by framebuffer::font::load_hex() and buildaux/hex2font, so it only depends on the standard library.
+ */
+namespace fontbin
+{
+/**
+ * Magic value of binary font.
+ */
+const uint32_t magic = 0x4C464E54;
+/**
+ * Number of entries in page table of binary font.
+ */
+const uint32_t pages = 0x1100;
+
+/**
+ * Parse a line of .hex font.
+ *
+ * Line format is <hex digits>:<32 or 64 hex digits>.
+ *
+ * Parameter line: The line, without line terminator.
+ * Parameter glyphs: The glyph is stored here, replacing any earlier glyph with the same codepoint.
+ * Returns: True if line is valid, false otherwise.
+ */
+inline bool parse_hex_line(const std::string& line, std::map<uint32_t, std::vector<uint32_t>>& glyphs)
+{
+	size_t splitter = line.find(':');
+	if(splitter == std::string::npos || splitter == 0 || splitter > 7)
+		return false;	//No :, or too long codepoint.
+	size_t len = line.length() - splitter - 1;
+	if(len != 32 && len != 64)
+		return false;	//Not 32/64 hexes after.
+	if(line.find_first_not_of("0123456789ABCDEFabcdef:") != std::string::npos)
+		return false;	//Invalid character.
+	if(line.find(':', splitter + 1) != std::string::npos)
+		return false;	//Second :.
+	uint32_t cp = strtoul(line.substr(0, splitter).c_str(), NULL, 16);
+	if(cp > 0x10FFFF)
+		return false;	//Codepoint out of range.
+	std::vector<uint32_t>& g = glyphs[cp];
+	g.clear();
+	for(size_t i = 0; i < len; i += 8)
+		g.push_back(strtoul(line.substr(splitter + 1 + i, 8).c_str(), NULL, 16));
+	return true;
+}
+
+/**
+ * Convert parsed glyphs to binary font. Space is always made blank.
+ *
+ * Parameter glyphs: The glyphs.
+ * Returns: The binary font.
+ */
+inline std::vector<uint32_t> make_binary(std::map<uint32_t, std::vector<uint32_t>>& glyphs)
+{
+	glyphs[32] = std::vector<uint32_t>(4, 0);
+	std::vector<uint32_t> bin;
+	bin.resize(2 + pages);
+	bin[0] = magic;
+	for(auto& i : glyphs) {
+		uint32_t& page = bin[2 + (i.first >> 8)];
+		if(!page) {
+			page = bin.size();
+			bin.resize(bin.size() + 256);
+		}
+	}
+	for(auto& i : glyphs) {
+		bin[bin[2 + (i.first >> 8)] + (i.first & 255)] = (bin.size() << 1) | (i.second.size() == 8 ? 1 : 0);
+		bin.insert(bin.end(), i.second.begin(), i.second.end());
+	}
+	bin[1] = bin.size();
+	return bin;
+}
+}
+
+#endif
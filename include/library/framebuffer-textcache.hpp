@@ -0,0 +1,130 @@
+#ifndef _library__framebuffer_textcache__hpp__included__
+#define _library__framebuffer_textcache__hpp__included__
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "framebuffer.hpp"
+#include "threads.hpp"
+
+namespace framebuffer
+{
+/**
+ * LRU cache of rasterized text.
+ *
+ * Text is rasterized to masks of color indices, so colors are not part of the key, and drawing text that is in
+ * the cache does not need to decode or lay out the text at all.
+ */
+class text_cache
+{
+public:
+/**
+ * Rasterized text.
+ */
+	struct mask
+	{
+		uint32_t width;
+		uint32_t height;
+		std::vector<uint8_t> data;	//Color index (0-3) for each pixel, row by row.
+	};
+/**
+ * Kind of rasterization. Each kind has its own meaning for flags and color indices, so text of different kinds
+ * is cached separately even if owner, text and flags are the same.
+ */
+	enum kind
+	{
+		KIND_PLAIN,		//font::render(): 1 is foreground, 2 is background.
+		KIND_HALO_TEXT,		//gui.text: 0 is background, 1 is foreground, 2 is halo.
+		KIND_WATCH		//Memory watches: 1 is foreground, 2 is halo, 3 is background.
+	};
+/**
+ * Cache statistics.
+ */
+	struct stats
+	{
+		uint64_t hits;
+		uint64_t misses;
+		size_t entries;
+		size_t bytes;
+	};
+/**
+ * Create a cache.
+ *
+ * Parameter limit: Maximum size of the masks in bytes.
+ */
+	text_cache(size_t limit) throw();
+/**
+ * Get the cache used for drawing on screen.
+ */
+	static text_cache& global() throw();
+/**
+ * Get rasterized text, rasterizing it if it is not in cache.
+ *
+ * Parameter owner: Identity of font. Text from different owners is cached separately.
+ * Parameter type: Kind of rasterization.
+ * Parameter text: The text.
+ * Parameter flags: Owner-specific flags that affect rasterization.
+ * Parameter rasterize: Function to rasterize the text. Called without locks held.
+ * Returns: The mask. Remains valid even if removed from cache.
+ */
+	std::shared_ptr<const mask> get(const void* owner, kind type, const std::string& text, uint32_t flags,
+		std::function<void(mask& m)> rasterize) throw(std::bad_alloc);
+/**
+ * Forget all text from given owner (e.g., because font is being destroyed).
+ */
+	void forget(const void* owner) throw();
+/**
+ * Forget all text.
+ */
+	void clear() throw();
+/**
+ * Set maximum size in bytes.
+ */
+	void set_limit(size_t limit) throw();
+/**
+ * Get statistics.
+ */
+	stats get_stats() throw();
+/**
+ * Draw a mask on screen.
+ *
+ * Parameter scr: The screen to draw on.
+ * Parameter x: The x coordinate (relative to screen, not origin).
+ * Parameter y: The y coordinate (relative to screen, not origin).
+ * Parameter m: The mask to draw.
+ * Parameter cmap: Colors for indices 0-3. Transparent colors are skipped.
+ */
+	template<bool X> static void blit(fb<X>& scr, uint32_t x, uint32_t y, const mask& m, color* cmap) throw();
+private:
+	struct key
+	{
+		const void* owner;
+		kind type;
+		uint32_t flags;
+		std::string text;
+		bool operator<(const key& k) const throw();
+	};
+	struct entry
+	{
+		std::shared_ptr<const mask> m;
+		std::list<key>::iterator lru;
+	};
+	text_cache(const text_cache&);
+	text_cache& operator=(const text_cache&);
+	void evict();
+	threads::lock lock;
+	std::map<key, entry> entries;
+	std::list<key> lru;		//Most recently used first.
+	size_t limit;
+	size_t bytes;
+	uint64_t hits;
+	uint64_t misses;
+};
+}
+
+#endif
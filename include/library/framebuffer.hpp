@@ -8,6 +8,7 @@
 #include <map>
 #include <set>
 #include "framebuffer-pixfmt.hpp"
+#include "framebuffer-fontbin.hpp"
 #include "threads.hpp"
 #include "memtracker.hpp"
 
@@ -257,6 +258,18 @@ struct fb
  */
 	void copy_from(raw& scr, size_t hscale, size_t vscale) throw();
 
+/**
+ * Make this framebuffer a view into rectangular part of another framebuffer. The origin is adjusted so that
+ * anything drawn using modular coordinate arithmetic lands at the same place as on the parent.
+ *
+ * parameter parent: The framebuffer to view into.
+ * parameter x: X coordinate of the part.
+ * parameter y: Y coordinate of the part.
+ * parameter w: Width of the part.
+ * parameter h: Height of the part.
+ * Returns: True on success, false if parent can't be split like that (upside down or misaligned).
+ */
+	bool set_view(fb<X>& parent, size_t x, size_t y, size_t w, size_t h) throw();
 /**
  * Get pointer into specified row.
  *
@@ -376,6 +389,18 @@ struct object
  * Clone the object.
  */
 	virtual void clone(struct queue& q) const throw(std::bad_alloc) = 0;
+/**
+ * Get bounding box of the object, relative to screen origin. Objects that return true are not allowed to draw
+ * outside the box, and must be able to draw on screen views (see fb::set_view()), whose origin may have wrapped
+ * around. Default is to return false (no bounds).
+ *
+ * parameter x: The X coordinate of the box is written here.
+ * parameter y: The Y coordinate of the box is written here.
+ * parameter w: The width of the box is written here.
+ * parameter h: The height of the box is written here.
+ * Returns: True if bounds are known, false if not.
+ */
+	virtual bool get_bounds(int32_t& x, int32_t& y, uint32_t& w, uint32_t& h) const throw();
 };
 
 /**
@@ -483,6 +508,14 @@ struct color_mod
 
 /**
  * Bitmap font (8x16).
+ *
+ * The glyphs are kept in binary form, which can be used directly from read-only memory:
+ * - Word 0: Magic (font::binary_magic).
+ * - Word 1: Total number of words.
+ * - Words 2-4353: Page table. Offset of page for codepoints 256*n to 256*n+255, or 0 if there are no glyphs.
+ * - Pages: 256 words each. Offset of glyph data shifted left by one, plus 1 if glyph is wide. 0 if no glyph.
+ * - Glyph data: 4 words (narrow) or 8 words (wide) each.
+ * Offsets are in words from the start.
  */
 struct font
 {
@@ -492,8 +525,7 @@ struct font
 	struct glyph
 	{
 		bool wide;		//If set, 16 wide instead of 8.
-		uint32_t* data;		//Glyph data. Bitpacked with element padding between rows.
-		size_t offset;		//Glyph offset.
+		const uint32_t* data;	//Glyph data. Bitpacked with element padding between rows.
 		uint32_t get_width() const throw() { return wide ? 16 : 8; }
 		uint32_t get_height() const throw() { return 16; }
 		bool read_pixel(uint32_t x, uint32_t y) const throw()
@@ -513,12 +545,24 @@ struct font
 	{
 		size_t x;		//X position.
 		size_t y;		//Y position.
-		const glyph* dglyph;	//The glyph itself.
+		glyph dglyph;		//The glyph itself.
 	};
+/**
+ * Magic value of binary font.
+ */
+	static const uint32_t binary_magic = fontbin::magic;
+/**
+ * Number of entries in page table of binary font.
+ */
+	static const uint32_t binary_pages = fontbin::pages;
 /**
  * Constructor.
  */
 	font() throw(std::bad_alloc);
+/**
+ * Destructor.
+ */
+	~font() throw();
 /**
  * Load a .hex format font.
  *
@@ -527,13 +571,30 @@ struct font
  * Throws std::runtime_error: Bad font data.
  */
 	void load_hex(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Load a binary font. The data is used in place, so it must stay valid for lifetime of the font.
+ *
+ * Parameter data: The font data.
+ * Parameter words: The font data size in words.
+ * Throws std::runtime_error: Bad font data.
+ */
+	void load_binary(const uint32_t* data, size_t words) throw(std::runtime_error);
 /**
  * Locate glyph.
  *
  * Parameter glyph: Number of glyph to locate.
  * Returns: Glyph parameters.
  */
-	const glyph& get_glyph(uint32_t glyph) throw();
+	glyph get_glyph(uint32_t glyph) throw()
+	{
+		uint32_t e = lookup(glyph);
+		if(!e)
+			return bad_glyph;
+		struct glyph g;
+		g.wide = e & 1;
+		g.data = binary + (e >> 1);
+		return g;
+	}
 /**
  * Get metrics of string.
  *
@@ -599,12 +660,19 @@ struct font
  */
 	void render(uint8_t* buf, size_t stride, const std::string& str, uint32_t alignx, bool hdbl, bool vdbl);
 private:
+	uint32_t lookup(uint32_t cp) const throw()
+	{
+		if(!binary || cp >= 256 * binary_pages)
+			return 0;
+		uint32_t page = binary[2 + (cp >> 8)];
+		return page ? binary[page + (cp & 255)] : 0;
+	}
 	glyph bad_glyph;
 	uint32_t bad_glyph_data[4];
-	std::map<uint32_t, glyph> glyphs;
+	const uint32_t* binary;
+	size_t binary_words;
 	size_t tabstop;
 	std::vector<uint32_t> memory;
-	void load_hex_glyph(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error);
 };
 
 
@@ -618,9 +686,16 @@ struct queue
 /**
  * Applies all objects in the queue in order.
  *
+ * If multiple render threads are enabled, the screen is split into tiles, and objects with bounds are drawn on
+ * the tiles in parallel. The result is the same as drawing in order.
+ *
  * parameter scr: The screen to apply queue to.
  */
 	template<bool X> void run(struct fb<X>& scr) throw();
+/**
+ * Set number of threads used for drawing queues. 0 or 1 draws sequentially.
+ */
+	static void set_threads(unsigned threads) throw(std::bad_alloc);
 
 /**
  * Frees all objects in the queue without applying them.
@@ -676,6 +751,8 @@ struct queue
 	~queue() throw();
 private:
 	void add(struct object& obj) throw(std::bad_alloc);
+	template<bool X> bool run_tiled(struct fb<X>& scr) throw(std::bad_alloc);
+	template<bool X> void run_tiles(struct fb<X>& scr, std::vector<fb<X>>& views) throw();
 	struct node { struct object* obj; struct node* next; bool killed; };
 	struct page {
 		char content[RENDER_PAGE_SIZE];
@@ -687,6 +764,8 @@ private:
 	size_t memory_allocated;
 	size_t pages;
 	threads::lock display_mutex; //Synchronize display and kill.
+	std::vector<std::vector<struct object*>> tile_bins;	//Objects to draw on each tile, in order.
+	std::vector<struct object*> tile_objects;		//All objects in tile_bins, in order.
 	std::map<size_t, page> memory;
 	memtracker::autorelease tracker;
 };
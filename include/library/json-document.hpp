@@ -0,0 +1,146 @@
+#ifndef _library__json_document__hpp__included__
+#define _library__json_document__hpp__included__
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <utility>
+#include <vector>
+#include "json.hpp"
+
+namespace JSON
+{
+/**
+ * A read-only JSON document.
+ *
+ * All values and strings are allocated from large blocks owned by the document, and strings are kept as UTF-8. This
+ * makes loading large documents much faster and smaller than with node, at the cost of not being modifiable.
+ */
+class document
+{
+public:
+/**
+ * A value in document. Valid as long as the document is.
+ */
+	class value
+	{
+	public:
+/**
+ * Get type of value (one of null, boolean, number, string, array or object).
+ */
+		int type() const throw() { return vtype; }
+/**
+ * Get boolean value (NT_BOOLEAN).
+ */
+		bool as_bool() const throw(error);
+/**
+ * Get double numeric value (NT_NUMBER).
+ */
+		double as_double() const throw(error);
+/**
+ * Get int64_t value (NT_NUMBER).
+ */
+		int64_t as_int() const throw(error);
+/**
+ * Get uint64_t value (NT_NUMBER).
+ */
+		uint64_t as_uint() const throw(error);
+/**
+ * Read the string as UTF-8 (NT_STRING).
+ */
+		std::string as_string8() const throw(std::bad_alloc, error);
+/**
+ * Get the string without copying (NT_STRING).
+ *
+ * Parameter len: Filled with length of string in bytes.
+ * Returns: The string, NUL-terminated.
+ */
+		const char* as_cstring(size_t& len) const throw(error);
+/**
+ * Read number of indices in array (NT_ARRAY).
+ */
+		size_t index_count() const throw(error);
+/**
+ * Read specified index from array (NT_ARRAY).
+ */
+		const value& index(size_t idx) const throw(error);
+/**
+ * Read number of fields in object, counting duplicate keys separately (NT_OBJECT).
+ */
+		size_t field_count() const throw(error);
+/**
+ * Read key of field by position (NT_OBJECT).
+ */
+		std::string key(size_t idx) const throw(std::bad_alloc, error);
+/**
+ * Read field by position (NT_OBJECT).
+ */
+		const value& field_value(size_t idx) const throw(error);
+/**
+ * Read number of instances of key in object (NT_OBJECT).
+ */
+		size_t field_count(const std::string& key) const throw(error);
+/**
+ * Specified field exists (NT_OBJECT)
+ */
+		bool field_exists(const std::string& key) const throw(error)
+		{
+			return (field_count(key) > 0);
+		}
+/**
+ * Read specified key from object (NT_OBJECT).
+ */
+		const value& field(const std::string& key, size_t subindex = 0) const throw(error);
+/**
+ * Copy the value to a modifiable node.
+ */
+		node to_node() const throw(std::bad_alloc);
+	private:
+		friend class document;
+		struct keyref
+		{
+			const char* str;
+			size_t len;
+		};
+		int vtype;
+		bool _boolean;
+		number_holder _number;
+		size_t count;			//Length of string, or number of children.
+		const char* _string;
+		const value* children;
+		const keyref* keys;		//Keys of children in objects.
+		const size_t* order;		//Children of large objects sorted by key, NULL for small ones.
+		//Returns position of first instance in order and number of instances. Only for indexed objects.
+		std::pair<size_t, size_t> find_key(const std::string& key) const throw();
+	};
+/**
+ * Parse a document.
+ *
+ * Parameter doc: The JSON text.
+ * Throws error: The document is not valid JSON.
+ */
+	document(const std::string& doc) throw(std::bad_alloc, error);
+	~document() throw();
+/**
+ * Get the root value.
+ */
+	const value& root() const throw() { return _root; }
+/**
+ * Get number of bytes allocated for the document.
+ */
+	size_t get_allocated() const throw() { return allocated; }
+private:
+	class builder;
+	document(const document&);
+	document& operator=(const document&);
+	void* alloc(size_t size) throw(std::bad_alloc);
+	static void make_node(const value& v, node& n) throw(std::bad_alloc);
+	std::list<char*> blocks;
+	char* free_ptr;
+	size_t free_left;
+	size_t allocated;
+	value _root;
+};
+}
+
+#endif
@@ -175,6 +175,76 @@ private:
 
 class node;
 
+/**
+ * A JSON number.
+ */
+class number_holder
+{
+public:
+	number_holder() { sub = 0; n.n0 = 0; }
+/**
+ * Parse a number.
+ *
+ * Parameter expr: The document.
+ * Parameter ptr: Position of the number, updated to point after it.
+ * Parameter len: Length of the document.
+ * Throws error: Not a valid number.
+ */
+	number_holder(const std::string& expr, size_t& ptr, size_t len);
+	template<typename T> T to() const
+	{
+		switch(sub) {
+		case 0: return n.n0;
+		case 1: return n.n1;
+		case 2: return n.n2;
+		}
+		return 0;
+	}
+	template<typename T> void from(T val);
+	void write(std::ostream& s) const;
+	bool operator==(const number_holder& h) const;
+private:
+	template<typename T> bool cmp(const T& num) const;
+	unsigned sub;
+	union {
+		double n0;
+		uint64_t n1;
+		int64_t n2;
+	} n;
+};
+
+/**
+ * Receiver of events from the event-based (SAX) parser.
+ *
+ * Strings and keys are passed as UTF-8 and are only valid for the duration of the call.
+ */
+class sax_handler
+{
+public:
+	virtual ~sax_handler() throw();
+	virtual void null_value() = 0;
+	virtual void boolean_value(bool v) = 0;
+	virtual void number_value(const number_holder& n) = 0;
+	virtual void string_value(const char* str, size_t len) = 0;
+	virtual void array_begin() = 0;
+	virtual void array_end() = 0;
+	virtual void object_begin() = 0;
+/**
+ * Key of the next value in object.
+ */
+	virtual void object_key(const char* str, size_t len) = 0;
+	virtual void object_end() = 0;
+};
+
+/**
+ * Parse a JSON document without building any tree, calling the handler for each value.
+ *
+ * Parameter doc: The document.
+ * Parameter handler: The handler to call.
+ * Throws error: The document is not valid JSON. The handler may have been called for part of document.
+ */
+void sax_parse(const std::string& doc, sax_handler& handler) throw(std::bad_alloc, error);
+
 /**
  * A JSON pointer
  */
@@ -694,37 +764,11 @@ public:
  */
 	iterator erase(iterator itr) throw(error);
 private:
-	class number_holder
-	{
-	public:
-		number_holder() { sub = 0; n.n0 = 0; }
-		number_holder(const std::string& expr, size_t& ptr, size_t len);
-		template<typename T> T to() const
-		{
-			switch(sub) {
-			case 0: return n.n0;
-			case 1: return n.n1;
-			case 2: return n.n2;
-			}
-			return 0;
-		}
-		template<typename T> void from(T val);
-		void write(std::ostream& s) const;
-		bool operator==(const number_holder& h) const;
-	private:
-		template<typename T> bool cmp(const T& num) const;
-		unsigned sub;
-		union {
-			double n0;
-			uint64_t n1;
-			int64_t n2;
-		} n;
-	};
 	friend class iterator;
 	friend class const_iterator;
+	friend class document;
+	class builder;
 	void fixup_nodes(const node& _node);
-	void ctor(const std::string& doc, size_t& ptr, size_t len) throw(std::bad_alloc, error);
-	node(const std::string& doc, size_t& ptr, size_t len) throw(std::bad_alloc, error);
 	template<typename T> void set_helper(T v)
 	{
 		std::u32string tmp;
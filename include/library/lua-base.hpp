@@ -499,6 +499,8 @@ public:
 	void rawget(int index) { lua_rawget(lua_handle, index); }
 	int isnil(int index) { return lua_isnil(lua_handle, index); }
 	void newtable() { lua_newtable(lua_handle); }
+	void createtable(int narr, int nrec) { lua_createtable(lua_handle, narr, nrec); }
+	int checkstack(int extra) { return lua_checkstack(lua_handle, extra); }
 	void pushcclosure(lua_CFunction fn, int n) { lua_pushcclosure(lua_handle, fn, n); }
 	void pushcfunction(lua_CFunction fn) { lua_pushcfunction(lua_handle, fn); }
 	void setfield(int index, const char* k) { lua_setfield(lua_handle, index, k); }
@@ -194,6 +194,17 @@ public:
  * Parameter bsize: Size of buffer.
  */
 	void read_range(uint64_t address, void* buffer, size_t bsize);
+/**
+ * Read equally spaced rows (not across regions) into packed buffer. Only one lookup is done.
+ *
+ * Parameter address: Address of the first row.
+ * Parameter size: Size of each row.
+ * Parameter rows: Number of rows.
+ * Parameter stride: Distance between starts of rows.
+ * Parameter buffer: Buffer to store the data to (size * rows bytes). Unmapped parts read as zeroes.
+ * Returns: Endianess of the region, 0 if address is not mapped.
+ */
+	int read_strided(uint64_t address, size_t size, size_t rows, uint64_t stride, void* buffer);
 /**
  * Write a byte range (not across regions).
  *
@@ -0,0 +1,68 @@
+#ifndef _library__memorystruct__hpp__included__
+#define _library__memorystruct__hpp__included__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * Layout of a structure in memory, described by a format string.
+ *
+ * The format string is a sequence of fields, each optionally preceded by repeat count:
+ * - 'b'/'B': Signed/unsigned byte.
+ * - 'w'/'W': Signed/unsigned word (2 bytes).
+ * - 'h'/'H': Signed/unsigned hword (3 bytes).
+ * - 'd'/'D': Signed/unsigned dword (4 bytes).
+ * - 'q'/'Q': Signed/unsigned qword (8 bytes).
+ * - 'f'/'F': Float (4 bytes)/double (8 bytes).
+ * - 'x': Padding byte (not a field).
+ * - '<', '>', '=': Following fields are little endian, big endian or endianess of the memory (the default).
+ * Whitespace is ignored.
+ */
+class memory_struct
+{
+public:
+/**
+ * A field.
+ */
+	struct field
+	{
+		size_t offset;		//Offset in structure.
+		char type;		//Type character from format.
+		int endian;		//-1 => little, 1 => big, 0 => memory.
+	};
+/**
+ * Parse a format.
+ *
+ * Parameter format: The format string.
+ * Throws std::runtime_error: Bad format.
+ */
+	memory_struct(const std::string& format) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Get size of structure.
+ */
+	size_t get_size() const throw() { return size; }
+/**
+ * Get number of fields (padding excluded).
+ */
+	size_t get_fields() const throw() { return fields.size(); }
+/**
+ * Get field.
+ */
+	const field& operator[](size_t i) const throw() { return fields[i]; }
+/**
+ * Decode field.
+ *
+ * Parameter row: The structure.
+ * Parameter i: The field number.
+ * Parameter endian: Endianess of the memory.
+ * Returns: Value of field.
+ */
+	double get(const char* row, size_t i, int endian) const throw();
+private:
+	std::vector<field> fields;
+	size_t size;
+};
+
+#endif
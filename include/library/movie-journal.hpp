@@ -0,0 +1,111 @@
+#ifndef _library__movie_journal__hpp__included__
+#define _library__movie_journal__hpp__included__
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "portctrl-data.hpp"
+
+/**
+ * Append-only journal of changes to movie input and metadata since the movie was last saved in full.
+ *
+ * The input of each branch is tracked in fixed size blocks of subframes. Each sync appends the blocks that changed
+ * since the previous sync, together with changed metadata, as one batch ending in a checksummed commit record, and
+ * then flushes the file to disk once. A batch that was not completely written (e.g. due to crash) is ignored on
+ * recovery and overwritten by the next batch.
+ */
+class movie_journal
+{
+public:
+/**
+ * Number of subframes in journal block.
+ */
+	static const uint32_t block_subframes = 8192;
+/**
+ * Create closed journal.
+ */
+	movie_journal() throw();
+/**
+ * Destructor.
+ */
+	~movie_journal() throw();
+/**
+ * Start a new journal, replacing any existing one.
+ *
+ * Parameter filename: The journal file.
+ * Parameter base: Identifies the full save the journal applies to.
+ * Parameter branches: The input branches, as in the full save.
+ * Parameter meta: The metadata, as in the full save.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Can't write the journal.
+ */
+	void start(const std::string& filename, const std::string& base,
+		const std::map<std::string, portctrl::frame_vector>& branches,
+		const std::map<std::string, std::string>& meta) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Replay existing journal and continue appending to it.
+ *
+ * Parameter filename: The journal file.
+ * Parameter base: Identifies the full save that was loaded. The journal is only replayed if it applies to this
+ *	save.
+ * Parameter branches: The input branches as loaded from the full save. Updated to the state in the journal.
+ * Parameter types: The port types for branches created in the journal.
+ * Parameter meta: The metadata as loaded from the full save. Updated to the state in the journal.
+ * Returns: Number of batches replayed. If 0, the journal is not open.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Can't write the journal.
+ */
+	uint64_t recover(const std::string& filename, const std::string& base,
+		std::map<std::string, portctrl::frame_vector>& branches, const portctrl::type_set& types,
+		std::map<std::string, std::string>& meta) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Append changes since the last sync (or start/recover) to the journal and flush it to disk.
+ *
+ * Does nothing if journal is not open.
+ *
+ * Parameter branches: The current input branches.
+ * Parameter meta: The current metadata.
+ * Returns: Number of bytes appended.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Can't write the journal. The journal is closed.
+ */
+	uint64_t sync(const std::map<std::string, portctrl::frame_vector>& branches,
+		const std::map<std::string, std::string>& meta) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Close the journal. The file is left in place.
+ */
+	void close() throw();
+/**
+ * Is the journal open?
+ */
+	bool is_open() const throw() { return fd >= 0; }
+/**
+ * Get the size of the journal file.
+ */
+	uint64_t get_size() const throw() { return size; }
+/**
+ * Get the base of the journal.
+ */
+	const std::string& get_base() const throw() { return base; }
+private:
+	movie_journal(const movie_journal&);
+	movie_journal& operator=(const movie_journal&);
+	struct branch_snapshot
+	{
+		size_t stride;
+		std::vector<unsigned char> data;
+	};
+	void snapshot(const std::map<std::string, portctrl::frame_vector>& branches,
+		const std::map<std::string, std::string>& meta);
+	void write_batch(std::vector<char>& batch);
+	int fd;
+	uint64_t size;
+	std::string filename;
+	std::string base;
+	std::map<std::string, branch_snapshot> snap_input;
+	std::map<std::string, std::string> snap_meta;
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef _library__perfscope__hpp__included__
+#define _library__perfscope__hpp__included__
+
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+
+namespace perfscope
+{
+/**
+ * Is timing active? Don't modify directly, use enable().
+ */
+extern volatile bool active;
+
+/**
+ * A named region of code to time. Define these as static objects.
+ */
+class region
+{
+public:
+/**
+ * Create a region.
+ *
+ * Parameter name: The name of region. Must be a string literal.
+ */
+	region(const char* name) throw();
+/**
+ * Get name of region.
+ */
+	const char* get_name() const throw() { return name; }
+/**
+ * Get index of region.
+ */
+	unsigned get_index() const throw() { return index; }
+private:
+	region(const region&);
+	region& operator=(const region&);
+	const char* name;
+	unsigned index;
+};
+
+/**
+ * Times the enclosing scope as given region. Times of nested scopes are included in the outer ones.
+ *
+ * When timing is not active, this costs one flag test.
+ */
+class scope
+{
+public:
+	scope(region& r) throw()
+	{
+		if(__builtin_expect(active, 0))
+			begin(r);
+		else
+			reg = NULL;
+	}
+	~scope() throw()
+	{
+		if(__builtin_expect(reg != NULL, 0))
+			end();
+	}
+private:
+	scope(const scope&);
+	scope& operator=(const scope&);
+	void begin(region& r) throw();
+	void end() throw();
+	region* reg;
+	uint64_t start;
+};
+
+/**
+ * Start or stop timing. Starting clears all recorded data.
+ *
+ * Parameter timing: Record per-frame times.
+ * Parameter trace: Also record every timed scope for trace output.
+ * Parameter max_events: Maximum number of trace events to record.
+ */
+void enable(bool timing, bool trace = false, size_t max_events = 4000000) throw(std::bad_alloc);
+/**
+ * Mark end of frame. Times recorded since last call are accounted to the frame that ended.
+ */
+void end_frame() throw(std::bad_alloc);
+/**
+ * Get per-frame statistics of each region as JSON.
+ *
+ * Times are in microseconds. Each region has count of calls, total time, mean, minimum, maximum, 50th, 90th and 99th
+ * percentiles of time per frame, and a histogram of time per frame with buckets [0,1), [1,2), [2,4), [4,8), ...
+ */
+std::string report_json() throw(std::bad_alloc);
+/**
+ * Get recorded events in Chrome trace event format.
+ */
+std::string trace_json() throw(std::bad_alloc);
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef _library__portctrl_chunked__hpp__included__
+#define _library__portctrl_chunked__hpp__included__
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "portctrl-data.hpp"
+
+namespace binarystream
+{
+struct input;
+struct output;
+}
+
+namespace portctrl
+{
+/**
+ * Controller input stored as independently compressed chunks of fixed number of subframes.
+ *
+ * The chunk index gives frame range and checksum of each chunk, so chunks can be decoded in parallel, or one at a
+ * time for random access. Encoding again after appending frames only compresses the chunks that changed.
+ */
+class chunked_input
+{
+public:
+/**
+ * Information about chunk.
+ */
+	struct chunk_info
+	{
+		uint64_t first_subframe;	//Index of first subframe in chunk.
+		uint64_t first_frame;		//Number of sync subframes before chunk.
+		uint32_t subframes;		//Number of subframes in chunk.
+		uint32_t syncs;			//Number of sync subframes in chunk.
+		uint32_t crc;			//CRC-32 of uncompressed data.
+	};
+/**
+ * Number of subframes in full chunk.
+ */
+	static const uint32_t chunk_subframes = 8192;
+/**
+ * Create empty input.
+ */
+	chunked_input() throw();
+/**
+ * Encode input. Chunks with the same contents as in previous encoding are not compressed again.
+ *
+ * Parameter v: The input to encode.
+ * Parameter level: Compression level (0-9).
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Compression failed.
+ */
+	void encode(const frame_vector& v, unsigned level) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Decode all of the input. Chunks are decompressed in parallel.
+ *
+ * Parameter v: The vector to write to. Must have the same stride as the input.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Stride mismatch or corrupt data.
+ */
+	void decode(frame_vector& v) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Decode one chunk.
+ *
+ * Parameter idx: Index of the chunk.
+ * Parameter out: Filled with the subframes in chunk.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Corrupt data.
+ */
+	void decode_chunk(size_t idx, std::vector<unsigned char>& out) const throw(std::bad_alloc,
+		std::runtime_error);
+/**
+ * Get number of chunks.
+ */
+	size_t get_chunk_count() const throw() { return chunks.size(); }
+/**
+ * Get information about chunk.
+ */
+	const chunk_info& get_chunk(size_t idx) const throw() { return chunks[idx].info; }
+/**
+ * Find the chunk containing the start of given frame.
+ *
+ * Parameter frame: The frame number (1-based).
+ * Returns: Index of chunk, or get_chunk_count() if there is no such frame.
+ */
+	size_t find_frame(uint64_t frame) const throw();
+/**
+ * Get the stride (bytes per subframe).
+ */
+	size_t get_stride() const throw() { return stride; }
+/**
+ * Get total number of subframes.
+ */
+	uint64_t get_subframes() const throw();
+/**
+ * Get number of bytes save() writes.
+ */
+	uint64_t binary_size() const throw();
+/**
+ * Save the index and compressed chunks.
+ */
+	void save(binarystream::output& s) const throw(std::bad_alloc, std::runtime_error);
+/**
+ * Load the index and compressed chunks. The chunks are not decompressed.
+ *
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Corrupt data.
+ */
+	void load(binarystream::input& s) throw(std::bad_alloc, std::runtime_error);
+private:
+	struct chunk
+	{
+		chunk_info info;
+		std::vector<char> data;		//Compressed data.
+		uint8_t hash[32];		//SHA-256 of uncompressed data.
+		bool hash_valid;
+	};
+	void decompress(const chunk& c, unsigned char* out) const;
+	void update_offsets();
+	size_t stride;
+	std::vector<chunk> chunks;
+};
+}
+
+#endif
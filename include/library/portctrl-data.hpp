@@ -1024,6 +1024,10 @@ private:
 
 /**
  * Vector of controller frames.
+ *
+ * The subframes are stored in chunks (pages) of at most get_frames_per_page() subframes each. Pages are only
+ * guaranteed to be full if the vector has only been appended to and resized; insert_range() and erase_range()
+ * only touch the pages around the edit point, and may leave pages partially filled.
  */
 class frame_vector
 {
@@ -1108,15 +1112,10 @@ public:
  */
 	frame operator[](size_t x)
 	{
-		size_t page = x / frames_per_page;
-		size_t pageoffset = frame_size * (x % frames_per_page);
 		if(x >= frames)
 			throw std::runtime_error("frame_vector::operator[]: Illegal index");
-		if(page != cache_page_num) {
-			cache_page = &pages[page];
-			cache_page_num = page;
-		}
-		return frame(cache_page->content + pageoffset, *types, this);
+		select_page(x);
+		return frame(cache_page->content + frame_size * (x - cache_page_first), *types, this);
 	}
 /**
  * Append a subframe.
@@ -1136,6 +1135,26 @@ public:
  * Throws std::bad_alloc: Not enough memory.
  */
 	void resize(size_t newsize) throw(std::bad_alloc);
+/**
+ * Insert blank subframes.
+ *
+ * Only the page at insertion point is rewritten, so the cost does not depend on amount of data after it.
+ *
+ * Parameter pos: The index to insert at. Can be size() to append.
+ * Parameter count: Number of subframes to insert.
+ * Parameter sync: If set, the inserted subframes have sync flag set.
+ * Throws std::bad_alloc: Not enough memory.
+ * Throws std::runtime_error: Invalid index.
+ */
+	void insert_range(size_t pos, size_t count, bool sync) throw(std::bad_alloc, std::runtime_error);
+/**
+ * Erase subframes.
+ *
+ * Parameter pos: The index of first subframe to erase.
+ * Parameter count: Number of subframes to erase.
+ * Throws std::runtime_error: Range is not inside the vector.
+ */
+	void erase_range(size_t pos, size_t count) throw(std::runtime_error);
 /**
  * Walk the indexes of sync subframes.
  *
@@ -1202,13 +1221,22 @@ public:
  */
 	size_t get_frames_per_page() const { return frames_per_page; }
 /**
- * Get content of given page.
+ * Return number of subframes on given page.
  */
-	unsigned char* get_page_buffer(size_t page) { return pages[page].content; }
+	size_t get_page_frames(size_t page) const { return pages[page]->frames; }
+/**
+ * Get content of given page. After editing the content directly, call recount_frames().
+ */
+	unsigned char* get_page_buffer(size_t page)
+	{
+		sync_stale = true;
+		sync_index_stale = true;
+		return pages[page]->content;
+	}
 /**
  * Get content of given page.
  */
-	const unsigned char* get_page_buffer(size_t page) const { return pages.find(page)->second.content; }
+	const unsigned char* get_page_buffer(size_t page) const { return pages[page]->content; }
 /**
  * Get binary save size.
  *
@@ -1250,9 +1278,17 @@ public:
 /**
  * Notify sync flag polarity change.
  *
+ * Parameter mem: The memory of subframe that changed.
  * Parameter polarity: 1 if positive edge, -1 if negative edge. 0 is ignored.
  */
-	void notify_sync_change(short polarity) {
+	void notify_sync_change(const unsigned char* mem, short polarity) {
+		if(!polarity)
+			return;
+		if(cache_page && mem >= cache_page->content && mem < cache_page->content + CONTROLLER_PAGE_SIZE)
+			cache_page->syncs += polarity;
+		else
+			sync_stale = true;
+		sync_index_stale = true;
 		uint64_t old_frame_count = real_frame_count;
 		real_frame_count = real_frame_count + polarity;
 		if(!freeze_count) call_framecount_notification(old_frame_count);
@@ -1329,27 +1365,57 @@ private:
 		page() {
 			memtracker::singleton()(movie_page_id, CONTROLLER_PAGE_SIZE + 36);
 			memset(content, 0, CONTROLLER_PAGE_SIZE);
+			frames = 0;
+			syncs = 0;
+		}
+		page(const page& p) {
+			memtracker::singleton()(movie_page_id, CONTROLLER_PAGE_SIZE + 36);
+			memcpy(content, p.content, CONTROLLER_PAGE_SIZE);
+			frames = p.frames;
+			syncs = p.syncs;
 		}
 		~page() { memtracker::singleton()(movie_page_id, -CONTROLLER_PAGE_SIZE - 36); }
+		size_t frames;		//Number of subframes used. Unused part is zero.
+		size_t syncs;		//Number of subframes with sync flag set.
 		unsigned char content[CONTROLLER_PAGE_SIZE];
+	private:
+		page& operator=(const page& p);
 	};
 	size_t frames_per_page;
 	size_t frame_size;
 	size_t frames;
 	const type_set* types;
 	size_t cache_page_num;
+	size_t cache_page_first;
 	page* cache_page;
-	std::map<size_t, page> pages;
+	std::vector<page*> pages;
+	std::vector<size_t> page_first;		//Index of first subframe on each page.
+	std::vector<uint64_t> page_first_sync;	//Number of sync subframes before each page.
+	bool index_stale;			//page_first needs rebuilding.
+	bool sync_index_stale;			//page_first_sync needs rebuilding.
+	bool sync_stale;			//Page sync counts need recounting.
 	uint64_t real_frame_count;
 	uint64_t frame_count_at_freeze;
 	size_t freeze_count;
 	std::set<fchange_listener*> on_framecount_change;
 	size_t walk_helper(size_t frame, bool sflag) throw();
+	void locate(size_t frame) throw();
+	void select_page(size_t frame) throw()
+	{
+		if(!cache_page || frame < cache_page_first || frame - cache_page_first >= cache_page->frames)
+			locate(frame);
+	}
+	void reserve_pages(size_t n) throw(std::bad_alloc);
+	void update_index() throw();
+	void update_sync_index() throw();
+	size_t count_syncs(const page* p, size_t first, size_t last) const throw();
+	void free_pages() throw();
 	threads::lock mlock;
 	void clear_cache()
 	{
 		cache_page_num = 0;
 		cache_page_num--;
+		cache_page_first = 0;
 		cache_page = NULL;
 	}
 	memtracker::autorelease tracker;
@@ -1362,7 +1428,7 @@ void frame::sync(bool x) throw()
 		backing[0] |= 1;
 	else
 		backing[0] &= ~1;
-	if(host) host->notify_sync_change((backing[0] & 1) - old);
+	if(host) host->notify_sync_change(backing, (backing[0] & 1) - old);
 }
 
 void frame::deserialize(const char* buf) throw(std::runtime_error)
@@ -1381,7 +1447,7 @@ void frame::deserialize(const char* buf) throw(std::runtime_error)
 				offset++;
 		}
 	}
-	if(host) host->notify_sync_change(sync() - old);
+	if(host) host->notify_sync_change(backing, sync() - old);
 }
 
 
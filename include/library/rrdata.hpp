@@ -9,12 +9,19 @@
 #include <sstream>
 #include <iostream>
 #include <fstream>
-#include <set>
 
 
+/**
+ * Set of load IDs, stored as sorted vector of disjoint half-open intervals.
+ *
+ * The project backing file is an append-only log of IDs. Periodically, the interval set is checkpointed into
+ * separate file, so opening a project only needs to read the checkpoint and replay the log after it.
+ */
 class rrdata_set
 {
 public:
+	struct instance;
+	typedef std::vector<std::pair<instance, instance>> interval_list;
 	struct instance
 	{
 /**
@@ -87,14 +94,14 @@ public:
 		{
 			initialized = false;
 		}
-		void init(const std::set<std::pair<instance, instance>>& obj)
+		void init(const interval_list& obj)
 		{
 			if(initialized) return;
 			initialized = true;
 			itr = obj.begin();
 			eitr = obj.end();
 		}
-		std::set<std::pair<instance, instance>>::const_iterator next()
+		interval_list::const_iterator next()
 		{
 			if(itr == eitr) return itr;
 			return itr++;
@@ -113,8 +120,8 @@ public:
 		instance pred;
 	private:
 		bool initialized;
-		std::set<std::pair<instance, instance>>::const_iterator itr;
-		std::set<std::pair<instance, instance>>::const_iterator eitr;
+		interval_list::const_iterator itr;
+		interval_list::const_iterator eitr;
 	};
 /**
  * Ctor
@@ -136,6 +143,14 @@ public:
  * Switch to no project, closing the load IDs.
  */
 	void close() throw();
+/**
+ * Get name of checkpoint file for project backing file.
+ */
+	static std::string checkpoint_name(const std::string& projectfile);
+/**
+ * Get number of intervals in the set.
+ */
+	size_t interval_count() const throw() { return data.size(); }
 /**
  * Add new specified instance to current project.
  *
@@ -201,18 +216,25 @@ public:
 	void debug_add(const instance& b, const instance& e) { return _add(b, e); }
 	bool debug_in_set(const instance& b) { return _in_set(b); }
 	bool debug_in_set(const instance& b, const instance& e) { return _in_set(b, e); }
-	uint64_t debug_nodecount(std::set<std::pair<instance, instance>>& set);
+	uint64_t debug_nodecount(interval_list& set);
 private:
 	bool _add(const instance& b);
 	void _add(const instance& b, const instance& e);
-	void _add(const instance& b, const instance& e, std::set<std::pair<instance, instance>>& set,
-		uint64_t& cnt);
+	static void _add(const instance& b, const instance& e, interval_list& set, uint64_t& cnt);
+	static void merge_intervals(interval_list& set, uint64_t& cnt, interval_list& add);
+	void write_log(const instance& i);
+	void maybe_checkpoint(bool force);
+	static bool read_checkpoint(const std::string& projectfile, const char* log, size_t loglen,
+		interval_list& set, uint64_t& cnt, uint64_t& covered);
 	bool _in_set(const instance& b) { return _in_set(b, b + 1); }
 	bool _in_set(const instance& b, const instance& e);
 	uint64_t emerg_action(struct esave_state& state, char* buf, size_t bufsize, uint64_t& scount) const;
 
-	std::set<std::pair<instance, instance>> data;
+	interval_list data;
 	std::ofstream ohandle;
+	uint64_t log_size;
+	uint64_t log_checkpointed;
+	instance log_last;
 	bool handle_open;
 	std::string current_projectfile;
 	bool lazy_mode;
@@ -0,0 +1,121 @@
+#ifndef _library__scaler__hpp__included__
+#define _library__scaler__hpp__included__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <stdexcept>
+
+/**
+ * Scaling of 32-bit 0x00RRGGBB images to 24-bit R, G, B output (what GUI image classes want).
+ */
+namespace scaler
+{
+/**
+ * Orientation flags. Flips are applied before rotation.
+ */
+const unsigned HFLIP = 1;
+const unsigned VFLIP = 2;
+const unsigned ROTATE = 4;	//90 degrees clockwise.
+
+/**
+ * Scaling method.
+ */
+enum method
+{
+	NEAREST,		//Nearest neighbor. Integer factors are fast path.
+	SHARP_BILINEAR		//Nearest to largest integer factor that fits, then bilinear to target size.
+};
+
+/**
+ * SIMD kernel level.
+ */
+enum simd
+{
+	SIMD_NONE,
+	SIMD_SSE2,
+	SIMD_AVX2
+};
+
+/**
+ * Get best SIMD level supported by CPU.
+ */
+simd get_best_simd() throw();
+/**
+ * Get name of SIMD level.
+ */
+const char* get_simd_name(simd level) throw();
+
+/**
+ * Copy image, flipping and rotating it. Done in tiles, so rotation does not miss cache on every pixel.
+ *
+ * Parameter dst: The destination. If rotating, it has width rows of height pixels, otherwise height rows of width
+ *	pixels.
+ * Parameter dstride: Destination stride in pixels.
+ * Parameter src: The source.
+ * Parameter sstride: Source stride in pixels.
+ * Parameter width: Width of source.
+ * Parameter height: Height of source.
+ * Parameter orient: Orientation flags.
+ */
+void transform(uint32_t* dst, size_t dstride, const uint32_t* src, size_t sstride, size_t width, size_t height,
+	unsigned orient) throw();
+
+/**
+ * Scaling context. Keeps the buffers and coordinate tables between frames.
+ */
+class context
+{
+public:
+/**
+ * Create a context, using best SIMD level supported.
+ */
+	context() throw();
+/**
+ * Set SIMD level to use. Levels not supported by CPU are lowered to best supported.
+ */
+	void set_simd(simd level) throw();
+/**
+ * Get SIMD level in use.
+ */
+	simd get_simd() const throw() { return level; }
+/**
+ * Scale image.
+ *
+ * Parameter m: The scaling method.
+ * Parameter dst: The destination, 3 bytes per pixel.
+ * Parameter dstride: Destination stride in bytes.
+ * Parameter dwidth: Destination width.
+ * Parameter dheight: Destination height.
+ * Parameter src: The source, 0x00RRGGBB pixels. High byte is ignored.
+ * Parameter sstride: Source stride in pixels.
+ * Parameter swidth: Source width.
+ * Parameter sheight: Source height.
+ * Parameter orient: Orientation flags to apply to source before scaling. Destination size is after rotation.
+ * Throws std::bad_alloc: Not enough memory.
+ */
+	void scale(method m, uint8_t* dst, size_t dstride, size_t dwidth, size_t dheight, const uint32_t* src,
+		size_t sstride, size_t swidth, size_t sheight, unsigned orient) throw(std::bad_alloc);
+private:
+	struct tap
+	{
+		uint32_t pos;		//First source pixel.
+		uint32_t weight;	//Weight of the next pixel, 0-256.
+	};
+	void nearest(uint8_t* dst, size_t dstride, size_t dwidth, size_t dheight, const uint32_t* src,
+		ptrdiff_t sstride, size_t swidth, size_t sheight);
+	void sharp_bilinear(uint8_t* dst, size_t dstride, size_t dwidth, size_t dheight, const uint32_t* src,
+		ptrdiff_t sstride, size_t swidth, size_t sheight);
+	static void make_nearest_taps(std::vector<tap>& taps, size_t ssize, size_t dsize);
+	static void make_sharp_taps(std::vector<tap>& taps, size_t ssize, size_t dsize);
+	simd level;
+	std::vector<uint32_t> scratch;
+	std::vector<uint32_t> rowbuf;
+	std::vector<uint32_t> rowout;
+	std::vector<tap> xtaps;
+	std::vector<tap> ytaps;
+};
+}
+
+#endif
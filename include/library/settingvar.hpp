@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 #include <set>
+#include <atomic>
 #include "threads.hpp"
 #include "string.hpp"
 #include <string>
@@ -453,22 +454,31 @@ public:
  */
 	valtype_t operator()(group& grp)
 	{
-		base* b = &grp[iname];
-		variable<model>* m = dynamic_cast<variable<model>*>(b);
-		if(!m)
-			throw std::runtime_error("No such setting in target group");
-		return m->get();
+		return resolve(grp).get();
 	}
 /**
  * Write value in instance.
  */
 	void operator()(group& grp, valtype_t val)
+	{
+		resolve(grp).set(val);
+	}
+/**
+ * Get setting name.
+ */
+	const std::string& get_iname() const throw() { return iname; }
+/**
+ * Get the variable in instance.
+ *
+ * Throws std::runtime_error: No such setting in group.
+ */
+	variable<model>& resolve(group& grp)
 	{
 		base* b = &grp[iname];
 		variable<model>* m = dynamic_cast<variable<model>*>(b);
 		if(!m)
 			throw std::runtime_error("No such setting in target group");
-		m->set(val);
+		return *m;
 	}
 private:
 	set& s;
@@ -477,6 +487,73 @@ private:
 	valtype_t defaultvalue;
 };
 
+/**
+ * Cached handle to setting in a group, for reading settings in hot paths.
+ *
+ * The setting is looked up on first read, after that reads are a single atomic load, without locking. The value is
+ * kept up to date by listening for changes of the setting. Only for models with scalar values (booleans, integers,
+ * enumerations).
+ */
+template<class model> class handle : public listener
+{
+	typedef typename model::valtype_t valtype_t;
+	handle(const handle<model>&);
+	handle<model>& operator=(const handle<model>&);
+public:
+/**
+ * Constructor.
+ *
+ * Parameter _svar: The supervariable to read.
+ * Parameter _grp: The group to read the setting from. Must outlive the handle. The setting does not need to exist
+ *	yet.
+ */
+	handle(supervariable<model>& _svar, group& _grp) throw(std::bad_alloc)
+		: svar(_svar), grp(_grp)
+	{
+		resolved = false;
+		grp.add_listener(*this);
+	}
+/**
+ * Destructor.
+ */
+	~handle() throw()
+	{
+		grp.remove_listener(*this);
+	}
+/**
+ * Read the value.
+ *
+ * Throws std::runtime_error: No such setting in group (only on first read).
+ */
+	valtype_t operator()()
+	{
+		if(resolved.load(std::memory_order_acquire))
+			return value.load(std::memory_order_relaxed);
+		threads::arlock h(get_setting_lock());
+		value.store(svar.resolve(grp).get(), std::memory_order_relaxed);
+		resolved.store(true, std::memory_order_release);
+		return value.load(std::memory_order_relaxed);
+	}
+/**
+ * Setting changed.
+ */
+	void on_setting_change(group& _grp, const base& val)
+	{
+		threads::arlock h(get_setting_lock());
+		if(!resolved.load(std::memory_order_relaxed) || val.get_iname() != svar.get_iname())
+			return;
+		try {
+			value.store(svar.resolve(grp).get(), std::memory_order_relaxed);
+		} catch(std::exception& e) {
+		}
+	}
+private:
+	supervariable<model>& svar;
+	group& grp;
+	std::atomic<valtype_t> value;
+	std::atomic<bool> resolved;
+};
+
 /**
  * Yes-no.
  */
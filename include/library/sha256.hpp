@@ -172,6 +172,20 @@ public:
 		hash(hashout, reinterpret_cast<const uint8_t*>(&data[0]), data.size());
 		return tostring(hashout);
 	}
+/**
+ * Hashes multiple independent blocks of data, using multi-buffer hashing if the CPU supports it.
+ *
+ * Parameter hashout: Array of count 32-byte buffers to write the hashes to.
+ * Parameter data: Array of count pointers to data to hash.
+ * Parameter datalen: Array of count lengths of data hashed.
+ * Parameter count: Number of blocks to hash.
+ */
+	static void hash_multiple(uint8_t* const* hashout, const uint8_t* const* data, const size_t* datalen,
+		size_t count) throw();
+/**
+ * Get name of implementation used for hashing on this CPU.
+ */
+	static const char* implementation() throw();
 private:
 	uint32_t state[8];
 	uint32_t datablock[16];
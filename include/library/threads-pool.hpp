@@ -0,0 +1,234 @@
+#ifndef _library__threads_pool__hpp__included__
+#define _library__threads_pool__hpp__included__
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include "exrethrow.hpp"
+#include "threads.hpp"
+
+namespace threads
+{
+class pool;
+
+/**
+ * Priority lane of task. Pending tasks in latency lane are always started before ones in normal lane.
+ */
+enum pool_lane
+{
+	LANE_LATENCY = 0,
+	LANE_NORMAL = 1,
+};
+
+/**
+ * A task submitted to pool.
+ */
+class task
+{
+public:
+/**
+ * Create a new task. Usually called by pool::submit().
+ */
+	task(pool& _owner, std::function<void()> _fn);
+/**
+ * Has the task completed?
+ */
+	bool ready();
+/**
+ * Wait for the task to complete. Other pending tasks are run on this thread while waiting.
+ */
+	void wait();
+/**
+ * Rethrow exception the task threw, if any. Must only be called after task has completed.
+ */
+	void rethrow();
+/**
+ * Run the task. Don't call from outside pool code.
+ */
+	void run();
+private:
+	task(const task&);
+	task& operator=(const task&);
+	pool& owner;
+	lock mlock;
+	cv cond;
+	bool done;
+	std::function<void()> fn;
+	exrethrow::storage error;
+};
+
+/**
+ * Future for result of task.
+ */
+template<typename T> class future
+{
+public:
+/**
+ * Create a future not bound to any task.
+ */
+	future() {}
+/**
+ * Is this bound to task?
+ */
+	bool valid() const { return (bool)t; }
+/**
+ * Is the result available?
+ */
+	bool ready() const { return t && t->ready(); }
+/**
+ * Wait for the result. Other pending tasks are run on this thread while waiting.
+ */
+	void wait() const { if(t) t->wait(); }
+/**
+ * Wait for and get the result. If the task threw, the exception is rethrown.
+ */
+	T get() const
+	{
+		wait();
+		t->rethrow();
+		return *value;
+	}
+private:
+	friend class pool;
+	future(std::shared_ptr<task> _t, std::shared_ptr<T> _value) : t(_t), value(_value) {}
+	std::shared_ptr<task> t;
+	std::shared_ptr<T> value;
+};
+
+template<> class future<void>
+{
+public:
+	future() {}
+	bool valid() const { return (bool)t; }
+	bool ready() const { return t && t->ready(); }
+	void wait() const { if(t) t->wait(); }
+	void get() const
+	{
+		wait();
+		t->rethrow();
+	}
+private:
+	friend class pool;
+	future(std::shared_ptr<task> _t) : t(_t) {}
+	std::shared_ptr<task> t;
+};
+
+/**
+ * Work-stealing pool of threads.
+ *
+ * Each worker thread has its own queue per lane. Tasks submitted from worker threads go to queue of that worker
+ * and are run newest first, other tasks go to shared queue. Idle workers take from their own queue, then from the
+ * shared queue and then steal oldest tasks from other workers.
+ */
+class pool
+{
+public:
+/**
+ * Pool statistics.
+ */
+	struct stats
+	{
+		unsigned threads;		//Number of worker threads.
+		uint64_t submitted[2];		//Tasks submitted, per lane.
+		uint64_t executed;		//Tasks completed.
+		uint64_t steals;		//Tasks taken from queue of another worker.
+		uint64_t sleeps;		//Times a worker found nothing to do.
+		uint64_t queued;		//Tasks currently pending.
+		uint64_t max_queued;		//Maximum number of tasks pending at once.
+	};
+/**
+ * Create a new pool.
+ *
+ * Parameter nthreads: Number of worker threads. 0 means pick based on number of CPUs.
+ */
+	pool(unsigned nthreads = 0);
+/**
+ * Destroy a pool. Tasks still pending are run on the calling thread.
+ */
+	~pool();
+/**
+ * Get the process-wide pool.
+ */
+	static pool& global();
+/**
+ * Set number of worker threads. Must not be called from a task.
+ *
+ * Parameter nthreads: Number of worker threads. 0 means pick based on number of CPUs.
+ */
+	void set_threads(unsigned nthreads);
+/**
+ * Get number of worker threads.
+ */
+	unsigned get_threads();
+/**
+ * Submit a task.
+ *
+ * Parameter fn: The function to run. Type of return value must be default-constructible.
+ * Parameter lane: The lane to submit to.
+ * Returns: Future for the return value.
+ */
+	template<typename T> future<T> submit(std::function<T()> fn, pool_lane lane = LANE_NORMAL)
+	{
+		std::shared_ptr<T> value(new T());
+		std::shared_ptr<task> t(new task(*this, [fn, value]() { *value = fn(); }));
+		enqueue(t, lane);
+		return future<T>(t, value);
+	}
+/**
+ * Run fn over subranges of [first, last) in parallel and wait for all to complete. The calling thread also
+ * participates.
+ *
+ * Parameter first: First index.
+ * Parameter last: One past last index.
+ * Parameter fn: Called with (low, high) for each subrange.
+ * Parameter grain: Maximum size of subrange.
+ * Parameter max_tasks: Maximum number of threads to use (0 => all).
+ * Throws: First exception fn threw, after all subranges have completed.
+ */
+	void parallel_for(size_t first, size_t last, std::function<void(size_t, size_t)> fn, size_t grain = 1,
+		unsigned max_tasks = 0);
+/**
+ * Run one pending task on calling thread.
+ *
+ * Returns: True if task was run, false if nothing was pending.
+ */
+	bool run_one();
+/**
+ * Get statistics.
+ */
+	stats get_stats();
+/**
+ * Worker thread entrypoint. Don't call from outside pool code.
+ */
+	void worker_main(size_t idx);
+private:
+	//Worker structures are never freed while pool exists, so stealing needs no lock on the set of workers.
+	static const unsigned max_threads = 64;
+	struct worker
+	{
+		lock mlock;
+		std::deque<std::shared_ptr<task>> queue[2];
+		thread* thr;
+	};
+	pool(const pool&);
+	pool& operator=(const pool&);
+	void enqueue(std::shared_ptr<task> t, pool_lane lane);
+	std::shared_ptr<task> take(size_t self);
+	void start_workers(unsigned nthreads);
+	void stop_workers();
+	lock workers_lock;
+	worker* workers[max_threads];
+	volatile unsigned nworkers;
+	lock mlock;
+	cv wakeup;
+	std::deque<std::shared_ptr<task>> injected[2];
+	uint64_t pending;
+	bool quit;
+	stats counters;
+};
+
+template<> future<void> pool::submit<void>(std::function<void()> fn, pool_lane lane);
+}
+
+#endif
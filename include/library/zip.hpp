@@ -2,23 +2,42 @@
 #define _library__zip__hpp__included__
 
 #include <boost/iostreams/filtering_stream.hpp>
+#include <deque>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <string>
 #include <map>
 #include <fstream>
 #include <sstream>
 #include <zlib.h>
+#include "filemap.hpp"
 #include "string.hpp"
+#include "threads-pool.hpp"
 
 namespace zip
 {
 /**
  * This class opens ZIP archive and offers methods to read members off it.
+ *
+ * The archive is mapped to memory and its central directory is read once when opening, so looking up members and
+ * reading small members is cheap.
  */
 class reader
 {
 public:
+/**
+ * Location of member in archive.
+ */
+	struct member_info
+	{
+		uint32_t header_offset;
+		uint32_t data_offset;		//0 if not yet read from local header.
+		uint32_t compressed_size;
+		uint32_t uncompressed_size;
+		uint32_t crc;
+		uint16_t compression;
+	};
 /**
  * This iterator iterates members of ZIP archive.
  */
@@ -145,12 +164,12 @@ public:
 /**
  * This iterator iterates members of ZIP archive in forward order.
  */
-	typedef iterator_class<std::map<std::string, uint64_t>::iterator, std::string> iterator;
+	typedef iterator_class<std::map<std::string, member_info>::iterator, std::string> iterator;
 
 /**
  * This iterator iterates members of ZIP archive in reverse order
  */
-	typedef iterator_class<std::map<std::string, uint64_t>::reverse_iterator, std::string>
+	typedef iterator_class<std::map<std::string, member_info>::reverse_iterator, std::string>
 		riterator;
 
 /**
@@ -278,9 +297,14 @@ public:
 private:
 	reader(reader&);
 	reader& operator=(reader&);
-	std::map<std::string, uint64_t> offsets;
-	std::ifstream* zipstream;
-	size_t* refcnt;
+	member_info& lookup(const std::string& name) throw(std::runtime_error);
+	const char* member_data(member_info& m) throw(std::runtime_error);
+	void read_member(const std::string& name, std::vector<char>& out, bool line) throw(std::bad_alloc,
+		std::runtime_error);
+	void read_central_directory(size_t eocd) throw(std::bad_alloc, std::runtime_error);
+	void read_local_headers() throw(std::bad_alloc, std::runtime_error);
+	std::map<std::string, member_info> members;
+	std::shared_ptr<filemap::mapping> map;
 };
 
 /**
@@ -342,6 +366,9 @@ public:
 /**
  * Creates new empty ZIP archive. The members will be compressed according to specified compression.
  *
+ * Members are compressed in parallel on the global thread pool, but are written in order they were created, so the
+ * archive does not depend on number of threads.
+ *
  * parameter zipfile: The zipfile to create.
  * parameter stream: The stream to write the ZIP to.
  * parameter _compression: Compression. 0 is uncompressed, 1-9 are deflate compression levels.
@@ -377,7 +404,8 @@ public:
 		std::runtime_error);
 
 /**
- * Closes open member and destroys stream corresponding to it.
+ * Closes open member and destroys stream corresponding to it. The member is compressed and written in background.
+ * Errors from that are reported by a later close_file() or commit().
  *
  * throws std::bad_alloc: Not enough memory.
  * throws std::logic_error: No file open.
@@ -426,16 +454,25 @@ private:
 		uint32_t compressed_size;
 		uint32_t offset;
 	};
+	struct compressed_member;
+	struct pending_member
+	{
+		std::string name;
+		threads::future<std::shared_ptr<compressed_member>> data;
+	};
 
 	writer(writer&);
 	writer& operator=(writer&);
+	static std::shared_ptr<compressed_member> compress_member(const std::vector<char>& content, bool deflate);
+	void write_pending(bool all);
 	std::ostream* zipstream;
 	bool system_stream;
 	std::string temp_path;
 	std::string zipfile_path;
 	std::string open_file;
 	uint32_t base_offset;
-	std::vector<char> current_compressed_file;
+	std::shared_ptr<std::vector<char>> current_file;
+	std::deque<pending_member> pending;
 	std::map<std::string, file_info> files;
 	unsigned compression;
 	boost::iostreams::filtering_ostream* s;
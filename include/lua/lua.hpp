@@ -20,6 +20,7 @@ namespace keyboard { class key; }
 #define LUA_TIMED_HOOK_TIMER 1
 
 class emulator_instance;
+class lua_profiler;
 
 void init_lua(emulator_instance& inst) throw();
 void quit_lua(emulator_instance& inst) throw();
@@ -106,6 +107,7 @@ struct lua_state
 	lua::render_context* renderq_saved;
 	lua::render_context* renderq_last;
 	bool renderq_redirect;
+	lua_profiler* profile;
 	void set_memory_limit(size_t max_mb);
 
 	std::list<std::string> startup_scripts;
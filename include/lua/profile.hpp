@@ -0,0 +1,117 @@
+#ifndef _lua__profile__hpp__included__
+#define _lua__profile__hpp__included__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include "library/lua-base.hpp"
+
+/**
+ * Lua callback profiler and frame time budget.
+ *
+ * Time spent in each callback is always accounted, so budgets work without the profiler. When the profiler is
+ * running, memory callbacks are accounted too, and Lua debug hooks count calls of each Lua function and sample
+ * which function is running.
+ */
+class lua_profiler
+{
+public:
+/**
+ * Statistics of callback.
+ */
+	struct callback_stats
+	{
+		uint64_t calls;		//Number of calls.
+		uint64_t total;		//Total time (microseconds).
+		uint64_t max;		//Longest call (microseconds).
+	};
+/**
+ * Statistics of Lua function.
+ */
+	struct function_stats
+	{
+		uint64_t calls;		//Number of calls (only counted when profiling).
+		uint64_t samples;	//Number of samples where this function was running.
+		uint64_t time;		//Estimated self time (microseconds).
+	};
+	lua_profiler(lua::state& _L);
+	~lua_profiler();
+/**
+ * Start profiling.
+ *
+ * Parameter interval: Number of Lua VM instructions between samples.
+ */
+	void start(unsigned interval = 1000);
+/**
+ * Stop profiling.
+ */
+	void stop();
+/**
+ * Is profiler running?
+ */
+	bool is_active() { return active; }
+/**
+ * Clear all statistics.
+ */
+	void reset();
+/**
+ * Callback is about to be run.
+ */
+	void enter_callback();
+/**
+ * Account a callback.
+ *
+ * Parameter name: Name of the callback.
+ * Parameter usecs: Time taken.
+ */
+	void account(const std::string& name, uint64_t usecs);
+/**
+ * Should paint callback be skipped to stay in frame time budget?
+ */
+	bool skip_paint();
+/**
+ * Account time taken by paint callback.
+ */
+	void paint_done(uint64_t usecs) { last_paint = usecs; }
+/**
+ * End of frame. Warns if frame time budget was exceeded.
+ */
+	void end_frame();
+/**
+ * Set frame time budget.
+ *
+ * Parameter usecs: Maximum time spent in Lua callbacks per frame (0 => no budget).
+ * Parameter _skip: Skip paint callbacks that would go over budget.
+ */
+	void set_budget(uint64_t usecs, bool _skip) { budget = usecs; skip = _skip; }
+/**
+ * Get callback statistics.
+ */
+	const std::map<std::string, callback_stats>& get_callbacks() { return callbacks; }
+/**
+ * Get Lua function statistics.
+ */
+	const std::map<std::string, function_stats>& get_functions() { return functions; }
+/**
+ * Get number of frames over budget and number of paints skipped.
+ */
+	std::pair<uint64_t, uint64_t> get_budget_stats() { return std::make_pair(over_budget, skipped_paints); }
+private:
+	static void hook(lua_State* L, lua_Debug* ar);
+	std::string function_key(lua_State* L, lua_Debug* ar);
+	lua::state& L;
+	bool active;
+	uint64_t last_sample;
+	std::map<std::string, callback_stats> callbacks;
+	std::map<std::string, function_stats> functions;
+	uint64_t budget;
+	bool skip;
+	uint64_t frame_used;
+	uint64_t last_paint;
+	bool skipped_last;
+	uint64_t over_budget;
+	uint64_t skipped_paints;
+	uint64_t frames_since_warning;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef _plat_wxwidgets__presenter__hpp__included__
+#define _plat_wxwidgets__presenter__hpp__included__
+
+#include "library/scaler.hpp"
+#include "library/threads.hpp"
+#include "library/triplebuffer.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class emulator_instance;
+struct SwsContext;
+
+/**
+ * Renders, flips/rotates and scales the main screen on a worker thread.
+ *
+ * Point and sharp bilinear scaling use the native scalers, the rest go through swscale.
+ *
+ * Finished frames are BGR24, handed to the UI thread through a triple buffer, so painting only has to blit.
+ */
+class wxwin_presenter
+{
+public:
+/**
+ * Scaling flag for native sharp bilinear scaling (not used by swscale).
+ */
+	static const int SHARP_BILINEAR = 0x800;
+/**
+ * How to present.
+ */
+	struct params
+	{
+		double xscale;			//Horizontal scale factor (before rotation).
+		double yscale;			//Vertical scale factor (before rotation).
+		uint32_t fit_width;		//Fit into this size, keeping aspect ratio (0 => don't).
+		uint32_t fit_height;
+		int flags;			//swscale flags or SHARP_BILINEAR.
+		bool hflip;
+		bool vflip;
+		bool rotate;
+		bool operator==(const params& p) const;
+	};
+/**
+ * A presented frame.
+ */
+	struct frame
+	{
+		std::vector<unsigned char> pixels;	//BGR24, width * 3 bytes per row.
+		uint32_t width;				//0 => Nothing to present.
+		uint32_t height;
+		uint64_t serial;			//Sequence number of frame.
+	};
+/**
+ * Statistics. Times are in microseconds.
+ */
+	struct stats
+	{
+		uint64_t frames;		//Frames presented.
+		uint64_t skipped;		//Frames presented, but replaced before UI got to them.
+		uint64_t render_total;		//Time spent rendering the screen.
+		uint64_t render_max;
+		uint64_t scale_total;		//Time spent flipping and scaling.
+		uint64_t scale_max;
+		uint64_t latency_total;		//Time from request to frame ready.
+		uint64_t latency_max;
+	};
+/**
+ * Create presenter and start the worker.
+ *
+ * Parameter inst: The emulator instance.
+ * Parameter on_ready: Called from worker thread when new frame is ready.
+ */
+	wxwin_presenter(emulator_instance& inst, std::function<void()> on_ready);
+/**
+ * Stop the worker.
+ */
+	~wxwin_presenter();
+/**
+ * Request a frame to be presented. Multiple requests before worker gets to them are merged.
+ */
+	void request();
+/**
+ * Set how to present. Requests a frame if changed.
+ */
+	void set_params(const params& p);
+/**
+ * Get the last presented frame. Must be released with put_read().
+ */
+	frame& get_read() { return buffers.get_read(); }
+/**
+ * Release frame from get_read().
+ */
+	void put_read() { buffers.put_read(); }
+/**
+ * Note that UI displayed frame with given serial (for statistics).
+ */
+	void displayed(uint64_t serial);
+/**
+ * Get statistics.
+ */
+	stats get_stats();
+private:
+	wxwin_presenter(const wxwin_presenter&);
+	wxwin_presenter& operator=(const wxwin_presenter&);
+	static void worker_entry(wxwin_presenter* p);
+	void worker();
+	void present(const params& p);
+	void finish_frame(frame& f, uint32_t width, uint32_t height, uint64_t t0, uint64_t t1);
+	emulator_instance& inst;
+	std::function<void()> on_ready;
+	threads::lock lock;
+	threads::cv cond;
+	bool pending;
+	bool quit;
+	uint64_t requested_at;
+	params current;
+	stats st;
+	uint64_t last_displayed;
+	frame A, B, C;
+	triplebuffer::triplebuffer<frame> buffers;
+	threads::thread* thread;
+	//Only used by worker.
+	SwsContext* sws_ctx;
+	scaler::context native;
+	std::vector<uint32_t> rotate_buffer;
+	uint64_t serial;
+};
+
+#endif
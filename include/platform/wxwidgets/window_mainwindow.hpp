@@ -1,6 +1,7 @@
 #ifndef _plat_wxwidgets__window_mainwindow__hpp__included__
 #define _plat_wxwidgets__window_mainwindow__hpp__included__
 
+#include "core/emustatus.hpp"
 #include "core/filedownload.hpp"
 #include "core/window.hpp"
 #include "platform/wxwidgets/window_status.hpp"
@@ -37,6 +38,7 @@ public:
 	~wxwin_mainwindow();
 	void request_paint();
 	void notify_update() throw();
+	void notify_presented() throw();
 	void notify_update_status() throw();
 	void notify_resized() throw();
 	void notify_exit() throw();
@@ -86,6 +88,8 @@ private:
 	projects_menu* projects;
 	wxTimer* focus_timer;
 	wxTimer* status_timer;
+	uint64_t status_seen[_lsnes_status::F_COUNT];
+	bool status_shown;
 	struct dispatch::target<> corechange;
 	struct dispatch::target<> titlechange;
 	struct dispatch::target<> newcore;
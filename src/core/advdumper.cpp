@@ -2,6 +2,7 @@
 #include "core/instance.hpp"
 #include "core/misc.hpp"
 #include "library/globalwrap.hpp"
+#include "library/perfscope.hpp"
 #include "library/string.hpp"
 #include "lua/lua.hpp"
 
@@ -12,6 +13,7 @@
 
 namespace
 {
+	perfscope::region perf_frame("dumper.frame");
 	globalwrap<std::map<std::string, dumper_factory_base*>> S_dumpers;
 	globalwrap<std::set<dumper_factory_base::notifier*>> S_notifiers;
 }
@@ -257,6 +259,7 @@ unsigned master_dumper::get_dumper_count() throw()
 
 void master_dumper::on_frame(struct framebuffer::raw& _frame, uint32_t fps_n, uint32_t fps_d)
 {
+	perfscope::scope t(perf_frame);
 	threads::arlock h(lock);
 	for(auto i : sdumpers)
 		try {
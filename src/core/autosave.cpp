@@ -0,0 +1,207 @@
+#include "core/autosave.hpp"
+#include "core/emustatus.hpp"
+#include "core/framerate.hpp"
+#include "core/instance.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/moviedata.hpp"
+#include "core/moviefile.hpp"
+#include "core/project.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "library/movie-journal.hpp"
+#include "library/string.hpp"
+
+#include <sys/stat.h>
+
+namespace
+{
+	settingvar::supervariable<settingvar::model_int<0, 3600>> SET_autosave_interval(lsnes_setgrp,
+		"autosave-interval", "Movie‣Autosave‣Journal interval (seconds)", 5);
+	settingvar::supervariable<settingvar::model_int<0, 4096>> SET_autosave_compact(lsnes_setgrp,
+		"autosave-compact", "Movie‣Autosave‣Save state when journal exceeds (MB)", 16);
+
+	//Only accessed from emulator thread. The journal of project being switched to is recovered into pending, so
+	//the journal of current project stays open until the switch succeeds.
+	movie_journal journals[2];
+	movie_journal* journal = &journals[0];
+	movie_journal* pending = &journals[1];
+	uint64_t last_sync;
+	//Set when saving state to compact the journal failed, cleared by next successful save.
+	bool compact_failed;
+
+	std::string journal_name(const std::string& prjid)
+	{
+		return get_config_path() + "/" + prjid + ".journal";
+	}
+
+	//Identifies the save the journal applies to. Size and time are included, so that saving again to the same
+	//file does not make an old journal apply to the new save.
+	std::string base_id(const std::string& savefile)
+	{
+		if(savefile == "")
+			return "";
+		struct stat s;
+		if(stat(savefile.c_str(), &s) < 0)
+			return savefile;
+		return (stringfmt() << savefile << "\n" << s.st_size << "\n" << s.st_mtime).str();
+	}
+
+	std::map<std::string, std::string> movie_meta(moviefile& mv)
+	{
+		std::map<std::string, std::string> meta;
+		meta["gamename"] = mv.gamename;
+		meta["projectid"] = mv.projectid;
+		meta["branch"] = mv.current_branch();
+		for(size_t i = 0; i < mv.authors.size(); i++)
+			meta[(stringfmt() << "author." << i).str()] = mv.authors[i].first + "|" + mv.authors[i].second;
+		for(auto& i : mv.subtitles)
+			meta[(stringfmt() << "subtitle." << i.first.get_frame() << "." << i.first.get_length()).str()] =
+				i.second;
+		return meta;
+	}
+
+	void apply_meta(moviefile& mv, std::map<std::string, std::string>& meta)
+	{
+		std::map<uint64_t, std::pair<std::string, std::string>> authors;
+		mv.subtitles.clear();
+		for(auto& i : meta) {
+			regex_results r;
+			if(i.first == "gamename")
+				mv.gamename = i.second;
+			else if(i.first == "branch" && mv.branches.count(i.second))
+				mv.input = &mv.branches[i.second];
+			else if(r = regex("author\\.([0-9]+)", i.first))
+				authors[parse_value<uint64_t>(r[1])] = split_author(i.second);
+			else if(r = regex("subtitle\\.([0-9]+)\\.([0-9]+)", i.first))
+				mv.subtitles[moviefile_subtiming(parse_value<uint64_t>(r[1]),
+					parse_value<uint64_t>(r[2]))] = i.second;
+		}
+		mv.authors.clear();
+		for(auto& i : authors)
+			mv.authors.push_back(i.second);
+	}
+}
+
+void autosave_journal_tick(bool force)
+{
+	auto& core = CORE();
+	if(!journal->is_open() || !*core.mlogic || !core.project->get())
+		return;
+	uint64_t interval = SET_autosave_interval(*core.settings);
+	uint64_t now = framerate_regulator::get_utime();
+	if(!force && (!interval || now < last_sync + interval * 1000000))
+		return;
+	last_sync = now;
+	auto& mv = core.mlogic->get_mfile();
+	try {
+		journal->sync(mv.branches, movie_meta(mv));
+	} catch(std::bad_alloc& e) {
+		OOM_panic();
+	} catch(std::exception& e) {
+		messages << "Autosave journal failed: " << e.what() << std::endl;
+		return;
+	}
+	uint64_t limit = SET_autosave_compact(*core.settings);
+	if(!force && limit && !compact_failed && journal->get_size() > (limit << 20)) {
+		//Saving the state starts a new journal. If it fails, don't retry (and show the error again) every
+		//interval, just keep appending to the journal.
+		auto p = core.project->get();
+		core.rom->runtosave();
+		compact_failed = true;
+		std::string filename = p->directory + "/" + p->prefix + "-autosave.lss";
+		do_save_state(filename, 1);
+		int tmp = -1;
+		core.slotcache->flush(translate_name_mprefix(filename, tmp, -1));
+		if(compact_failed)
+			messages << "Autosave journal not compacted until next successful save." << std::endl;
+	}
+}
+
+void autosave_journal_reset(const std::string& savefile)
+{
+	auto& core = CORE();
+	auto p = core.project->get();
+	compact_failed = false;
+	if(!p || !*core.mlogic || !SET_autosave_interval(*core.settings)) {
+		journal->close();
+		return;
+	}
+	auto& mv = core.mlogic->get_mfile();
+	try {
+		journal->start(journal_name(p->id), base_id(savefile), mv.branches, movie_meta(mv));
+	} catch(std::bad_alloc& e) {
+		OOM_panic();
+	} catch(std::exception& e) {
+		messages << "Can't start autosave journal: " << e.what() << std::endl;
+	}
+	last_sync = framerate_regulator::get_utime();
+}
+
+bool autosave_journal_recover(project_info& p, const std::string& savefile, moviefile& mv)
+{
+	pending->close();
+	//Recover into a copy, so the save is left alone if the journal turns out not to apply.
+	std::map<std::string, portctrl::frame_vector> branches = mv.branches;
+	std::map<std::string, std::string> meta = movie_meta(mv);
+	uint64_t batches;
+	try {
+		batches = pending->recover(journal_name(p.id), base_id(savefile), branches,
+			mv.input->get_types(), meta);
+	} catch(std::bad_alloc& e) {
+		throw;
+	} catch(std::exception& e) {
+		messages << "Can't open autosave journal: " << e.what() << std::endl;
+		return false;
+	}
+	last_sync = framerate_regulator::get_utime();
+	if(!batches)
+		return false;
+	//Changes made after loading another movie must not be applied on top of this one.
+	if(meta["projectid"] != mv.projectid) {
+		pending->close();
+		messages << "Autosave journal is for another movie, not recovering it." << std::endl;
+		return false;
+	}
+	std::string current;
+	for(auto& i : mv.branches)
+		if(&i.second == mv.input)
+			current = i.first;
+	//After swap, branches holds the input as saved.
+	std::swap(mv.branches, branches);
+	portctrl::frame_vector& base_input = *mv.input;
+	//The journal may have removed the current branch, the recovered metadata names the right one.
+	if(mv.branches.count(current))
+		mv.input = &mv.branches[current];
+	else if(!mv.branches.empty())
+		mv.input = &mv.branches.begin()->second;
+	apply_meta(mv, meta);
+	//The saved state is only usable if the recovered input still leads to it.
+	if(mv.dyn.save_frame && (mv.dyn.pollcounters.empty() || !base_input.compatible(*mv.input,
+		mv.dyn.save_frame, &mv.dyn.pollcounters[0]))) {
+		mv.clear_dynstate();
+		messages << "Recovered input diverges before the last save, playing from the start." << std::endl;
+	}
+	messages << "Recovered " << batches << " autosaves from the journal (" << mv.get_frame_count()
+		<< " frames)." << std::endl;
+	return true;
+}
+
+void autosave_journal_close(bool sync)
+{
+	try {
+		if(sync)
+			autosave_journal_tick(true);
+	} catch(...) {
+	}
+	journal->close();
+}
+
+void autosave_journal_finish_switch(bool switched)
+{
+	if(switched) {
+		journal->close();
+		std::swap(journal, pending);
+	}
+	pending->close();
+}
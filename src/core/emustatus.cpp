@@ -1,3 +1,4 @@
+#include "cmdhelp/debug.hpp"
 #include "cmdhelp/loadsave.hpp"
 #include "core/advdumper.hpp"
 #include "core/audioapi.hpp"
@@ -6,6 +7,7 @@
 #include "core/framerate.hpp"
 #include "core/inthread.hpp"
 #include "core/jukebox.hpp"
+#include "core/messages.hpp"
 #include "core/memorywatch.hpp"
 #include "core/movie.hpp"
 #include "core/moviedata.hpp"
@@ -14,6 +16,8 @@
 #include "core/project.hpp"
 #include "core/rom.hpp"
 #include "core/runmode.hpp"
+#include "library/perfscope.hpp"
+#include "library/settingvar.hpp"
 #include "lua/lua.hpp"
 
 #include <sstream>
@@ -24,10 +28,118 @@ const int _lsnes_status::pause_break = 2;
 const uint64_t _lsnes_status::subframe_savepoint = 0xFFFFFFFFFFFFFFFEULL;
 const uint64_t _lsnes_status::subframe_video = 0xFFFFFFFFFFFFFFFFULL;
 
-slotinfo_cache::slotinfo_cache(movie_logic& _mlogic, command::group& _cmd)
+namespace
+{
+	perfscope::region perf_update("status.update");
+	const std::string no_string;
+
+	void copy_field_group(_lsnes_status& dst, const _lsnes_status& src, unsigned g)
+	{
+		switch(g) {
+		case _lsnes_status::F_COUNTERS:
+			dst.movie_valid = src.movie_valid;
+			dst.curframe = src.curframe;
+			dst.length = src.length;
+			dst.lag = src.lag;
+			dst.subframe = src.subframe;
+			break;
+		case _lsnes_status::F_STATE:
+			dst.dumping = src.dumping;
+			dst.speed = src.speed;
+			dst.pause = src.pause;
+			dst.mode = src.mode;
+			break;
+		case _lsnes_status::F_SLOT:
+			dst.saveslot_valid = src.saveslot_valid;
+			dst.saveslot = src.saveslot;
+			dst.slotinfo = src.slotinfo;
+			dst.branch_valid = src.branch_valid;
+			dst.branch = src.branch;
+			break;
+		case _lsnes_status::F_MBRANCH:
+			dst.mbranch_valid = src.mbranch_valid;
+			dst.mbranch = src.mbranch;
+			break;
+		case _lsnes_status::F_RTC:
+			dst.rtc_valid = src.rtc_valid;
+			dst.rtc = src.rtc;
+			break;
+		case _lsnes_status::F_MACROS:
+			dst.macros = src.macros;
+			break;
+		case _lsnes_status::F_INPUTS:
+			dst.inputs = src.inputs;
+			break;
+		case _lsnes_status::F_MVARS:
+			dst.mvars = src.mvars;
+			break;
+		case _lsnes_status::F_LVARS:
+			dst.lvars = src.lvars;
+			break;
+		}
+		dst.versions[g] = src.versions[g];
+	}
+}
+
+_lsnes_status::_lsnes_status()
+{
+	valid = false;
+	movie_valid = false;
+	curframe = length = lag = subframe = 0;
+	dumping = false;
+	speed = 0;
+	saveslot_valid = false;
+	saveslot = 0;
+	branch_valid = false;
+	mbranch_valid = false;
+	pause = pause_none;
+	mode = 'C';
+	rtc_valid = false;
+	for(unsigned i = 0; i < F_COUNT; i++)
+		versions[i] = 0;
+}
+
+uint32_t _lsnes_status::changed_since(uint64_t* seen) const
+{
+	uint32_t r = 0;
+	for(unsigned i = 0; i < F_COUNT; i++) {
+		if(seen[i] != versions[i])
+			r |= (1UL << i);
+		seen[i] = versions[i];
+	}
+	return r;
+}
+
+//Slot file names change with the slot path.
+struct slotinfo_cache_listener : public settingvar::listener
+{
+	slotinfo_cache_listener(settingvar::group& _grp, slotinfo_cache& _cache)
+		: grp(_grp), cache(_cache)
+	{
+		grp.add_listener(*this);
+	}
+	~slotinfo_cache_listener() throw() { grp.remove_listener(*this); };
+	void on_setting_change(settingvar::group& _grp, const settingvar::base& val)
+	{
+		if(val.get_iname() == "slotpath")
+			cache.flush();
+	}
+private:
+	settingvar::group& grp;
+	slotinfo_cache& cache;
+};
+
+slotinfo_cache::slotinfo_cache(movie_logic& _mlogic, settingvar::group& _settings, command::group& _cmd)
 	: mlogic(_mlogic), cmd(_cmd),
 	flushcmd(cmd, CLOADSAVE::flushslots, [this]() { this->flush(); })
 {
+	generation = 0;
+	listener = new slotinfo_cache_listener(_settings, *this);
+}
+
+slotinfo_cache::~slotinfo_cache()
+{
+	delete listener;
 }
 
 std::string slotinfo_cache::get(const std::string& _filename)
@@ -54,28 +166,123 @@ std::string slotinfo_cache::get(const std::string& _filename)
 void slotinfo_cache::flush(const std::string& _filename)
 {
 	cache.erase(resolve_relative_path(_filename));
+	generation++;
 }
 
 void slotinfo_cache::flush()
 {
 	cache.clear();
+	generation++;
 }
 
 status_updater::status_updater(project_state& _project, movie_logic& _mlogic, voice_commentary& _commentary,
 	triplebuffer::triplebuffer<_lsnes_status>& _status, emulator_runmode& _runmode, master_dumper& _mdumper,
 	save_jukebox& _jukebox, slotinfo_cache& _slotcache, framerate_regulator& _framerate,
 	controller_state& _controls, multitrack_edit& _mteditor, lua_state& _lua2, loaded_rom& _rom,
-	memwatch_set& _mwatch, emulator_dispatch& _dispatch)
+	memwatch_set& _mwatch, emulator_dispatch& _dispatch, command::group& _cmd)
 	: project(_project), mlogic(_mlogic), commentary(_commentary), status(_status), runmode(_runmode),
 	mdumper(_mdumper), jukebox(_jukebox), slotcache(_slotcache), framerate(_framerate), controls(_controls),
-	mteditor(_mteditor), lua2(_lua2), rom(_rom), mwatch(_mwatch), dispatch(_dispatch)
+	mteditor(_mteditor), lua2(_lua2), rom(_rom), mwatch(_mwatch), dispatch(_dispatch), cmd(_cmd),
+	costcmd(cmd, CDEBUG::statcost, [this]() { this->show_cost(); })
 {
+	version_counter = 0;
+	slot_dirty = true;
+	slot_project = NULL;
+	slot_branch = 0;
+	slot_number = 0;
+	slot_generation = 0;
+	rtc_known = false;
+	rtc_second = 0;
+	update_count = 0;
+	update_usecs = 0;
+	slot_recomputes = 0;
+	rtc_recomputes = 0;
+	//Branch names are not visible in any cheaply comparable state.
+	branchchange.set(dispatch.branch_change, [this]() { this->slot_dirty = true; });
+}
+
+void status_updater::update_slot()
+{
+	//Slot file name depends on slot, project and its branch and the existence of slot files (which changes
+	//only by saving, which flushes slot cache). The info also depends on the loaded movie.
+	auto p = project.get();
+	size_t slot;
+	try {
+		slot = jukebox.get_slot();
+	} catch(...) {
+		set_field(_lsnes_status::F_SLOT, model.saveslot_valid, false);
+		return;
+	}
+	const std::string& projectid = mlogic ? mlogic.get_mfile().projectid : no_string;
+	uint64_t branch = p ? p->get_current_branch() : 0;
+	if(!slot_dirty && model.saveslot_valid && slot_number == slot && slot_project == p && slot_branch == branch &&
+		slot_generation == slotcache.get_generation() && slot_projectid == projectid)
+		return;
+	slot_dirty = false;
+	slot_number = slot;
+	slot_project = p;
+	slot_branch = branch;
+	slot_projectid = projectid;
+	slot_recomputes++;
+	try {
+		int tmp = -1;
+		std::string sfilen = translate_name_mprefix(jukebox.get_slot_name(), tmp, -1);
+		set_field(_lsnes_status::F_SLOT, model.saveslot, (uint64_t)slot + 1);
+		set_field(_lsnes_status::F_SLOT, model.slotinfo, utf8::to32(slotcache.get(sfilen)));
+		set_field(_lsnes_status::F_SLOT, model.saveslot_valid, true);
+	} catch(...) {
+		set_field(_lsnes_status::F_SLOT, model.saveslot_valid, false);
+	}
+	//Read the generation after the lookup, which may have flushed entries.
+	slot_generation = slotcache.get_generation();
+	set_field(_lsnes_status::F_SLOT, model.branch_valid, p != NULL);
+	if(p)
+		set_field(_lsnes_status::F_SLOT, model.branch, utf8::to32(p->get_branch_string()));
 }
 
+void status_updater::update_rtc()
+{
+	if(!mlogic || runmode.is_corrupt()) {
+		rtc_known = false;
+		set_field(_lsnes_status::F_RTC, model.rtc_valid, false);
+		return;
+	}
+	int64_t second = mlogic.get_mfile().dyn.rtc_second;
+	if(rtc_known && rtc_second == second)
+		return;
+	rtc_known = true;
+	rtc_second = second;
+	rtc_recomputes++;
+	time_t timevalue = static_cast<time_t>(second);
+	struct tm* time_decompose = gmtime(&timevalue);
+	char datebuffer[512];
+	strftime(datebuffer, 511, "%Y%m%d(%a)T%H%M%S", time_decompose);
+	set_field(_lsnes_status::F_RTC, model.rtc, utf8::to32(datebuffer));
+	set_field(_lsnes_status::F_RTC, model.rtc_valid, true);
+}
 
 void status_updater::update()
 {
-	auto p = project.get();
+	perfscope::scope pt(perf_update);
+	uint64_t t = framerate_regulator::get_utime();
+	auto& _status = status.get_write();
+	try {
+		do_update();
+		//The write buffer holds status from few updates back. Only copy the field groups that changed since.
+		for(unsigned i = 0; i < _lsnes_status::F_COUNT; i++)
+			if(_status.versions[i] != model.versions[i])
+				copy_field_group(_status, model, i);
+		_status.valid = true;
+	} catch(...) {
+	}
+	status.put_write();
+	update_usecs += framerate_regulator::get_utime() - t;
+	update_count++;
+	dispatch.status_update();
+}
+
+void status_updater::do_update()
+{
 	bool readonly = false;
 	{
 		uint64_t magic[4];
@@ -86,78 +293,63 @@ void status_updater::update()
 		else
 			commentary.frame_number(0, 60.0);	//Default.
 	}
-	auto& _status = status.get_write();
-	try {
-		if(mlogic && !runmode.is_corrupt()) {
-			_status.movie_valid = true;
-			_status.curframe = mlogic.get_movie().get_current_frame();
-			_status.length = mlogic.get_movie().get_frame_count();
-			_status.lag = mlogic.get_movie().get_lag_frames();
-			if(runmode.get_point() == emulator_runmode::P_START)
-				_status.subframe = 0;
-			else if(runmode.get_point() == emulator_runmode::P_SAVE)
-				_status.subframe = _lsnes_status::subframe_savepoint;
-			else if(runmode.get_point() == emulator_runmode::P_VIDEO)
-				_status.subframe = _lsnes_status::subframe_video;
-			else
-				_status.subframe = mlogic.get_movie().next_poll_number();
-		} else {
-			_status.movie_valid = false;
-			_status.curframe = 0;
-			_status.length = 0;
-			_status.lag = 0;
-			_status.subframe = 0;
-		}
-		_status.dumping = (mdumper.get_dumper_count() > 0);
-		if(runmode.is_paused_break())
-			_status.pause = _lsnes_status::pause_break;
-		else if(runmode.is_paused_normal())
-			_status.pause = _lsnes_status::pause_normal;
+	if(mlogic && !runmode.is_corrupt()) {
+		uint64_t subframe;
+		if(runmode.get_point() == emulator_runmode::P_START)
+			subframe = 0;
+		else if(runmode.get_point() == emulator_runmode::P_SAVE)
+			subframe = _lsnes_status::subframe_savepoint;
+		else if(runmode.get_point() == emulator_runmode::P_VIDEO)
+			subframe = _lsnes_status::subframe_video;
 		else
-			_status.pause = _lsnes_status::pause_none;
-		if(mlogic) {
-			auto& mo = mlogic.get_movie();
-			readonly = mo.readonly_mode();
-			if(runmode.is_corrupt())
-				_status.mode = 'C';
-			else if(!readonly)
-				_status.mode = 'R';
-			else if(mo.get_frame_count() >= mo.get_current_frame())
-				_status.mode = 'P';
-			else
-				_status.mode = 'F';
-		}
-		try {
-			_status.saveslot_valid = true;
-			int tmp = -1;
-			std::string sfilen = translate_name_mprefix(jukebox.get_slot_name(), tmp, -1);
-			_status.saveslot = jukebox.get_slot() + 1;
-			_status.slotinfo = utf8::to32(slotcache.get(sfilen));
-		} catch(...) {
-			_status.saveslot_valid = false;
-		}
-		_status.branch_valid = (p != NULL);
-		if(p) _status.branch = utf8::to32(p->get_branch_string());
-
-		std::string cur_branch = mlogic ? mlogic.get_mfile().current_branch() :
-			"";
-		_status.mbranch_valid = (cur_branch != "");
-		_status.mbranch = utf8::to32(cur_branch);
-
-		_status.speed = (unsigned)(100 * framerate.get_realized_multiplier() + 0.5);
-
-		if(mlogic && !runmode.is_corrupt()) {
-			time_t timevalue = static_cast<time_t>(mlogic.get_mfile().dyn.rtc_second);
-			struct tm* time_decompose = gmtime(&timevalue);
-			char datebuffer[512];
-			strftime(datebuffer, 511, "%Y%m%d(%a)T%H%M%S", time_decompose);
-			_status.rtc = utf8::to32(datebuffer);
-			_status.rtc_valid = true;
-		} else {
-			_status.rtc_valid = false;
-		}
+			subframe = mlogic.get_movie().next_poll_number();
+		set_field(_lsnes_status::F_COUNTERS, model.movie_valid, true);
+		set_field(_lsnes_status::F_COUNTERS, model.curframe, mlogic.get_movie().get_current_frame());
+		set_field(_lsnes_status::F_COUNTERS, model.length, mlogic.get_movie().get_frame_count());
+		set_field(_lsnes_status::F_COUNTERS, model.lag, mlogic.get_movie().get_lag_frames());
+		set_field(_lsnes_status::F_COUNTERS, model.subframe, subframe);
+	} else {
+		set_field(_lsnes_status::F_COUNTERS, model.movie_valid, false);
+		set_field(_lsnes_status::F_COUNTERS, model.curframe, (uint64_t)0);
+		set_field(_lsnes_status::F_COUNTERS, model.length, (uint64_t)0);
+		set_field(_lsnes_status::F_COUNTERS, model.lag, (uint64_t)0);
+		set_field(_lsnes_status::F_COUNTERS, model.subframe, (uint64_t)0);
+	}
+	set_field(_lsnes_status::F_STATE, model.dumping, (mdumper.get_dumper_count() > 0));
+	if(runmode.is_paused_break())
+		set_field(_lsnes_status::F_STATE, model.pause, _lsnes_status::pause_break);
+	else if(runmode.is_paused_normal())
+		set_field(_lsnes_status::F_STATE, model.pause, _lsnes_status::pause_normal);
+	else
+		set_field(_lsnes_status::F_STATE, model.pause, _lsnes_status::pause_none);
+	if(mlogic) {
+		auto& mo = mlogic.get_movie();
+		readonly = mo.readonly_mode();
+		if(runmode.is_corrupt())
+			set_field(_lsnes_status::F_STATE, model.mode, 'C');
+		else if(!readonly)
+			set_field(_lsnes_status::F_STATE, model.mode, 'R');
+		else if(mo.get_frame_count() >= mo.get_current_frame())
+			set_field(_lsnes_status::F_STATE, model.mode, 'P');
+		else
+			set_field(_lsnes_status::F_STATE, model.mode, 'F');
+	}
+	update_slot();
 
-		auto mset = controls.active_macro_set();
+	const std::string& cur_branch = mlogic ? mlogic.get_mfile().current_branch() : no_string;
+	if(cur_branch != mbranch_name) {
+		mbranch_name = cur_branch;
+		set_field(_lsnes_status::F_MBRANCH, model.mbranch_valid, (cur_branch != ""));
+		set_field(_lsnes_status::F_MBRANCH, model.mbranch, utf8::to32(cur_branch));
+	}
+
+	set_field(_lsnes_status::F_STATE, model.speed,
+		(unsigned)(100 * framerate.get_realized_multiplier() + 0.5));
+
+	update_rtc();
+
+	auto mset = controls.active_macro_set();
+	if(mset != macro_set) {
 		bool mfirst = true;
 		std::ostringstream mss;
 		for(auto i: mset) {
@@ -165,44 +357,57 @@ void status_updater::update()
 			mss << i;
 			mfirst = false;
 		}
-		_status.macros = utf8::to32(mss.str());
+		set_field(_lsnes_status::F_MACROS, model.macros, utf8::to32(mss.str()));
+		std::swap(macro_set, mset);
+	}
 
-		portctrl::frame c;
-		if(!mteditor.any_records())
-			c = mlogic.get_movie().get_controls();
-		else
-			c = controls.get_committed();
-		_status.inputs.clear();
-		for(unsigned i = 0;; i++) {
-			auto pindex = controls.lcid_to_pcid(i);
-			if(pindex.first < 0 || !controls.is_present(pindex.first, pindex.second))
-				break;
-			char32_t buffer[MAX_DISPLAY_LENGTH];
-			c.display(pindex.first, pindex.second, buffer);
-			std::u32string _buffer = buffer;
-			if(readonly && mteditor.is_enabled()) {
-				multitrack_edit::state st = mteditor.get(pindex.first, pindex.second);
-				if(st == multitrack_edit::MT_PRESERVE)
-					_buffer += U" (keep)";
-				else if(st == multitrack_edit::MT_OVERWRITE)
-					_buffer += U" (rewrite)";
-				else if(st == multitrack_edit::MT_OR)
-					_buffer += U" (OR)";
-				else if(st == multitrack_edit::MT_XOR)
-					_buffer += U" (XOR)";
-				else
-					_buffer += U" (\?\?\?)";
-			}
-			_status.inputs.push_back(_buffer);
+	portctrl::frame c;
+	if(!mteditor.any_records())
+		c = mlogic.get_movie().get_controls();
+	else
+		c = controls.get_committed();
+	std::vector<std::u32string> inputs;
+	for(unsigned i = 0;; i++) {
+		auto pindex = controls.lcid_to_pcid(i);
+		if(pindex.first < 0 || !controls.is_present(pindex.first, pindex.second))
+			break;
+		char32_t buffer[MAX_DISPLAY_LENGTH];
+		c.display(pindex.first, pindex.second, buffer);
+		std::u32string _buffer = buffer;
+		if(readonly && mteditor.is_enabled()) {
+			multitrack_edit::state st = mteditor.get(pindex.first, pindex.second);
+			if(st == multitrack_edit::MT_PRESERVE)
+				_buffer += U" (keep)";
+			else if(st == multitrack_edit::MT_OVERWRITE)
+				_buffer += U" (rewrite)";
+			else if(st == multitrack_edit::MT_OR)
+				_buffer += U" (OR)";
+			else if(st == multitrack_edit::MT_XOR)
+				_buffer += U" (XOR)";
+			else
+				_buffer += U" (\?\?\?)";
 		}
-		//Lua variables.
-		_status.lvars = lua2.get_watch_vars();
-		//Memory watches.
-		_status.mvars = mwatch.get_window_vars();
+		inputs.push_back(_buffer);
+	}
+	set_field(_lsnes_status::F_INPUTS, model.inputs, inputs);
+	//Lua variables.
+	set_field(_lsnes_status::F_LVARS, model.lvars, lua2.get_watch_vars());
+	//Memory watches.
+	set_field(_lsnes_status::F_MVARS, model.mvars, mwatch.get_window_vars());
+}
 
-		_status.valid = true;
-	} catch(...) {
+void status_updater::show_cost()
+{
+	if(!update_count) {
+		messages << "No status updates yet." << std::endl;
+		return;
 	}
-	status.put_write();
-	dispatch.status_update();
+	messages << "Status updates: " << update_count << ", average " << update_usecs / update_count
+		<< "us per update." << std::endl;
+	messages << "Slot info recomputed " << slot_recomputes << " times, RTC " << rtc_recomputes << " times."
+		<< std::endl;
+	update_count = 0;
+	update_usecs = 0;
+	slot_recomputes = 0;
+	rtc_recomputes = 0;
 }
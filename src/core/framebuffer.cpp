@@ -15,11 +15,13 @@
 #include "library/framebuffer.hpp"
 #include "library/framebuffer-pixfmt-lrgb.hpp"
 #include "library/minmax.hpp"
+#include "library/perfscope.hpp"
 #include "library/triplebuffer.hpp"
 #include "lua/lua.hpp"
 
 namespace
 {
+	perfscope::region perf_redraw("framebuffer.redraw");
 	struct render_list_entry
 	{
 		uint32_t codepoint;
@@ -84,6 +86,8 @@ namespace
 		"UI‣Left padding", 0);
 	settingvar::supervariable<settingvar::model_int<0, 8191>> SET_drb(lsnes_setgrp, "right-border",
 		"UI‣Right padding", 0);
+	settingvar::supervariable<settingvar::model_int<0, 64>> SET_render_threads(lsnes_setgrp, "render-threads",
+		"UI‣Render threads (0=sequential)", 0);
 }
 
 framebuffer::raw emu_framebuffer::screen_corrupt;
@@ -91,7 +95,9 @@ framebuffer::raw emu_framebuffer::screen_corrupt;
 emu_framebuffer::emu_framebuffer(subtitle_commentary& _subtitles, settingvar::group& _settings, memwatch_set& _mwatch,
 	keyboard::keyboard& _keyboard, emulator_dispatch& _dispatch, lua_state& _lua2, loaded_rom& _rom,
 	status_updater& _supdater, command::group& _cmd, input_queue& _iqueue)
-	: buffering(buffer1, buffer2, buffer3), subtitles(_subtitles), settings(_settings), mwatch(_mwatch),
+	: buffering(buffer1, buffer2, buffer3), subtitles(_subtitles), settings(_settings),
+	dtb(SET_dtb, settings), dbb(SET_dbb, settings), dlb(SET_dlb, settings), drb(SET_drb, settings),
+	render_threads(SET_render_threads, settings), mwatch(_mwatch),
 	keyboard(_keyboard), edispatch(_dispatch), lua2(_lua2), rom(_rom), supdater(_supdater), cmd(_cmd),
 	iqueue(_iqueue), screenshot(cmd, CFRAMEBUF::ss, [this](command::arg_filename a) { this->do_screenshot(a); })
 {
@@ -136,6 +142,7 @@ void emu_framebuffer::init_special_screens() throw(std::bad_alloc)
 
 void emu_framebuffer::redraw_framebuffer(framebuffer::raw& todraw, bool no_lua, bool spontaneous)
 {
+	perfscope::scope t(perf_redraw);
 	uint32_t hscl, vscl;
 	auto g = rom.get_scale_factors(todraw.get_width(), todraw.get_height());
 	hscl = g.first;
@@ -157,10 +164,10 @@ void emu_framebuffer::redraw_framebuffer(framebuffer::raw& todraw, bool no_lua,
 	ri.fbuf = todraw;
 	ri.hscl = hscl;
 	ri.vscl = vscl;
-	ri.lgap = max(lrc.left_gap, (unsigned)SET_dlb(settings));
-	ri.rgap = max(lrc.right_gap, (unsigned)SET_drb(settings));
-	ri.tgap = max(lrc.top_gap, (unsigned)SET_dtb(settings));
-	ri.bgap = max(lrc.bottom_gap, (unsigned)SET_dbb(settings));
+	ri.lgap = max(lrc.left_gap, (unsigned)dlb());
+	ri.rgap = max(lrc.right_gap, (unsigned)drb());
+	ri.tgap = max(lrc.top_gap, (unsigned)dtb());
+	ri.bgap = max(lrc.bottom_gap, (unsigned)dbb());
 	mwatch.watch(ri.rq);
 	buffering.put_write();
 	edispatch.screen_update();
@@ -176,6 +183,23 @@ void emu_framebuffer::redraw_framebuffer()
 	redraw_framebuffer(copy, last_redraw_no_lua, false);
 }
 
+void emu_framebuffer::paint_skipped_frame(framebuffer::raw& todraw)
+{
+	perfscope::scope t(perf_redraw);
+	auto g = rom.get_scale_factors(todraw.get_width(), todraw.get_height());
+	skipped_rq.clear();
+	struct lua::render_context lrc;
+	lrc.left_gap = 0;
+	lrc.right_gap = 0;
+	lrc.bottom_gap = 0;
+	lrc.top_gap = 0;
+	lrc.queue = &skipped_rq;
+	lrc.width = todraw.get_width() * g.first;
+	lrc.height = todraw.get_height() * g.second;
+	lua2.callback_do_paint(&lrc, true);
+	skipped_rq.clear();
+}
+
 void emu_framebuffer::render_framebuffer()
 {
 	render_info& ri = buffering.get_read();
@@ -183,6 +207,7 @@ void emu_framebuffer::render_framebuffer()
 		ri.tgap + ri.bgap);
 	main_screen.set_origin(ri.lgap, ri.tgap);
 	main_screen.copy_from(ri.fbuf, ri.hscl, ri.vscl);
+	framebuffer::queue::set_threads(render_threads());
 	ri.rq.run(main_screen);
 	//We would want divide by 2, but we'll do it ourselves in order to do mouse.
 	keyboard::mouse_calibration xcal;
@@ -22,6 +22,7 @@
 #include "core/multitrack.hpp"
 #include "core/project.hpp"
 #include "core/queue.hpp"
+#include "core/ramrecorder.hpp"
 #include "core/random.hpp"
 #include "core/rom.hpp"
 #include "core/runmode.hpp"
@@ -82,9 +83,9 @@ emulator_instance::emulator_instance()
 	D.init(command);
 	D.init(iqueue, *command);
 	D.init(mlogic);
-	D.init(slotcache, *mlogic, *command);
-	D.init(memory);
 	D.init(settings);
+	D.init(slotcache, *mlogic, *settings, *command);
+	D.init(memory);
 	D.init(lua);
 	D.init(lua2, *lua, *command, *settings);
 	D.init(mwatch, *memory, *project, *fbuf, *rom);
@@ -115,8 +116,9 @@ emulator_instance::emulator_instance()
 	D.init(framerate, *command);
 	D.init(mdumper, *lua2);
 	D.init(runmode);
+	D.init(ramrec, *memory, *mwatch, *command);
 	D.init(supdater, *project, *mlogic, *commentary, *status, *runmode, *mdumper, *jukebox, *slotcache,
-	       *framerate, *controls, *mteditor, *lua2, *rom, *mwatch, *dispatch);
+	       *framerate, *controls, *mteditor, *lua2, *rom, *mwatch, *dispatch, *command);
 
 	status_A->valid = false;
 	status_B->valid = false;
@@ -3,6 +3,7 @@
 #include "cmdhelp/loadsave.hpp"
 #include "cmdhelp/mhold.hpp"
 #include "core/advdumper.hpp"
+#include "core/autosave.hpp"
 #include "core/command.hpp"
 #include "core/controller.hpp"
 #include "core/debug.hpp"
@@ -23,6 +24,7 @@
 #include "core/multitrack.hpp"
 #include "core/project.hpp"
 #include "core/queue.hpp"
+#include "core/ramrecorder.hpp"
 #include "core/random.hpp"
 #include "core/rom.hpp"
 #include "core/runmode.hpp"
@@ -32,8 +34,11 @@
 #include "interface/c-interface.hpp"
 #include "interface/romtype.hpp"
 #include "library/framebuffer.hpp"
+#include "library/perfscope.hpp"
 #include "library/settingvar.hpp"
+#include "library/sha256.hpp"
 #include "library/string.hpp"
+#include "library/threads-pool.hpp"
 #include "library/zip.hpp"
 #include "lua/lua.hpp"
 
@@ -59,6 +64,10 @@ namespace
 		"advance-subframe-timeout", "Delays‣Subframe advance", 100);
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_pause_on_end(lsnes_setgrp,
 		"pause-on-end", "Movie‣Pause on end", false);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_seek_skip_output(lsnes_setgrp,
+		"seek-skip-output", "Movie‣Skip output while seeking", true);
+	settingvar::supervariable<settingvar::model_int<0,64>> SET_task_threads(lsnes_setgrp, "task-threads",
+		"System‣Task pool threads (0=auto)", 0);
 
 	//Mode and filename of pending load, one of LOAD_* constants.
 	int loadmode;
@@ -72,6 +81,11 @@ namespace
 	//Stop at frame.
 	bool stop_at_frame_active = false;
 	uint64_t stop_at_frame = 0;
+	//Frame to quit at (0 => don't) and function to call when it is reached.
+	uint64_t quit_at_frame = 0;
+	std::function<void()> quit_at_frame_fn;
+	//Output of frame being emulated is discarded.
+	bool output_skipped = false;
 	//Macro hold.
 	bool macro_hold_1;
 	bool macro_hold_2;
@@ -176,6 +190,20 @@ portctrl::frame movie_logic::update_controls(bool subframe, bool forced) throw(s
 namespace
 {
 
+	//Is the output of the next frame going to be thrown away?
+	bool skip_output()
+	{
+		auto& core = CORE();
+		if(!core.runmode->is_freerunning() || !SET_seek_skip_output(*core.settings))
+			return false;
+		if(core.mdumper->get_dumper_count())
+			return false;
+		//Nobody looks at the output before quitting.
+		if(quit_at_frame)
+			return true;
+		return stop_at_frame_active && (core.mlogic->get_movie().get_current_frame() + 1 < stop_at_frame);
+	}
+
 	//Do pending load (automatically unpauses).
 	void mark_pending_load(std::string filename, int lmode)
 	{
@@ -285,6 +313,12 @@ public:
 		auto& core = CORE();
 		core.lua2->callback_do_frame_emulated();
 		core.runmode->set_point(emulator_runmode::P_VIDEO);
+		//Nothing is dumping and next frame is going to be drawn over this one anyway. Scripts still see the
+		//frame.
+		if(output_skipped) {
+			core.fbuf->paint_skipped_frame(screen);
+			return;
+		}
 		core.fbuf->redraw_framebuffer(screen, false, true);
 		auto rate = core.rom->get_audio_rate();
 		uint32_t gv = gcd(fps_n, fps_d);
@@ -352,6 +386,96 @@ namespace
 			uint64_t x = CORE().mlogic->get_rrdata().write(tmp);
 			messages << x << " rerecord(s)" << std::endl;
 		});
+	command::fnptr<> CMD_show_task_pool(lsnes_cmds, "show-task-pool", "Show task pool statistics",
+		"Syntax: show-task-pool\nShows statistics of the shared task pool.\n",
+		[]() throw(std::bad_alloc, std::runtime_error) {
+			threads::pool::stats s = threads::pool::global().get_stats();
+			messages << s.threads << " thread(s), " << s.queued << " task(s) pending (max " << s.max_queued
+				<< ")" << std::endl;
+			messages << "Submitted " << s.submitted[threads::LANE_LATENCY] << " latency + "
+				<< s.submitted[threads::LANE_NORMAL] << " normal, executed " << s.executed << ", stolen "
+				<< s.steals << ", idle " << s.sleeps << std::endl;
+		});
+
+	//Feeds constant input to core and drops everything core outputs.
+	struct verify_callbacks : public emucore_callbacks
+	{
+		verify_callbacks(emucore_callbacks& _parent, const portctrl::frame& _controls)
+			: parent(_parent), controls(_controls)
+		{
+		}
+		~verify_callbacks() throw()
+		{
+		}
+		int16_t get_input(unsigned port, unsigned index, unsigned control)
+		{
+			return controls.axis3(port, index, control);
+		}
+		int16_t set_input(unsigned port, unsigned index, unsigned control, int16_t value)
+		{
+			return controls.axis3(port, index, control);
+		}
+		void notify_latch(std::list<std::string>& args) {}
+		void timer_tick(uint32_t increment, uint32_t per_second) {}
+		std::string get_firmware_path() { return parent.get_firmware_path(); }
+		std::string get_base_path() { return parent.get_base_path(); }
+		time_t get_time() { return parent.get_time(); }
+		time_t get_randomseed() { return parent.get_randomseed(); }
+		void output_frame(framebuffer::raw& screen, uint32_t fps_n, uint32_t fps_d) {}
+		void action_state_updated() {}
+		void memory_read(uint64_t addr, uint64_t value) {}
+		void memory_write(uint64_t addr, uint64_t value) {}
+		void memory_execute(uint64_t addr, uint64_t proc) {}
+		void memory_trace(uint64_t proc, const char* str, bool insn) {}
+	private:
+		emucore_callbacks& parent;
+		portctrl::frame controls;
+	};
+
+	std::string run_frames_hash(unsigned frames, bool skip_output)
+	{
+		auto& core = CORE();
+		for(unsigned i = 0; i < frames; i++)
+			core.rom->emulate(skip_output);
+		return sha256::hash(core.rom->save_core_state(true));
+	}
+
+	command::fnptr<const std::string&> CMD_verify_skip_output(lsnes_cmds, "verify-skip-output",
+		"Check that skipping output does not desync",
+		"Syntax: verify-skip-output [<frames>]\nRuns <frames> frames (default 60) with current input held, with"
+		" and without\nskipping output, and checks that the resulting states are the same.\n",
+		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
+			auto& core = CORE();
+			unsigned frames = (args != "") ? parse_value<unsigned>(args) : 60;
+			if(!core.rom->can_skip_output()) {
+				messages << "Core does not skip any output" << std::endl;
+				return;
+			}
+			std::vector<char> saved = core.rom->save_core_state();
+			bool pflag = core.rom->get_pflag();
+			verify_callbacks vcb(*ecore_callbacks, core.mlogic->get_movie().get_controls());
+			emucore_callbacks* old = ecore_callbacks;
+			std::string h1, h2;
+			ecore_callbacks = &vcb;
+			try {
+				h1 = run_frames_hash(frames, false);
+				core.rom->load_core_state(saved);
+				h2 = run_frames_hash(frames, true);
+			} catch(...) {
+				ecore_callbacks = old;
+				core.rom->load_core_state(saved);
+				core.rom->set_pflag(pflag);
+				throw;
+			}
+			ecore_callbacks = old;
+			core.rom->load_core_state(saved);
+			core.rom->set_pflag(pflag);
+			if(h1 == h2)
+				messages << "States after " << frames << " frames match (" << h1 << ")" << std::endl;
+			else
+				messages << "States after " << frames << " frames differ: " << h1 << " vs. " << h2
+					<< std::endl;
+		});
 
 	command::fnptr<const std::string&> CMD_quit_emulator(lsnes_cmds, "quit-emulator", "Quit the emulator",
 		"Syntax: quit-emulator [/y]\nQuits emulator (/y => don't ask for confirmation).\n",
@@ -806,7 +930,7 @@ nothing_to_do:
 			}
 			if(do_unsafe_rewind && !unsafe_rewind_obj) {
 				uint64_t t = framerate_regulator::get_utime();
-				core.mlogic->get_mfile().dyn.savestate = core.rom->save_core_state(true);
+				core.rom->save_core_state(core.mlogic->get_mfile().dyn.savestate, true);
 				core.lua2->callback_do_unsafe_rewind(core.mlogic->get_movie(), NULL);
 				do_unsafe_rewind = false;
 				messages << "Rewind point set in " << (framerate_regulator::get_utime() - t)
@@ -853,6 +977,10 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 	initialize_all_builtin_c_cores();
 	core_core::install_all_handlers();
 
+	//Only apply task pool size when it changes, reading the handle is cheap.
+	settingvar::handle<settingvar::model_int<0,64>> task_threads(SET_task_threads, *core.settings);
+	int64_t applied_task_threads = -1;
+
 	//Load our given movie.
 	bool first_round = false;
 	bool just_did_loadstate = false;
@@ -902,9 +1030,17 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 			core.mlogic->get_movie().get_pollcounters().set_framepflag(false);
 			core.mlogic->new_frame_starting(core.runmode->is_skiplag());
 			core.mlogic->get_movie().get_pollcounters().set_framepflag(true);
+			if(quit_at_frame && core.mlogic->get_movie().get_current_frame() > quit_at_frame) {
+				quit_at_frame = 0;
+				if(quit_at_frame_fn)
+					quit_at_frame_fn();
+				quit_at_frame_fn = std::function<void()>();
+				core.runmode->set_quit();
+			}
 			if(core.runmode->is_quit() && queued_saves.empty())
 				break;
 			handle_saves();
+			autosave_journal_tick();
 			int r = 0;
 			if(queued_saves.empty())
 				r = handle_load();
@@ -937,12 +1073,20 @@ void main_loop(struct loaded_rom& rom, struct moviefile& initial, bool load_has_
 			just_did_loadstate = false;
 		}
 		core.dbg->do_callback_frame(core.mlogic->get_movie().get_current_frame(), false);
-		core.rom->emulate();
+		if(task_threads() != applied_task_threads) {
+			applied_task_threads = task_threads();
+			threads::pool::global().set_threads(applied_task_threads);
+		}
+		output_skipped = skip_output();
+		core.rom->emulate(output_skipped);
+		output_skipped = false;
+		core.ramrec->sample(core.mlogic->get_movie().get_current_frame());
 		random_mix_timing_entropy();
 		if(core.runmode->is_freerunning())
 			platform::wait(core.framerate->to_wait_frame(framerate_regulator::get_utime()));
 		first_round = false;
 		core.lua2->callback_do_frame();
+		perfscope::end_frame();
 	}
 out:
 	core.jukebox->unset_update();
@@ -970,6 +1114,12 @@ void set_stop_at_frame(uint64_t frame)
 	platform::set_paused(false);
 }
 
+void set_quit_at_frame(uint64_t frame, std::function<void()> on_reached)
+{
+	quit_at_frame = frame;
+	quit_at_frame_fn = on_reached;
+}
+
 void do_flush_slotinfo()
 {
 	CORE().slotcache->flush();
@@ -165,15 +165,10 @@ void movie_branches::export_branch(const std::string& filename, const std::strin
 		(stringfmt() << "Can't open '" << filename << "' for writing.").throwex();
 	if(binary) {
 		uint64_t stride = v.get_stride();
-		uint64_t pageframes = v.get_frames_per_page();
-		uint64_t vsize = v.size();
-		size_t pagenum = 0;
-		while(vsize > 0) {
-			uint64_t count = (vsize > pageframes) ? pageframes : vsize;
-			size_t bytes = count * stride;
-			unsigned char* content = v.get_page_buffer(pagenum++);
-			file.write(reinterpret_cast<char*>(content), bytes);
-			vsize -= count;
+		for(size_t pagenum = 0; pagenum < v.get_page_count(); pagenum++) {
+			size_t bytes = v.get_page_frames(pagenum) * stride;
+			const unsigned char* content = v.get_page_buffer(pagenum);
+			file.write(reinterpret_cast<const char*>(content), bytes);
 		}
 	} else {
 		char buf[MAX_SERIALIZED_SIZE];
@@ -18,6 +18,7 @@
 #include "library/memorywatch.hpp"
 #include "library/memorywatch-list.hpp"
 #include "library/memorywatch-null.hpp"
+#include "library/perfscope.hpp"
 #include "library/string.hpp"
 
 #include <functional>
@@ -32,6 +33,7 @@
 
 namespace
 {
+	perfscope::region perf_watch("memwatch.watch");
 	globalwrap<std::map<std::string, std::pair<framebuffer::font2*, size_t>>> S_fonts_in_use;
 
 	framebuffer::font2& get_builtin_font2()
@@ -78,24 +80,38 @@ namespace
 		}
 	}
 
-	std::string json_string_default(const JSON::node& node, const std::string& pointer, const std::string& dflt)
+	//Field of given type, or NULL if there is none.
+	const JSON::document::value* json_field(const JSON::document::value& node, const std::string& key, int type)
 	{
-		return (node.type_of(pointer) == JSON::string) ? node[pointer].as_string8() : dflt;
+		if(node.type() != JSON::object || !node.field_exists(key))
+			return NULL;
+		const JSON::document::value& v = node.field(key);
+		return (v.type() == type) ? &v : NULL;
 	}
 
-	uint64_t json_unsigned_default(const JSON::node& node, const std::string& pointer, uint64_t dflt)
+	std::string json_string_default(const JSON::document::value& node, const std::string& key,
+		const std::string& dflt)
 	{
-		return (node.type_of(pointer) == JSON::number) ? node[pointer].as_uint() : dflt;
+		auto v = json_field(node, key, JSON::string);
+		return v ? v->as_string8() : dflt;
 	}
 
-	int64_t json_signed_default(const JSON::node& node, const std::string& pointer, int64_t dflt)
+	uint64_t json_unsigned_default(const JSON::document::value& node, const std::string& key, uint64_t dflt)
 	{
-		return (node.type_of(pointer) == JSON::number) ? node[pointer].as_int() : dflt;
+		auto v = json_field(node, key, JSON::number);
+		return v ? v->as_uint() : dflt;
 	}
 
-	bool json_boolean_default(const JSON::node& node, const std::string& pointer, bool dflt)
+	int64_t json_signed_default(const JSON::document::value& node, const std::string& key, int64_t dflt)
 	{
-		return (node.type_of(pointer) == JSON::boolean) ? node[pointer].as_bool() : dflt;
+		auto v = json_field(node, key, JSON::number);
+		return v ? v->as_int() : dflt;
+	}
+
+	bool json_boolean_default(const JSON::document::value& node, const std::string& key, bool dflt)
+	{
+		auto v = json_field(node, key, JSON::boolean);
+		return v ? v->as_bool() : dflt;
 	}
 
 	void dummy_target_fn(const std::string& n, const std::string& v) {}
@@ -194,7 +210,7 @@ JSON::node memwatch_printer::serialize()
 	return ndata;
 }
 
-void memwatch_printer::unserialize(const JSON::node& node)
+void memwatch_printer::unserialize(const JSON::document::value& node)
 {
 	std::string _position = json_string_default(node, "position", "");
 	if(_position == "disabled") position = PC_DISABLED;
@@ -307,10 +323,11 @@ JSON::node memwatch_item::serialize()
 	return ndata;
 }
 
-void memwatch_item::unserialize(const JSON::node& node)
+void memwatch_item::unserialize(const JSON::document::value& node)
 {
-	if(node.type_of("printer") == JSON::object)
-		printer.unserialize(node["printer"]);
+	auto _printer = json_field(node, "printer", JSON::object);
+	if(_printer)
+		printer.unserialize(*_printer);
 	else
 		printer = memwatch_printer();
 	expr = json_string_default(node, "expr", "0");
@@ -449,8 +466,10 @@ void memwatch_set::set(const std::string& name, const std::string& item)
 			messages << "Can't handle old memory watch '" << name << "'" << std::endl;
 			return;
 		}
-	} else
-		_item.unserialize(JSON::node(item));
+	} else {
+		JSON::document doc(item);
+		_item.unserialize(doc.root());
+	}
 	set(name, _item);
 }
 
@@ -471,6 +490,7 @@ std::string memwatch_set::get_string(const std::string& name, JSON::printer* pri
 
 void memwatch_set::watch(struct framebuffer::queue& rq)
 {
+	perfscope::scope t(perf_watch);
 	//Set framebuffer for all FB watches.
 	watch_set.foreach([&rq](memorywatch::item& i) {
 		memorywatch::output_fb* fb = dynamic_cast<memorywatch::output_fb*>(i.printer.as_pointer());
@@ -543,7 +563,8 @@ void memwatch_set::set_multi(std::list<std::pair<std::string, std::string>>& lis
 	std::list<std::pair<std::string, memwatch_item>> _list;
 	for(auto& i: list) {
 		memwatch_item it;
-		it.unserialize(JSON::node(i.second));
+		JSON::document doc(i.second);
+		it.unserialize(doc.root());
 		_list.push_back(std::make_pair(i.first, it));
 	}
 	set_multi(_list);
@@ -2,6 +2,7 @@
 
 #include "cmdhelp/moviedata.hpp"
 #include "core/advdumper.hpp"
+#include "core/autosave.hpp"
 #include "core/command.hpp"
 #include "core/dispatch.hpp"
 #include "core/framebuffer.hpp"
@@ -32,6 +33,8 @@ namespace
 {
 	settingvar::supervariable<settingvar::model_int<0, 9>> SET_savecompression(lsnes_setgrp, "savecompression",
 		"Movie‣Saving‣Compression",  7);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_binary_chunked(lsnes_setgrp,
+		"binary-chunked-input", "Movie‣Saving‣Binary input in chunks (needs newer lsnes to load)", false);
 	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_readonly_load_preserves(
 		lsnes_setgrp, "preserve_on_readonly_load", "Movie‣Loading‣Preserve on readonly load", true);
 	threads::lock mprefix_lock;
@@ -64,6 +67,56 @@ namespace
 			messages << "Saved core state to " << name << std::endl;
 		});
 
+	command::fnptr<const std::string&> CMD_convert_movie(lsnes_cmds, CMOVIEDATA::convert,
+		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
+			auto& core = CORE();
+			regex_results r = regex("([^ \t]+)[ \t]+([^ \t]+)[ \t]+(.+)", args,
+				"Syntax: convert-movie <format> <input> <output>");
+			bool binary = (r[1] != "zip");
+			bool chunked = (r[1] == "binary2");
+			if(r[1] != "zip" && r[1] != "binary" && r[1] != "binary2")
+				throw std::runtime_error("Format must be zip, binary or binary2");
+			uint64_t t1 = framerate_regulator::get_utime();
+			moviefile mv(r[2], core.rom->get_internal_rom_type());
+			temporary_handle<rrdata_set> rrd;
+			rrd.get()->read(mv.c_rrdata);
+			//Savestates stay savestates.
+			bool as_state = !mv.dyn.savestate.empty();
+			mv.save(r[3], SET_savecompression(*core.settings), binary, *rrd.get(), as_state, chunked);
+			uint64_t t2 = framerate_regulator::get_utime();
+			messages << "Converted '" << r[2] << "' to " << r[1] << " format '" << r[3] << "' in "
+				<< (t2 - t1) << " microseconds." << std::endl;
+		});
+
+	command::fnptr<const std::string&> CMD_bench_coresave(lsnes_cmds, CMOVIEDATA::benchcore,
+		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
+			auto& core = CORE();
+			uint64_t rounds = 100;
+			if(args != "")
+				rounds = parse_value<uint64_t>(args);
+			if(!rounds)
+				throw std::runtime_error("Need at least one round");
+			std::vector<char> buf;
+			uint64_t save_time = 0, load_time = 0, save_max = 0, load_max = 0;
+			for(uint64_t i = 0; i < rounds; i++) {
+				uint64_t t1 = framerate_regulator::get_utime();
+				core.rom->save_core_state(buf);
+				uint64_t t2 = framerate_regulator::get_utime();
+				core.rom->load_core_state(&buf[0], buf.size());
+				uint64_t t3 = framerate_regulator::get_utime();
+				save_time += (t2 - t1);
+				load_time += (t3 - t2);
+				save_max = max(save_max, t2 - t1);
+				load_max = max(load_max, t3 - t2);
+			}
+			messages << "Core " << core.rom->get_core_identifier() << ", state size " << buf.size()
+				<< " bytes, " << rounds << " rounds:" << std::endl;
+			messages << "Savestate: " << (save_time / rounds) << " usec average, " << save_max
+				<< " usec max." << std::endl;
+			messages << "Loadstate: " << (load_time / rounds) << " usec average, " << load_max
+				<< " usec max." << std::endl;
+		});
+
 	bool warn_hash_mismatch(const std::string& mhash, const fileimage::image& slot,
 		const std::string& name, bool fatal)
 	{
@@ -91,6 +144,8 @@ namespace
 			mprefix_valid = (pfx != "");
 			mprefix = pfx;
 		}
+		//Slot file names change.
+		core.slotcache->flush();
 		core.supdater->update();
 	}
 
@@ -226,6 +281,7 @@ void do_save_state(const std::string& filename, int binary) throw(std::bad_alloc
 	}
 	auto& target = core.mlogic->get_mfile();
 	std::string filename2 = translate_name_mprefix(filename, binary, 1);
+	bool saved = false;
 	core.lua2->callback_pre_save(filename2, true);
 	try {
 		uint64_t origtime = framerate_regulator::get_utime();
@@ -249,11 +305,12 @@ void do_save_state(const std::string& filename, int binary) throw(std::bad_alloc
 		}
 		target.dyn.active_macros = core.controls->get_macro_frames();
 		target.save(filename2, SET_savecompression(*core.settings), binary > 0,
-			core.mlogic->get_rrdata(), true);
+			core.mlogic->get_rrdata(), true, SET_binary_chunked(*core.settings));
 		uint64_t took = framerate_regulator::get_utime() - origtime;
 		std::string kind = (binary > 0) ? "(binary format)" : "(zip format)";
 		messages << "Saved state " << kind << " '" << filename2 << "' in " << took << " microseconds."
 			<< std::endl;
+		saved = true;
 		core.lua2->callback_post_save(filename2, true);
 	} catch(std::bad_alloc& e) {
 		throw;
@@ -267,6 +324,9 @@ void do_save_state(const std::string& filename, int binary) throw(std::bad_alloc
 	if(p) {
 		p->last_save = last_save;
 		p->flush();
+		//The changes up to now are in the save.
+		if(saved)
+			autosave_journal_reset(last_save);
 	}
 }
 
@@ -281,6 +341,7 @@ void do_save_movie(const std::string& filename, int binary) throw(std::bad_alloc
 	}
 	auto& target = core.mlogic->get_mfile();
 	std::string filename2 = translate_name_mprefix(filename, binary, 0);
+	bool saved = false;
 	core.lua2->callback_pre_save(filename2, false);
 	try {
 		uint64_t origtime = framerate_regulator::get_utime();
@@ -290,11 +351,12 @@ void do_save_movie(const std::string& filename, int binary) throw(std::bad_alloc
 			target.authors = prj->authors;
 		}
 		target.save(filename2, SET_savecompression(*core.settings), binary > 0,
-			core.mlogic->get_rrdata(), false);
+			core.mlogic->get_rrdata(), false, SET_binary_chunked(*core.settings));
 		uint64_t took = framerate_regulator::get_utime() - origtime;
 		std::string kind = (binary > 0) ? "(binary format)" : "(zip format)";
 		messages << "Saved movie " << kind << " '" << filename2 << "' in " << took << " microseconds."
 			<< std::endl;
+		saved = true;
 		core.lua2->callback_post_save(filename2, false);
 	} catch(std::bad_alloc& e) {
 		OOM_panic();
@@ -308,6 +370,9 @@ void do_save_movie(const std::string& filename, int binary) throw(std::bad_alloc
 	if(p) {
 		p->last_save = last_save;
 		p->flush();
+		//The changes up to now are in the save.
+		if(saved)
+			autosave_journal_reset(last_save);
 	}
 }
 
@@ -767,6 +832,10 @@ void do_load_state(struct moviefile& _movie, int lmode, bool& used)
 
 	core.lua2->callback_movie_lost("load");
 
+	//The journal applies to the last save of the old movie. It starts again on next save.
+	if(*core.mlogic && core.mlogic->get_mfile().projectid != _movie.projectid)
+		autosave_journal_close();
+
 	//Copy the data.
 	if(new_rrdata) core.mlogic->set_rrdata(*(rrd()), true);
 	core.mlogic->set_movie(*newmovie(), true);
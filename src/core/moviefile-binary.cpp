@@ -3,12 +3,15 @@
 #include "core/moviefile.hpp"
 #include "library/binarystream.hpp"
 #include "library/minmax.hpp"
+#include "library/portctrl-chunked.hpp"
 #include "library/serialization.hpp"
 #include "library/string.hpp"
+#include "library/threads.hpp"
 #include "library/zip.hpp"
 
 #include <cstring>
 #include <cerrno>
+#include <list>
 #include <fcntl.h>
 #include <unistd.h>
 #if defined(_WIN32) || defined(_WIN64) || defined(TEST_WIN32_CODE)
@@ -18,6 +21,43 @@
 #define EXTRA_OPENFLAGS 0
 #endif
 
+namespace
+{
+	//Chunked encodings of branches from the last save or load, by project ID and branch name, so saving again only
+	//compresses the chunks that changed. Reuse is decided by hash of the contents, so mixing up movies only costs
+	//the reuse. Encodings of a few most recently used movies are kept, so that e.g. converting another movie does
+	//not throw away the ones of the current movie.
+	threads::lock chunk_cache_lock;
+	std::map<std::pair<std::string, std::string>, portctrl::chunked_input> chunk_cache;
+	std::list<std::string> chunk_cache_movies;	//Most recently used first.
+	const size_t chunk_cache_max_movies = 2;
+
+	//Mark movie as most recently used and forget the least recently used ones. Call with chunk_cache_lock held.
+	void chunk_cache_use(const std::string& projectid)
+	{
+		chunk_cache_movies.remove(projectid);
+		chunk_cache_movies.push_front(projectid);
+		while(chunk_cache_movies.size() > chunk_cache_max_movies) {
+			const std::string& old = chunk_cache_movies.back();
+			auto i = chunk_cache.lower_bound(std::make_pair(old, std::string()));
+			while(i != chunk_cache.end() && i->first.first == old)
+				chunk_cache.erase(i++);
+			chunk_cache_movies.pop_back();
+		}
+	}
+
+	void load_chunked(binarystream::input& s, const std::string& projectid, const std::string& branch,
+		portctrl::frame_vector& v)
+	{
+		portctrl::chunked_input c;
+		c.load(s);
+		c.decode(v);
+		threads::alock h(chunk_cache_lock);
+		chunk_cache_use(projectid);
+		std::swap(chunk_cache[std::make_pair(projectid, branch)], c);
+	}
+}
+
 void moviefile::brief_info::binary_io(int _stream)
 {
 	binarystream::input in(_stream);
@@ -57,7 +97,8 @@ void moviefile::brief_info::binary_io(int _stream)
 	}, binarystream::null_default);
 }
 
-void moviefile::binary_io(int _stream, rrdata_set& rrd, bool as_state) throw(std::bad_alloc, std::runtime_error)
+void moviefile::binary_io(int _stream, rrdata_set& rrd, bool as_state, bool chunked, unsigned compression)
+	throw(std::bad_alloc, std::runtime_error)
 {
 	binarystream::output out(_stream);
 	out.string(gametype->get_name());
@@ -180,15 +221,37 @@ void moviefile::binary_io(int _stream, rrdata_set& rrd, bool as_state) throw(std
 
 	int64_t next_bnum = 0;
 	std::map<std::string, uint64_t> branch_table;
+	if(chunked) {
+		threads::alock h(chunk_cache_lock);
+		chunk_cache_use(projectid);
+		//Forget branches that are gone.
+		auto i = chunk_cache.lower_bound(std::make_pair(projectid, std::string()));
+		while(i != chunk_cache.end() && i->first.first == projectid) {
+			if(branches.count(i->first.second))
+				i++;
+			else
+				chunk_cache.erase(i++);
+		}
+	}
 	for(auto& i : branches) {
 		branch_table[i.first] = next_bnum++;
 		out.extension(TAG_BRANCH_NAME, [&i](binarystream::output& s) {
 			s.string_implicit(i.first);
 		}, false, i.first.length());
-		uint32_t tag = (&i.second == input) ? TAG_MOVIE : TAG_BRANCH;
-		out.extension(tag, [&i](binarystream::output& s) {
-			i.second.save_binary(s);
-		}, true, i.second.binary_size());
+		if(chunked) {
+			threads::alock h(chunk_cache_lock);
+			portctrl::chunked_input& c = chunk_cache[std::make_pair(projectid, i.first)];
+			c.encode(i.second, compression);
+			uint32_t tag = (&i.second == input) ? TAG_MOVIE_CHUNKED : TAG_BRANCH_CHUNKED;
+			out.extension(tag, [&c](binarystream::output& s) {
+				c.save(s);
+			}, true, c.binary_size());
+		} else {
+			uint32_t tag = (&i.second == input) ? TAG_MOVIE : TAG_BRANCH;
+			out.extension(tag, [&i](binarystream::output& s) {
+				i.second.save_binary(s);
+			}, true, i.second.binary_size());
+		}
 	}
 }
 
@@ -240,6 +303,13 @@ void moviefile::binary_io(int _stream, core_type& romtype) throw(std::bad_alloc,
 		}},{TAG_BRANCH, [this, &ports, &next_branch](binarystream::input& s) {
 			branches[next_branch].clear(ports);
 			branches[next_branch].load_binary(s);
+		}},{TAG_MOVIE_CHUNKED, [this, &ports, &next_branch](binarystream::input& s) {
+			branches[next_branch].clear(ports);
+			load_chunked(s, projectid, next_branch, branches[next_branch]);
+			input = &branches[next_branch];
+		}},{TAG_BRANCH_CHUNKED, [this, &ports, &next_branch](binarystream::input& s) {
+			branches[next_branch].clear(ports);
+			load_chunked(s, projectid, next_branch, branches[next_branch]);
 		}},{TAG_MOVIE_SRAM, [this](binarystream::input& s) {
 			std::string a = s.string();
 			s.blob_implicit(this->movie_sram[a]);
@@ -331,6 +401,10 @@ std::set<std::string> moviefile_branch_extractor_binary::enumerate()
 			r.insert(name);
 		}},{TAG_BRANCH, [this, &r, &name](binarystream::input& s) {
 			r.insert(name);
+		}},{TAG_MOVIE_CHUNKED, [this, &r, &name](binarystream::input& s) {
+			r.insert(name);
+		}},{TAG_BRANCH_CHUNKED, [this, &r, &name](binarystream::input& s) {
+			r.insert(name);
 		}}
 	}, binarystream::null_default);
 
@@ -368,6 +442,20 @@ void moviefile_branch_extractor_binary::read(const std::string& name, portctrl::
 			v.clear();
 			v.load_binary(s);
 			done = true;
+		}},{TAG_MOVIE_CHUNKED, [this, &v, &mname, &name, &done](binarystream::input& s) {
+			if(name != mname)
+				return;
+			portctrl::chunked_input c;
+			c.load(s);
+			c.decode(v);
+			done = true;
+		}},{TAG_BRANCH_CHUNKED, [this, &v, &mname, &name, &done](binarystream::input& s) {
+			if(name != mname)
+				return;
+			portctrl::chunked_input c;
+			c.load(s);
+			c.decode(v);
+			done = true;
 		}}
 	}, binarystream::null_default);
 	if(!done)
@@ -81,16 +81,11 @@ namespace
 	void emerg_write_movie(int handle, const portctrl::frame_vector& v, uint32_t tag)
 	{
 		uint64_t stride = v.get_stride();
-		uint64_t pageframes = v.get_frames_per_page();
-		uint64_t vsize = v.size();
-		emerg_write_member(handle, tag, vsize * stride);
-		size_t pagenum = 0;
-		while(vsize > 0) {
-			uint64_t count = (vsize > pageframes) ? pageframes : vsize;
-			size_t bytes = count * stride;
-			const unsigned char* content = v.get_page_buffer(pagenum++);
+		emerg_write_member(handle, tag, v.size() * stride);
+		for(size_t pagenum = 0; pagenum < v.get_page_count(); pagenum++) {
+			size_t bytes = v.get_page_frames(pagenum) * stride;
+			const unsigned char* content = v.get_page_buffer(pagenum);
 			emerg_write_bytes(handle, content, bytes);
-			vsize -= count;
 		}
 	}
 	uint64_t append_number(char* ptr, uint64_t n)
@@ -44,7 +44,7 @@ namespace
 				return false;
 			x += r;
 		}
-		return !strcmp(buf, "lsmv\x1A");
+		return moviefile::is_binary_magic(buf);
 	}
 
 	void write_whole(int s, const char* buf, size_t size)
@@ -188,8 +188,8 @@ void moviefile::fixup_current_branch(const moviefile& mv)
 			input = &branches[i.first];
 }
 
-void moviefile::save(const std::string& movie, unsigned compression, bool binary, rrdata_set& rrd, bool as_state)
-	throw(std::bad_alloc, std::runtime_error)
+void moviefile::save(const std::string& movie, unsigned compression, bool binary, rrdata_set& rrd, bool as_state,
+	bool chunked) throw(std::bad_alloc, std::runtime_error)
 {
 	regex_results rr;
 	if(rr = regex("\\$MEMORY:(.*)", movie)) {
@@ -211,9 +211,9 @@ void moviefile::save(const std::string& movie, unsigned compression, bool binary
 			(stringfmt() << "Failed to open '" << tmp << "': " << strerror(err)).throwex();
 		}
 		try {
-			char buf[5] = {'l', 's', 'm', 'v', 0x1A};
+			char buf[5] = {'l', 's', 'm', 'v', (char)(chunked ? 0x1B : 0x1A)};
 			write_whole(strm, buf, 5);
-			binary_io(strm, rrd, as_state);
+			binary_io(strm, rrd, as_state, chunked, compression);
 		} catch(std::exception& e) {
 			close(strm);
 			(stringfmt() << "Failed to write '" << tmp << "': " << e.what()).throwex();
@@ -360,6 +360,12 @@ bool moviefile::is_movie_or_savestate(const std::string& filename)
 	}
 }
 
+bool moviefile::is_binary_magic(const char* buf)
+{
+	//Version 2 has different magic, so versions that don't know chunked input don't load it as empty.
+	return !memcmp(buf, "lsmv\x1A", 5) || !memcmp(buf, "lsmv\x1B", 5);
+}
+
 moviefile::branch_extractor::~branch_extractor()
 {
 	delete real;
@@ -370,10 +376,9 @@ moviefile::branch_extractor::branch_extractor(const std::string& filename)
 	bool binary = false;
 	{
 		std::istream& s = zip::openrel(filename, "");
-		char buf[6] = {0};
+		char buf[5] = {0};
 		s.read(buf, 5);
-		if(!strcmp(buf, "lsmv\x1A"))
-			binary = true;
+		binary = is_binary_magic(buf);
 		delete &s;
 	}
 	if(binary)
@@ -392,10 +397,9 @@ moviefile::sram_extractor::sram_extractor(const std::string& filename)
 	bool binary = false;
 	{
 		std::istream& s = zip::openrel(filename, "");
-		char buf[6] = {0};
+		char buf[5] = {0};
 		s.read(buf, 5);
-		if(!strcmp(buf, "lsmv\x1A"))
-			binary = true;
+		binary = is_binary_magic(buf);
 		delete &s;
 	}
 	if(binary)
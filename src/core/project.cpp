@@ -1,5 +1,6 @@
 #include "cmdhelp/lua.hpp"
 #include "cmdhelp/project.hpp"
+#include "core/autosave.hpp"
 #include "core/command.hpp"
 #include "core/controller.hpp"
 #include "core/dispatch.hpp"
@@ -337,6 +338,7 @@ project_info* project_state::get()
 bool project_state::set(project_info* p, bool current)
 {
 	if(!p) {
+		autosave_journal_close();
 		if(active_project)
 			commentary.unload_collection();
 		active_project = p;
@@ -350,6 +352,10 @@ bool project_state::set(project_info* p, bool current)
 	bool switched = false;
 	std::set<core_sysregion*> sysregs;
 	bool used = false;
+	std::string loaded_from;
+	bool recovered = false;
+	//Journal of the old project gets the last changes. It stays open in case the switch fails.
+	autosave_journal_tick(true);
 	try {
 		if(current)
 			goto skip_rom_movie;
@@ -380,6 +386,7 @@ bool project_state::set(project_info* p, bool current)
 		if(p->last_save != "")
 			try {
 				newmovie = new moviefile(p->last_save, newrom.get_internal_rom_type());
+				loaded_from = p->last_save;
 			} catch(std::exception& e) {
 				messages << "Warning: Can't load last save: " << e.what() << std::endl;
 				newmovie = new moviefile();
@@ -389,6 +396,8 @@ bool project_state::set(project_info* p, bool current)
 			newmovie = new moviefile();
 			fill_stub_movie(*newmovie, *p, newrom.get_internal_rom_type());
 		}
+		//Changes made after the last save, if it was not the last thing done.
+		recovered = autosave_journal_recover(*p, loaded_from, *newmovie);
 		//Okay, loaded, load into core.
 		newrom.load(p->settings, p->movie_rtc_second, p->movie_rtc_subsecond);
 		rom = newrom;
@@ -420,7 +429,11 @@ skip_rom_movie:
 		platform::error_message(std::string("Can't switch projects: ") + e.what());
 		messages << "Can't switch projects: " << e.what() << std::endl;
 	}
+	autosave_journal_finish_switch(switched);
 	if(switched) {
+		//If the project was made from the current movie, the journal starts on first save.
+		if(!current && !recovered)
+			autosave_journal_reset(loaded_from);
 		do_flush_slotinfo();
 		supdater.update();
 		edispatch.core_change();
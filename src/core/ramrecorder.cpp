@@ -0,0 +1,343 @@
+#include "cmdhelp/ramrecorder.hpp"
+#include "core/memorywatch.hpp"
+#include "core/messages.hpp"
+#include "core/ramrecorder.hpp"
+#include "library/hex.hpp"
+#include "library/int24.hpp"
+#include "library/memoryspace.hpp"
+#include "library/memorystruct.hpp"
+#include "library/minmax.hpp"
+#include "library/serialization.hpp"
+#include "library/string.hpp"
+
+#include <cctype>
+#include <fstream>
+
+namespace
+{
+	void write_u32(std::ostream& s, uint32_t v)
+	{
+		char buf[4];
+		serialization::u32l(buf, v);
+		s.write(buf, 4);
+	}
+
+	void write_u64(std::ostream& s, uint64_t v)
+	{
+		char buf[8];
+		serialization::u64l(buf, v);
+		s.write(buf, 8);
+	}
+}
+
+ram_recorder::ram_recorder(memory_space& _memory, memwatch_set& _mwatch, command::group& _cmd)
+	: memory(_memory), mwatch(_mwatch), cmd(_cmd),
+	addcmd(cmd, CRAMREC::add, [this](const std::string& args) {
+		regex_results r = regex("([^ \t]+)[ \t]+([^ \t]+)[ \t]+([^ \t]+)[ \t]*", args,
+			"Syntax: ram-record-add <name> <address> <type>");
+		this->add(r[1], parse_value<uint64_t>(r[2]), r[3]);
+	}),
+	watchcmd(cmd, CRAMREC::watch, [this](const std::string& args) { this->add_watch(args); }),
+	removecmd(cmd, CRAMREC::remove, [this](const std::string& args) { this->remove(args); }),
+	startcmd(cmd, CRAMREC::start, [this]() {
+		this->set_active(true);
+		messages << "RAM recorder started" << std::endl;
+	}),
+	stopcmd(cmd, CRAMREC::stop, [this]() {
+		this->set_active(false);
+		messages << "RAM recorder stopped" << std::endl;
+	}),
+	clearcmd(cmd, CRAMREC::clear, [this]() { this->clear(); }),
+	statuscmd(cmd, CRAMREC::status, [this]() {
+		messages << "RAM recorder is " << (this->active ? "recording" : "stopped") << ", " << this->samples
+			<< " frame(s) in " << this->get_bytes() << " bytes" << std::endl;
+		for(auto& i : this->columns)
+			messages << i.name << ": " << i.type << " at 0x" << hex::to(i.addr) << std::endl;
+	}),
+	csvcmd(cmd, CRAMREC::csv, [this](const std::string& args) {
+		regex_results r = regex("([^ \t]+)([ \t]+([0-9]+)[ \t]+([0-9]+))?[ \t]*", args,
+			"Syntax: ram-record-export <file> [<first> <last>]");
+		if(r[2] != "")
+			this->export_csv(r[1], parse_value<uint64_t>(r[3]), parse_value<uint64_t>(r[4]));
+		else
+			this->export_csv(r[1]);
+		messages << "Wrote '" << r[1] << "'" << std::endl;
+	}),
+	bincmd(cmd, CRAMREC::binary, [this](const std::string& args) {
+		this->export_binary(args);
+		messages << "Wrote '" << args << "'" << std::endl;
+	})
+{
+	samples = 0;
+	last_frame = 0;
+	active = false;
+}
+
+ram_recorder::~ram_recorder()
+{
+}
+
+void ram_recorder::add(const std::string& name, uint64_t addr, const std::string& type)
+{
+	memory_struct s(type);
+	if(s.get_fields() != 1)
+		throw std::runtime_error("Type must be a single field");
+	add_column(name, addr, s[0].type, s[0].endian);
+}
+
+void ram_recorder::add_watch(const std::string& name)
+{
+	memwatch_item& w = mwatch.get(name);
+	uint64_t addr;
+	try {
+		addr = parse_value<uint64_t>(w.expr);
+	} catch(...) {
+		throw std::runtime_error("Memory watch '" + name + "' does not read a fixed address");
+	}
+	if(!w.bytes || (w.addr_base == 0xFFFFFFFFFFFFFFFFULL && !w.addr_size))
+		throw std::runtime_error("Memory watch '" + name + "' does not read memory");
+	if(w.addr_size)
+		addr %= w.addr_size;
+	addr += w.addr_base;
+	char type;
+	switch(w.bytes) {
+	case 1: type = 'b'; break;
+	case 2: type = 'w'; break;
+	case 3: type = 'h'; break;
+	case 4: type = w.float_flag ? 'f' : 'd'; break;
+	case 8: type = w.float_flag ? 'F' : 'q'; break;
+	default: throw std::runtime_error("Memory watch '" + name + "' has unsupported size");
+	}
+	if(w.float_flag && w.bytes < 4)
+		throw std::runtime_error("Memory watch '" + name + "' has unsupported size");
+	if(!w.signed_flag && !w.float_flag)
+		type = toupper(type);
+	//Memory watches read in host order unless told otherwise.
+	add_column(name, addr, type, w.endianess ? w.endianess : memory_space::get_system_endian());
+}
+
+void ram_recorder::add_column(const std::string& name, uint64_t addr, char type, int endian)
+{
+	for(auto& i : columns)
+		if(i.name == name)
+			throw std::runtime_error("RAM recorder column '" + name + "' already exists");
+	columns.push_back(column());
+	column& c = columns.back();
+	c.name = name;
+	c.addr = addr;
+	c.type = type;
+	c.size = memory_struct(std::string(1, type)).get_size();
+	c.endian = endian;
+	//Frames recorded before the column was added read as zero.
+	for(uint64_t i = 0; i < samples; i++)
+		c.log.append(0);
+}
+
+void ram_recorder::remove(const std::string& name)
+{
+	for(auto i = columns.begin(); i != columns.end(); i++)
+		if(i->name == name) {
+			columns.erase(i);
+			return;
+		}
+	throw std::runtime_error("No RAM recorder column '" + name + "'");
+}
+
+std::list<std::string> ram_recorder::get_columns()
+{
+	std::list<std::string> r;
+	for(auto& i : columns)
+		r.push_back(i.name);
+	return r;
+}
+
+ram_recorder::column& ram_recorder::find(const std::string& name)
+{
+	for(auto& i : columns)
+		if(i.name == name)
+			return i;
+	throw std::runtime_error("No RAM recorder column '" + name + "'");
+}
+
+void ram_recorder::clear()
+{
+	for(auto& i : columns)
+		i.log.clear();
+	segments.clear();
+	samples = 0;
+	last_frame = 0;
+}
+
+size_t ram_recorder::get_bytes()
+{
+	size_t b = segments.size() * sizeof(segments[0]);
+	for(auto& i : columns)
+		b += i.log.get_bytes();
+	return b;
+}
+
+void ram_recorder::truncate(uint64_t frame)
+{
+	uint64_t n = samples;
+	while(!segments.empty() && segments.back().first >= frame) {
+		n = segments.back().second;
+		segments.pop_back();
+	}
+	if(!segments.empty())
+		n = min(n, segments.back().second + (frame - segments.back().first));
+	for(auto& i : columns)
+		i.log.truncate(n);
+	samples = n;
+	last_frame = segments.empty() ? 0 : segments.back().first + (n - 1 - segments.back().second);
+}
+
+void ram_recorder::sample(uint64_t frame)
+{
+	if(!active || columns.empty())
+		return;
+	if(samples && frame <= last_frame)
+		truncate(frame);
+	if(!samples || frame != last_frame + 1)
+		segments.push_back(std::make_pair(frame, samples));
+	for(auto& i : columns) {
+		char buf[8];
+		int e = memory.read_strided(i.addr, i.size, 1, i.size, buf);
+		e = i.endian ? i.endian : e;
+		int64_t v;
+		switch(i.type) {
+		case 'b': v = static_cast<int8_t>(buf[0]); break;
+		case 'B': v = static_cast<uint8_t>(buf[0]); break;
+		case 'w': v = serialization::read_endian<int16_t>(buf, e); break;
+		case 'W': v = serialization::read_endian<uint16_t>(buf, e); break;
+		case 'h': v = (int32_t)serialization::read_endian<ss_int24_t>(buf, e); break;
+		case 'H': v = (uint32_t)serialization::read_endian<ss_uint24_t>(buf, e); break;
+		case 'd': v = serialization::read_endian<int32_t>(buf, e); break;
+		case 'D': v = serialization::read_endian<uint32_t>(buf, e); break;
+		case 'q': v = serialization::read_endian<int64_t>(buf, e); break;
+		case 'Q': v = serialization::read_endian<uint64_t>(buf, e); break;
+		case 'f': {
+			double d = serialization::read_endian<float>(buf, e);
+			memcpy(&v, &d, sizeof(v));
+			break;
+		}
+		case 'F': v = serialization::read_endian<int64_t>(buf, e); break;
+		default: v = 0; break;
+		}
+		i.log.append(v);
+	}
+	samples++;
+	last_frame = frame;
+}
+
+double ram_recorder::to_double(char type, int64_t raw)
+{
+	if(type == 'f' || type == 'F') {
+		double d;
+		memcpy(&d, &raw, sizeof(d));
+		return d;
+	} else if(type == 'Q')
+		return static_cast<uint64_t>(raw);
+	return raw;
+}
+
+std::vector<ram_recorder::range> ram_recorder::find_ranges(uint64_t first, uint64_t last)
+{
+	std::vector<range> r;
+	for(size_t i = 0; i < segments.size(); i++) {
+		uint64_t sframe = segments[i].first;
+		uint64_t sindex = segments[i].second;
+		uint64_t scount = ((i + 1 < segments.size()) ? segments[i + 1].second : samples) - sindex;
+		uint64_t lo = max(first, sframe);
+		uint64_t hi = min(last, sframe + scount - 1);
+		if(lo > hi)
+			continue;
+		range x;
+		x.frame = lo;
+		x.index = sindex + (lo - sframe);
+		x.count = hi - lo + 1;
+		r.push_back(x);
+	}
+	return r;
+}
+
+std::vector<std::pair<uint64_t, double>> ram_recorder::query(const std::string& name, uint64_t first,
+	uint64_t last)
+{
+	column& c = find(name);
+	std::vector<std::pair<uint64_t, double>> r;
+	std::vector<int64_t> buf;
+	for(auto& i : find_ranges(first, last)) {
+		buf.resize(i.count);
+		c.log.read(i.index, i.count, &buf[0]);
+		for(uint64_t j = 0; j < i.count; j++)
+			r.push_back(std::make_pair(i.frame + j, to_double(c.type, buf[j])));
+	}
+	return r;
+}
+
+void ram_recorder::export_csv(const std::string& filename, uint64_t first, uint64_t last)
+{
+	std::ofstream f(filename);
+	if(!f)
+		throw std::runtime_error("Can't open '" + filename + "' for writing");
+	f << "frame";
+	for(auto& i : columns)
+		f << "," << i.name;
+	f << std::endl;
+	//Decode in chunks, so exporting long recordings doesn't need memory for all of them at once.
+	const uint64_t chunk = column_log::block_size;
+	std::vector<std::vector<int64_t>> buf(columns.size(), std::vector<int64_t>(chunk));
+	for(auto& i : find_ranges(first, last)) {
+		for(uint64_t j = 0; j < i.count; j += chunk) {
+			uint64_t n = min(chunk, i.count - j);
+			size_t k = 0;
+			for(auto& c : columns)
+				c.log.read(i.index + j, n, &buf[k++][0]);
+			for(uint64_t l = 0; l < n; l++) {
+				f << (i.frame + j + l);
+				k = 0;
+				for(auto& c : columns) {
+					int64_t v = buf[k++][l];
+					if(c.type == 'f' || c.type == 'F')
+						f << "," << to_double(c.type, v);
+					else if(c.type == 'Q')
+						f << "," << static_cast<uint64_t>(v);
+					else
+						f << "," << v;
+				}
+				f << "\n";
+			}
+		}
+	}
+	if(!f)
+		throw std::runtime_error("Can't write '" + filename + "'");
+}
+
+void ram_recorder::export_binary(const std::string& filename)
+{
+	std::ofstream f(filename, std::ios::binary);
+	if(!f)
+		throw std::runtime_error("Can't open '" + filename + "' for writing");
+	f.write("lsnesram", 8);
+	write_u32(f, columns.size());
+	write_u64(f, samples);
+	for(auto& i : columns) {
+		write_u32(f, i.name.length());
+		f.write(i.name.c_str(), i.name.length());
+		write_u64(f, i.addr);
+		f.put(i.type);
+	}
+	for(auto& i : find_ranges(0, 0xFFFFFFFFFFFFFFFFULL))
+		for(uint64_t j = 0; j < i.count; j++)
+			write_u64(f, i.frame + j);
+	std::vector<int64_t> buf(column_log::block_size);
+	for(auto& c : columns)
+		for(uint64_t j = 0; j < samples; j += buf.size()) {
+			uint64_t n = min((uint64_t)buf.size(), samples - j);
+			c.log.read(j, n, &buf[0]);
+			for(uint64_t l = 0; l < n; l++)
+				write_u64(f, buf[l]);
+		}
+	if(!f)
+		throw std::runtime_error("Can't write '" + filename + "'");
+}
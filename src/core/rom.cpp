@@ -149,39 +149,54 @@ std::map<std::string, std::vector<char>> load_sram_commandline(const std::vector
 std::vector<char> loaded_rom::save_core_state(bool nochecksum) throw(std::bad_alloc, std::runtime_error)
 {
 	std::vector<char> ret;
-	rtype().serialize(ret);
+	save_core_state(ret, nochecksum);
+	return ret;
+}
+
+void loaded_rom::save_core_state(std::vector<char>& out, bool nochecksum) throw(std::bad_alloc,
+	std::runtime_error)
+{
+	//Reserve room for checksum too, so appending it does not reallocate.
+	size_t hint = rtype().serialize_size_hint();
+	if(hint)
+		out.reserve(hint + 32);
+	rtype().serialize(out);
 	if(nochecksum)
-		return ret;
-	size_t offset = ret.size();
+		return;
+	size_t offset = out.size();
 	unsigned char tmp[32];
 #ifdef USE_LIBGCRYPT_SHA256
-	gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &ret[0], offset);
+	gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &out[0], offset);
 #else
-	sha256::hash(tmp, ret);
+	sha256::hash(tmp, out);
 #endif
-	ret.resize(offset + 32);
-	memcpy(&ret[offset], tmp, 32);
-	return ret;
+	out.resize(offset + 32);
+	memcpy(&out[offset], tmp, 32);
 }
 
 void loaded_rom::load_core_state(const std::vector<char>& buf, bool nochecksum) throw(std::runtime_error)
+{
+	load_core_state(&buf[0], buf.size(), nochecksum);
+}
+
+void loaded_rom::load_core_state(const char* buf, size_t size, bool nochecksum) throw(std::runtime_error)
 {
 	if(nochecksum) {
-		rtype().unserialize(&buf[0], buf.size());
+		rtype().unserialize(buf, size);
 		return;
 	}
 
-	if(buf.size() < 32)
+	if(size < 32)
 		throw std::runtime_error("Savestate corrupt");
 	if(!savestate_no_check(*CORE().settings)) {
 		unsigned char tmp[32];
 #ifdef USE_LIBGCRYPT_SHA256
-		gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, &buf[0], buf.size() - 32);
+		gcry_md_hash_buffer(GCRY_MD_SHA256, tmp, buf, size - 32);
 #else
-		sha256::hash(tmp, reinterpret_cast<const uint8_t*>(&buf[0]), buf.size() - 32);
+		sha256::hash(tmp, reinterpret_cast<const uint8_t*>(buf), size - 32);
 #endif
-		if(memcmp(tmp, &buf[buf.size() - 32], 32))
+		if(memcmp(tmp, buf + size - 32, 32))
 			throw std::runtime_error("Savestate corrupt");
 	}
-	rtype().unserialize(&buf[0], buf.size() - 32);
+	rtype().unserialize(buf, size - 32);
 }
@@ -1,4 +1,5 @@
 #include "core/instance.hpp"
+#include "core/romimage.hpp"
 #include "core/rom.hpp"
 #include "core/settings.hpp"
 #include "core/window.hpp"
@@ -11,81 +12,69 @@
 namespace
 {
 	bool db_loaded;
-	std::map<std::pair<std::string, uint64_t>, std::string> our_db;
-	std::string database_name()
+
+	fileimage::hashindex& our_db()
 	{
-		return get_config_path() + "/rom.db";
+		return lsnes_image_hasher.get_index();
 	}
 
-	void load_db()
+	void rescan_hint_dir(const std::string& dir, const std::map<std::string, uint64_t>& headersizes)
 	{
-		std::ifstream db(database_name());
-		if(db) {
-			std::string line;
-			while(std::getline(db, line)) {
-				istrip_CR(line);
-				size_t split = line.find_first_of("|");
-				if(split >= line.length())
-					continue;
-				std::string hash = line.substr(0, split);
-				std::string filename = line.substr(split + 1);
-				uint64_t prefix = 0;
-				size_t split2 = hash.find_first_of(":");
-				if(split2 < hash.length()) {
-					std::string _prefix = hash.substr(split2 + 1);
-					hash = hash.substr(0, split2);
-					try { prefix = parse_value<uint64_t>(_prefix); } catch(...) {};
-				}
-				if(hash != "") {
-					our_db[std::make_pair(filename, prefix)] = hash;
-				} else {
-					our_db.erase(std::make_pair(filename, prefix));
-				}
+		std::set<std::string> files;
+		try {
+			files = directory::enumerate(dir, ".*");
+		} catch(...) {
+			return;
+		}
+		for(auto& i : files) {
+			size_t split = i.find_last_of(".");
+			if(split >= i.length())
+				continue;
+			std::string ext = i.substr(split + 1);
+			if(ext == "xml") {
+				lsnes_image_hasher.prefetch(i, fileimage::std_headersize_fn(0));
+				continue;
 			}
+			auto h = headersizes.find(ext);
+			if(h == headersizes.end() || !directory::is_regular(i))
+				continue;
+			lsnes_image_hasher.prefetch(i, fileimage::std_headersize_fn(h->second));
 		}
+	}
+
+	void load_db()
+	{
+		auto& core = CORE();
 		db_loaded = true;
+		open_rom_hash_index();
+		//Hash new and changed files in hint directories in background, so later guesses hit the index.
+		std::map<std::string, uint64_t> headersizes;
+		for(auto i : core_type::get_core_types())
+			for(unsigned j = 0; j < i->get_image_count(); j++)
+				for(auto k : i->get_image_info(j).extensions)
+					headersizes[k] = i->get_image_info(j).headersize;
+		rescan_hint_dir(SET_rompath(*core.settings), headersizes);
+		rescan_hint_dir(SET_firmwarepath(*core.settings), headersizes);
 	}
 
-	void record_hash(const std::string& _file, uint64_t prefix, const std::string& hash)
+	void record_hash(const std::string& file, uint64_t prefix, const std::string& hash)
 	{
 		if(!db_loaded) load_db();
 		//Database write. If there is existing entry for file, it is overwritten.
-		std::string file = directory::absolute_path(_file);
-		std::pair<std::string, uint64_t> key = std::make_pair(file, prefix);
-		if(hash == "" && !our_db.count(key))
-			return;		//Already correct.
-		if(our_db.count(key) && our_db[key] == hash)
-			return;		//Already correct.
-		if(hash != "")
-			our_db[key] = hash;
-		else
-			our_db.erase(key);
-		std::ofstream db(database_name(), std::ios::app);
-		db << hash << ":" << prefix << "|" << file << std::endl;
+		our_db().store(file, prefix, hash);
 	}
 
-	void record_hash_deleted(const std::string& _file)
+	void record_hash_deleted(const std::string& file)
 	{
 		if(!db_loaded) load_db();
-		auto itr = our_db.begin();
-		while(true) {
-			itr = our_db.lower_bound(std::make_pair(_file, 0));
-			if(itr == our_db.end() || itr->first.first != _file)
-				return;
-			record_hash(_file, itr->first.second, "");
-		}
+		our_db().forget(file);
 	}
 
 	std::list<std::pair<std::string, uint64_t>> retretive_files_by_hash(const std::string& hash)
 	{
 		if(!db_loaded) load_db();
 		//Database read. The read is for keys with given value.
-		std::list<std::pair<std::string, uint64_t>> x;
-		for(auto i : our_db)
-			if(i.second == hash) {
-				x.push_back(i.first);
-			}
-		return x;
+		return our_db().files_by_hash(hash);
 	}
 
 	std::string hash_file(const std::string& file, uint64_t hsize)
@@ -197,6 +186,18 @@ void try_guess_roms(rom_request& req)
 	}
 }
 
+void open_rom_hash_index()
+{
+	if(our_db().has_backing_file())
+		return;
+	std::string index_name = get_config_path() + "/rom.idx";
+	std::string legacy_name = get_config_path() + "/rom.db";
+	bool fresh = !directory::exists(index_name);
+	our_db().set_backing_file(index_name);
+	if(fresh && directory::exists(legacy_name))
+		our_db().import_legacy(legacy_name);
+}
+
 void record_filehash(const std::string& file, uint64_t prefix, const std::string& hash)
 {
 	record_hash(file, prefix, hash);
@@ -340,9 +340,10 @@ void rom_image::load_bundle(const std::string& file, std::istream& spec, const s
 	//Load ROMs.
 	for(size_t i = 0; i < rtype->get_image_count(); i++) {
 		romimg[i] = fileimage::image(lsnes_image_hasher, cromimg[i], file,
-			xlate_info(rtype->get_image_info(i)));
-		romxml[i] = fileimage::image(lsnes_image_hasher, cromxml[i], file, get_xml_info());
+			xlate_info(rtype->get_image_info(i)), true);
+		romxml[i] = fileimage::image(lsnes_image_hasher, cromxml[i], file, get_xml_info(), true);
 	}
+	hash_loaded_images();
 	record_files(*this);	//Have to do this before patching.
 
 	//Patch ROMs.
@@ -448,10 +449,12 @@ rom_image::rom_image(const std::string file[ROM_SLOT_COUNT], const std::string&
 		if(file[i] != "")
 			pmand |= t->get_image_info(i).mandatory;
 		tmand |= t->get_image_info(i).mandatory;
-		romimg[i] = fileimage::image(lsnes_image_hasher, file[i], "", xlate_info(t->get_image_info(i)));
+		romimg[i] = fileimage::image(lsnes_image_hasher, file[i], "", xlate_info(t->get_image_info(i)),
+			true);
 		if(zip::file_exists(file[i] + ".xml"))
-			romxml[i] = fileimage::image(lsnes_image_hasher, file[i] + ".xml", "", get_xml_info());
+			romxml[i] = fileimage::image(lsnes_image_hasher, file[i] + ".xml", "", get_xml_info(), true);
 	}
+	hash_loaded_images();
 	msu1_base = zip::resolverel(file[romidx], "");
 	record_files(*this);
 	if(pmand != tmand)
@@ -482,6 +485,16 @@ rom_image::~rom_image()
 {
 }
 
+void rom_image::hash_loaded_images()
+{
+	fileimage::image* images[2 * ROM_SLOT_COUNT];
+	for(unsigned i = 0; i < ROM_SLOT_COUNT; i++) {
+		images[2 * i] = &romimg[i];
+		images[2 * i + 1] = &romxml[i];
+	}
+	fileimage::image::hash_deferred(images, 2 * ROM_SLOT_COUNT);
+}
+
 void rom_image::account_images()
 {
 	//Hack: don't account any size before main.
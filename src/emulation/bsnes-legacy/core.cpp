@@ -1226,6 +1226,9 @@ namespace
 			out.resize(s.size());
 			memcpy(&out[0], s.data(), s.size());
 		}
+		size_t c_serialize_size_hint() {
+			return internal_rom ? SNES::system.serialize_size : 0;
+		}
 		void c_unserialize(const char* in, size_t insize) {
 			if(!internal_rom)
 				throw std::runtime_error("No ROM loaded");
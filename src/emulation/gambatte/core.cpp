@@ -73,6 +73,8 @@ namespace
 	unsigned frame_overflow = 0;
 	std::vector<unsigned char> romdata;
 	std::vector<char> init_savestate;
+	std::vector<char> loadstate_buffer;
+	size_t last_savestate_size = 0;
 	uint32_t cover_fbmem[480 * 432];
 	uint32_t primary_framebuffer[160*144];
 	uint32_t accumulator_l = 0;
@@ -611,16 +613,17 @@ namespace
 				serialization::u32b(&out[osize + 4 * i], primary_framebuffer[i]);
 			out.push_back(frame_overflow >> 8);
 			out.push_back(frame_overflow);
+			last_savestate_size = out.size();
 		}
+		size_t c_serialize_size_hint() { return last_savestate_size; }
 		void c_unserialize(const char* in, size_t insize) {
 			if(!internal_rom)
 				throw std::runtime_error("Can't load without ROM");
 			size_t foffset = insize - 2 - 4 * sizeof(primary_framebuffer) /
 				sizeof(primary_framebuffer[0]);
-			std::vector<char> tmp;
-			tmp.resize(foffset);
-			memcpy(&tmp[0], in, foffset);
-			instance->loadState(tmp);
+			//libgambatte only loads from vector. Reuse the buffer so loads do not allocate.
+			loadstate_buffer.assign(in, in + foffset);
+			instance->loadState(loadstate_buffer);
 			for(size_t i = 0; i < sizeof(primary_framebuffer) / sizeof(primary_framebuffer[0]); i++)
 				primary_framebuffer[i] = serialization::u32b(&in[foffset + 4 * i]);
 
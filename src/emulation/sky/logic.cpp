@@ -296,18 +296,18 @@ namespace sky
 		return state_level_fadein;
 	}
 
-	uint8_t do_level_play(struct instance& inst, uint16_t b)
+	uint8_t level_play_logic(struct gstate& state, noise_maker& sfx, uint16_t b, bool& simulated)
 	{
-		inst.indirect_flag = false;
+		simulated = false;
 		//Handle demo.
-		b = inst.state.curdemo.fetchkeys(b, inst.state.p.lpos, inst.state.p.framecounter);
+		b = state.curdemo.fetchkeys(b, state.p.lpos, state.p.framecounter);
 		if((b & 96) == 96) {
-			inst.state.p.death = physics::death_escaped;
+			state.p.death = physics::death_escaped;
 			return state_level_fadeout;
 		}
-		if((b & ~inst.state.lastkeys) & 32)
-			inst.state.paused = inst.state.paused ? 0 : 1;
-		if(inst.state.paused)
+		if((b & ~state.lastkeys) & 32)
+			state.paused = state.paused ? 0 : 1;
+		if(state.paused)
 			return state_level_play;
 		int lr = 0, ad = 0;
 		bool jump = ((b & 16) != 0);
@@ -317,13 +317,10 @@ namespace sky
 		if((b & 8) != 0) ad--;
 		if((b & 256) != 0) lr = 2;	//Cheat for demo.
 		if((b & 512) != 0) ad = 2;	//Cheat for demo.
-		uint8_t death = inst.state.simulate_frame(inst.gsfx, lr, ad, jump);
-		if(!inst.state.p.death && inst.state.waited < 65535)
-			inst.state.waited++;
-		draw_level(inst);
-		if(inst.state.timeattack)
-			draw_timeattack_time(inst, inst.state.waited);
-		draw_gauges(inst);
+		uint8_t death = state.simulate_frame(sfx, lr, ad, jump);
+		if(!state.p.death && state.waited < 65535)
+			state.waited++;
+		simulated = true;
 		if(death == physics::death_finished)
 			return state_level_complete;
 		else if(death)
@@ -332,6 +329,23 @@ namespace sky
 			return state_level_play;
 	}
 
+	uint8_t do_level_play(struct instance& inst, uint16_t b)
+	{
+		bool simulated;
+		inst.indirect_flag = false;
+		uint8_t newstate = level_play_logic(inst.state, inst.gsfx, b, simulated);
+		if(!simulated)
+			return newstate;
+		if(!inst.skip_output) {
+			draw_level(inst);
+			if(inst.state.timeattack)
+				draw_timeattack_time(inst, inst.state.waited);
+		}
+		//Gauges keep indicator state in game state, so these can't be skipped.
+		draw_gauges(inst);
+		return newstate;
+	}
+
 	uint8_t do_lockup(struct instance& inst, uint16_t b)
 	{
 		inst.mplayer.set_song(NULL);
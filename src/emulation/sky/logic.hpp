@@ -12,5 +12,7 @@ namespace sky
 	bool simulate_needs_input(struct instance& inst);
 	void rom_boot_vector(struct instance& inst);
 	void handle_loadstate(struct instance& inst);
+	//Gameplay part of level play frame, without drawing. Does not touch rng, frames_ran or lastkeys.
+	uint8_t level_play_logic(struct gstate& state, noise_maker& sfx, uint16_t b, bool& simulated);
 }
 #endif
@@ -0,0 +1,236 @@
+#include "search.hpp"
+#include "logic.hpp"
+#include "library/minmax.hpp"
+#include "library/threads-pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace sky
+{
+	namespace
+	{
+		struct null_noise_maker : public noise_maker
+		{
+			~null_noise_maker() {}
+			void operator()(int sound, bool hipri = true) {}
+		};
+
+		struct search_node
+		{
+			search_state s;
+			uint32_t parent;
+			uint16_t input;
+			double score;
+		};
+
+		struct search_worker
+		{
+			//Level data and demo are only read, so one scratch copy per worker is enough.
+			gstate scratch;
+			const std::vector<search_node>* frontier;
+			const std::vector<uint16_t>* inputs;
+			size_t first;
+			size_t last;
+			std::vector<search_node> out;
+			std::unordered_set<uint64_t> seen;
+			uint64_t duplicates;
+			void run();
+		};
+
+		void search_worker::run()
+		{
+			null_noise_maker sfx;
+			out.clear();
+			seen.clear();
+			duplicates = 0;
+			for(size_t i = first; i < last; i++) {
+				for(auto b : *inputs) {
+					search_node n;
+					bool simulated;
+					(*frontier)[i].s.store(scratch);
+					//Same as simulate_frame() for level play, except no drawing or sound.
+					uint8_t newstate = level_play_logic(scratch, sfx, b, simulated);
+					if(newstate != scratch.state)
+						scratch.change_state(newstate);
+					scratch.lastkeys = b;
+					n.s.load(scratch);
+					if(!seen.insert(n.s.hash()).second) {
+						duplicates++;
+						continue;
+					}
+					n.parent = i;
+					n.input = b;
+					n.score = 0;
+					out.push_back(n);
+				}
+			}
+		}
+
+		double default_objective(const search_state& s)
+		{
+			return s.p.lpos;
+		}
+
+		bool better(const search_node& a, const search_node& b)
+		{
+			return (a.score > b.score);
+		}
+	}
+
+	void search_state::load(const gstate& s)
+	{
+		p = s.p;
+		waited = s.waited;
+		paused = s.paused;
+		lastkeys = s.lastkeys;
+		secret = s.secret;
+		state = s.state;
+	}
+
+	void search_state::store(gstate& s) const
+	{
+		s.p = p;
+		s.waited = waited;
+		s.paused = paused;
+		s.lastkeys = lastkeys;
+		s.secret = secret;
+		s.state = state;
+	}
+
+	uint64_t search_state::hash() const
+	{
+		//Only the pause key of last keys matters for future frames.
+		unsigned char buf[sizeof(physics) + 6];
+		memcpy(buf, &p, sizeof(physics));
+		buf[sizeof(physics) + 0] = waited;
+		buf[sizeof(physics) + 1] = waited >> 8;
+		buf[sizeof(physics) + 2] = paused;
+		buf[sizeof(physics) + 3] = lastkeys & 32;
+		buf[sizeof(physics) + 4] = secret;
+		buf[sizeof(physics) + 5] = state;
+		//FNV-1a.
+		uint64_t h = 0xCBF29CE484222325ULL;
+		for(size_t i = 0; i < sizeof(buf); i++) {
+			h ^= buf[i];
+			h *= 0x100000001B3ULL;
+		}
+		return h;
+	}
+
+	search_params::search_params()
+	{
+		frames = 60;
+		width = 4096;
+		threads = 0;
+		mask = 31;
+	}
+
+	search_result search_inputs(const gstate& start, const search_params& params)
+	{
+		if(start.state != state_level_play)
+			throw std::runtime_error("Not playing a level");
+		if(!params.width)
+			throw std::runtime_error("Search width must be positive");
+		std::function<double(const search_state& s)> objective = params.objective ? params.objective :
+			default_objective;
+		std::vector<uint16_t> inputs;
+		for(uint16_t b = 0; b < 128; b++)
+			if((b & params.mask) == b)
+				inputs.push_back(b);
+		unsigned nthreads = params.threads;
+		if(!nthreads)
+			nthreads = max(min(threads::thread::hardware_concurrency(), 8U), 1U);
+
+		search_result r;
+		r.score = 0;
+		r.finished = false;
+		r.expanded = 0;
+		r.duplicates = 0;
+		//history[i][j] is (parent index, input) of j:th state after i + 1 frames.
+		std::vector<std::vector<std::pair<uint32_t, uint16_t>>> history;
+		std::vector<search_node> frontier(1);
+		frontier[0].s.load(start);
+		frontier[0].score = objective(frontier[0].s);
+		size_t best = 0;
+		r.score = frontier[0].score;
+
+		std::vector<search_worker> workers(nthreads);
+		for(auto& w : workers)
+			w.scratch = start;
+		for(unsigned f = 0; f < params.frames && !r.finished; f++) {
+			size_t nworkers = min((size_t)nthreads, frontier.size());
+			size_t per = (frontier.size() + nworkers - 1) / nworkers;
+			for(size_t i = 0; i < nworkers; i++) {
+				workers[i].frontier = &frontier;
+				workers[i].inputs = &inputs;
+				workers[i].first = min(i * per, frontier.size());
+				workers[i].last = min((i + 1) * per, frontier.size());
+			}
+			threads::pool::global().parallel_for(0, nworkers, [&workers](size_t lo, size_t hi) {
+				for(size_t i = lo; i < hi; i++)
+					workers[i].run();
+			}, 1, nworkers);
+			r.expanded += frontier.size() * inputs.size();
+
+			//Merge the results, dropping states reached by some other worker and dead ends.
+			std::unordered_set<uint64_t> seen;
+			std::vector<search_node> next;
+			for(size_t i = 0; i < nworkers && !r.finished; i++) {
+				r.duplicates += workers[i].duplicates;
+				for(auto& n : workers[i].out) {
+					if(n.s.state == state_level_complete) {
+						//Finishing beats everything, and nothing can finish earlier.
+						next.clear();
+						next.push_back(n);
+						r.finished = true;
+						break;
+					}
+					if(n.s.state != state_level_play)
+						continue;
+					if(!seen.insert(n.s.hash()).second) {
+						r.duplicates++;
+						continue;
+					}
+					next.push_back(n);
+				}
+			}
+			if(next.empty())
+				break;
+			for(auto& n : next)
+				n.score = objective(n.s);
+			if(next.size() > params.width) {
+				std::nth_element(next.begin(), next.begin() + params.width, next.end(), better);
+				next.resize(params.width);
+			}
+			history.push_back(std::vector<std::pair<uint32_t, uint16_t>>());
+			auto& h = history.back();
+			h.reserve(next.size());
+			best = 0;
+			for(size_t i = 0; i < next.size(); i++) {
+				h.push_back(std::make_pair(next[i].parent, next[i].input));
+				if(next[i].score > next[best].score)
+					best = i;
+			}
+			r.score = next[best].score;
+			frontier.swap(next);
+		}
+
+		r.inputs.resize(history.size());
+		for(size_t i = history.size(); i > 0; i--) {
+			r.inputs[i - 1] = history[i - 1][best].second;
+			best = history[i - 1][best].first;
+		}
+		return r;
+	}
+
+	std::string search_input_string(uint16_t b)
+	{
+		const char* names = "LRADJSs";
+		std::string x;
+		for(unsigned i = 0; i < 7; i++)
+			x.push_back(((b >> i) & 1) ? names[i] : '.');
+		return x;
+	}
+}
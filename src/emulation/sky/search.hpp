@@ -0,0 +1,52 @@
+#ifndef _skycore__search__hpp__included__
+#define _skycore__search__hpp__included__
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "state.hpp"
+
+namespace sky
+{
+	//The part of game state that level play can change. Everything else in gstate is either constant over
+	//level (level data, demo) or does not affect gameplay (rng, sound and music state).
+	struct search_state
+	{
+		physics p;
+		uint16_t waited;
+		uint8_t paused;
+		uint8_t lastkeys;
+		uint8_t secret;
+		uint8_t state;
+		void load(const gstate& s);
+		void store(gstate& s) const;
+		uint64_t hash() const;
+	};
+
+	struct search_params
+	{
+		search_params();
+		unsigned frames;		//Number of frames to search.
+		unsigned width;			//Number of best states kept after each frame.
+		unsigned threads;		//Number of worker threads (0 => automatic).
+		uint16_t mask;			//Buttons that may be pressed (bits as in simulate_frame).
+		//Objective to maximize. Always called from the thread doing the search. If not set, distance is used.
+		std::function<double(const search_state& s)> objective;
+	};
+
+	struct search_result
+	{
+		std::vector<uint16_t> inputs;	//Best input sequence found.
+		double score;			//Objective of final state.
+		bool finished;			//Input sequence finishes the level.
+		uint64_t expanded;		//Number of states simulated.
+		uint64_t duplicates;		//Number of states dropped as already seen.
+	};
+
+	//Search input sequences from level play state start. Throws if not playing a level.
+	search_result search_inputs(const gstate& start, const search_params& params);
+	//Format input as controller buttons, e.g. "LR..J..".
+	std::string search_input_string(uint16_t b);
+}
+#endif
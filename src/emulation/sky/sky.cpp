@@ -3,14 +3,17 @@
 #include "framebuffer.hpp"
 #include "instance.hpp"
 #include "logic.hpp"
+#include "search.hpp"
 #include "demo.hpp"
 #include "core/dispatch.hpp"
 #include "core/audioapi.hpp"
 #include "core/instance.hpp"
+#include "core/command.hpp"
 #include "core/messages.hpp"
 #include "interface/romtype.hpp"
 #include "interface/callbacks.hpp"
 #include "library/framebuffer-pixfmt-rgb32.hpp"
+#include "lua/internal.hpp"
 
 namespace sky
 {
@@ -234,6 +237,43 @@ namespace sky
 		}
 	}
 
+	void emulate_frame(bool skip_output)
+	{
+		uint16_t x = 0;
+		if(simulate_needs_input(corei)) {
+			for(unsigned i = 0; i < 7; i++)
+				if(ecore_callbacks->get_input(0, 1, iindexes[cstyle][i]))
+					x |= (1 << i);
+			pflag = true;
+		}
+		corei.skip_output = skip_output;
+		simulate_frame(corei, x);
+		corei.skip_output = false;
+		uint32_t* fb = corei.get_framebuffer();
+		framebuffer::info inf;
+		inf.type = &framebuffer::pixfmt_rgb32;
+		inf.mem = reinterpret_cast<char*>(fb);
+		inf.physwidth = FB_WIDTH;
+		inf.physheight = FB_HEIGHT;
+		inf.physstride = 4 * FB_WIDTH;
+		inf.width = FB_WIDTH;
+		inf.height = FB_HEIGHT;
+		inf.stride = 4 * FB_WIDTH;
+		inf.offset_x = 0;
+		inf.offset_y = 0;
+
+		framebuffer::raw ls(inf);
+		ecore_callbacks->output_frame(ls, 656250, 18227);
+		ecore_callbacks->timer_tick(18227, 656250);
+		size_t samples = 1333;
+		samples += corei.extrasamples();
+		int16_t sbuf[2668];
+		//Sound effect and music state is saved, so these need to be generated anyway.
+		fetch_sfx(corei, sbuf, samples);
+		if(!skip_output)
+			CORE().audio->submit_buffer(sbuf, samples, true, 48000);
+	}
+
 	struct _sky_core : public core_core, public core_type, public core_region, public core_sysregion
 	{
 		_sky_core()
@@ -285,6 +325,7 @@ namespace sky
 			out.resize(wram.second);
 			memcpy(&out[0], wram.first, wram.second);
 		}
+		size_t c_serialize_size_hint() { return corei.state.as_ram().second; }
 		void c_unserialize(const char* in, size_t insize) {
 			auto wram = corei.state.as_ram();
 			if(insize != wram.second)
@@ -300,37 +341,9 @@ namespace sky
 		}
 		void c_install_handler() {}
 		void c_uninstall_handler() {}
-		void c_emulate() {
-			uint16_t x = 0;
-			if(simulate_needs_input(corei)) {
-				for(unsigned i = 0; i < 7; i++)
-					if(ecore_callbacks->get_input(0, 1, iindexes[cstyle][i]))
-						x |= (1 << i);
-				pflag = true;
-			}
-			simulate_frame(corei, x);
-			uint32_t* fb = corei.get_framebuffer();
-			framebuffer::info inf;
-			inf.type = &framebuffer::pixfmt_rgb32;
-			inf.mem = reinterpret_cast<char*>(fb);
-			inf.physwidth = FB_WIDTH;
-			inf.physheight = FB_HEIGHT;
-			inf.physstride = 4 * FB_WIDTH;
-			inf.width = FB_WIDTH;
-			inf.height = FB_HEIGHT;
-			inf.stride = 4 * FB_WIDTH;
-			inf.offset_x = 0;
-			inf.offset_y = 0;
-
-			framebuffer::raw ls(inf);
-			ecore_callbacks->output_frame(ls, 656250, 18227);
-			ecore_callbacks->timer_tick(18227, 656250);
-			size_t samples = 1333;
-			samples += corei.extrasamples();
-			int16_t sbuf[2668];
-			fetch_sfx(corei, sbuf, samples);
-			CORE().audio->submit_buffer(sbuf, samples, true, 48000);
-		}
+		void c_emulate() { emulate_frame(false); }
+		bool c_can_skip_output() { return true; }
+		void c_emulate_skip_output() { emulate_frame(true); }
 		void c_runtosave() {}
 		bool c_get_pflag() { return pflag; }
 		void c_set_pflag(bool _pflag) { pflag = _pflag; }
@@ -427,4 +440,86 @@ namespace sky
 			rom_boot_vector(corei);
 		}
 	} sky_core;
+
+	void print_search_result(const search_result& r)
+	{
+		messages << "Simulated " << r.expanded << " states (" << r.duplicates << " duplicates), score "
+			<< r.score << (r.finished ? ", level finished" : "") << std::endl;
+		for(size_t i = 0; i < r.inputs.size();) {
+			size_t j = i;
+			while(j < r.inputs.size() && r.inputs[j] == r.inputs[i])
+				j++;
+			messages << (j - i) << "x " << search_input_string(r.inputs[i]) << std::endl;
+			i = j;
+		}
+	}
+
+	command::fnptr<const std::string&> sky_search(lsnes_cmds, "sky-search", "Search inputs maximizing distance",
+		"Syntax: sky-search <frames> [<width> [<threads>]]\nSearch inputs for next <frames> frames, keeping <width>"
+		" best states\nafter each frame.\n",
+		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
+			regex_results r = regex("([0-9]+)([ \t]+([0-9]+)([ \t]+([0-9]+))?)?[ \t]*", args,
+				"Syntax: sky-search <frames> [<width> [<threads>]]");
+			search_params p;
+			p.frames = parse_value<unsigned>(r[1]);
+			if(r[3] != "") p.width = parse_value<unsigned>(r[3]);
+			if(r[5] != "") p.threads = parse_value<unsigned>(r[5]);
+			print_search_result(search_inputs(corei.state, p));
+		});
+
+	int lua_search(lua::state& L, lua::parameters& P)
+	{
+		search_params p;
+		int lfn = 0;
+
+		P(p.frames, P.optional(p.width, p.width), P.optional(p.mask, p.mask));
+		if(P.is_function())
+			P(P.function(lfn));
+		else if(!P.is_novalue())
+			P.expected("function or nil");
+		if(lfn) {
+			//Lua is not thread-safe, so the search calls this from this thread only.
+			p.objective = [&L, lfn](const search_state& s) -> double {
+				L.pushvalue(lfn);
+				L.newtable();
+				const std::pair<const char*, double> fields[] = {
+					std::make_pair("lpos", s.p.lpos), std::make_pair("hpos", s.p.hpos),
+					std::make_pair("vpos", s.p.vpos), std::make_pair("lspeed", s.p.lspeed),
+					std::make_pair("hspeed", s.p.hspeed), std::make_pair("vspeed", s.p.vspeed),
+					std::make_pair("fuel", s.p.fuel_left), std::make_pair("o2", s.p.o2_left),
+					std::make_pair("flags", s.p.flags), std::make_pair("death", s.p.death),
+					std::make_pair("waited", s.waited), std::make_pair("secret", s.secret),
+				};
+				for(auto& i : fields) {
+					L.pushstring(i.first);
+					L.pushnumber(i.second);
+					L.settable(-3);
+				}
+				int r = L.pcall(1, 1, 0);
+				if(r) {
+					std::string err = (r == LUA_ERRRUN) ? L.get_string(-1, "sky.search") :
+						"Error in objective function";
+					L.pop(1);
+					throw std::runtime_error(err);
+				}
+				double score = L.isnumber(-1) ? L.tonumber(-1) : 0;
+				L.pop(1);
+				return score;
+			};
+		}
+		search_result r = search_inputs(corei.state, p);
+		L.newtable();
+		for(size_t i = 0; i < r.inputs.size(); i++) {
+			L.pushnumber(i + 1);
+			L.pushnumber(r.inputs[i]);
+			L.settable(-3);
+		}
+		L.pushnumber(r.score);
+		L.pushboolean(r.finished);
+		return 3;
+	}
+
+	lua::functions search_fns_sky(lua_func_misc, "sky", {
+		{"search", lua_search},
+	});
 }
@@ -1,8 +1,7 @@
 #include "library/framebuffer.hpp"
 
-#include <cstring>
-
-extern const char* font_hex_data;
+extern const uint32_t font_bin_data[];
+extern const size_t font_bin_data_words;
 framebuffer::font main_font;
 
 void do_init_font()
@@ -10,6 +9,7 @@ void do_init_font()
 	static bool flag = false;
 	if(flag)
 		return;
-	main_font.load_hex(font_hex_data, strlen(font_hex_data));
+	//The font is precompiled, so this only sets up pointers into it.
+	main_font.load_binary(font_bin_data, font_bin_data_words);
 	flag = true;
 }
@@ -2,6 +2,7 @@
 #include "interface/romtype.hpp"
 #include "interface/callbacks.hpp"
 #include "library/minmax.hpp"
+#include "library/perfscope.hpp"
 #include "library/string.hpp"
 #include <set>
 #include <map>
@@ -16,6 +17,7 @@ thread_local const loadlib::module* module_loading;
 
 namespace
 {
+	perfscope::region perf_emulate("core.emulate");
 	void mark_against_loading(const void* obj)
 	{
 		auto i = module_loading;
@@ -330,6 +332,21 @@ bool core_core::c_isnull() const
 	return false;
 }
 
+size_t core_core::c_serialize_size_hint()
+{
+	return 0;
+}
+
+bool core_core::c_can_skip_output()
+{
+	return false;
+}
+
+void core_core::c_emulate_skip_output()
+{
+	c_emulate();
+}
+
 core_sysregion::core_sysregion(const std::string& _name, core_type& _type, core_region& _region)
 	: name(_name), type(_type), region(_region)
 {
@@ -478,6 +495,11 @@ void core_core::unserialize(const char* in, size_t insize)
 	c_unserialize(in, insize);
 }
 
+size_t core_core::serialize_size_hint()
+{
+	return c_serialize_size_hint();
+}
+
 core_region& core_core::get_region()
 {
 	return c_get_region();
@@ -508,9 +530,18 @@ void core_core::uninstall_handler()
 	c_uninstall_handler();
 }
 
-void core_core::emulate()
+void core_core::emulate(bool skip_output)
 {
-	c_emulate();
+	perfscope::scope t(perf_emulate);
+	if(skip_output && c_can_skip_output())
+		c_emulate_skip_output();
+	else
+		c_emulate();
+}
+
+bool core_core::can_skip_output()
+{
+	return c_can_skip_output();
 }
 
 void core_core::runtosave()
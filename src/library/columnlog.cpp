@@ -0,0 +1,107 @@
+#include "columnlog.hpp"
+#include "minmax.hpp"
+
+namespace
+{
+	inline uint64_t zigzag(int64_t v)
+	{
+		return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+	}
+
+	inline int64_t unzigzag(uint64_t v)
+	{
+		return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+	}
+
+	inline size_t read_varint(const std::vector<uint8_t>& data, size_t pos, uint64_t& v)
+	{
+		v = 0;
+		unsigned shift = 0;
+		while(pos < data.size()) {
+			uint8_t b = data[pos++];
+			v |= static_cast<uint64_t>(b & 0x7F) << shift;
+			if(!(b & 0x80))
+				break;
+			shift += 7;
+		}
+		return pos;
+	}
+}
+
+column_log::column_log() throw()
+{
+	count = 0;
+	last = 0;
+}
+
+void column_log::append(int64_t value) throw(std::bad_alloc)
+{
+	if(count % block_size == 0) {
+		blocks.push_back(data.size());
+		last = 0;
+	}
+	//Differences wrap, so the full range of values works.
+	uint64_t d = zigzag(static_cast<int64_t>(static_cast<uint64_t>(value) - static_cast<uint64_t>(last)));
+	while(d >= 0x80) {
+		data.push_back(0x80 | (d & 0x7F));
+		d >>= 7;
+	}
+	data.push_back(d);
+	last = value;
+	count++;
+}
+
+size_t column_log::skip(size_t pos, uint64_t n, int64_t& value) const throw()
+{
+	for(uint64_t i = 0; i < n; i++) {
+		uint64_t d;
+		pos = read_varint(data, pos, d);
+		value = static_cast<int64_t>(static_cast<uint64_t>(value) + static_cast<uint64_t>(unzigzag(d)));
+	}
+	return pos;
+}
+
+void column_log::read(uint64_t first, uint64_t n, int64_t* out) const throw()
+{
+	uint64_t avail = (first < count) ? min(n, count - first) : 0;
+	if(avail) {
+		uint64_t b = first / block_size;
+		int64_t value = 0;
+		size_t pos = skip(blocks[b], first % block_size, value);
+		for(uint64_t i = 0; i < avail; i++) {
+			if((first + i) % block_size == 0) {
+				pos = blocks[(first + i) / block_size];
+				value = 0;
+			}
+			pos = skip(pos, 1, value);
+			out[i] = value;
+		}
+	}
+	for(uint64_t i = avail; i < n; i++)
+		out[i] = 0;
+}
+
+void column_log::truncate(uint64_t n) throw()
+{
+	if(n >= count)
+		return;
+	if(!n) {
+		clear();
+		return;
+	}
+	uint64_t b = (n - 1) / block_size;
+	int64_t value = 0;
+	size_t pos = skip(blocks[b], (n - 1) % block_size + 1, value);
+	data.resize(pos);
+	blocks.resize(b + 1);
+	count = n;
+	last = value;
+}
+
+void column_log::clear() throw()
+{
+	data.clear();
+	blocks.clear();
+	count = 0;
+	last = 0;
+}
@@ -0,0 +1,214 @@
+#include "fileimage-hashindex.hpp"
+#include "directory.hpp"
+#include "string.hpp"
+#include <fstream>
+
+namespace fileimage
+{
+namespace
+{
+	//Size used for entries with unknown size/timestamp. Never matches a real file.
+	const uint64_t unknown_size = 0xFFFFFFFFFFFFFFFFULL;
+
+	bool stat_file(const std::string& filename, uint64_t& size, time_t& mtime)
+	{
+		if(!directory::is_regular(filename))
+			return false;
+		uintmax_t s = directory::size(filename);
+		if(s == static_cast<uintmax_t>(-1))
+			return false;
+		size = s;
+		mtime = directory::mtime(filename);
+		return true;
+	}
+}
+
+hashindex::hashindex()
+{
+	log_records = 0;
+}
+
+hashindex::~hashindex()
+{
+}
+
+void hashindex::set_backing_file(const std::string& filename)
+{
+	threads::alock h(mlock);
+	auto inmemory = entries;
+	backingfile = filename;
+	read_file(filename, false);
+	//Entries computed before the file was known are newer than ones on disk.
+	for(auto& i : inmemory)
+		set_entry(i.first, &i.second);
+	compact_unlocked();
+}
+
+bool hashindex::has_backing_file()
+{
+	threads::alock h(mlock);
+	return (backingfile != "");
+}
+
+void hashindex::import_legacy(const std::string& filename)
+{
+	threads::alock h(mlock);
+	read_file(filename, true);
+	compact_unlocked();
+}
+
+std::string hashindex::lookup(const std::string& _filename, uint64_t prefix)
+{
+	std::string filename = directory::absolute_path(_filename);
+	uint64_t size;
+	time_t mtime;
+	if(!stat_file(filename, size, mtime))
+		return "";
+	threads::alock h(mlock);
+	auto i = entries.find(std::make_pair(filename, prefix));
+	if(i == entries.end())
+		return "";
+	if(i->second.size != size || i->second.mtime != mtime)
+		return "";	//Stale.
+	return i->second.hash;
+}
+
+void hashindex::store(const std::string& _filename, uint64_t prefix, const std::string& hash)
+{
+	std::string filename = directory::absolute_path(_filename);
+	key_t key = std::make_pair(filename, prefix);
+	entry e;
+	e.hash = hash;
+	if(hash != "" && !stat_file(filename, e.size, e.mtime))
+		return;		//File is gone.
+	threads::alock h(mlock);
+	auto i = entries.find(key);
+	if(hash == "" && i == entries.end())
+		return;		//Already correct.
+	if(hash != "" && i != entries.end() && i->second.hash == e.hash && i->second.size == e.size &&
+		i->second.mtime == e.mtime)
+		return;		//Already correct.
+	set_entry(key, (hash != "") ? &e : NULL);
+	append_record(key, (hash != "") ? &e : NULL);
+	//Compact if the log has grown well past the number of live entries.
+	if(log_records > 2 * entries.size() + 1024)
+		compact_unlocked();
+}
+
+void hashindex::forget(const std::string& _filename)
+{
+	std::string filename = directory::absolute_path(_filename);
+	threads::alock h(mlock);
+	while(true) {
+		auto i = entries.lower_bound(std::make_pair(filename, 0));
+		if(i == entries.end() || i->first.first != filename)
+			return;
+		key_t key = i->first;
+		set_entry(key, NULL);
+		append_record(key, NULL);
+	}
+}
+
+std::list<std::pair<std::string, uint64_t>> hashindex::files_by_hash(const std::string& hash)
+{
+	threads::alock h(mlock);
+	std::list<std::pair<std::string, uint64_t>> x;
+	auto r = by_hash.equal_range(hash);
+	for(auto i = r.first; i != r.second; i++)
+		x.push_back(i->second);
+	return x;
+}
+
+void hashindex::compact()
+{
+	threads::alock h(mlock);
+	compact_unlocked();
+}
+
+void hashindex::set_entry(const key_t& key, const entry* e)
+{
+	auto i = entries.find(key);
+	if(i != entries.end()) {
+		auto r = by_hash.equal_range(i->second.hash);
+		for(auto j = r.first; j != r.second; j++)
+			if(j->second == key) {
+				by_hash.erase(j);
+				break;
+			}
+		entries.erase(i);
+	}
+	if(e) {
+		entries[key] = *e;
+		by_hash.insert(std::make_pair(e->hash, key));
+	}
+}
+
+void hashindex::read_file(const std::string& filename, bool legacy)
+{
+	std::ifstream strm(filename);
+	std::string line;
+	while(std::getline(strm, line)) {
+		istrip_CR(line);
+		regex_results r;
+		entry e;
+		try {
+			if(legacy && (r = regex("([0-9a-f]*):([0-9]+)\\|(.+)", line))) {
+				key_t key = std::make_pair(r[3], parse_value<uint64_t>(r[2]));
+				e.size = unknown_size;
+				e.mtime = 0;
+				e.hash = r[1];
+				set_entry(key, (r[1] != "") ? &e : NULL);
+			} else if(!legacy && (r = regex("\\+([0-9a-f]{64}) ([0-9]+) ([0-9]+) (-?[0-9]+) (.+)", line))) {
+				key_t key = std::make_pair(r[5], parse_value<uint64_t>(r[2]));
+				e.size = parse_value<uint64_t>(r[3]);
+				e.mtime = parse_value<int64_t>(r[4]);
+				e.hash = r[1];
+				set_entry(key, &e);
+				log_records++;
+			} else if(!legacy && (r = regex("-([0-9]+) (.+)", line))) {
+				key_t key = std::make_pair(r[2], parse_value<uint64_t>(r[1]));
+				set_entry(key, NULL);
+				log_records++;
+			}
+			//Anything else is likely truncated line from crash. Ignore it.
+		} catch(...) {
+		}
+	}
+}
+
+void hashindex::append_record(const key_t& key, const entry* e)
+{
+	if(backingfile == "")
+		return;
+	std::string line;
+	if(e)
+		line = (stringfmt() << "+" << e->hash << " " << key.second << " " << e->size << " "
+			<< static_cast<int64_t>(e->mtime) << " " << key.first << "\n").str();
+	else
+		line = (stringfmt() << "-" << key.second << " " << key.first << "\n").str();
+	//Write the whole line at once, so a crash can at most leave one partial line at end.
+	std::ofstream strm(backingfile, std::ios::app);
+	strm.write(line.c_str(), line.length());
+	strm.flush();
+	log_records++;
+}
+
+void hashindex::compact_unlocked()
+{
+	if(backingfile == "")
+		return;
+	std::string backingtmp = backingfile + ".new";
+	std::ofstream strm(backingtmp);
+	if(!strm)
+		return;
+	for(auto& i : entries)
+		strm << "+" << i.second.hash << " " << i.first.second << " " << i.second.size << " "
+			<< static_cast<int64_t>(i.second.mtime) << " " << i.first.first << std::endl;
+	strm.close();
+	if(!strm)
+		return;
+	if(directory::rename_overwrite(backingtmp.c_str(), backingfile.c_str()))
+		return;
+	log_records = entries.size();
+}
+}
@@ -5,6 +5,7 @@
 #include "minmax.hpp"
 #include "zip.hpp"
 #include "directory.hpp"
+#include <algorithm>
 #include <functional>
 #include <sstream>
 
@@ -12,7 +13,6 @@ namespace fileimage
 {
 namespace
 {
-	std::map<std::string, std::pair<time_t, std::string>> cached_entries;
 
 	threads::lock& global_queue_mutex()
 	{
@@ -30,67 +30,6 @@ namespace
 		return f % (2 * h);
 	}
 
-	void* thread_trampoline(hash* h)
-	{
-		h->entrypoint();
-		return NULL;
-	}
-
-	std::string lookup_cache(const std::string& filename, uint64_t prefixlen)
-	{
-		std::string cache = filename + ".sha256";
-		if(prefixlen) cache += (stringfmt() << "-" << prefixlen).str();
-		time_t filetime = directory::mtime(filename);
-		if(cached_entries.count(cache)) {
-			//Found the cache entry...
-			if(cached_entries[cache].first == filetime)
-				return cached_entries[cache].second;
-			else {
-				//Stale.
-				unlink(cache.c_str());
-				cached_entries.erase(cache);
-				return "";
-			}
-		}
-
-		std::string cached_hash;
-		time_t rfiletime;
-
-		std::ifstream in(cache);
-		if(!in)
-			return "";	//Failed.
-
-		std::string tmp;
-		std::getline(in, tmp);
-		std::istringstream _in(tmp);
-		_in >> rfiletime;
-		std::getline(in, cached_hash);
-
-		if(rfiletime == filetime) {
-			cached_entries[cache] = std::make_pair(rfiletime, cached_hash);
-		} else  {
-			//Stale.
-			unlink(cache.c_str());
-			cached_entries.erase(cache);
-			return "";
-		}
-		return cached_hash;
-	}
-
-	void store_cache(const std::string& filename, uint64_t prefixlen, const std::string& value)
-	{
-		std::string cache = filename + ".sha256";
-		if(prefixlen) cache += (stringfmt() << "-" << prefixlen).str();
-		time_t filetime = directory::mtime(filename);
-		std::ofstream out(cache);
-		cached_entries[cache] = std::make_pair(filetime, value);
-		if(!out)
-			return;		//Failed!
-		out << filetime << std::endl;
-		out << value << std::endl;
-		out.close();
-	}
-
 	uint64_t get_file_size(const std::string& filename)
 	{
 		uintmax_t size = directory::size(filename);
@@ -132,7 +71,7 @@ hashval::~hashval()
 {
 	threads::alock h2(global_queue_mutex());
 	threads::alock h(mlock);
-	if(hasher)
+	if(!is_ready && hasher)
 		hasher->unlink(*this);
 }
 
@@ -201,9 +140,9 @@ hashval& hashval::operator=(const hashval& f)
 void hashval::resolve(unsigned id, const std::string& hash, uint64_t _prefix)
 {
 	threads::alock h(mlock);
-	hasher->unlink(*this);
 	if(id != cbid)
 		return;
+	hasher->unlink(*this);
 	is_ready = true;
 	value = hash;
 	prefixv = _prefix;
@@ -213,9 +152,9 @@ void hashval::resolve(unsigned id, const std::string& hash, uint64_t _prefix)
 void hashval::resolve_error(unsigned id, const std::string& err)
 {
 	threads::alock h(mlock);
-	hasher->unlink(*this);
 	if(id != cbid)
 		return;
+	hasher->unlink(*this);
 	is_ready = true;
 	error = err;
 	prefixv = 0;
@@ -230,7 +169,7 @@ void hash::link(hashval& future)
 		unsigned cbid = future.cbid;
 		for(auto& i : queue)
 			if(i.cbid == cbid)
-				i.interested--;
+				i.interested++;
 	}
 	future.prev = last_future;
 	future.next = NULL;
@@ -249,7 +188,7 @@ void hash::unlink(hashval& future)
 		unsigned cbid = future.cbid;
 		for(auto& i : queue)
 			if(i.cbid == cbid)
-				i.interested++;
+				i.interested--;
 	}
 	if(&future == first_future)
 		first_future = future.next;
@@ -261,21 +200,40 @@ void hash::unlink(hashval& future)
 		future.next->prev = future.prev;
 }
 
+hashval hash::queue_file(queue_job& j)
+{
+	j.progress = 0;
+	j.claimed = false;
+	j.interested = j.background ? 0 : 1;
+	j.cbid = next_cbid++;
+	hashval future;
+	if(!j.background)
+		future = hashval(*this, j.cbid);
+	threads::alock h(mlock);
+	queue.push_back(j);
+	//Background jobs are not shown in progress.
+	if(!j.background) {
+		total_work += j.size;
+		work_size += j.size;
+	}
+	//Each job gets one task on the shared pool. Forget tasks that have already completed.
+	for(auto i = tasks.begin(); i != tasks.end();)
+		if(i->ready())
+			i = tasks.erase(i);
+		else
+			i++;
+	tasks.push_back(threads::pool::global().submit<void>([this]() { this->entrypoint(); }));
+	return future;
+}
+
 hashval hash::operator()(const std::string& filename, uint64_t prefixlen)
 {
 	queue_job j;
 	j.filename = filename;
 	j.prefix = prefixlen;
 	j.size = get_file_size(filename);
-	j.cbid = next_cbid++;
-	j.interested = 1;
-	hashval future(*this, j.cbid);
-	queue.push_back(j);
-	threads::alock h(mlock);
-	total_work += j.size;
-	work_size += j.size;
-	condition.notify_all();
-	return future;
+	j.background = false;
+	return queue_file(j);
 }
 
 hashval hash::operator()(const std::string& filename, std::function<uint64_t(uint64_t)> prefixlen)
@@ -284,15 +242,20 @@ hashval hash::operator()(const std::string& filename, std::function<uint64_t(uin
 	j.filename = filename;
 	j.size = get_file_size(filename);
 	j.prefix = prefixlen(j.size);
-	j.cbid = next_cbid++;
-	j.interested = 1;
-	hashval future(*this, j.cbid);
-	queue.push_back(j);
-	threads::alock h(mlock);
-	total_work += j.size;
-	work_size += j.size;
-	condition.notify_all();
-	return future;
+	j.background = false;
+	return queue_file(j);
+}
+
+void hash::prefetch(const std::string& filename, std::function<uint64_t(uint64_t)> prefixlen)
+{
+	queue_job j;
+	j.filename = filename;
+	j.size = get_file_size(filename);
+	j.prefix = prefixlen(j.size);
+	j.background = true;
+	if(index.lookup(filename, j.prefix) != "")
+		return;
+	queue_file(j);
 }
 
 void hash::set_callback(std::function<void(uint64_t, uint64_t)> cb)
@@ -303,25 +266,29 @@ void hash::set_callback(std::function<void(uint64_t, uint64_t)> cb)
 
 hash::hash()
 {
+	//Make sure the pool outlives this object, as destructor waits on tasks in it.
+	threads::pool::global();
 	quitting = false;
 	first_future = NULL;
 	last_future = NULL;
 	next_cbid = 0;
 	total_work = 0;
+	total_progress = 0;
 	work_size = 0;
 	progresscb = [](uint64_t x, uint64_t y) -> void {};
-	hash_thread = new threads::thread(thread_trampoline, this);
 }
 
 hash::~hash()
 {
+	std::list<threads::future<void>> pending;
 	{
 		threads::alock h(mlock);
 		quitting = true;
-		condition.notify_all();
+		std::swap(pending, tasks);
 	}
-	hash_thread->join();
-	delete hash_thread;
+	//Tasks that have not started yet exit immediately.
+	for(auto& i : pending)
+		i.wait();
 	threads::alock h2(global_queue_mutex());
 	while(first_future)
 		first_future->resolve_error(first_future->cbid, "Hasher deleted");
@@ -330,88 +297,97 @@ hash::~hash()
 void hash::entrypoint()
 {
 	FILE* fp;
-	while(true) {
-		//Wait for work or quit signal.
-		{
-			threads::alock h(mlock);
-			while(!quitting && queue.empty()) {
-				send_idle();
-				condition.wait(h);
+	std::list<queue_job>::iterator current_job;
+	//Pick the first job nobody has claimed yet. There is one task per job, so there always is one.
+	{
+		threads::alock h(mlock);
+		if(quitting)
+			return;
+		for(current_job = queue.begin(); current_job != queue.end(); current_job++)
+			if(!current_job->claimed)
+				break;
+		if(current_job == queue.end())
+			return;
+		current_job->claimed = true;
+	}
+
+	//Hash this item.
+	std::string cached_hash;
+	fp = NULL;
+	cached_hash = index.lookup(current_job->filename, current_job->prefix);
+	if(cached_hash != "") {
+		threads::alock h2(global_queue_mutex());
+		for(hashval* fut = first_future; fut != NULL; fut = fut->next)
+			fut->resolve(current_job->cbid, cached_hash, current_job->prefix);
+		goto finished;
+	}
+	fp = fopen(current_job->filename.c_str(), "rb");
+	if(!fp) {
+		threads::alock h2(global_queue_mutex());
+		for(hashval* fut = first_future; fut != NULL; fut = fut->next)
+			fut->resolve_error(current_job->cbid, "Can't open file");
+	} else {
+		sha256 hash;
+		uint64_t toskip = current_job->prefix;
+		while(!feof(fp) && !ferror(fp)) {
+			{
+				threads::alock h(mlock);
+				if(quitting || (!current_job->interested && !current_job->background))
+					goto finished; //Aborted.
 			}
-			if(quitting)
-				return;
-			//We hawe work.
-			current_job = queue.begin();
+			unsigned char buf[65536];
+			uint64_t offset = 0;
+			size_t s = fread(buf, 1, sizeof(buf), fp);
+			//The first current_job->prefix bytes need to be skipped.
+			offset = min(toskip, (uint64_t)s);
+			toskip -= offset;
+			if(s > offset) hash.write(buf + offset, s - offset);
+			{
+				threads::alock h(mlock);
+				current_job->progress += s;
+				if(!current_job->background)
+					total_progress += s;
+			}
+			if(!current_job->background)
+				send_callback();
 		}
-
-		//Hash this item.
-		uint64_t progress = 0;
-		std::string cached_hash;
-		fp = NULL;
-		cached_hash = lookup_cache(current_job->filename, current_job->prefix);
-		if(cached_hash != "") {
+		if(ferror(fp)) {
 			threads::alock h2(global_queue_mutex());
 			for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-				fut->resolve(current_job->cbid, cached_hash, current_job->prefix);
-			goto finished;
-		}
-		fp = fopen(current_job->filename.c_str(), "rb");
-		if(!fp) {
+				fut->resolve_error(current_job->cbid, "Can't read file");
+		} else {
+			std::string hval = hash.read();
 			threads::alock h2(global_queue_mutex());
 			for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-				fut->resolve_error(current_job->cbid, "Can't open file");
-		} else {
-			sha256 hash;
-			uint64_t toskip = current_job->prefix;
-			while(!feof(fp) && !ferror(fp)) {
-				{
-					threads::alock h(mlock);
-					if(!current_job->interested)
-						goto finished; //Aborted.
-				}
-				unsigned char buf[16384];
-				uint64_t offset = 0;
-				size_t s = fread(buf, 1, sizeof(buf), fp);
-				progress += s;
-				//The first current_job->prefix bytes need to be skipped.
-				offset = min(toskip, (uint64_t)s);
-				toskip -= offset;
-				if(s > offset) hash.write(buf + offset, s - offset);
-				send_callback(progress);
-			}
-			if(ferror(fp)) {
-				threads::alock h2(global_queue_mutex());
-				for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-					fut->resolve_error(current_job->cbid, "Can't read file");
-			} else {
-				std::string hval = hash.read();
-				threads::alock h2(global_queue_mutex());
-				for(hashval* fut = first_future; fut != NULL; fut = fut->next)
-					fut->resolve(current_job->cbid, hval, current_job->prefix);
-				store_cache(current_job->filename, current_job->prefix, hval);
-			}
+				fut->resolve(current_job->cbid, hval, current_job->prefix);
+			index.store(current_job->filename, current_job->prefix, hval);
 		}
+	}
 finished:
-		if(fp) fclose(fp);
-		//Okay, this work item is complete.
-		{
-			threads::alock h(mlock);
+	if(fp) fclose(fp);
+	//Okay, this work item is complete.
+	{
+		threads::alock h(mlock);
+		if(!current_job->background) {
 			total_work -= current_job->size;
-			queue.erase(current_job);
+			total_progress -= current_job->progress;
 		}
-		send_callback(0);
+		queue.erase(current_job);
+		if(queue.empty())
+			send_idle();
 	}
+	send_callback();
 }
 
-void hash::send_callback(uint64_t this_completed)
+void hash::send_callback()
 {
 	uint64_t amount;
 	{
 		threads::alock h(mlock);
-		if(this_completed > total_work)
+		if(total_progress > total_work)
 			amount = 0;
 		else
-			amount = total_work - this_completed;
+			amount = total_work - total_progress;
 	}
 	progresscb(amount, work_size);
 }
@@ -430,7 +406,7 @@ image::image() throw(std::bad_alloc)
 }
 
 image::image(hash& h, const std::string& _filename, const std::string& base,
-	const struct image::info& info) throw(std::bad_alloc, std::runtime_error)
+	const struct image::info& info, bool defer_hash) throw(std::bad_alloc, std::runtime_error)
 {
 	if(info.type == info::IT_NONE && _filename != "")
 		throw std::runtime_error("Tried to load NULL image");
@@ -471,7 +447,8 @@ image::image(hash& h, const std::string& _filename, const std::string& base,
 			data->resize(0);
 		}
 		stripped = headered;
-		sha_256 = hashval(sha256::hash(*data), headered);
+		if(!defer_hash)
+			sha_256 = hashval(sha256::hash(*data), headered);
 		if(info.type == info::IT_MARKUP) {
 			size_t osize = data->size();
 			data->resize(osize + 1);
@@ -492,6 +469,44 @@ image::image(hash& h, const std::string& _filename, const std::string& base,
 	throw std::runtime_error("Unknown image type");
 }
 
+void image::hash_deferred(image* const* images, size_t count) throw(std::bad_alloc)
+{
+	std::vector<std::pair<size_t, image*>> todo;
+	for(size_t i = 0; i < count; i++)
+		if((images[i]->type == info::IT_MEMORY || images[i]->type == info::IT_MARKUP) &&
+			!images[i]->sha_256.ready()) {
+			//Markup has NUL appended, which is not part of the hash.
+			size_t len = images[i]->data->size() - ((images[i]->type == info::IT_MARKUP) ? 1 : 0);
+			todo.push_back(std::make_pair(len, images[i]));
+		}
+	//Multi-buffer hashing runs at the speed of the longest buffer, so only hash buffers of similar length
+	//together, longest first. The rest (e.g. ROM with its small markup) is hashed one by one.
+	std::sort(todo.begin(), todo.end(), [](const std::pair<size_t, image*>& a,
+		const std::pair<size_t, image*>& b) { return a.first > b.first; });
+	uint8_t hashes[8][32];
+	uint8_t* hashptr[8];
+	const uint8_t* dataptr[8];
+	size_t datalen[8];
+	for(size_t i = 0; i < todo.size();) {
+		size_t n = 0;
+		while(n < 8 && i + n < todo.size() && todo[i + n].first >= todo[i].first / 2) {
+			hashptr[n] = hashes[n];
+			dataptr[n] = reinterpret_cast<const uint8_t*>(todo[i + n].second->data->data());
+			datalen[n] = todo[i + n].first;
+			n++;
+		}
+		if(n > 1)
+			sha256::hash_multiple(hashptr, dataptr, datalen, n);
+		else
+			sha256::hash(hashptr[0], dataptr[0], datalen[0]);
+		for(size_t j = 0; j < n; j++) {
+			image& img = *todo[i + j].second;
+			img.sha_256 = hashval(sha256::tostring(hashptr[j]), img.stripped);
+		}
+		i += n;
+	}
+}
+
 void image::patch(const std::vector<char>& patch, int32_t offset) throw(std::bad_alloc, std::runtime_error)
 {
 	if(type == info::IT_NONE)
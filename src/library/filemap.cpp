@@ -0,0 +1,85 @@
+#include "filemap.hpp"
+#include <fstream>
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace filemap
+{
+mapping::mapping(const std::string& filename) throw(std::bad_alloc, std::runtime_error)
+{
+	base = NULL;
+	length = 0;
+	handle = NULL;
+	mapped = false;
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if(f != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER s;
+		if(GetFileSizeEx(f, &s) && s.QuadPart > 0) {
+			HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+			if(m) {
+				void* p = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+				if(p) {
+					base = reinterpret_cast<const char*>(p);
+					length = s.QuadPart;
+					handle = m;
+					mapped = true;
+				} else
+					CloseHandle(m);
+			}
+		}
+		CloseHandle(f);
+		if(mapped)
+			return;
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd >= 0) {
+		struct stat s;
+		if(!fstat(fd, &s) && s.st_size > 0) {
+			void* p = mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if(p != MAP_FAILED) {
+				base = reinterpret_cast<const char*>(p);
+				length = s.st_size;
+				mapped = true;
+			}
+		}
+		close(fd);
+		if(mapped)
+			return;
+	}
+#endif
+	//Mapping failed (or file is empty), read the file instead.
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+	if(!in)
+		throw std::runtime_error("Can't open '" + filename + "'");
+	char buf[65536];
+	while(in) {
+		in.read(buf, sizeof(buf));
+		fallback.insert(fallback.end(), buf, buf + in.gcount());
+	}
+	if(in.bad())
+		throw std::runtime_error("Can't read '" + filename + "'");
+	base = fallback.empty() ? NULL : &fallback[0];
+	length = fallback.size();
+}
+
+mapping::~mapping() throw()
+{
+	if(!mapped)
+		return;
+#if defined(_WIN32) || defined(_WIN64)
+	UnmapViewOfFile(base);
+	CloseHandle(reinterpret_cast<HANDLE>(handle));
+#else
+	munmap(const_cast<char*>(base), length);
+#endif
+}
+}
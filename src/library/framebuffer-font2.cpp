@@ -1,4 +1,5 @@
 #include "framebuffer-font2.hpp"
+#include "framebuffer-textcache.hpp"
 #include "range.hpp"
 #include "serialization.hpp"
 #include <functional>
@@ -220,6 +221,11 @@ font2::font2()
 	rowadvance = 0;
 }
 
+font2::~font2() throw()
+{
+	text_cache::global().forget(this);
+}
+
 font2::font2(const std::string& file)
 {
 	std::istream* toclose = NULL;
@@ -0,0 +1,205 @@
+#include "framebuffer-textcache.hpp"
+#include "range.hpp"
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace framebuffer
+{
+namespace
+{
+	//Rough per-entry overhead of map and list nodes.
+	const size_t entry_overhead = 128;
+
+	size_t entry_size(const std::string& text, const text_cache::mask& m)
+	{
+		return 2 * text.length() + m.data.size() + entry_overhead;
+	}
+
+	template<typename T> void blit_row(T* p, const uint8_t* m, size_t n, color* cmap)
+	{
+		for(size_t i = 0; i < n; i++)
+			if(cmap[m[i]])
+				cmap[m[i]].apply(p[i]);
+	}
+
+#ifdef __SSE2__
+	//Same as color::blend(), 4 pixels at once. The products fit in 16 bits, so this can work on 16-bit lanes.
+	inline __m128i sse2_blend(__m128i px, __m128i inv, __m128i hi, __m128i lo)
+	{
+		const __m128i lomask = _mm_set1_epi32(0x00FF00FF);
+		const __m128i himask = _mm_set1_epi32(0xFF00FF00);
+		__m128i a = _mm_and_si128(px, lomask);
+		__m128i b = _mm_srli_epi16(px, 8);
+		a = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(a, inv), hi), 8);
+		b = _mm_and_si128(_mm_add_epi16(_mm_mullo_epi16(b, inv), lo), himask);
+		return _mm_or_si128(a, b);
+	}
+
+	template<> void blit_row(uint32_t* p, const uint8_t* m, size_t n, color* cmap)
+	{
+		__m128i inv[4], hi[4], lo[4], idx[4];
+		unsigned nactive = 0;
+		for(unsigned c = 0; c < 4; c++) {
+			if(!cmap[c])
+				continue;
+			inv[nactive] = _mm_set1_epi16(cmap[c].inv);
+			hi[nactive] = _mm_set1_epi32(cmap[c].hi);
+			lo[nactive] = _mm_set1_epi32(cmap[c].lo);
+			idx[nactive++] = _mm_set1_epi32(c);
+		}
+		if(!nactive)
+			return;
+		const __m128i zero = _mm_setzero_si128();
+		size_t i = 0;
+		for(; i + 4 <= n; i += 4) {
+			uint32_t mm;
+			memcpy(&mm, m + i, 4);
+			__m128i mv = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(mm), zero), zero);
+			__m128i px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+			__m128i out = px;
+			for(unsigned j = 0; j < nactive; j++) {
+				__m128i sel = _mm_cmpeq_epi32(mv, idx[j]);
+				if(_mm_movemask_epi8(sel) == 0)
+					continue;
+				__m128i c = sse2_blend(px, inv[j], hi[j], lo[j]);
+				out = _mm_or_si128(_mm_andnot_si128(sel, out), _mm_and_si128(sel, c));
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), out);
+		}
+		for(; i < n; i++)
+			if(cmap[m[i]])
+				cmap[m[i]].apply(p[i]);
+	}
+#endif
+}
+
+bool text_cache::key::operator<(const key& k) const throw()
+{
+	if(owner != k.owner)
+		return owner < k.owner;
+	if(type != k.type)
+		return type < k.type;
+	if(flags != k.flags)
+		return flags < k.flags;
+	return text < k.text;
+}
+
+text_cache::text_cache(size_t _limit) throw()
+{
+	limit = _limit;
+	bytes = 0;
+	hits = 0;
+	misses = 0;
+}
+
+text_cache& text_cache::global() throw()
+{
+	//Never destroyed, fonts with static lifetime forget their text on destruction.
+	static text_cache* c = new text_cache(4 << 20);
+	return *c;
+}
+
+std::shared_ptr<const text_cache::mask> text_cache::get(const void* owner, kind type, const std::string& text,
+	uint32_t flags, std::function<void(mask& m)> rasterize) throw(std::bad_alloc)
+{
+	key k;
+	k.owner = owner;
+	k.type = type;
+	k.flags = flags;
+	k.text = text;
+	{
+		threads::alock h(lock);
+		auto i = entries.find(k);
+		if(i != entries.end()) {
+			hits++;
+			lru.splice(lru.begin(), lru, i->second.lru);
+			return i->second.m;
+		}
+		misses++;
+	}
+	//Rasterize without holding the lock, other threads may be drawing different text.
+	std::shared_ptr<mask> m(new mask);
+	m->width = m->height = 0;
+	rasterize(*m);
+	size_t size = entry_size(text, *m);
+	threads::alock h(lock);
+	auto i = entries.find(k);
+	if(i != entries.end())
+		return i->second.m;	//Someone else got there first.
+	if(size > limit)
+		return m;		//Wouldn't fit anyway.
+	lru.push_front(k);
+	entry& e = entries[k];
+	e.m = m;
+	e.lru = lru.begin();
+	bytes += size;
+	evict();
+	return m;
+}
+
+void text_cache::evict()
+{
+	while(bytes > limit && !lru.empty()) {
+		auto i = entries.find(lru.back());
+		bytes -= entry_size(i->first.text, *i->second.m);
+		entries.erase(i);
+		lru.pop_back();
+	}
+}
+
+void text_cache::forget(const void* owner) throw()
+{
+	threads::alock h(lock);
+	for(auto i = lru.begin(); i != lru.end();) {
+		if(i->owner != owner) {
+			i++;
+			continue;
+		}
+		auto j = entries.find(*i);
+		bytes -= entry_size(j->first.text, *j->second.m);
+		entries.erase(j);
+		i = lru.erase(i);
+	}
+}
+
+void text_cache::clear() throw()
+{
+	threads::alock h(lock);
+	entries.clear();
+	lru.clear();
+	bytes = 0;
+}
+
+void text_cache::set_limit(size_t _limit) throw()
+{
+	threads::alock h(lock);
+	limit = _limit;
+	evict();
+}
+
+text_cache::stats text_cache::get_stats() throw()
+{
+	threads::alock h(lock);
+	stats s;
+	s.hits = hits;
+	s.misses = misses;
+	s.entries = entries.size();
+	s.bytes = bytes;
+	return s;
+}
+
+template<bool X> void text_cache::blit(fb<X>& scr, uint32_t x, uint32_t y, const mask& m, color* cmap) throw()
+{
+	range bX = (range::make_w(scr.get_width()) - x) & range::make_w(m.width);
+	range bY = (range::make_w(scr.get_height()) - y) & range::make_w(m.height);
+	if(!bX.size() || !bY.size())
+		return;
+	for(uint32_t r = bY.low(); r < bY.high(); r++)
+		blit_row(scr.rowptr(y + r) + (x + bX.low()), &m.data[r * m.width + bX.low()], bX.size(), cmap);
+}
+
+template void text_cache::blit(fb<false>& scr, uint32_t x, uint32_t y, const mask& m, color* cmap) throw();
+template void text_cache::blit(fb<true>& scr, uint32_t x, uint32_t y, const mask& m, color* cmap) throw();
+}
@@ -1,9 +1,12 @@
 #include "framebuffer.hpp"
+#include "framebuffer-textcache.hpp"
 #include "hex.hpp"
 #include "png.hpp"
 #include "serialization.hpp"
 #include "string.hpp"
 #include "minmax.hpp"
+#include "perfscope.hpp"
+#include "threads-pool.hpp"
 #include "utf8.hpp"
 #include <functional>
 #include <cstring>
@@ -22,6 +25,7 @@ unsigned default_shift_b;
 
 namespace
 {
+	perfscope::region perf_run("render.queue");
 	void recalculate_default_shifts()
 	{
 		uint32_t magic = 0x18000810;
@@ -510,6 +514,30 @@ const typename fb<X>::element_t* fb<X>::rowptr(size_t row) const throw()
 	return mem + stride * row;
 }
 
+template<bool X>
+bool fb<X>::set_view(fb<X>& parent, size_t x, size_t y, size_t w, size_t h) throw()
+{
+	if(parent.upside_down || x + w > parent.width || y + h > parent.height)
+		return false;
+	//rowptr() realigns unaligned memory, which would shift the view.
+	element_t* p = parent.rowptr(y) + x;
+	if((reinterpret_cast<size_t>(p) % 16) || (parent.stride * sizeof(element_t) % 16))
+		return false;
+	set(p, w, h, parent.stride);
+	offset_x = parent.offset_x - x;
+	offset_y = parent.offset_y - y;
+	last_blit_w = parent.last_blit_w;
+	last_blit_h = parent.last_blit_h;
+	current_fmt = parent.current_fmt;
+	auxpal.rshift = parent.auxpal.rshift;
+	auxpal.gshift = parent.auxpal.gshift;
+	auxpal.bshift = parent.auxpal.bshift;
+	active_rshift = parent.active_rshift;
+	active_gshift = parent.active_gshift;
+	active_bshift = parent.active_bshift;
+	return true;
+}
+
 template<bool X> uint8_t fb<X>::get_palette_r() const throw() { return auxpal.rshift; }
 template<bool X> uint8_t fb<X>::get_palette_g() const throw() { return auxpal.gshift; }
 template<bool X> uint8_t fb<X>::get_palette_b() const throw() { return auxpal.bshift; }
@@ -519,6 +547,23 @@ size_t raw::get_height() const throw() { return height; }
 template<bool X> size_t fb<X>::get_origin_x() const throw() { return offset_x; }
 template<bool X> size_t fb<X>::get_origin_y() const throw() { return offset_y; }
 
+namespace
+{
+	//Size of tiles for parallel drawing. Multiple of 4 pixels, so tiles stay aligned.
+	const size_t tile_size = 64;
+	//Runs of objects with bounds shorter than this are not worth splitting to tiles.
+	const size_t tile_min_objects = 256;
+
+	threads::lock render_threads_lock;
+	unsigned render_threads = 0;
+}
+
+void queue::set_threads(unsigned threads) throw(std::bad_alloc)
+{
+	threads::alock h(render_threads_lock);
+	render_threads = threads;
+}
+
 void queue::add(struct object& obj) throw(std::bad_alloc)
 {
 	struct node* n = reinterpret_cast<struct node*>(alloc(sizeof(node)));
@@ -543,10 +588,98 @@ void queue::copy_from(queue& q) throw(std::bad_alloc)
 	}
 }
 
+template<bool X> void queue::run_tiles(struct fb<X>& scr, std::vector<fb<X>>& views) throw()
+{
+	if(tile_objects.size() < tile_min_objects) {
+		for(auto i : tile_objects) {
+			try {
+				(*i)(scr);
+			} catch(...) {
+			}
+		}
+	} else {
+		threads::pool::global().parallel_for(0, views.size(), [this, &views](size_t first, size_t last) {
+			for(size_t t = first; t < last; t++)
+				for(auto i : tile_bins[t]) {
+					try {
+						(*i)(views[t]);
+					} catch(...) {
+					}
+				}
+		}, 1, render_threads);
+	}
+	for(auto& i : tile_bins)
+		i.clear();
+	tile_objects.clear();
+}
+
+template<bool X> bool queue::run_tiled(struct fb<X>& scr) throw(std::bad_alloc)
+{
+	size_t width = scr.get_width();
+	size_t height = scr.get_height();
+	size_t tiles_x = (width + tile_size - 1) / tile_size;
+	size_t tiles_y = (height + tile_size - 1) / tile_size;
+	if(tiles_x * tiles_y < 2)
+		return false;
+	std::vector<fb<X>> views(tiles_x * tiles_y);
+	for(size_t j = 0; j < tiles_y; j++)
+		for(size_t i = 0; i < tiles_x; i++) {
+			size_t x = i * tile_size;
+			size_t y = j * tile_size;
+			if(!views[j * tiles_x + i].set_view(scr, x, y, min(tile_size, width - x),
+				min(tile_size, height - y)))
+				return false;
+		}
+	tile_bins.resize(views.size());
+	int64_t ox = static_cast<int32_t>(scr.get_origin_x());
+	int64_t oy = static_cast<int32_t>(scr.get_origin_y());
+	for(struct node* tmp = queue_head; tmp; tmp = tmp->next) {
+		if(tmp->killed)
+			continue;
+		int32_t bx, by;
+		uint32_t bw, bh;
+		if(!tmp->obj->get_bounds(bx, by, bw, bh)) {
+			//No bounds, draw everything before it, and then it on the whole screen.
+			run_tiles(scr, views);
+			try {
+				(*(tmp->obj))(scr);
+			} catch(...) {
+			}
+			continue;
+		}
+		int64_t x1 = max(ox + bx, (int64_t)0);
+		int64_t y1 = max(oy + by, (int64_t)0);
+		int64_t x2 = min(ox + bx + (int64_t)bw, (int64_t)width);
+		int64_t y2 = min(oy + by + (int64_t)bh, (int64_t)height);
+		if(x1 >= x2 || y1 >= y2)
+			continue;	//Entierely offscreen.
+		for(size_t j = y1 / tile_size; j <= (size_t)(y2 - 1) / tile_size; j++)
+			for(size_t i = x1 / tile_size; i <= (size_t)(x2 - 1) / tile_size; i++)
+				tile_bins[j * tiles_x + i].push_back(tmp->obj);
+		tile_objects.push_back(tmp->obj);
+	}
+	run_tiles(scr, views);
+	return true;
+}
+
 template<bool X> void queue::run(struct fb<X>& scr) throw()
 {
+	perfscope::scope t(perf_run);
 	//Take queue lock in order to syncronize this with killing the queue.
 	threads::alock h(display_mutex);
+	{
+		threads::alock h2(render_threads_lock);
+		try {
+			if(render_threads > 1 && run_tiled(scr))
+				return;
+		} catch(...) {
+			//Out of memory. Whatever got drawn, don't draw it again.
+			for(auto& i : tile_bins)
+				i.clear();
+			tile_objects.clear();
+			return;
+		}
+	}
 	struct node* tmp = queue_head;
 	while(tmp) {
 		try {
@@ -639,6 +772,11 @@ bool object::kill_request(void* obj) throw()
 	return false;
 }
 
+bool object::get_bounds(int32_t& x, int32_t& y, uint32_t& w, uint32_t& h) const throw()
+{
+	return false;
+}
+
 font::font() throw(std::bad_alloc)
 {
 	bad_glyph_data[0] = 0x018001AAU;
@@ -647,81 +785,70 @@ font::font() throw(std::bad_alloc)
 	bad_glyph_data[3] = 0x55800180U;
 	bad_glyph.wide = false;
 	bad_glyph.data = bad_glyph_data;
+	binary = NULL;
+	binary_words = 0;
 }
 
-void font::load_hex_glyph(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error)
+font::~font() throw()
 {
-	char buf2[8];
-	std::string line(data, data + size);
-	size_t linelen = line.length();
-
-	//Check if the line is valid.
-	//Line format is <hex digits>:<32 or 64 hex digits>.
-	size_t splitter = line.find(':');
-	if(splitter >= linelen || !(splitter + 33 == linelen || splitter + 65 == linelen))
-		(stringfmt() << "Invalid line '" << line << "'").throwex();	//No :, or not 32/64 hexes after.
-	if(line.find_first_not_of("0123456789ABCDEFabcdef:") < line.length())
-		(stringfmt() << "Invalid line '" << line << "'").throwex();	//Invalid character.
-	if(line.find(':', splitter + 1) < line.length())
-		(stringfmt() << "Invalid line '" << line << "'").throwex();	//Second :.
-	if(splitter > 7)
-		(stringfmt() << "Invalid line '" << line << "'").throwex();	//Too long codepoint.
-
-	std::string codepoint = line.substr(0, splitter);
-	std::string cdata = line.substr(splitter + 1);
-	strcpy(buf2, codepoint.c_str());
-	char* end2;
-	unsigned long cp = strtoul(buf2, &end2, 16);
-	if(*end2 || cp > 0x10FFFF)
-		(stringfmt() << "Invalid line '" << line << "'").throwex();	//Codepoint out of range.
-	glyphs[cp].wide = (cdata.length() == 64);
-	size_t p = memory.size();
-	for(size_t i = 0; i < cdata.length(); i += 8) {
-		char buf[9] = {0};
-		char* end;
-		for(size_t j = 0; j < 8; j++)
-			buf[j] = cdata[i + j];
-		memory.push_back(strtoul(buf, &end, 16));
-	}
-	glyphs[cp].offset = p;
+	text_cache::global().forget(this);
 }
 
 void font::load_hex(const char* data, size_t size) throw(std::bad_alloc, std::runtime_error)
 {
+	std::map<uint32_t, std::vector<uint32_t>> glyphs;
 	const char* enddata = data + size;
 	while(data != enddata) {
 		size_t linesize = 0;
 		while(data + linesize != enddata && data[linesize] != '\n' && data[linesize] != '\r')
 			linesize++;
-		if(linesize && data[0] != '#')
-			load_hex_glyph(data, linesize);
+		if(linesize && data[0] != '#') {
+			std::string line(data, data + linesize);
+			if(!fontbin::parse_hex_line(line, glyphs))
+				(stringfmt() << "Invalid line '" << line << "'").throwex();
+		}
 		data += linesize;
 		if(data != enddata)
 			data++;
 	}
-	memory.push_back(0);
-	memory.push_back(0);
-	memory.push_back(0);
-	memory.push_back(0);
-	glyphs[32].wide = false;
-	glyphs[32].offset = memory.size() - 4;
-	for(auto& i : glyphs)
-		i.second.data = &memory[i.second.offset];
+	std::vector<uint32_t> bin = fontbin::make_binary(glyphs);
+	std::swap(memory, bin);
+	binary = &memory[0];
+	binary_words = memory.size();
 }
 
-const font::glyph& font::get_glyph(uint32_t glyph) throw()
+void font::load_binary(const uint32_t* data, size_t words) throw(std::runtime_error)
 {
-	if(glyphs.count(glyph))
-		return glyphs[glyph];
-	else
-		return bad_glyph;
+	if(words < 2 + binary_pages || data[0] != binary_magic || data[1] != words)
+		throw std::runtime_error("Bad binary font");
+	//Check the offsets, so lookups don't need to.
+	for(size_t i = 0; i < binary_pages; i++) {
+		uint32_t page = data[2 + i];
+		if(!page)
+			continue;
+		if(page < 2 + binary_pages || page > words - 256)
+			throw std::runtime_error("Bad binary font");
+		for(size_t j = 0; j < 256; j++) {
+			uint32_t e = data[page + j];
+			if(e && (e >> 1) + ((e & 1) ? 8 : 4) > words)
+				throw std::runtime_error("Bad binary font");
+		}
+	}
+	memory.clear();
+	binary = data;
+	binary_words = words;
 }
 
 std::set<uint32_t> font::get_glyphs_set()
 {
 	std::set<uint32_t> out;
-	for(auto& i : glyphs)
-		out.insert(i.first);
+	for(uint32_t i = 0; binary && i < binary_pages; i++) {
+		if(!binary[2 + i])
+			continue;
+		for(uint32_t j = 0; j < 256; j++)
+			if(binary[binary[2 + i] + j])
+				out.insert(256 * i + j);
+	}
 	return out;
 }
 
@@ -760,7 +887,7 @@ std::vector<font::layout> font::dolayout(const std::string& string) throw(std::b
 		bool ydbl) {
 		l[gtr].x = x;
 		l[gtr].y = y;
-		l[gtr++].dglyph = &g;
+		l[gtr++].dglyph = g;
 	});
 	return l;
 }
@@ -769,7 +896,7 @@ uint32_t font::get_width(const std::string& string)
 {
 	uint32_t width = 0;
 	utf8::to32i(string.begin(), string.end(), lambda_output_iterator<int32_t>([this, &width](const int32_t cp) {
-		const glyph& g = get_glyph(cp);
+		glyph g = get_glyph(cp);
 		const uint32_t tabs = TABSTOPS >> 3;
 		switch(cp) {
 		case 9:
@@ -789,64 +916,42 @@ template<bool X> void font::render(struct fb<X>& scr, int32_t x, int32_t y, cons
 {
 	x += scr.get_origin_x();
 	y += scr.get_origin_y();
-	size_t swidth = scr.get_width();
-	size_t sheight = scr.get_height();
-
-	for_each_glyph(text, x, hdbl, vdbl, [this, x, y, &scr, swidth, sheight, &fg, &bg](uint32_t lx, uint32_t ly,
-		const glyph& g, bool hdbl, bool vdbl) {
-		//Render this glyph at x + lx, y + ly.
-		int32_t gx = x + lx;
-		int32_t gy = y + ly;
-		//Don't draw characters completely off-screen.
-		if(gy <= (vdbl ? -32 : -16) || gy >= (ssize_t)sheight)
-			return;
-		if(gx <= -(hdbl ? 2 : 1) * (g.wide ? 16 : 8) || gx >= (ssize_t)swidth)
-			return;
-		//Compute the bounding box.
-		uint32_t xstart = 0;
-		uint32_t ystart = 0;
-		uint32_t xlength = (hdbl ? 2 : 1) * (g.wide ? 16 : 8);
-		uint32_t ylength = (vdbl ? 32 : 16);
-		if(gx < 0)	xstart = -gx;
-		if(gy < 0)	ystart = -gy;
-		xlength -= xstart;
-		ylength -= ystart;
-		if(gx + xstart + xlength > swidth)	xlength = swidth - (gx + xstart);
-		if(gy + ystart + ylength > sheight)	ylength = sheight - (gy + ystart);
-		if(g.data)
-			for(size_t i = 0; i < ylength; i++) {
-				typename fb<X>::element_t* r = scr.rowptr(gy + ystart + i) +
-					(gx + xstart);
-				uint32_t _y = (i + ystart) >> (vdbl ? 1 : 0);
-				uint32_t d = g.data[_y >> (g.wide ? 1 : 2)];
-				if(g.wide)
-					d >>= 16 - ((_y & 1) << 4);
-				else
-					d >>= 24 - ((_y & 3) << 3);
-				if(hdbl)
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - ((j + xstart) >> 1);
-						if(((d >> b) & 1) != 0)
-							fg.apply(r[j]);
-						else
-							bg.apply(r[j]);
-					}
-				else
-					for(size_t j = 0; j < xlength; j++) {
-						uint32_t b = (g.wide ? 15 : 7) - (j + xstart);
-						if(((d >> b) & 1) != 0)
-							fg.apply(r[j]);
-						else
-							bg.apply(r[j]);
+	//Tabs align to absolute position, so with tabs the alignment is part of the key.
+	uint32_t alignx = (text.find('\t') < text.length()) ? (static_cast<uint32_t>(x) % TABSTOPS) : 0;
+	uint32_t flags = (hdbl ? 1 : 0) | (vdbl ? 2 : 0) | (alignx << 2);
+	std::shared_ptr<const text_cache::mask> m;
+	try {
+		m = text_cache::global().get(this, text_cache::KIND_PLAIN, text, flags,
+			[this, &text, alignx, hdbl, vdbl](text_cache::mask& m) {
+			//Index 1 is foreground, 2 is background, 0 is outside glyphs.
+			auto size = get_metrics(text, alignx, hdbl, vdbl);
+			m.width = size.first;
+			m.height = size.second;
+			m.data.resize(m.width * m.height);
+			for_each_glyph(text, alignx, hdbl, vdbl, [&m](uint32_t lx, uint32_t ly, const glyph& g,
+				bool hdbl, bool vdbl) {
+				uint32_t w = (g.wide ? 16 : 8) << (hdbl ? 1 : 0);
+				uint32_t h = 16 << (vdbl ? 1 : 0);
+				for(uint32_t i = 0; i < h; i++) {
+					uint8_t* r = &m.data[(ly + i) * m.width + lx];
+					uint32_t _y = i >> (vdbl ? 1 : 0);
+					uint32_t d = g.data[_y >> (g.wide ? 1 : 2)];
+					if(g.wide)
+						d >>= 16 - ((_y & 1) << 4);
+					else
+						d >>= 24 - ((_y & 3) << 3);
+					for(uint32_t j = 0; j < w; j++) {
+						uint32_t b = (g.wide ? 15 : 7) - (j >> (hdbl ? 1 : 0));
+						r[j] = ((d >> b) & 1) ? 1 : 2;
 					}
-			}
-		else
-			for(size_t i = 0; i < ylength; i++) {
-				typename fb<X>::element_t* r = scr.rowptr(gy + ystart + i) + (gx + xstart);
-				for(size_t j = 0; j < xlength; j++)
-					bg.apply(r[j]);
-			}
-	});
+				}
+			});
+		});
+	} catch(std::bad_alloc& e) {
+		return;
+	}
+	color cmap[4] = {color(-1), fg, bg, color(-1)};
+	text_cache::blit(scr, x, y, *m, cmap);
 }
 
 void font::render(uint8_t* buf, size_t stride, const std::string& str, uint32_t alignx, bool hdbl, bool vdbl)
@@ -892,7 +997,7 @@ void font::for_each_glyph(const std::string& str, uint32_t alignx, bool xdbl, bo
 	auto _cb = &cb;
 	utf8::to32i(str.begin(), str.end(), lambda_output_iterator<int32_t>([this, &layout_x, &layout_y, _xdbl,
 		_ydbl, offset, _cb](const int32_t cp) {
-		const glyph& g = get_glyph(cp);
+		glyph g = get_glyph(cp);
 		switch(cp) {
 		case 9:
 			layout_x = (layout_x + TABSTOPS) / TABSTOPS * TABSTOPS;
@@ -0,0 +1,359 @@
+#include "json-document.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace JSON
+{
+namespace
+{
+	const size_t block_size = 65536;
+	const size_t alloc_align = 8;
+	//Objects with more fields than this get index sorted by key.
+	const size_t index_threshold = 8;
+
+	int compare_key(const char* a, size_t alen, const char* b, size_t blen)
+	{
+		int r = memcmp(a, b, std::min(alen, blen));
+		if(r)
+			return r;
+		return (alen < blen) ? -1 : ((alen > blen) ? 1 : 0);
+	}
+}
+
+/**
+ * Builds document from parse events. Children are collected to a stack and copied to the document when the array
+ * or object ends, so each container is single contiguous allocation.
+ */
+class document::builder : public sax_handler
+{
+public:
+	builder(document& _doc) : doc(_doc) {}
+	void null_value()
+	{
+		value v = blank(null);
+		add(v);
+	}
+	void boolean_value(bool b)
+	{
+		value v = blank(boolean);
+		v._boolean = b;
+		add(v);
+	}
+	void number_value(const number_holder& n)
+	{
+		value v = blank(number);
+		v._number = n;
+		add(v);
+	}
+	void string_value(const char* str, size_t len)
+	{
+		value v = blank(string);
+		v._string = copy_string(str, len);
+		v.count = len;
+		add(v);
+	}
+	void array_begin() { begin(array); }
+	void array_end() { end(); }
+	void object_begin() { begin(object); }
+	void object_key(const char* str, size_t len)
+	{
+		key.str = copy_string(str, len);
+		key.len = len;
+	}
+	void object_end() { end(); }
+private:
+	struct frame
+	{
+		int vtype;
+		size_t first_value;
+		size_t first_key;
+		value::keyref key;	//Key of the container itself.
+	};
+	value blank(int vtype)
+	{
+		value v;
+		v.vtype = vtype;
+		v._boolean = false;
+		v.count = 0;
+		v._string = NULL;
+		v.children = NULL;
+		v.keys = NULL;
+		v.order = NULL;
+		return v;
+	}
+	const char* copy_string(const char* str, size_t len)
+	{
+		char* s = reinterpret_cast<char*>(doc.alloc(len + 1));
+		memcpy(s, str, len);
+		s[len] = 0;
+		return s;
+	}
+	void add(const value& v)
+	{
+		if(frames.empty()) {
+			doc._root = v;
+			return;
+		}
+		if(frames.back().vtype == object)
+			keys.push_back(key);
+		values.push_back(v);
+	}
+	void begin(int vtype)
+	{
+		frame f;
+		f.vtype = vtype;
+		f.first_value = values.size();
+		f.first_key = keys.size();
+		f.key = key;
+		frames.push_back(f);
+	}
+	void end()
+	{
+		frame f = frames.back();
+		frames.pop_back();
+		value v = blank(f.vtype);
+		v.count = values.size() - f.first_value;
+		if(v.count) {
+			value* c = reinterpret_cast<value*>(doc.alloc(v.count * sizeof(value)));
+			for(size_t i = 0; i < v.count; i++)
+				new(c + i) value(values[f.first_value + i]);
+			v.children = c;
+			if(f.vtype == object) {
+				value::keyref* k = reinterpret_cast<value::keyref*>(doc.alloc(v.count *
+					sizeof(value::keyref)));
+				memcpy(k, &keys[f.first_key], v.count * sizeof(value::keyref));
+				v.keys = k;
+				if(v.count > index_threshold) {
+					//Stable, so instances of the same key stay in order.
+					size_t* o = reinterpret_cast<size_t*>(doc.alloc(v.count * sizeof(size_t)));
+					for(size_t i = 0; i < v.count; i++)
+						o[i] = i;
+					std::stable_sort(o, o + v.count, [k](size_t a, size_t b) {
+						return compare_key(k[a].str, k[a].len, k[b].str, k[b].len) < 0;
+					});
+					v.order = o;
+				}
+			}
+		}
+		values.resize(f.first_value);
+		keys.resize(f.first_key);
+		key = f.key;
+		add(v);
+	}
+	document& doc;
+	std::vector<value> values;
+	std::vector<value::keyref> keys;
+	std::vector<frame> frames;
+	value::keyref key;
+};
+
+document::document(const std::string& doc) throw(std::bad_alloc, error)
+{
+	free_ptr = NULL;
+	free_left = 0;
+	allocated = 0;
+	_root.vtype = null;
+	_root._boolean = false;
+	_root.count = 0;
+	_root._string = NULL;
+	_root.children = NULL;
+	_root.keys = NULL;
+	_root.order = NULL;
+	try {
+		builder b(*this);
+		sax_parse(doc, b);
+	} catch(...) {
+		for(auto i : blocks)
+			delete[] i;
+		throw;
+	}
+}
+
+document::~document() throw()
+{
+	for(auto i : blocks)
+		delete[] i;
+}
+
+void* document::alloc(size_t size) throw(std::bad_alloc)
+{
+	size = (size + alloc_align - 1) / alloc_align * alloc_align;
+	if(size > free_left) {
+		//Large allocations get block of their own, so the current block is not wasted.
+		size_t bsize = (size > block_size / 4) ? size : block_size;
+		char* b = new char[bsize];
+		blocks.push_back(b);
+		allocated += bsize;
+		if(bsize == size)
+			return b;
+		free_ptr = b;
+		free_left = bsize;
+	}
+	void* r = free_ptr;
+	free_ptr += size;
+	free_left -= size;
+	return r;
+}
+
+bool document::value::as_bool() const throw(error)
+{
+	if(vtype != boolean)
+		throw error(ERR_NOT_A_BOOLEAN);
+	return _boolean;
+}
+
+double document::value::as_double() const throw(error)
+{
+	if(vtype != number)
+		throw error(ERR_NOT_A_NUMBER);
+	return _number.to<double>();
+}
+
+int64_t document::value::as_int() const throw(error)
+{
+	if(vtype != number)
+		throw error(ERR_NOT_A_NUMBER);
+	return _number.to<int64_t>();
+}
+
+uint64_t document::value::as_uint() const throw(error)
+{
+	if(vtype != number)
+		throw error(ERR_NOT_A_NUMBER);
+	return _number.to<uint64_t>();
+}
+
+std::string document::value::as_string8() const throw(std::bad_alloc, error)
+{
+	size_t len;
+	const char* s = as_cstring(len);
+	return std::string(s, len);
+}
+
+const char* document::value::as_cstring(size_t& len) const throw(error)
+{
+	if(vtype != string)
+		throw error(ERR_NOT_A_STRING);
+	len = count;
+	return _string;
+}
+
+size_t document::value::index_count() const throw(error)
+{
+	if(vtype != array)
+		throw error(ERR_NOT_AN_ARRAY);
+	return count;
+}
+
+const document::value& document::value::index(size_t idx) const throw(error)
+{
+	if(vtype != array)
+		throw error(ERR_NOT_AN_ARRAY);
+	if(idx >= count)
+		throw error(ERR_INDEX_INVALID);
+	return children[idx];
+}
+
+size_t document::value::field_count() const throw(error)
+{
+	if(vtype != object)
+		throw error(ERR_NOT_AN_OBJECT);
+	return count;
+}
+
+std::string document::value::key(size_t idx) const throw(std::bad_alloc, error)
+{
+	if(vtype != object)
+		throw error(ERR_NOT_AN_OBJECT);
+	if(idx >= count)
+		throw error(ERR_INDEX_INVALID);
+	return std::string(keys[idx].str, keys[idx].len);
+}
+
+const document::value& document::value::field_value(size_t idx) const throw(error)
+{
+	if(vtype != object)
+		throw error(ERR_NOT_AN_OBJECT);
+	if(idx >= count)
+		throw error(ERR_INDEX_INVALID);
+	return children[idx];
+}
+
+std::pair<size_t, size_t> document::value::find_key(const std::string& key) const throw()
+{
+	const keyref* k = keys;
+	const size_t* lo = std::lower_bound(order, order + count, key, [k](size_t a, const std::string& b) {
+		return compare_key(k[a].str, k[a].len, b.data(), b.length()) < 0;
+	});
+	const size_t* hi = std::upper_bound(lo, order + count, key, [k](const std::string& a, size_t b) {
+		return compare_key(a.data(), a.length(), k[b].str, k[b].len) < 0;
+	});
+	return std::make_pair(lo - order, hi - lo);
+}
+
+size_t document::value::field_count(const std::string& key) const throw(error)
+{
+	if(vtype != object)
+		throw error(ERR_NOT_AN_OBJECT);
+	if(order)
+		return find_key(key).second;
+	size_t n = 0;
+	for(size_t i = 0; i < count; i++)
+		if(keys[i].len == key.length() && !memcmp(keys[i].str, key.data(), keys[i].len))
+			n++;
+	return n;
+}
+
+const document::value& document::value::field(const std::string& key, size_t subindex) const throw(error)
+{
+	if(vtype != object)
+		throw error(ERR_NOT_AN_OBJECT);
+	if(order) {
+		std::pair<size_t, size_t> r = find_key(key);
+		if(subindex < r.second)
+			return children[order[r.first + subindex]];
+		throw error(r.second ? ERR_INSTANCE_INVALID : ERR_KEY_INVALID);
+	}
+	bool found = false;
+	for(size_t i = 0; i < count; i++)
+		if(keys[i].len == key.length() && !memcmp(keys[i].str, key.data(), keys[i].len)) {
+			found = true;
+			if(!subindex--)
+				return children[i];
+		}
+	throw error(found ? ERR_INSTANCE_INVALID : ERR_KEY_INVALID);
+}
+
+node document::value::to_node() const throw(std::bad_alloc)
+{
+	node n;
+	document::make_node(*this, n);
+	return n;
+}
+
+void document::make_node(const value& v, node& n) throw(std::bad_alloc)
+{
+	n.vtype = v.vtype;
+	switch(v.vtype) {
+	case boolean_tag::id:
+		n._boolean = v._boolean;
+		break;
+	case number_tag::id:
+		n._number = v._number;
+		break;
+	case string_tag::id:
+		n._string = utf8::to32(std::string(v._string, v.count));
+		break;
+	case array_tag::id:
+		for(size_t i = 0; i < v.count; i++)
+			make_node(v.children[i], n.append(node()));
+		break;
+	case object_tag::id:
+		for(size_t i = 0; i < v.count; i++)
+			make_node(v.children[i], n.insert(utf8::to32(std::string(v.keys[i].str, v.keys[i].len)),
+				node()));
+		break;
+	}
+}
+}
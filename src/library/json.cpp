@@ -185,9 +185,9 @@ object_tag object;
 null_tag null;
 none_tag none;
 
-template<> void node::number_holder::from(double val) { sub = 0; n.n0 = val; }
-template<> void node::number_holder::from(uint64_t val) { sub = 1; n.n1 = val; }
-template<> void node::number_holder::from(int64_t val) { sub = 2; n.n2 = val; }
+template<> void number_holder::from(double val) { sub = 0; n.n0 = val; }
+template<> void number_holder::from(uint64_t val) { sub = 1; n.n1 = val; }
+template<> void number_holder::from(int64_t val) { sub = 2; n.n2 = val; }
 
 namespace
 {
@@ -218,7 +218,7 @@ namespace
 	};
 }
 
-node::number_holder::number_holder(const std::string& expr, size_t& ptr, size_t len)
+number_holder::number_holder(const std::string& expr, size_t& ptr, size_t len)
 {
 	//-?(0|1-9[0-9]+)(.[0-9]+)?([eE][+-]?[0-9]+)?
 	int state = 0;
@@ -238,20 +238,21 @@ node::number_holder::number_holder(const std::string& expr, size_t& ptr, size_t
 		goto bad;
 	x = expr.substr(ptr, tmp - ptr);
 	ptr = tmp;
-	try {
-		if(regex_match("[0-9]+", x)) {
-			n.n1 = parse_value<uint64_t>(x);
-			sub = 1;
-			return;
-		}
-	} catch(...) {}
-	try {
-		if(regex_match("[+-]?[0-9]+", x)) {
+	//The DFA only leaves integers in states 2 and 3.
+	if(state == 2 || state == 3) {
+		try {
+			if(x[0] != '-') {
+				n.n1 = parse_value<uint64_t>(x);
+				sub = 1;
+				return;
+			}
+		} catch(...) {}
+		try {
 			n.n2 = parse_value<int64_t>(x);
 			sub = 2;
 			return;
-		}
-	} catch(...) {}
+		} catch(...) {}
+	}
 	try {
 		n.n0 = parse_value<double>(x);
 		sub = 0;
@@ -262,7 +263,7 @@ bad:
 }
 
 
-void node::number_holder::write(std::ostream& s) const
+void number_holder::write(std::ostream& s) const
 {
 	switch(sub) {
 	case 0: s << n.n0; break;
@@ -271,7 +272,7 @@ void node::number_holder::write(std::ostream& s) const
 	}
 }
 
-template<typename T> bool node::number_holder::cmp(const T& num) const
+template<typename T> bool number_holder::cmp(const T& num) const
 {
 	switch(sub) {
 	case 0: return n.n0 == num;
@@ -281,7 +282,7 @@ template<typename T> bool node::number_holder::cmp(const T& num) const
 	throw error(ERR_UNKNOWN_SUBTYPE);
 }
 
-template<> bool node::number_holder::cmp(const int64_t& num) const
+template<> bool number_holder::cmp(const int64_t& num) const
 {
 	switch(sub) {
 	case 0: return n.n0 == num;
@@ -291,7 +292,7 @@ template<> bool node::number_holder::cmp(const int64_t& num) const
 	throw error(ERR_UNKNOWN_SUBTYPE);
 }
 
-template<> bool node::number_holder::cmp(const uint64_t& num) const
+template<> bool number_holder::cmp(const uint64_t& num) const
 {
 	switch(sub) {
 	case 0: return n.n0 == num;
@@ -302,7 +303,7 @@ template<> bool node::number_holder::cmp(const uint64_t& num) const
 }
 
 
-bool node::number_holder::operator==(const number_holder& h) const
+bool number_holder::operator==(const number_holder& h) const
 {
 	switch(sub) {
 	case 0:	return h.cmp(n.n0);
@@ -446,11 +447,6 @@ errorcode node::field_soft(const std::u32string& key, size_t subindex, node*& ou
 
 node::node(const node& _node) throw(std::bad_alloc)
 {
-	std::u32string tmp1 = _node._string;
-	std::list<node> tmp2 = _node.xarray;
-	std::map<std::u32string, std::list<node>> tmp3 = _node.xobject;
-	std::vector<node*> tmp4 = _node.xarray_index;
-
 	vtype = _node.vtype;
 	_number = _node._number;
 	_boolean = _node._boolean;
@@ -758,12 +754,56 @@ namespace
 		return i;
 	}
 
-	void read_string(std::u32string& target, const std::string& doc, size_t& ptr, size_t len)
+	class utf8_appender
+	{
+	public:
+		utf8_appender(std::string& _out) : out(_out) {}
+		utf8_appender& operator*() { return *this; }
+		utf8_appender& operator++() { return *this; }
+		void operator=(char32_t ch)
+		{
+			if(ch < 0x80)
+				out.push_back(ch);
+			else if(ch < 0x800) {
+				out.push_back(0xC0 + (ch >> 6));
+				out.push_back(0x80 + (ch & 0x3F));
+			} else if(ch < 0x10000) {
+				out.push_back(0xE0 + (ch >> 12));
+				out.push_back(0x80 + ((ch >> 6) & 0x3F));
+				out.push_back(0x80 + (ch & 0x3F));
+			} else {
+				out.push_back(0xF0 + (ch >> 18));
+				out.push_back(0x80 + ((ch >> 12) & 0x3F));
+				out.push_back(0x80 + ((ch >> 6) & 0x3F));
+				out.push_back(0x80 + (ch & 0x3F));
+			}
+		}
+	private:
+		std::string& out;
+	};
+
+	//Read string as UTF-8. Plain ASCII strings without escapes are returned from doc itself, others are decoded
+	//to scratch.
+	void read_string_utf8(std::string& scratch, const char*& str, size_t& slen, const std::string& doc,
+		size_t& ptr, size_t len)
 	{
-		size_t cpcnt;
-		read_string_impl(iterator_counter(cpcnt), doc, ptr, len);
-		target.resize(cpcnt);
-		ptr = read_string_impl(target.begin(), doc, ptr, len) + 1;
+		size_t i = ptr;
+		while(i < len) {
+			unsigned char ch = doc[i];
+			if(ch < 32 || ch >= 128 || ch == '\\' || ch == '\"')
+				break;
+			i++;
+		}
+		if(i < len && doc[i] == '\"') {
+			str = doc.data() + ptr;
+			slen = i - ptr;
+			ptr = i + 1;
+			return;
+		}
+		scratch.clear();
+		ptr = read_string_impl(utf8_appender(scratch), doc, ptr, len) + 1;
+		str = scratch.data();
+		slen = scratch.length();
 	}
 
 	json_token parse_token(const std::string& doc, size_t& ptr, size_t len)
@@ -875,6 +915,27 @@ bad:
 		}
 	}
 
+	//Read object key and the colon after it.
+	void read_object_key(sax_handler& h, std::string& scratch, const std::string& doc, size_t& ptr, size_t len)
+	{
+		const char* str;
+		size_t slen;
+		size_t tmp3 = ptr;
+		json_token t = parse_token(doc, ptr, len);
+		if(t.type == json_token::TEOF)
+			throw error(ERR_TRUNCATED_JSON, PARSE_OBJECT_NAME, ptr);
+		if(t.type != json_token::TSTRING)
+			throw error(ERR_EXPECTED_STRING_KEY, PARSE_OBJECT_NAME, tmp3);
+		read_string_utf8(scratch, str, slen, doc, ptr, len);
+		tmp3 = ptr;
+		t = parse_token(doc, ptr, len);
+		if(t.type == json_token::TEOF)
+			throw error(ERR_TRUNCATED_JSON, PARSE_OBJECT_COLON, ptr);
+		if(t.type != json_token::TCOLON)
+			throw error(ERR_EXPECTED_COLON, PARSE_OBJECT_COLON, tmp3);
+		h.object_key(str, slen);
+	}
+
 	std::u32string pointer_escape_field(const std::u32string& orig) throw(std::bad_alloc)
 	{
 		std::basic_stringstream<char32_t> x;
@@ -939,108 +1000,178 @@ std::string node::serialize(printer* _printer) const throw(std::bad_alloc, error
 	throw error(ERR_UNKNOWN_TYPE);
 }
 
-node::node(const std::string& doc) throw(std::bad_alloc, error)
+sax_handler::~sax_handler() throw()
 {
-	size_t tmp = 0;
-	ctor(doc, tmp, doc.length());
-	skip_ws(doc, tmp, doc.length());
-	if(tmp < doc.length())
-		throw error(ERR_GARBAGE_AFTER_END, PARSE_END_OF_DOCUMENT, tmp);
 }
 
-void node::ctor(const std::string& doc, size_t& ptr, size_t len) throw(std::bad_alloc, error)
+void sax_parse(const std::string& doc, sax_handler& h) throw(std::bad_alloc, error)
 {
-	size_t tmp3;
-	tmp3 = ptr;
-	json_token t = parse_token(doc, ptr, len);
-	size_t tmp = ptr;
-	std::string tmp2;
-	switch(t.type) {
-	case json_token::TTRUE:
-		set(boolean, true);
-		return;
-	case json_token::TFALSE:
-		set(boolean, false);
-		return;
-	case json_token::TNULL:
-		set(null);
-		return;
-	case json_token::TEOF:
-		throw error(ERR_TRUNCATED_JSON, PARSE_VALUE_START, ptr);
-	case json_token::TCOMMA:
-		throw error(ERR_UNEXPECTED_COMMA, PARSE_VALUE_START, tmp3);
-	case json_token::TCOLON:
-		throw error(ERR_UNEXPECTED_COLON, PARSE_VALUE_START, tmp3);
-	case json_token::TARRAY_END:
-		throw error(ERR_UNEXPECTED_RIGHT_BRACKET, PARSE_VALUE_START, tmp3);
-	case json_token::TOBJECT_END:
-		throw error(ERR_UNEXPECTED_RIGHT_BRACE, PARSE_VALUE_START, tmp3);
-	case json_token::TSTRING:
-		set(string, U"");
-		read_string(_string, doc, ptr, len);
-		break;
-	case json_token::TNUMBER:
-		set(number, 0.0);
-		_number = number_holder(doc, ptr, len);
-		break;
-	case json_token::TOBJECT:
-		*this = object();
-		if(parse_token(doc, tmp, len).type == json_token::TOBJECT_END) {
-			ptr = tmp;
+	size_t ptr = 0;
+	size_t len = doc.length();
+	std::string scratch;
+	const char* str;
+	size_t slen;
+	//'[' or '{' for each open array or object.
+	std::vector<char> stack;
+	while(true) {
+		//Value.
+		size_t tmp3 = ptr;
+		json_token t = parse_token(doc, ptr, len);
+		size_t tmp = ptr;
+		switch(t.type) {
+		case json_token::TTRUE:
+			h.boolean_value(true);
 			break;
-		}
-		while(true) {
-			tmp3 = ptr;
-			json_token t2 = parse_token(doc, ptr, len);
-			if(t2.type == json_token::TEOF)
-				throw error(ERR_TRUNCATED_JSON, PARSE_OBJECT_NAME, ptr);
-			if(t2.type != json_token::TSTRING)
-				throw error(ERR_EXPECTED_STRING_KEY, PARSE_OBJECT_NAME, tmp3);
-			std::u32string key;
-			read_string(key, doc, ptr, len);
-			tmp3 = ptr;
-			t2 = parse_token(doc, ptr, len);
-			if(t2.type == json_token::TEOF)
-				throw error(ERR_TRUNCATED_JSON, PARSE_OBJECT_COLON, ptr);
-			if(t2.type != json_token::TCOLON)
-				throw error(ERR_EXPECTED_COLON, PARSE_OBJECT_COLON, tmp3);
-			insert(key, node(doc, ptr, len));
-			tmp3 = ptr;
-			t2 = parse_token(doc, ptr, len);
-			if(t2.type == json_token::TEOF)
-				throw error(ERR_TRUNCATED_JSON, PARSE_OBJECT_AFTER_VALUE, ptr);
-			if(t2.type == json_token::TOBJECT_END)
-				break;
-			if(t2.type != json_token::TCOMMA)
-				throw error(ERR_EXPECTED_COMMA, PARSE_OBJECT_AFTER_VALUE, tmp3);
-		}
-		break;
-	case json_token::TARRAY:
-		*this = array();
-		if(parse_token(doc, tmp, len).type == json_token::TARRAY_END) {
-			ptr = tmp;
+		case json_token::TFALSE:
+			h.boolean_value(false);
 			break;
+		case json_token::TNULL:
+			h.null_value();
+			break;
+		case json_token::TEOF:
+			throw error(ERR_TRUNCATED_JSON, PARSE_VALUE_START, ptr);
+		case json_token::TCOMMA:
+			throw error(ERR_UNEXPECTED_COMMA, PARSE_VALUE_START, tmp3);
+		case json_token::TCOLON:
+			throw error(ERR_UNEXPECTED_COLON, PARSE_VALUE_START, tmp3);
+		case json_token::TARRAY_END:
+			throw error(ERR_UNEXPECTED_RIGHT_BRACKET, PARSE_VALUE_START, tmp3);
+		case json_token::TOBJECT_END:
+			throw error(ERR_UNEXPECTED_RIGHT_BRACE, PARSE_VALUE_START, tmp3);
+		case json_token::TSTRING:
+			read_string_utf8(scratch, str, slen, doc, ptr, len);
+			h.string_value(str, slen);
+			break;
+		case json_token::TNUMBER:
+			h.number_value(number_holder(doc, ptr, len));
+			break;
+		case json_token::TOBJECT:
+			h.object_begin();
+			if(parse_token(doc, tmp, len).type == json_token::TOBJECT_END) {
+				ptr = tmp;
+				h.object_end();
+				break;
+			}
+			stack.push_back('{');
+			read_object_key(h, scratch, doc, ptr, len);
+			continue;
+		case json_token::TARRAY:
+			h.array_begin();
+			if(parse_token(doc, tmp, len).type == json_token::TARRAY_END) {
+				ptr = tmp;
+				h.array_end();
+				break;
+			}
+			stack.push_back('[');
+			continue;
+		case json_token::TINVALID:
+			throw error(ERR_UNKNOWN_CHARACTER, PARSE_VALUE_START, tmp3);
 		}
+		//After value: Close arrays and objects until there is a next value.
 		while(true) {
-			append(node(doc, ptr, len));
+			if(stack.empty())
+				goto out;
 			tmp3 = ptr;
 			json_token t2 = parse_token(doc, ptr, len);
-			if(t2.type == json_token::TEOF)
-				throw error(ERR_TRUNCATED_JSON, PARSE_ARRAY_AFTER_VALUE, ptr);
-			if(t2.type == json_token::TARRAY_END)
-				break;
-			if(t2.type != json_token::TCOMMA)
-				throw error(ERR_EXPECTED_COMMA, PARSE_ARRAY_AFTER_VALUE, tmp3);
+			if(stack.back() == '[') {
+				if(t2.type == json_token::TEOF)
+					throw error(ERR_TRUNCATED_JSON, PARSE_ARRAY_AFTER_VALUE, ptr);
+				if(t2.type == json_token::TARRAY_END) {
+					stack.pop_back();
+					h.array_end();
+					continue;
+				}
+				if(t2.type != json_token::TCOMMA)
+					throw error(ERR_EXPECTED_COMMA, PARSE_ARRAY_AFTER_VALUE, tmp3);
+			} else {
+				if(t2.type == json_token::TEOF)
+					throw error(ERR_TRUNCATED_JSON, PARSE_OBJECT_AFTER_VALUE, ptr);
+				if(t2.type == json_token::TOBJECT_END) {
+					stack.pop_back();
+					h.object_end();
+					continue;
+				}
+				if(t2.type != json_token::TCOMMA)
+					throw error(ERR_EXPECTED_COMMA, PARSE_OBJECT_AFTER_VALUE, tmp3);
+				read_object_key(h, scratch, doc, ptr, len);
+			}
+			break;
 		}
-		break;
-	case json_token::TINVALID:
-		throw error(ERR_UNKNOWN_CHARACTER, PARSE_VALUE_START, tmp3);
 	}
+out:
+	skip_ws(doc, ptr, len);
+	if(ptr < len)
+		throw error(ERR_GARBAGE_AFTER_END, PARSE_END_OF_DOCUMENT, ptr);
 }
 
-node::node(const std::string& doc, size_t& ptr, size_t len) throw(std::bad_alloc, error)
+/**
+ * Builds node tree from parse events. Values are built in place, so nothing is copied.
+ */
+class node::builder : public sax_handler
+{
+public:
+	builder(node& _root) : root(_root) {}
+	void null_value() { add().vtype = null; }
+	void boolean_value(bool v)
+	{
+		node& n = add();
+		n.vtype = boolean;
+		n._boolean = v;
+	}
+	void number_value(const number_holder& v)
+	{
+		node& n = add();
+		n.vtype = number;
+		n._number = v;
+	}
+	void string_value(const char* str, size_t len)
+	{
+		node& n = add();
+		n.vtype = string;
+		size_t cps = 0;
+		utf8::to32i(str, str + len, iterator_counter(cps));
+		n._string.resize(cps);
+		utf8::to32i(str, str + len, n._string.begin());
+	}
+	void array_begin()
+	{
+		node& n = add();
+		n.vtype = array;
+		stack.push_back(&n);
+	}
+	void array_end() { stack.pop_back(); }
+	void object_begin()
+	{
+		node& n = add();
+		n.vtype = object;
+		stack.push_back(&n);
+	}
+	void object_key(const char* str, size_t len)
+	{
+		key.clear();
+		utf8::to32i(str, str + len, std::back_inserter(key));
+	}
+	void object_end() { stack.pop_back(); }
+private:
+	node& add()
+	{
+		if(stack.empty())
+			return root;
+		node& parent = *stack.back();
+		if(parent.vtype == array)
+			return parent.append(node());
+		return parent.insert(key, node());
+	}
+	node& root;
+	std::vector<node*> stack;
+	std::u32string key;
+};
+
+node::node(const std::string& doc) throw(std::bad_alloc, error)
 {
-	ctor(doc, ptr, len);
+	vtype = null;
+	builder b(*this);
+	sax_parse(doc, b);
 }
 
 node& node::operator[](const std::u32string& pointer) throw(std::bad_alloc, error)
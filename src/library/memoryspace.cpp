@@ -44,19 +44,20 @@ namespace
 		return true;
 	}
 
+	//Parts past the end of region read as zeroes.
 	void read_range_r(memory_space::region& r, uint64_t offset, void* buffer, size_t bsize)
 	{
-		if(r.direct_map) {
-			if(offset >= r.size) {
-				memset(buffer, 0, bsize);
-				return;
-			}
-			uint64_t maxcopy = min(static_cast<uint64_t>(bsize), r.size - offset);
+		if(offset >= r.size) {
+			memset(buffer, 0, bsize);
+			return;
+		}
+		uint64_t maxcopy = min(static_cast<uint64_t>(bsize), r.size - offset);
+		if(r.direct_map)
 			memcpy(buffer, r.direct_map + offset, maxcopy);
-			if(maxcopy < bsize)
-				memset(reinterpret_cast<char*>(buffer) + maxcopy, 0, bsize - maxcopy);
-		} else
-			r.read(offset, buffer, bsize);
+		else
+			r.read(offset, buffer, maxcopy);
+		if(maxcopy < bsize)
+			memset(reinterpret_cast<char*>(buffer) + maxcopy, 0, bsize - maxcopy);
 	}
 
 	bool write_range_r(memory_space::region& r, uint64_t offset, const void* buffer, size_t bsize)
@@ -216,6 +217,26 @@ void memory_space::read_range(uint64_t address, void* buffer, size_t bsize)
 	read_range_r(*g.first, g.second, buffer, bsize);
 }
 
+int memory_space::read_strided(uint64_t address, size_t size, size_t rows, uint64_t stride, void* buffer)
+{
+	char* buf = reinterpret_cast<char*>(buffer);
+	auto g = lookup(address);
+	if(!g.first) {
+		memset(buffer, 0, size * rows);
+		return 0;
+	}
+	if(stride == size) {
+		read_range_r(*g.first, g.second, buffer, size * rows);
+		return g.first->endian;
+	}
+	uint64_t offset = g.second;
+	for(size_t i = 0; i < rows; i++) {
+		read_range_r(*g.first, offset, buf + i * size, size);
+		offset += stride;
+	}
+	return g.first->endian;
+}
+
 bool memory_space::write_range(uint64_t address, const void* buffer, size_t bsize)
 {
 	auto g = lookup(address);
@@ -0,0 +1,90 @@
+#include "memorystruct.hpp"
+#include "int24.hpp"
+#include "serialization.hpp"
+
+namespace
+{
+	const size_t max_size = 65536;
+
+	size_t type_size(char t)
+	{
+		switch(t) {
+		case 'b': case 'B': case 'x': return 1;
+		case 'w': case 'W': return 2;
+		case 'h': case 'H': return 3;
+		case 'd': case 'D': case 'f': return 4;
+		case 'q': case 'Q': case 'F': return 8;
+		default: return 0;
+		}
+	}
+}
+
+memory_struct::memory_struct(const std::string& format) throw(std::bad_alloc, std::runtime_error)
+{
+	size = 0;
+	int endian = 0;
+	size_t repeat = 0;
+	bool have_repeat = false;
+	for(auto c : format) {
+		if(c >= '0' && c <= '9') {
+			repeat = 10 * repeat + (c - '0');
+			have_repeat = true;
+			if(repeat > max_size)
+				throw std::runtime_error("Structure too large");
+			continue;
+		}
+		if(c == ' ' || c == '\t' || c == '\n') {
+			if(have_repeat)
+				throw std::runtime_error("Repeat count without type");
+			continue;
+		}
+		if(c == '<' || c == '>' || c == '=') {
+			if(have_repeat)
+				throw std::runtime_error("Repeat count without type");
+			endian = (c == '<') ? -1 : (c == '>') ? 1 : 0;
+			continue;
+		}
+		size_t tsize = type_size(c);
+		if(!tsize)
+			throw std::runtime_error(std::string("Unknown type '") + c + "' in structure format");
+		size_t count = have_repeat ? repeat : 1;
+		if(size + count * tsize > max_size)
+			throw std::runtime_error("Structure too large");
+		for(size_t i = 0; i < count; i++) {
+			if(c != 'x') {
+				field f;
+				f.offset = size;
+				f.type = c;
+				f.endian = endian;
+				fields.push_back(f);
+			}
+			size += tsize;
+		}
+		repeat = 0;
+		have_repeat = false;
+	}
+	if(have_repeat)
+		throw std::runtime_error("Repeat count without type");
+}
+
+double memory_struct::get(const char* row, size_t i, int endian) const throw()
+{
+	const field& f = fields[i];
+	const char* p = row + f.offset;
+	int e = f.endian ? f.endian : endian;
+	switch(f.type) {
+	case 'b': return static_cast<int8_t>(*p);
+	case 'B': return static_cast<uint8_t>(*p);
+	case 'w': return serialization::read_endian<int16_t>(p, e);
+	case 'W': return serialization::read_endian<uint16_t>(p, e);
+	case 'h': return (int32_t)serialization::read_endian<ss_int24_t>(p, e);
+	case 'H': return (uint32_t)serialization::read_endian<ss_uint24_t>(p, e);
+	case 'd': return serialization::read_endian<int32_t>(p, e);
+	case 'D': return serialization::read_endian<uint32_t>(p, e);
+	case 'q': return serialization::read_endian<int64_t>(p, e);
+	case 'Q': return serialization::read_endian<uint64_t>(p, e);
+	case 'f': return serialization::read_endian<float>(p, e);
+	case 'F': return serialization::read_endian<double>(p, e);
+	default: return 0;
+	}
+}
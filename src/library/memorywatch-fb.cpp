@@ -1,4 +1,5 @@
 #include "framebuffer-font2.hpp"
+#include "framebuffer-textcache.hpp"
 #include "memorywatch-fb.hpp"
 #include "utf8.hpp"
 #include "minmax.hpp"
@@ -8,6 +9,13 @@ namespace memorywatch
 {
 namespace
 {
+	inline bool glyph_bit(const framebuffer::font2::glyph& g, int32_t x, int32_t y)
+	{
+		if(x < 0 || y < 0 || x >= (int32_t)g.width || y >= (int32_t)g.height)
+			return false;
+		return (g.fglyph[y * g.stride + (x >> 5)] >> (31 - (x & 31))) & 1;
+	}
+
 	struct fb_object : public framebuffer::object
 	{
 		struct params
@@ -30,12 +38,14 @@ namespace
 		void clone(framebuffer::queue& q) const throw(std::bad_alloc);
 	private:
 		template<bool ext> void draw(struct framebuffer::fb<ext>& scr) throw();
+		void rasterize(framebuffer::text_cache::mask& m, uint32_t alignx, bool halo);
 		params p;
+		std::string text;
 		std::u32string msg;
 	};
 
 	fb_object::fb_object(const fb_object::params& _p, const std::string& _msg)
-		: p(_p)
+		: p(_p), text(_msg)
 	{
 		msg = utf8::to32(_msg);
 	}
@@ -90,7 +100,6 @@ namespace
 		}
 		drawx = p.x;
 		drawy = p.y;
-		orig_x = p.x;
 		if(p.cliprange_x) {
 			if(drawx < 0)
 				drawx = 0;
@@ -104,10 +113,35 @@ namespace
 				drawy = scr.get_height() - height;
 		}
 		if(has_halo) {
-			orig_x++;
 			drawx++;
 			drawy++;
 		}
+		//Tabs align relative to screen, so with tabs the alignment is part of the key.
+		uint32_t alignx = (text.find('\t') < text.length()) ? (drawx & 63) : 0;
+		std::shared_ptr<const framebuffer::text_cache::mask> m;
+		try {
+			m = framebuffer::text_cache::global().get(p.font, framebuffer::text_cache::KIND_WATCH, text,
+				(has_halo ? 1 : 0) | (alignx << 1),
+				[this, alignx, has_halo](framebuffer::text_cache::mask& m) {
+					rasterize(m, alignx, has_halo); });
+		} catch(std::bad_alloc& e) {
+			return;
+		}
+		framebuffer::color cmap[4] = {framebuffer::color(-1), p.fg, p.halo, p.bg};
+		uint32_t border = has_halo ? 1 : 0;
+		framebuffer::text_cache::blit(scr, drawx - border, drawy - border, *m, cmap);
+	}
+
+	//Mask: 0 is outside glyphs, 1 is foreground, 2 is halo and 3 is background. Where glyph boxes overlap, the
+	//later glyph wins.
+	void fb_object::rasterize(framebuffer::text_cache::mask& m, uint32_t alignx, bool halo)
+	{
+		int32_t border = halo ? 1 : 0;
+		std::vector<std::pair<std::pair<int32_t, int32_t>, const framebuffer::font2::glyph*>> placed;
+		int32_t drawx = alignx;
+		int32_t drawy = 0;
+		uint32_t width = 0;
+		uint32_t height = 0;
 		for(size_t i = 0; i < msg.size();) {
 			uint32_t cp = msg[i];
 			std::u32string k = p.font->best_ligature_match(msg, i);
@@ -119,13 +153,40 @@ namespace
 			if(cp == 9) {
 				drawx = (drawx + 64) >> 6 << 6;
 			} else if(cp == 10) {
-				drawx = orig_x;
+				drawx = alignx;
 				drawy += p.font->get_rowadvance();
 			} else {
-				glyph.render(scr, drawx, drawy, p.fg, p.bg, p.halo);
+				//Mask coordinates of the glyph box (including halo).
+				int32_t bx = drawx - alignx;
+				int32_t by = drawy;
+				placed.push_back(std::make_pair(std::make_pair(bx, by), &glyph));
+				width = max(width, (uint32_t)(bx + glyph.width + 2 * border));
+				height = max(height, (uint32_t)(by + glyph.height + 2 * border));
 				drawx += glyph.width;
 			}
 		}
+		m.width = width;
+		m.height = height;
+		m.data.resize(width * height);
+		for(auto& i : placed) {
+			const framebuffer::font2::glyph& g = *i.second;
+			for(int32_t y = 0; y < (int32_t)g.height + 2 * border; y++) {
+				uint8_t* row = &m.data[(i.first.second + y) * width + i.first.first];
+				for(int32_t x = 0; x < (int32_t)g.width + 2 * border; x++) {
+					int32_t gx = x - border;
+					int32_t gy = y - border;
+					if(glyph_bit(g, gx, gy))
+						row[x] = 1;
+					else if(halo && (glyph_bit(g, gx - 1, gy - 1) || glyph_bit(g, gx, gy - 1) ||
+						glyph_bit(g, gx + 1, gy - 1) || glyph_bit(g, gx - 1, gy) ||
+						glyph_bit(g, gx + 1, gy) || glyph_bit(g, gx - 1, gy + 1) ||
+						glyph_bit(g, gx, gy + 1) || glyph_bit(g, gx + 1, gy + 1)))
+						row[x] = 2;
+					else
+						row[x] = 3;
+				}
+			}
+		}
 	}
 }
 
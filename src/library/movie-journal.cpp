@@ -0,0 +1,463 @@
+#include "movie-journal.hpp"
+#include "filemap.hpp"
+#include "serialization.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <zlib.h>
+#include <fcntl.h>
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+	//Journal header: magic, length of base identifier and the identifier.
+	const char journal_magic[] = "LSMVJNL1";
+	const size_t journal_header = 12;
+	//Record header: type, length of payload.
+	const size_t record_header = 5;
+	//Record types.
+	const char rec_length = 'L';		//Name, stride, subframes.
+	const char rec_data = 'D';		//Name, block index, compressed block.
+	const char rec_remove = 'X';		//Name.
+	const char rec_meta = 'M';		//Key, value.
+	const char rec_unmeta = 'K';		//Key.
+	const char rec_commit = 'C';		//CRC-32 of batch up to this record.
+	//Block data is usually very compressible, and speed matters more than ratio.
+	const int block_compression = 1;
+
+#if defined(_WIN32) || defined(_WIN64)
+	int j_open(const std::string& name, bool trunc)
+	{
+		return _open(name.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (trunc ? _O_TRUNC : 0), 0666);
+	}
+	int j_write(int fd, const char* buf, size_t size) { return _write(fd, buf, size); }
+	int j_flush(int fd) { return _commit(fd); }
+	int j_truncate(int fd, uint64_t size)
+	{
+		if(_chsize_s(fd, size))
+			return -1;
+		return (_lseeki64(fd, size, SEEK_SET) < 0) ? -1 : 0;
+	}
+	void j_close(int fd) { _close(fd); }
+#else
+	int j_open(const std::string& name, bool trunc)
+	{
+		return open(name.c_str(), O_WRONLY | O_CREAT | (trunc ? O_TRUNC : 0), 0666);
+	}
+	int j_write(int fd, const char* buf, size_t size) { return write(fd, buf, size); }
+	int j_flush(int fd) { return fsync(fd); }
+	int j_truncate(int fd, uint64_t size)
+	{
+		if(ftruncate(fd, size))
+			return -1;
+		return (lseek(fd, size, SEEK_SET) < 0) ? -1 : 0;
+	}
+	void j_close(int fd) { close(fd); }
+#endif
+
+	void put_u32(std::vector<char>& out, uint32_t v)
+	{
+		size_t p = out.size();
+		out.resize(p + 4);
+		serialization::u32b(&out[p], v);
+	}
+
+	void put_u64(std::vector<char>& out, uint64_t v)
+	{
+		size_t p = out.size();
+		out.resize(p + 8);
+		serialization::u64b(&out[p], v);
+	}
+
+	void put_string(std::vector<char>& out, const std::string& s)
+	{
+		put_u32(out, s.length());
+		out.insert(out.end(), s.begin(), s.end());
+	}
+
+	//Returns offset of the payload, for end_record().
+	size_t begin_record(std::vector<char>& out, char type)
+	{
+		out.push_back(type);
+		put_u32(out, 0);
+		return out.size();
+	}
+
+	void end_record(std::vector<char>& out, size_t payload)
+	{
+		serialization::u32b(&out[payload - 4], out.size() - payload);
+	}
+
+	//Reads fields of a record payload.
+	struct payload_reader
+	{
+		payload_reader(const char* _ptr, size_t _left) : ptr(_ptr), left(_left) {}
+		uint32_t u32()
+		{
+			need(4);
+			uint32_t v = serialization::u32b(ptr);
+			ptr += 4;
+			left -= 4;
+			return v;
+		}
+		uint64_t u64()
+		{
+			need(8);
+			uint64_t v = serialization::u64b(ptr);
+			ptr += 8;
+			left -= 8;
+			return v;
+		}
+		std::string string()
+		{
+			uint32_t len = u32();
+			need(len);
+			std::string v(ptr, len);
+			ptr += len;
+			left -= len;
+			return v;
+		}
+		std::string rest()
+		{
+			std::string v(ptr, left);
+			ptr += left;
+			left = 0;
+			return v;
+		}
+		void need(size_t amount)
+		{
+			if(left < amount)
+				throw std::runtime_error("Truncated journal record");
+		}
+		const char* ptr;
+		size_t left;
+	};
+
+	//Copy bytes to frame vector, starting from given byte offset.
+	void write_range(portctrl::frame_vector& v, uint64_t offset, const unsigned char* data, size_t size)
+	{
+		size_t stride = v.get_stride();
+		uint64_t pos = 0;
+		for(size_t i = 0; i < v.get_page_count() && size; i++) {
+			uint64_t bytes = v.get_page_frames(i) * stride;
+			if(offset < pos + bytes) {
+				size_t amount = std::min(pos + bytes - offset, (uint64_t)size);
+				memcpy(v.get_page_buffer(i) + (offset - pos), data, amount);
+				data += amount;
+				offset += amount;
+				size -= amount;
+			}
+			pos += bytes;
+		}
+		if(size)
+			throw std::runtime_error("Journal block past the end of input");
+	}
+
+	//Apply one record. Returns true for commit records.
+	bool apply_record(char type, payload_reader r, std::map<std::string, portctrl::frame_vector>& branches,
+		const portctrl::type_set& types, std::map<std::string, std::string>& meta,
+		std::set<std::string>& touched)
+	{
+		if(type == rec_length) {
+			std::string name = r.string();
+			size_t stride = r.u32();
+			uint64_t subframes = r.u64();
+			if(!branches.count(name)) {
+				if(types.size() != stride)
+					throw std::runtime_error("Journal branch does not match the controller types");
+				branches.insert(std::make_pair(name, portctrl::frame_vector(types)));
+			}
+			portctrl::frame_vector& v = branches.find(name)->second;
+			if(v.get_stride() != stride)
+				throw std::runtime_error("Journal branch does not match the controller types");
+			v.resize(subframes);
+			touched.insert(name);
+		} else if(type == rec_data) {
+			std::string name = r.string();
+			uint64_t block = r.u64();
+			std::string cdata = r.rest();
+			if(!branches.count(name))
+				throw std::runtime_error("Journal block for unknown branch");
+			portctrl::frame_vector& v = branches.find(name)->second;
+			uint64_t first = block * movie_journal::block_subframes;
+			if(first >= v.size())
+				throw std::runtime_error("Journal block past the end of input");
+			uLongf size = std::min((uint64_t)movie_journal::block_subframes, v.size() - first) *
+				v.get_stride();
+			std::vector<unsigned char> buf(size);
+			uLongf got = size;
+			if(uncompress(&buf[0], &got, reinterpret_cast<const Bytef*>(cdata.data()), cdata.length()) !=
+				Z_OK || got != size)
+				throw std::runtime_error("Corrupt journal block");
+			write_range(v, first * v.get_stride(), &buf[0], size);
+			touched.insert(name);
+		} else if(type == rec_remove) {
+			branches.erase(r.string());
+		} else if(type == rec_meta) {
+			std::string key = r.string();
+			meta[key] = r.rest();
+		} else if(type == rec_unmeta) {
+			meta.erase(r.string());
+		} else if(type == rec_commit)
+			return true;
+		else
+			throw std::runtime_error("Unknown journal record");
+		return false;
+	}
+}
+
+movie_journal::movie_journal() throw()
+{
+	fd = -1;
+	size = 0;
+}
+
+movie_journal::~movie_journal() throw()
+{
+	close();
+}
+
+void movie_journal::close() throw()
+{
+	if(fd >= 0)
+		j_close(fd);
+	fd = -1;
+	size = 0;
+	snap_input.clear();
+	snap_meta.clear();
+}
+
+void movie_journal::snapshot(const std::map<std::string, portctrl::frame_vector>& branches,
+	const std::map<std::string, std::string>& meta)
+{
+	snap_input.clear();
+	for(auto& i : branches) {
+		branch_snapshot& s = snap_input[i.first];
+		const portctrl::frame_vector& v = i.second;
+		s.stride = v.get_stride();
+		s.data.resize(v.size() * s.stride);
+		size_t ptr = 0;
+		for(size_t j = 0; j < v.get_page_count(); j++) {
+			size_t bytes = v.get_page_frames(j) * s.stride;
+			if(bytes)
+				memcpy(&s.data[ptr], v.get_page_buffer(j), bytes);
+			ptr += bytes;
+		}
+	}
+	snap_meta = meta;
+}
+
+void movie_journal::write_batch(std::vector<char>& batch)
+{
+	size_t ptr = 0;
+	while(ptr < batch.size()) {
+		int r = j_write(fd, &batch[ptr], batch.size() - ptr);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r <= 0) {
+			close();
+			throw std::runtime_error("Can't write journal");
+		}
+		ptr += r;
+	}
+	if(j_flush(fd)) {
+		close();
+		throw std::runtime_error("Can't flush journal");
+	}
+	size += batch.size();
+}
+
+void movie_journal::start(const std::string& _filename, const std::string& _base,
+	const std::map<std::string, portctrl::frame_vector>& branches,
+	const std::map<std::string, std::string>& meta) throw(std::bad_alloc, std::runtime_error)
+{
+	close();
+	fd = j_open(_filename, true);
+	if(fd < 0)
+		throw std::runtime_error("Can't create journal");
+	filename = _filename;
+	base = _base;
+	std::vector<char> header(journal_magic, journal_magic + 8);
+	put_string(header, base);
+	write_batch(header);
+	snapshot(branches, meta);
+}
+
+uint64_t movie_journal::recover(const std::string& _filename, const std::string& _base,
+	std::map<std::string, portctrl::frame_vector>& branches, const portctrl::type_set& types,
+	std::map<std::string, std::string>& meta) throw(std::bad_alloc, std::runtime_error)
+{
+	close();
+	uint64_t batches = 0;
+	size_t valid_end = 0;
+	std::map<std::string, portctrl::frame_vector> nbranches = branches;
+	std::map<std::string, std::string> nmeta = meta;
+	std::set<std::string> touched;
+	try {
+		filemap::mapping m(_filename);
+		const char* d = m.data();
+		size_t len = m.size();
+		if(len < journal_header || memcmp(d, journal_magic, 8))
+			return 0;
+		uint32_t baselen = serialization::u32b(d + 8);
+		if(len - journal_header < baselen || std::string(d + journal_header, baselen) != _base)
+			return 0;
+		//Find the end of last complete batch, then apply the batches up to it.
+		size_t first = journal_header + baselen;
+		size_t batch_start = first;
+		valid_end = first;
+		for(size_t ptr = first; ptr + record_header <= len;) {
+			size_t plen = serialization::u32b(d + ptr + 1);
+			if(len - ptr - record_header < plen)
+				break;
+			if(d[ptr] == rec_commit) {
+				if(plen != 4 || serialization::u32b(d + ptr + record_header) != crc32(0,
+					reinterpret_cast<const Bytef*>(d + batch_start), ptr - batch_start))
+					break;
+				batch_start = valid_end = ptr + record_header + plen;
+			}
+			ptr += record_header + plen;
+		}
+		for(size_t ptr = first; ptr < valid_end;) {
+			size_t plen = serialization::u32b(d + ptr + 1);
+			if(apply_record(d[ptr], payload_reader(d + ptr + record_header, plen), nbranches, types,
+				nmeta, touched))
+				batches++;
+			ptr += record_header + plen;
+		}
+	} catch(std::bad_alloc& e) {
+		throw;
+	} catch(...) {
+		//No journal, or it is damaged past repair.
+		return 0;
+	}
+	if(!batches)
+		return 0;
+	for(auto& i : touched)
+		if(nbranches.count(i))
+			nbranches[i].recount_frames();
+	//Assign element-wise, so that pointers to surviving branches stay valid.
+	for(auto i = branches.begin(); i != branches.end();) {
+		if(nbranches.count(i->first))
+			i++;
+		else
+			branches.erase(i++);
+	}
+	for(auto& i : nbranches)
+		if(touched.count(i.first) || !branches.count(i.first))
+			branches[i.first] = i.second;
+	meta = nmeta;
+
+	fd = j_open(_filename, false);
+	if(fd < 0 || j_truncate(fd, valid_end)) {
+		close();
+		throw std::runtime_error("Can't open journal for writing");
+	}
+	filename = _filename;
+	base = _base;
+	size = valid_end;
+	snapshot(branches, meta);
+	return batches;
+}
+
+uint64_t movie_journal::sync(const std::map<std::string, portctrl::frame_vector>& branches,
+	const std::map<std::string, std::string>& meta) throw(std::bad_alloc, std::runtime_error)
+{
+	if(fd < 0)
+		return 0;
+	std::vector<char> batch;
+	for(auto& i : branches) {
+		const portctrl::frame_vector& v = i.second;
+		bool is_new = !snap_input.count(i.first);
+		branch_snapshot& s = snap_input[i.first];
+		if(is_new || s.stride != v.get_stride()) {
+			s.stride = v.get_stride();
+			s.data.clear();
+			is_new = true;
+		}
+		size_t bsize = block_subframes * s.stride;
+		size_t old_size = s.data.size();
+		size_t nbytes = v.size() * s.stride;
+		s.data.resize(nbytes);
+		//Compare the pages to the snapshot block by block, without copying unchanged data.
+		std::set<uint64_t> dirty;
+		size_t off = 0;
+		for(size_t j = 0; j < v.get_page_count(); j++) {
+			const unsigned char* page = v.get_page_buffer(j);
+			size_t bytes = v.get_page_frames(j) * s.stride;
+			for(size_t pos = off; pos < off + bytes;) {
+				uint64_t blk = pos / bsize;
+				size_t segend = std::min(off + bytes, (size_t)(blk + 1) * bsize);
+				const unsigned char* src = page + (pos - off);
+				if(segend > old_size || memcmp(&s.data[pos], src, segend - pos)) {
+					memcpy(&s.data[pos], src, segend - pos);
+					dirty.insert(blk);
+				}
+				pos = segend;
+			}
+			off += bytes;
+		}
+		if(is_new || nbytes != old_size) {
+			size_t p = begin_record(batch, rec_length);
+			put_string(batch, i.first);
+			put_u32(batch, s.stride);
+			put_u64(batch, v.size());
+			end_record(batch, p);
+		}
+		for(auto blk : dirty) {
+			size_t first = blk * bsize;
+			size_t bytes = std::min(nbytes - first, bsize);
+			size_t p = begin_record(batch, rec_data);
+			put_string(batch, i.first);
+			put_u64(batch, blk);
+			uLongf csize = compressBound(bytes);
+			size_t cptr = batch.size();
+			batch.resize(cptr + csize);
+			if(compress2(reinterpret_cast<Bytef*>(&batch[cptr]), &csize, &s.data[first], bytes,
+				block_compression) != Z_OK)
+				throw std::runtime_error("Failed to compress journal block");
+			batch.resize(cptr + csize);
+			end_record(batch, p);
+		}
+	}
+	for(auto i = snap_input.begin(); i != snap_input.end();) {
+		if(branches.count(i->first)) {
+			i++;
+			continue;
+		}
+		size_t p = begin_record(batch, rec_remove);
+		put_string(batch, i->first);
+		end_record(batch, p);
+		snap_input.erase(i++);
+	}
+	for(auto& i : meta) {
+		auto j = snap_meta.find(i.first);
+		if(j != snap_meta.end() && j->second == i.second)
+			continue;
+		size_t p = begin_record(batch, rec_meta);
+		put_string(batch, i.first);
+		batch.insert(batch.end(), i.second.begin(), i.second.end());
+		end_record(batch, p);
+	}
+	for(auto& i : snap_meta) {
+		if(meta.count(i.first))
+			continue;
+		size_t p = begin_record(batch, rec_unmeta);
+		put_string(batch, i.first);
+		end_record(batch, p);
+	}
+	snap_meta = meta;
+	if(batch.empty())
+		return 0;
+	uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(&batch[0]), batch.size());
+	size_t p = begin_record(batch, rec_commit);
+	put_u32(batch, crc);
+	end_record(batch, p);
+	write_batch(batch);
+	return batch.size();
+}
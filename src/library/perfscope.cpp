@@ -0,0 +1,198 @@
+#include "perfscope.hpp"
+#include "json.hpp"
+#include "minmax.hpp"
+#include "threads.hpp"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <vector>
+
+namespace perfscope
+{
+volatile bool active = false;
+
+namespace
+{
+	//Regions are registered from static constructors, so these have to be zero-initialized PODs.
+	const unsigned max_regions = 128;
+	region* regions[max_regions];
+	unsigned region_count;
+
+	struct region_data
+	{
+		uint64_t frame_ns;		//Time accumulated in current frame.
+		uint64_t calls;			//Total number of calls.
+		std::vector<uint64_t> frames;	//Time per completed frame.
+	};
+
+	struct event
+	{
+		unsigned region;
+		unsigned thread;
+		uint64_t start;
+		uint64_t duration;
+	};
+
+	threads::lock data_lock;
+	region_data data[max_regions];
+	bool tracing;
+	size_t trace_limit;
+	std::vector<event> trace;
+	uint64_t frames;
+	uint64_t dropped_events;
+	unsigned next_thread;
+	thread_local unsigned thread_id;
+
+	uint64_t get_ns()
+	{
+		static auto base = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::high_resolution_clock::now() - base).count();
+	}
+
+	uint64_t percentile(const std::vector<uint64_t>& sorted, unsigned p)
+	{
+		if(sorted.empty())
+			return 0;
+		return sorted[min((size_t)((sorted.size() * p) / 100), sorted.size() - 1)];
+	}
+}
+
+region::region(const char* _name) throw()
+{
+	name = _name;
+	index = region_count;
+	if(region_count < max_regions)
+		regions[region_count++] = this;
+}
+
+void scope::begin(region& r) throw()
+{
+	reg = (r.get_index() < max_regions) ? &r : NULL;
+	start = get_ns();
+}
+
+void scope::end() throw()
+{
+	uint64_t now = get_ns();
+	threads::alock h(data_lock);
+	if(!active)
+		return;
+	region_data& d = data[reg->get_index()];
+	d.frame_ns += now - start;
+	d.calls++;
+	if(!tracing)
+		return;
+	if(trace.size() >= trace_limit) {
+		dropped_events++;
+		return;
+	}
+	if(!thread_id)
+		thread_id = ++next_thread;
+	event e;
+	e.region = reg->get_index();
+	e.thread = thread_id;
+	e.start = start;
+	e.duration = now - start;
+	try {
+		trace.push_back(e);
+	} catch(...) {
+		dropped_events++;
+	}
+}
+
+void enable(bool timing, bool _trace, size_t max_events) throw(std::bad_alloc)
+{
+	threads::alock h(data_lock);
+	active = false;
+	if(!timing)
+		return;
+	for(unsigned i = 0; i < max_regions; i++) {
+		data[i].frame_ns = 0;
+		data[i].calls = 0;
+		data[i].frames.clear();
+	}
+	trace.clear();
+	frames = 0;
+	dropped_events = 0;
+	tracing = _trace;
+	trace_limit = max_events;
+	if(tracing)
+		trace.reserve(min(max_events, (size_t)65536));
+	active = true;
+}
+
+void end_frame() throw(std::bad_alloc)
+{
+	if(!active)
+		return;
+	threads::alock h(data_lock);
+	for(unsigned i = 0; i < region_count; i++) {
+		data[i].frames.push_back(data[i].frame_ns);
+		data[i].frame_ns = 0;
+	}
+	frames++;
+}
+
+std::string report_json() throw(std::bad_alloc)
+{
+	threads::alock h(data_lock);
+	JSON::node r(JSON::object);
+	r.insert("frames", JSON::u(frames));
+	if(tracing)
+		r.insert("dropped_events", JSON::u(dropped_events));
+	JSON::node& regs = r.insert("regions", JSON::node(JSON::object));
+	for(unsigned i = 0; i < region_count; i++) {
+		std::vector<uint64_t> sorted = data[i].frames;
+		std::sort(sorted.begin(), sorted.end());
+		uint64_t total = 0;
+		JSON::node histogram(JSON::array);
+		std::vector<uint64_t> buckets;
+		for(auto j : sorted) {
+			total += j;
+			uint64_t us = j / 1000;
+			size_t b = 0;
+			while(us) {
+				b++;
+				us >>= 1;
+			}
+			if(b >= buckets.size())
+				buckets.resize(b + 1);
+			buckets[b]++;
+		}
+		for(auto j : buckets)
+			histogram.append(JSON::u(j));
+		JSON::node& reg = regs.insert(regions[i]->get_name(), JSON::node(JSON::object));
+		reg.insert("calls", JSON::u(data[i].calls));
+		reg.insert("total_us", JSON::f(total / 1000.0));
+		reg.insert("mean_us", JSON::f(sorted.empty() ? 0.0 : total / 1000.0 / sorted.size()));
+		reg.insert("min_us", JSON::f(sorted.empty() ? 0.0 : sorted.front() / 1000.0));
+		reg.insert("p50_us", JSON::f(percentile(sorted, 50) / 1000.0));
+		reg.insert("p90_us", JSON::f(percentile(sorted, 90) / 1000.0));
+		reg.insert("p99_us", JSON::f(percentile(sorted, 99) / 1000.0));
+		reg.insert("max_us", JSON::f(sorted.empty() ? 0.0 : sorted.back() / 1000.0));
+		reg.insert("histogram", histogram);
+	}
+	JSON::printer_indenting ip;
+	return r.serialize(&ip);
+}
+
+std::string trace_json() throw(std::bad_alloc)
+{
+	threads::alock h(data_lock);
+	//Traces can have millions of events, so this does not go through JSON::node.
+	std::ostringstream o;
+	o << "{\"traceEvents\":[";
+	bool first = true;
+	for(auto& e : trace) {
+		if(!first)
+			o << ",";
+		first = false;
+		o << "\n{\"name\":\"" << regions[e.region]->get_name() << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+			<< e.thread << ",\"ts\":" << e.start / 1000 << "." << (e.start % 1000) / 100 << ",\"dur\":"
+			<< e.duration / 1000 << "." << (e.duration % 1000) / 100 << "}";
+	}
+	o << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return o.str();
+}
+}
@@ -0,0 +1,210 @@
+#include "portctrl-chunked.hpp"
+#include "binarystream.hpp"
+#include "sha256.hpp"
+#include "threads-pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <zlib.h>
+
+namespace portctrl
+{
+chunked_input::chunked_input() throw()
+{
+	stride = 0;
+}
+
+uint64_t chunked_input::get_subframes() const throw()
+{
+	if(chunks.empty())
+		return 0;
+	return chunks.back().info.first_subframe + chunks.back().info.subframes;
+}
+
+void chunked_input::update_offsets()
+{
+	uint64_t subframe = 0;
+	uint64_t frame = 0;
+	for(auto& i : chunks) {
+		i.info.first_subframe = subframe;
+		i.info.first_frame = frame;
+		subframe += i.info.subframes;
+		frame += i.info.syncs;
+	}
+}
+
+void chunked_input::encode(const frame_vector& v, unsigned level) throw(std::bad_alloc, std::runtime_error)
+{
+	//Chunks don't follow page boundaries, so copy the input to one buffer first.
+	size_t nstride = v.get_stride();
+	uint64_t total = v.size();
+	std::vector<unsigned char> buf(total * nstride);
+	size_t ptr = 0;
+	for(size_t i = 0; i < v.get_page_count(); i++) {
+		size_t bytes = v.get_page_frames(i) * nstride;
+		memcpy(&buf[ptr], v.get_page_buffer(i), bytes);
+		ptr += bytes;
+	}
+	//Chunks of previous encoding that can be reused.
+	std::map<std::string, const chunk*> old;
+	if(nstride == stride)
+		for(auto& i : chunks)
+			if(i.hash_valid)
+				old[std::string(reinterpret_cast<const char*>(i.hash), 32)] = &i;
+
+	std::vector<chunk> nchunks((total + chunk_subframes - 1) / chunk_subframes);
+	threads::pool::global().parallel_for(0, nchunks.size(), [&buf, &nchunks, &old, nstride, total, level](
+		size_t low, size_t high) {
+		for(size_t i = low; i < high; i++) {
+			chunk& c = nchunks[i];
+			uint64_t first = (uint64_t)i * chunk_subframes;
+			c.info.subframes = std::min((uint64_t)chunk_subframes, total - first);
+			const unsigned char* data = &buf[first * nstride];
+			size_t size = c.info.subframes * nstride;
+			c.info.syncs = 0;
+			for(size_t j = 0; j < c.info.subframes; j++)
+				if(frame::sync(data + j * nstride))
+					c.info.syncs++;
+			c.info.crc = crc32(0, data, size);
+			sha256 h;
+			h.write(data, size);
+			h.read(c.hash);
+			c.hash_valid = true;
+			auto j = old.find(std::string(reinterpret_cast<const char*>(c.hash), 32));
+			if(j != old.end()) {
+				c.data = j->second->data;
+				continue;
+			}
+			uLongf csize = compressBound(size);
+			c.data.resize(csize);
+			if(compress2(reinterpret_cast<Bytef*>(&c.data[0]), &csize, data, size, level) != Z_OK)
+				throw std::runtime_error("Failed to compress input chunk");
+			c.data.resize(csize);
+		}
+	});
+	std::swap(chunks, nchunks);
+	stride = nstride;
+	update_offsets();
+}
+
+void chunked_input::decompress(const chunk& c, unsigned char* out) const
+{
+	uLongf size = c.info.subframes * stride;
+	if(!size)
+		return;
+	if(uncompress(out, &size, reinterpret_cast<const Bytef*>(c.data.empty() ? NULL : &c.data[0]),
+		c.data.size()) != Z_OK || size != c.info.subframes * stride)
+		throw std::runtime_error("Input chunk is corrupt");
+	if(crc32(0, out, size) != c.info.crc)
+		throw std::runtime_error("Input chunk checksum mismatch");
+}
+
+void chunked_input::decode_chunk(size_t idx, std::vector<unsigned char>& out) const throw(std::bad_alloc,
+	std::runtime_error)
+{
+	if(idx >= chunks.size())
+		throw std::runtime_error("Invalid input chunk index");
+	out.resize(chunks[idx].info.subframes * stride);
+	decompress(chunks[idx], out.empty() ? NULL : &out[0]);
+}
+
+void chunked_input::decode(frame_vector& v) throw(std::bad_alloc, std::runtime_error)
+{
+	if(v.get_stride() != stride && !chunks.empty())
+		throw std::runtime_error("Input does not match the controller types");
+	uint64_t total = get_subframes();
+	std::vector<unsigned char> buf(total * stride);
+	threads::pool::global().parallel_for(0, chunks.size(), [this, &buf](size_t low, size_t high) {
+		for(size_t i = low; i < high; i++) {
+			chunk& c = this->chunks[i];
+			unsigned char* out = &buf[c.info.first_subframe * this->stride];
+			this->decompress(c, out);
+			//Record the hash, so saving this input again does not need to compress it.
+			sha256 h;
+			h.write(out, c.info.subframes * this->stride);
+			h.read(c.hash);
+			c.hash_valid = true;
+		}
+	});
+	v.resize(0);
+	v.resize(total);
+	size_t ptr = 0;
+	for(size_t i = 0; i < v.get_page_count(); i++) {
+		size_t bytes = v.get_page_frames(i) * stride;
+		memcpy(v.get_page_buffer(i), &buf[ptr], bytes);
+		ptr += bytes;
+	}
+	uint64_t frames = chunks.empty() ? 0 : chunks.back().info.first_frame + chunks.back().info.syncs;
+	if(v.recount_frames() != frames)
+		throw std::runtime_error("Input chunk index does not match the input");
+}
+
+size_t chunked_input::find_frame(uint64_t frame) const throw()
+{
+	if(!frame)
+		return chunks.size();
+	//The first chunk with more than frame - 1 syncs before its end.
+	auto i = std::upper_bound(chunks.begin(), chunks.end(), frame - 1, [](uint64_t f, const chunk& c) {
+		return f < c.info.first_frame + c.info.syncs;
+	});
+	return i - chunks.begin();
+}
+
+uint64_t chunked_input::binary_size() const throw()
+{
+	binarystream::output s;
+	uint64_t size = s.numberbytes(stride) + s.numberbytes(chunks.size());
+	for(auto& i : chunks)
+		size += s.numberbytes(i.info.subframes) + s.numberbytes(i.info.syncs) + 4 +
+			s.numberbytes(i.data.size()) + i.data.size();
+	return size;
+}
+
+void chunked_input::save(binarystream::output& s) const throw(std::bad_alloc, std::runtime_error)
+{
+	//Index first, so the chunks can be located without decompressing anything.
+	s.number(stride);
+	s.number(chunks.size());
+	for(auto& i : chunks) {
+		s.number(i.info.subframes);
+		s.number(i.info.syncs);
+		s.number32(i.info.crc);
+		s.number(i.data.size());
+	}
+	for(auto& i : chunks)
+		if(!i.data.empty())
+			s.raw(&i.data[0], i.data.size());
+}
+
+void chunked_input::load(binarystream::input& s) throw(std::bad_alloc, std::runtime_error)
+{
+	std::vector<chunk> nchunks;
+	size_t nstride = s.number();
+	uint64_t count = s.number();
+	//Each index entry takes at least 7 bytes, don't allocate based on bogus count.
+	if(count > s.get_left() / 7)
+		throw std::runtime_error("Input chunk index is corrupt");
+	nchunks.resize(count);
+	for(auto& i : nchunks) {
+		uint64_t subframes = s.number();
+		uint64_t syncs = s.number();
+		i.info.crc = s.number32();
+		uint64_t csize = s.number();
+		if(subframes > chunk_subframes || syncs > subframes || csize > s.get_left())
+			throw std::runtime_error("Input chunk index is corrupt");
+		i.info.subframes = subframes;
+		i.info.syncs = syncs;
+		i.data.resize(csize);
+		i.hash_valid = false;
+	}
+	for(auto& i : nchunks) {
+		if(i.data.size() > s.get_left())
+			throw std::runtime_error("Input chunk data is truncated");
+		if(!i.data.empty())
+			s.raw(&i.data[0], i.data.size());
+	}
+	std::swap(chunks, nchunks);
+	stride = nstride;
+	update_offsets();
+}
+}
@@ -12,6 +12,7 @@
 #include <list>
 #include <deque>
 #include <complex>
+#include <algorithm>
 
 namespace portctrl
 {
@@ -472,7 +473,7 @@ frame& frame::operator=(const frame& obj) throw(std::runtime_error)
 	types = obj.types;
 	short old = sync();
 	memcpy(backing, obj.backing, types->size());
-	if(host) host->notify_sync_change(sync() - old);
+	if(host) host->notify_sync_change(backing, sync() - old);
 	return *this;
 }
 
@@ -480,6 +481,75 @@ frame_vector::fchange_listener::~fchange_listener()
 {
 }
 
+void frame_vector::free_pages() throw()
+{
+	for(auto i : pages)
+		delete i;
+	pages.clear();
+	page_first.clear();
+	page_first_sync.clear();
+	index_stale = false;
+	sync_index_stale = false;
+	sync_stale = false;
+	clear_cache();
+}
+
+void frame_vector::reserve_pages(size_t n) throw(std::bad_alloc)
+{
+	//The indices get the same capacity, so rebuilding them never needs to allocate.
+	if(n <= pages.capacity() && n <= page_first.capacity() && n <= page_first_sync.capacity())
+		return;
+	n = max(n, 2 * pages.size());
+	pages.reserve(n);
+	page_first.reserve(n);
+	page_first_sync.reserve(n);
+}
+
+void frame_vector::update_index() throw()
+{
+	page_first.resize(pages.size());
+	size_t first = 0;
+	for(size_t i = 0; i < pages.size(); i++) {
+		page_first[i] = first;
+		first += pages[i]->frames;
+	}
+	index_stale = false;
+}
+
+void frame_vector::update_sync_index() throw()
+{
+	if(sync_stale)
+		for(auto i : pages)
+			i->syncs = count_syncs(i, 0, i->frames);
+	sync_stale = false;
+	page_first_sync.resize(pages.size());
+	uint64_t first = 0;
+	for(size_t i = 0; i < pages.size(); i++) {
+		page_first_sync[i] = first;
+		first += pages[i]->syncs;
+	}
+	sync_index_stale = false;
+}
+
+size_t frame_vector::count_syncs(const page* p, size_t first, size_t last) const throw()
+{
+	size_t ret = 0;
+	for(size_t i = first; i < last; i++)
+		if(frame::sync(p->content + i * frame_size))
+			ret++;
+	return ret;
+}
+
+void frame_vector::locate(size_t frame) throw()
+{
+	if(index_stale)
+		update_index();
+	size_t page = std::upper_bound(page_first.begin(), page_first.end(), frame) - page_first.begin() - 1;
+	cache_page_num = page;
+	cache_page_first = page_first[page];
+	cache_page = pages[page];
+}
+
 size_t frame_vector::walk_helper(size_t frame, bool sflag) throw()
 {
 	size_t ret = sflag ? frame : 0;
@@ -487,27 +557,15 @@ size_t frame_vector::walk_helper(size_t frame, bool sflag) throw()
 		return ret;
 	frame++;
 	ret++;
-	size_t page = frame / frames_per_page;
-	size_t offset = frame_size * (frame % frames_per_page);
-	size_t index = frame % frames_per_page;
-	if(cache_page_num != page) {
-		cache_page = &pages[page];
-		cache_page_num = page;
-	}
 	while(frame < frames) {
-		if(index == frames_per_page) {
-			page++;
-			cache_page = &pages[page];
-			cache_page_num = page;
-			index = 0;
-			offset = 0;
+		select_page(frame);
+		const unsigned char* content = cache_page->content;
+		for(size_t index = frame - cache_page_first; index < cache_page->frames; index++) {
+			if(frame::sync(content + index * frame_size))
+				return ret;
+			frame++;
+			ret++;
 		}
-		if(frame::sync(cache_page->content + offset))
-			break;
-		index++;
-		offset += frame_size;
-		frame++;
-		ret++;
 	}
 	return ret;
 }
@@ -516,25 +574,12 @@ size_t frame_vector::recount_frames() throw()
 {
 	uint64_t old_frame_count = real_frame_count;
 	size_t ret = 0;
-	if(!frames)
-		return 0;
-	cache_page_num = 0;
-	cache_page = &pages[0];
-	size_t offset = 0;
-	size_t index = 0;
-	for(size_t i = 0; i < frames; i++) {
-		if(index == frames_per_page) {
-			cache_page_num++;
-			cache_page = &pages[cache_page_num];
-			index = 0;
-			offset = 0;
-		}
-		if(frame::sync(cache_page->content + offset))
-			ret++;
-		index++;
-		offset += frame_size;
-
+	for(auto i : pages) {
+		i->syncs = count_syncs(i, 0, i->frames);
+		ret += i->syncs;
 	}
+	sync_stale = false;
+	sync_index_stale = true;
 	real_frame_count = ret;
 	call_framecount_notification(old_frame_count);
 	return ret;
@@ -547,16 +592,14 @@ void frame_vector::clear(const type_set& p) throw(std::runtime_error)
 	frames_per_page = CONTROLLER_PAGE_SIZE / frame_size;
 	frames = 0;
 	types = &p;
-	clear_cache();
-	pages.clear();
+	free_pages();
 	real_frame_count = 0;
 	call_framecount_notification(old_frame_count);
 }
 
 frame_vector::~frame_vector() throw()
 {
-	pages.clear();
-	cache_page = NULL;
+	free_pages();
 }
 
 frame_vector::frame_vector() throw()
@@ -580,19 +623,23 @@ void frame_vector::append(frame cframe) throw(std::bad_alloc, std::runtime_error
 	frame check(*types);
 	if(!check.types_match(cframe))
 		throw std::runtime_error("frame_vector::append: Type mismatch");
-	if(frames % frames_per_page == 0) {
+	if(pages.empty() || pages.back()->frames == frames_per_page) {
 		//Create new page.
-		pages[frames / frames_per_page];
+		reserve_pages(pages.size() + 1);
+		pages.push_back(new page);
+		if(!index_stale)
+			page_first.push_back(frames);
+		if(!sync_index_stale)
+			page_first_sync.push_back(real_frame_count);
 	}
 	//Write the entry.
-	size_t page = frames / frames_per_page;
-	size_t offset = frame_size * (frames % frames_per_page);
-	if(cache_page_num != page) {
-		cache_page_num = page;
-		cache_page = &pages[page];
+	page* pg = pages.back();
+	frame(pg->content + frame_size * pg->frames, *types) = cframe;
+	pg->frames++;
+	if(cframe.sync()) {
+		pg->syncs++;
+		real_frame_count++;
 	}
-	frame(cache_page->content + offset, *types) = cframe;
-	if(cframe.sync()) real_frame_count++;
 	frames++;
 }
 
@@ -611,22 +658,30 @@ frame_vector& frame_vector::operator=(const frame_vector& v)
 	if(this == &v)
 		return *this;
 	uint64_t old_frame_count = real_frame_count;
-	resize(v.frames);
-	clear_cache();
+	std::vector<page*> newpages;
+	try {
+		newpages.reserve(v.pages.size());
+		page_first.reserve(v.pages.size());
+		page_first_sync.reserve(v.pages.size());
+		for(auto i : v.pages)
+			newpages.push_back(new page(*i));
+	} catch(...) {
+		for(auto i : newpages)
+			delete i;
+		throw;
+	}
 
-	//Copy the fields.
+	//This can't fail anymore. Replace the pages and copy the fields.
+	free_pages();
+	std::swap(pages, newpages);
 	frame_size = v.frame_size;
 	frames_per_page = v.frames_per_page;
+	frames = v.frames;
 	types = v.types;
 	real_frame_count = v.real_frame_count;
-
-	//This can't fail anymore. Copy the raw page contents.
-	size_t pagecount = (frames + frames_per_page - 1) / frames_per_page;
-	for(size_t i = 0; i < pagecount; i++) {
-		page& pg = pages[i];
-		const page& pg2 = v.pages.find(i)->second;
-		pg = pg2;
-	}
+	index_stale = true;
+	sync_index_stale = true;
+	sync_stale = v.sync_stale;
 	call_framecount_notification(old_frame_count);
 	return *this;
 }
@@ -637,42 +692,223 @@ void frame_vector::resize(size_t newsize) throw(std::bad_alloc)
 	if(newsize == 0) {
 		clear();
 	} else if(newsize < frames) {
-		//Shrink movie.
+		//Shrink movie from the end.
 		uint64_t old_frame_count = real_frame_count;
-		for(size_t i = newsize; i < frames; i++)
-			if((*this)[i].sync()) real_frame_count--;
-		size_t current_pages = (frames + frames_per_page - 1) / frames_per_page;
-		size_t pages_needed = (newsize + frames_per_page - 1) / frames_per_page;
-		for(size_t i = pages_needed; i < current_pages; i++)
-			pages.erase(i);
-		//Now zeroize the excess memory.
-		if(newsize < pages_needed * frames_per_page) {
-			size_t offset = frame_size * (newsize % frames_per_page);
-			memset(pages[pages_needed - 1].content + offset, 0, CONTROLLER_PAGE_SIZE - offset);
+		while(frames > newsize) {
+			page* pg = pages.back();
+			size_t remove = min(frames - newsize, pg->frames);
+			size_t removed_syncs = count_syncs(pg, pg->frames - remove, pg->frames);
+			real_frame_count -= removed_syncs;
+			frames -= remove;
+			if(remove == pg->frames) {
+				delete pg;
+				pages.pop_back();
+			} else {
+				pg->frames -= remove;
+				pg->syncs -= removed_syncs;
+				//Now zeroize the excess memory.
+				memset(pg->content + frame_size * pg->frames, 0, frame_size * remove);
+			}
 		}
-		frames = newsize;
+		//The index entries of the remaining pages stay valid.
+		if(page_first.size() > pages.size())
+			page_first.resize(pages.size());
+		if(page_first_sync.size() > pages.size())
+			page_first_sync.resize(pages.size());
 		call_framecount_notification(old_frame_count);
 	} else if(newsize > frames) {
-		//Enlarge movie.
-		size_t current_pages = (frames + frames_per_page - 1) / frames_per_page;
-		size_t pages_needed = (newsize + frames_per_page - 1) / frames_per_page;
-		//Create the needed pages.
-		for(size_t i = current_pages; i < pages_needed; i++) {
-			try {
-				pages[i];
-			} catch(...) {
-				for(size_t i = current_pages; i < pages_needed; i++)
-					if(pages.count(i))
-						pages.erase(i);
-				throw;
-			}
+		//Enlarge movie. First use the free space in the last page, then add full pages.
+		size_t fill = 0;
+		if(!pages.empty())
+			fill = min(newsize - frames, frames_per_page - pages.back()->frames);
+		size_t pages_needed = (newsize - frames - fill + frames_per_page - 1) / frames_per_page;
+		std::vector<page*> newpages;
+		try {
+			newpages.reserve(pages_needed);
+			reserve_pages(pages.size() + pages_needed);
+			for(size_t i = 0; i < pages_needed; i++)
+				newpages.push_back(new page);
+		} catch(...) {
+			for(auto i : newpages)
+				delete i;
+			throw;
+		}
+		if(fill) {
+			pages.back()->frames += fill;
+			frames += fill;
+		}
+		for(auto i : newpages) {
+			i->frames = min(newsize - frames, frames_per_page);
+			if(!index_stale)
+				page_first.push_back(frames);
+			if(!sync_index_stale)
+				page_first_sync.push_back(real_frame_count);
+			pages.push_back(i);
+			frames += i->frames;
 		}
-		frames = newsize;
 		//This can use real_frame_count, because the real frame count won't change.
 		call_framecount_notification(real_frame_count);
 	}
 }
 
+void frame_vector::insert_range(size_t pos, size_t count, bool sync) throw(std::bad_alloc, std::runtime_error)
+{
+	if(pos > frames)
+		throw std::runtime_error("frame_vector::insert_range: Illegal index");
+	if(!count)
+		return;
+	uint64_t old_frame_count = real_frame_count;
+	//Find the page to split, and the number of subframes on it before (head) and after (tail) the insertion
+	//point. When appending, the last page gets filled.
+	bool have_target = !pages.empty();
+	size_t target = 0;
+	size_t head = 0;
+	size_t tail = 0;
+	if(pos < frames) {
+		locate(pos);
+		target = cache_page_num;
+		head = pos - cache_page_first;
+		tail = cache_page->frames - head;
+	} else if(have_target) {
+		target = pages.size() - 1;
+		head = pages[target]->frames;
+	}
+	size_t total = head + count + tail;
+	size_t npages = (total + frames_per_page - 1) / frames_per_page;
+	size_t nnew = npages - (have_target ? 1 : 0);
+	//Allocate everything before touching the pages, so that running out of memory leaves the vector intact.
+	page* saved = NULL;
+	std::vector<page*> newpages;
+	try {
+		newpages.reserve(nnew);
+		reserve_pages(pages.size() + nnew);
+		if(tail)
+			saved = new page(*pages[target]);
+		for(size_t i = 0; i < nnew; i++)
+			newpages.push_back(new page);
+	} catch(...) {
+		delete saved;
+		for(auto i : newpages)
+			delete i;
+		throw;
+	}
+	clear_cache();
+	//Copy subframes [from, from + len) of head + inserted + tail to dst.
+	auto copy_out = [this, saved, head, count, sync](unsigned char* dst, size_t from, size_t len) -> void {
+		if(len && from < head) {
+			size_t n = min(len, head - from);
+			memcpy(dst, saved->content + from * frame_size, n * frame_size);
+			dst += n * frame_size;
+			from += n;
+			len -= n;
+		}
+		if(len && from < head + count) {
+			size_t n = min(len, head + count - from);
+			memset(dst, 0, n * frame_size);
+			if(sync)
+				for(size_t i = 0; i < n; i++)
+					dst[i * frame_size] |= 1;
+			dst += n * frame_size;
+			from += n;
+			len -= n;
+		}
+		if(len)
+			memcpy(dst, saved->content + (from - count) * frame_size, len * frame_size);
+	};
+	//If there is nothing after the insertion point, fill the pages, like append would. Otherwise spread the
+	//subframes evenly, so further edits nearby don't immediately split the pages again.
+	size_t start = 0;
+	for(size_t k = 0; k < npages; k++) {
+		page* pg = (have_target && k == 0) ? pages[target] : newpages[k - (have_target ? 1 : 0)];
+		size_t len;
+		if(!tail)
+			len = min(total - start, frames_per_page);
+		else
+			len = total / npages + ((k < total % npages) ? 1 : 0);
+		if(have_target && k == 0 && !tail) {
+			//The head is already in place.
+			copy_out(pg->content + head * frame_size, head, len - head);
+		} else {
+			copy_out(pg->content, start, len);
+			if(have_target && k == 0)
+				memset(pg->content + len * frame_size, 0, CONTROLLER_PAGE_SIZE - len * frame_size);
+		}
+		pg->frames = len;
+		pg->syncs = count_syncs(pg, 0, len);
+		start += len;
+	}
+	delete saved;
+	pages.insert(pages.begin() + (have_target ? target + 1 : 0), newpages.begin(), newpages.end());
+	frames += count;
+	if(sync)
+		real_frame_count += count;
+	index_stale = true;
+	sync_index_stale = true;
+	if(!freeze_count)
+		call_framecount_notification(old_frame_count);
+}
+
+void frame_vector::erase_range(size_t pos, size_t count) throw(std::runtime_error)
+{
+	if(pos > frames || count > frames - pos)
+		throw std::runtime_error("frame_vector::erase_range: Illegal range");
+	if(!count)
+		return;
+	uint64_t old_frame_count = real_frame_count;
+	locate(pos);
+	size_t first = cache_page_num;
+	size_t offset = pos - cache_page_first;
+	clear_cache();
+	//Remove the subframes page by page. Only the first and the last page can be partially affected.
+	size_t p = first;
+	size_t left = count;
+	while(left) {
+		page* pg = pages[p++];
+		size_t n = min(left, pg->frames - offset);
+		size_t removed_syncs = count_syncs(pg, offset, offset + n);
+		real_frame_count -= removed_syncs;
+		pg->syncs -= removed_syncs;
+		left -= n;
+		if(n < pg->frames) {
+			memmove(pg->content + offset * frame_size, pg->content + (offset + n) * frame_size,
+				(pg->frames - offset - n) * frame_size);
+			memset(pg->content + (pg->frames - n) * frame_size, 0, n * frame_size);
+		}
+		pg->frames -= n;
+		offset = 0;
+	}
+	//Drop the pages that became empty.
+	size_t w = first;
+	for(size_t i = first; i < p; i++) {
+		if(pages[i]->frames)
+			pages[w++] = pages[i];
+		else
+			delete pages[i];
+	}
+	pages.erase(pages.begin() + w, pages.begin() + p);
+	//Merge the pages around the erased range if they fit in one.
+	size_t i = first ? first - 1 : 0;
+	while(i < w && i + 1 < pages.size()) {
+		page* a = pages[i];
+		page* b = pages[i + 1];
+		if(a->frames + b->frames <= frames_per_page) {
+			memcpy(a->content + a->frames * frame_size, b->content, b->frames * frame_size);
+			a->frames += b->frames;
+			a->syncs += b->syncs;
+			delete b;
+			pages.erase(pages.begin() + i + 1);
+			if(w > i + 1)
+				w--;
+		} else
+			i++;
+	}
+	frames -= count;
+	index_stale = true;
+	sync_index_stale = true;
+	if(!freeze_count)
+		call_framecount_notification(old_frame_count);
+}
+
 bool frame_vector::compatible(frame_vector& with, uint64_t nframe, const uint32_t* polls)
 {
 	//Types have to match.
@@ -689,13 +925,13 @@ bool frame_vector::compatible(frame_vector& with, uint64_t nframe, const uint32_
 	size_t old_size = size();
 	size_t new_size = with.size();
 	size_t pagenum = 0;
-	size_t ocomplete_pages = old_size / frames_per_page;  //Round DOWN
-	size_t ncomplete_pages = new_size / frames_per_page;  //Round DOWN
-	size_t complete_pages = min(ocomplete_pages, ncomplete_pages);
-	while(syncs_seen + frames_per_page < nframe - 1 && pagenum < complete_pages) {
-		//Fast process page. The above condition guarantees that these pages are completely used.
-		auto opagedata = pages[pagenum].content;
-		auto npagedata = with.pages[pagenum].content;
+	size_t common_pages = min(pages.size(), with.pages.size());
+	while(syncs_seen + frames_per_page < nframe - 1 && pagenum < common_pages &&
+		pages[pagenum]->frames == frames_per_page && with.pages[pagenum]->frames == frames_per_page) {
+		//Fast process page. Since all the preceeding pages were full too, the pages cover the same
+		//subframes.
+		auto opagedata = pages[pagenum]->content;
+		auto npagedata = with.pages[pagenum]->content;
 		size_t pagedataamt = frames_per_page * frame_size;
 		if(memcmp(opagedata, npagedata, pagedataamt))
 			return false;
@@ -750,16 +986,9 @@ uint64_t frame_vector::binary_size() const throw()
 void frame_vector::save_binary(binarystream::output& stream) const throw(std::runtime_error)
 {
 	uint64_t stride = get_stride();
-	uint64_t pageframes = get_frames_per_page();
-	uint64_t vsize = size();
-	size_t pagenum = 0;
-	while(vsize > 0) {
-		uint64_t count = (vsize > pageframes) ? pageframes : vsize;
-		size_t bytes = count * stride;
-		const unsigned char* content = get_page_buffer(pagenum++);
-		stream.raw(content, bytes);
-		vsize -= count;
-	}
+	size_t pages = get_page_count();
+	for(size_t i = 0; i < pages; i++)
+		stream.raw(get_page_buffer(i), get_page_frames(i) * stride);
 }
 
 void frame_vector::load_binary(binarystream::input& stream) throw(std::bad_alloc, std::runtime_error)
@@ -769,6 +998,8 @@ void frame_vector::load_binary(binarystream::input& stream) throw(std::bad_alloc
 	uint64_t vsize = 0;
 	size_t pagenum = 0;
 	uint64_t pagesize = stride * pageframes;
+	//Start from empty vector, so each resize below adds exactly one full page.
+	resize(0);
 	while(stream.get_left()) {
 		resize(vsize + pageframes);
 		unsigned char* contents = get_page_buffer(pagenum++);
@@ -785,11 +1016,17 @@ void frame_vector::swap_data(frame_vector& v) throw()
 	uint64_t toldsize = real_frame_count;
 	uint64_t voldsize = v.real_frame_count;
 	std::swap(pages, v.pages);
+	std::swap(page_first, v.page_first);
+	std::swap(page_first_sync, v.page_first_sync);
+	std::swap(index_stale, v.index_stale);
+	std::swap(sync_index_stale, v.sync_index_stale);
+	std::swap(sync_stale, v.sync_stale);
 	std::swap(frames_per_page, v.frames_per_page);
 	std::swap(frame_size, v.frame_size);
 	std::swap(frames, v.frames);
 	std::swap(types, v.types);
 	std::swap(cache_page_num, v.cache_page_num);
+	std::swap(cache_page_first, v.cache_page_first);
 	std::swap(cache_page, v.cache_page);
 	std::swap(real_frame_count, v.real_frame_count);
 	if(!freeze_count)
@@ -800,52 +1037,29 @@ void frame_vector::swap_data(frame_vector& v) throw()
 
 int64_t frame_vector::find_frame(uint64_t n)
 {
-	if(!n) return -1;
-	uint64_t stride = get_stride();
-	uint64_t pageframes = get_frames_per_page();
-	uint64_t vsize = size();
-	size_t pagenum = 0;
-	while(vsize > 0) {
-		uint64_t count = (vsize > pageframes) ? pageframes : vsize;
-		const unsigned char* content = get_page_buffer(pagenum++);
-		size_t offset = 0;
-		for(unsigned i = 0; i < count; i++) {
-			if(frame::sync(content + offset)) n--;
-			if(n == 0) return (pagenum - 1) * pageframes + i;
-			offset += stride;
-		}
-		vsize -= count;
-	}
+	if(!n || pages.empty()) return -1;
+	if(index_stale)
+		update_index();
+	if(sync_index_stale)
+		update_sync_index();
+	//The last page with less than n syncs before it is the only one that can contain the sync.
+	size_t pagenum = std::upper_bound(page_first_sync.begin(), page_first_sync.end(), n - 1) -
+		page_first_sync.begin() - 1;
+	n -= page_first_sync[pagenum];
+	const page* pg = pages[pagenum];
+	for(size_t i = 0; i < pg->frames; i++)
+		if(frame::sync(pg->content + i * frame_size) && !--n)
+			return page_first[pagenum] + i;
 	return -1;
 }
 
 int64_t frame_vector::subframe_to_frame(uint64_t n)
 {
-	int64_t ret = 1;
-	uint64_t stride = get_stride();
-	uint64_t pageframes = get_frames_per_page();
-	uint64_t vsize = size();
-	if(n >= vsize) return -1;
-	size_t pagenum = 0;
-	size_t cpage = n / pageframes;
-	for(uint64_t p = 0; p < cpage; p++) {
-		const unsigned char* content = get_page_buffer(pagenum++);
-		size_t offset = 0;
-		for(unsigned i = 0; i < pageframes; i++) {
-			if(frame::sync(content + offset)) ret++;
-			offset += stride;
-		}
-	}
-	{
-		const unsigned char* content = get_page_buffer(pagenum++);
-		size_t offset = 0;
-		unsigned idx = n % pageframes;
-		for(unsigned i = 0; i < idx; i++) {
-			if(frame::sync(content + offset)) ret++;
-			offset += stride;
-		}
-	}
-	return ret;
+	if(n >= frames) return -1;
+	if(sync_index_stale)
+		update_sync_index();
+	locate(n);
+	return 1 + page_first_sync[cache_page_num] + count_syncs(cache_page, 0, n - cache_page_first);
 }
 
 frame::frame() throw()
@@ -1,5 +1,9 @@
 #include "rrdata.hpp"
+#include "directory.hpp"
+#include "filemap.hpp"
 #include "hex.hpp"
+#include "serialization.hpp"
+#include <algorithm>
 #include <cstring>
 #include <limits>
 #include <functional>
@@ -7,6 +11,28 @@
 
 #define MAXRUN 16843009
 
+namespace
+{
+	//Checkpoint file header: magic, covered log bytes, interval count, rerecord count, last covered record.
+	const char checkpoint_magic[] = "LSNESRRC";
+	const size_t checkpoint_header = 32 + RRDATA_BYTES;
+	const size_t checkpoint_entry = 2 * RRDATA_BYTES;
+	//Minimum number of log records past the checkpoint before rewriting it.
+	const uint64_t checkpoint_interval = 4096;
+
+	uint64_t symbols_in_interval(const rrdata_set::instance& b, const rrdata_set::instance& e) throw()
+	{
+		uint64_t c = 0;
+		rrdata_set::instance x = b;
+		while(x != e) {
+			unsigned diff = e - x;
+			x = x + diff;
+			c = c + diff;
+		}
+		return c;
+	}
+}
+
 rrdata_set::instance::instance() throw()
 {
 	memset(bytes, 0, RRDATA_BYTES);
@@ -106,6 +132,119 @@ rrdata_set::rrdata_set() throw()
 	rcount = 0;
 	lazy_mode = false;
 	handle_open = false;
+	log_size = 0;
+	log_checkpointed = 0;
+}
+
+std::string rrdata_set::checkpoint_name(const std::string& projectfile)
+{
+	return projectfile + ".idx";
+}
+
+void rrdata_set::merge_intervals(interval_list& set, uint64_t& cnt, interval_list& add)
+{
+	if(add.empty())
+		return;
+	set.insert(set.end(), add.begin(), add.end());
+	std::sort(set.begin(), set.end());
+	size_t j = 0;
+	for(size_t i = 1; i < set.size(); i++) {
+		if(set[i].first <= set[j].second) {
+			if(set[j].second < set[i].second)
+				set[j].second = set[i].second;
+		} else
+			set[++j] = set[i];
+	}
+	set.resize(j + 1);
+	cnt = 0;
+	for(auto& i : set)
+		cnt += symbols_in_interval(i.first, i.second);
+}
+
+bool rrdata_set::read_checkpoint(const std::string& projectfile, const char* log, size_t loglen,
+	interval_list& set, uint64_t& cnt, uint64_t& covered)
+{
+	try {
+		filemap::mapping m(checkpoint_name(projectfile));
+		const char* d = m.data();
+		if(m.size() < checkpoint_header || memcmp(d, checkpoint_magic, 8))
+			return false;
+		uint64_t _covered = serialization::u64b(d + 8);
+		uint64_t intervals = serialization::u64b(d + 16);
+		uint64_t _cnt = serialization::u64b(d + 24);
+		//The log must still contain the covered part unchanged (checked by comparing the last record).
+		if(_covered > loglen || _covered % RRDATA_BYTES)
+			return false;
+		if(_covered && memcmp(log + _covered - RRDATA_BYTES, d + 32, RRDATA_BYTES))
+			return false;
+		if(intervals > (m.size() - checkpoint_header) / checkpoint_entry)
+			return false;
+		interval_list _set;
+		_set.reserve(intervals);
+		uint64_t rcnt = 0;
+		for(uint64_t i = 0; i < intervals; i++) {
+			const char* e = d + checkpoint_header + i * checkpoint_entry;
+			instance b(reinterpret_cast<const unsigned char*>(e));
+			instance f(reinterpret_cast<const unsigned char*>(e + RRDATA_BYTES));
+			//Intervals must be nonempty, sorted and not touching.
+			if(b >= f || (!_set.empty() && _set.back().second >= b))
+				return false;
+			_set.push_back(std::make_pair(b, f));
+			rcnt += symbols_in_interval(b, f);
+		}
+		if(rcnt != _cnt)
+			return false;
+		std::swap(set, _set);
+		cnt = _cnt;
+		covered = _covered;
+		return true;
+	} catch(...) {
+		return false;
+	}
+}
+
+void rrdata_set::maybe_checkpoint(bool force)
+{
+	if(!handle_open || current_projectfile == "" || log_size == log_checkpointed)
+		return;
+	//Rewriting the checkpoint is linear in number of intervals, so space the rewrites so that the cost
+	//amortizes to constant per added record.
+	uint64_t pending = (log_size - log_checkpointed) / RRDATA_BYTES;
+	if(!force && pending < std::max(checkpoint_interval, static_cast<uint64_t>(data.size())))
+		return;
+	if(log_size % RRDATA_BYTES)
+		return;		//Damaged log, the checkpoint could not be validated.
+	std::vector<char> buf(checkpoint_header + checkpoint_entry * data.size());
+	memcpy(&buf[0], checkpoint_magic, 8);
+	serialization::u64b(&buf[8], log_size);
+	serialization::u64b(&buf[16], data.size());
+	serialization::u64b(&buf[24], rcount);
+	memcpy(&buf[32], log_last.bytes, RRDATA_BYTES);
+	char* ptr = &buf[checkpoint_header];
+	for(auto& i : data) {
+		memcpy(ptr, i.first.bytes, RRDATA_BYTES);
+		memcpy(ptr + RRDATA_BYTES, i.second.bytes, RRDATA_BYTES);
+		ptr += checkpoint_entry;
+	}
+	std::string filename = checkpoint_name(current_projectfile);
+	std::string tmpfile = filename + ".new";
+	std::ofstream out(tmpfile.c_str(), std::ios_base::out | std::ios_base::binary);
+	if(!out)
+		return;
+	out.write(&buf[0], buf.size());
+	out.close();
+	if(!out)
+		return;
+	if(directory::rename_overwrite(tmpfile.c_str(), filename.c_str()))
+		return;
+	log_checkpointed = log_size;
+}
+
+void rrdata_set::write_log(const instance& i)
+{
+	ohandle.write(reinterpret_cast<const char*>(i.bytes), RRDATA_BYTES);
+	log_size += RRDATA_BYTES;
+	log_last = i;
 }
 
 void rrdata_set::read_base(const std::string& projectfile, bool lazy) throw(std::bad_alloc)
@@ -113,58 +252,85 @@ void rrdata_set::read_base(const std::string& projectfile, bool lazy) throw(std:
 	if(projectfile == current_projectfile && (!lazy_mode || lazy))
 		return;
 	if(lazy) {
-		std::set<std::pair<instance, instance>> new_rrset;
-		data = new_rrset;
+		maybe_checkpoint(true);
+		data.clear();
 		current_projectfile = projectfile;
 		rcount = 0;
 		lazy_mode = true;
 		if(handle_open)
 			ohandle.close();
 		handle_open = false;
+		log_size = log_checkpointed = 0;
 		return;
 	}
-	std::set<std::pair<instance, instance>> new_rrset;
+	interval_list new_rrset;
 	uint64_t new_count = 0;
-	if(projectfile == current_projectfile) {
-		new_rrset = data;
-		new_count = rcount;
-	}
+	uint64_t covered = 0;
+	instance last;
 	std::string filename = projectfile;
 	if(handle_open) {
+		maybe_checkpoint(true);
 		ohandle.close();
 		handle_open = false;
 	}
-	std::ifstream ihandle(filename.c_str(), std::ios_base::in | std::ios_base::binary);
-	while(ihandle) {
-		unsigned char bytes[RRDATA_BYTES];
-		ihandle.read(reinterpret_cast<char*>(bytes), RRDATA_BYTES);
-		instance k(bytes);
-		//std::cerr << "Loaded symbol: " << k << std::endl;
-		_add(k, k + 1, new_rrset, new_count);
+	size_t loglen = 0;
+	try {
+		filemap::mapping log(filename);
+		const char* d = log.data();
+		loglen = log.size();
+		read_checkpoint(projectfile, d, loglen, new_rrset, new_count, covered);
+		//Replay the log past the checkpoint, coalescing consecutive IDs into runs. The runs are merged in
+		//one go, as inserting them one by one would be quadratic if they are out of order.
+		interval_list runs;
+		for(size_t ptr = covered; ptr + RRDATA_BYTES <= loglen; ptr += RRDATA_BYTES) {
+			instance k(reinterpret_cast<const unsigned char*>(d + ptr));
+			if(!runs.empty() && k == runs.back().second)
+				++runs.back().second;
+			else
+				runs.push_back(std::make_pair(k, k + 1));
+		}
+		merge_intervals(new_rrset, new_count, runs);
+		if(loglen >= RRDATA_BYTES)
+			last = instance(reinterpret_cast<const unsigned char*>(d + loglen / RRDATA_BYTES *
+				RRDATA_BYTES - RRDATA_BYTES));
+	} catch(std::bad_alloc& e) {
+		throw;
+	} catch(...) {
+		//No log yet.
 	}
-	ihandle.close();
+	if(projectfile == current_projectfile)
+		for(auto& i : data)
+			_add(i.first, i.second, new_rrset, new_count);
 	ohandle.open(filename.c_str(), std::ios_base::out | std::ios_base::app | std::ios_base::binary);
 	if(ohandle)
 		handle_open = true;
+	log_size = loglen;
+	log_checkpointed = covered;
+	log_last = last;
 	if(projectfile == current_projectfile && lazy_mode && !lazy) {
 		//Finish the project creation, write all.
 		for(auto i : data) {
 			instance tmp = i.first;
 			while(tmp != i.second) {
-				ohandle.write(reinterpret_cast<const char*>(tmp.bytes), RRDATA_BYTES);
+				write_log(tmp);
 				++tmp;
 			}
 			ohandle.flush();
 		}
 	}
-	data = new_rrset;
+	std::swap(data, new_rrset);
 	rcount = new_count;
 	current_projectfile = projectfile;
 	lazy_mode = lazy;
+	maybe_checkpoint(false);
 }
 
 void rrdata_set::close() throw()
 {
+	try {
+		maybe_checkpoint(true);
+	} catch(...) {
+	}
 	current_projectfile = "";
 	if(handle_open)
 		ohandle.close();
@@ -175,8 +341,9 @@ void rrdata_set::add(const struct rrdata_set::instance& i) throw(std::bad_alloc)
 {
 	if(_add(i) && handle_open) {
 		//std::cerr << "New symbol: " << i << std::endl;
-		ohandle.write(reinterpret_cast<const char*>(i.bytes), RRDATA_BYTES);
+		write_log(i);
 		ohandle.flush();
+		maybe_checkpoint(false);
 	}
 }
 
@@ -214,18 +381,6 @@ namespace
 		memcpy(buf1 + (RRDATA_BYTES - j + 1), buf2 + (3 - (opcode >> 5)), opcode >> 5);
 		return (RRDATA_BYTES - j + 1) + (opcode >> 5);
 	}
-
-	uint64_t symbols_in_interval(const rrdata_set::instance& b, const rrdata_set::instance& e) throw()
-	{
-		uint64_t c = 0;
-		rrdata_set::instance x = b;
-		while(x != e) {
-			unsigned diff = e - x;
-			x = x + diff;
-			c = c + diff;
-		}
-		return c;
-	}
 }
 
 uint64_t rrdata_set::emerg_action(struct rrdata_set::esave_state& state, char* buf, size_t bufsize, uint64_t& scount)
@@ -330,13 +485,15 @@ uint64_t rrdata_set::read(std::vector<char>& strm) throw(std::bad_alloc)
 				//TODO: Optimize this.
 				instance n = d + i;
 				if(!_in_set(n)) {
-					ohandle.write(reinterpret_cast<const char*>(n.bytes), RRDATA_BYTES);
+					write_log(n);
 					any = true;
 				}
 			}
 		if(any)
 			ohandle.flush();
 		_add(d, d + rep);
+		if(any)
+			maybe_checkpoint(false);
 	});
 }
 
@@ -372,85 +529,56 @@ void rrdata_set::_add(const instance& b, const instance& e)
 	_add(b, e, data, rcount);
 }
 
-void rrdata_set::_add(const instance& b, const instance& e, std::set<std::pair<instance, instance>>& set,
-	uint64_t& cnt)
+void rrdata_set::_add(const instance& b, const instance& e, interval_list& set, uint64_t& cnt)
 {
-	//Special case: Nothing.
-	if(set.empty()) {
-		set.insert(std::make_pair(b, e));
+	if(b >= e)
+		return;
+	//Fast path: Extending the last interval or appending after it, which is what recording does.
+	if(set.empty() || set.back().second < b) {
+		set.push_back(std::make_pair(b, e));
 		cnt += symbols_in_interval(b, e);
 		return;
 	}
-	//Just insert it.
-	auto itr = set.lower_bound(std::make_pair(b, e));
-	if(itr != set.end() && itr->first == b && itr->second == e)
+	if(set.back().second == b) {
+		set.back().second = e;
+		cnt += symbols_in_interval(b, e);
 		return;
-	set.insert(std::make_pair(b, e));
-	cnt += symbols_in_interval(b, e);
-	itr = set.lower_bound(std::make_pair(b, e));
-	auto itr1 = itr;
-	auto itr2 = itr;
-	if(itr1 != set.begin()) itr1--;
-	itr2++;
-	bool have1 = (itr1 != itr);
-	instance rangebase = b;
-	//If the thing is entierely in itr1, undo the add.
-	if(have1 && b >= itr1->first && e <= itr1->second) {
-		cnt -= symbols_in_interval(b, e);
-		set.erase(itr);
+	}
+	//Find the first interval that overlaps or touches [b, e).
+	auto itr = std::lower_bound(set.begin(), set.end(), b, [](const std::pair<instance, instance>& x,
+		const instance& y) -> bool { return x.second < y; });
+	if(itr == set.end() || e < itr->first) {
+		set.insert(itr, std::make_pair(b, e));
+		cnt += symbols_in_interval(b, e);
 		return;
 	}
-	//Attach the thing to itr1 if appropriate.
-	if(have1 && b <= itr1->second) {
-		cnt -= symbols_in_interval(b, itr1->second);
-		rangebase = itr1->first;
-		set.insert(std::make_pair(itr1->first, e));
-		auto tmp = set.lower_bound(std::make_pair(itr1->first, e));
-		set.erase(itr1);
-		set.erase(itr);
-		itr = tmp;
-		have1 = false;
-	}
-	while(itr2 != set.end()) {
-		if(e < itr2->first)
-			break;	//Nothing to merge anymore.
-		if(e >= itr2->second && (rangebase != itr2->first || e != itr2->second)) {
-			//This entiere range is subsumed.
-			cnt -= symbols_in_interval(itr2->first, itr2->second);
-			auto tmp = itr2;
-			itr2++;
-			set.erase(tmp);
-		} else if(e < itr2->second) {
-			//Combines with range.
-			cnt -= symbols_in_interval(itr2->first, e);
-			if(rangebase != itr2->first) {
-				set.insert(std::make_pair(rangebase, itr2->second));
-				set.erase(itr2);
-			}
-			set.erase(itr);
-			break;
-		}
+	//Merge all intervals overlapping or touching [b, e) into the first one.
+	instance nb = (itr->first < b) ? itr->first : b;
+	instance ne = e;
+	uint64_t covered = 0;
+	auto jtr = itr;
+	for(; jtr != set.end() && jtr->first <= e; jtr++) {
+		covered += symbols_in_interval(jtr->first, jtr->second);
+		if(ne < jtr->second)
+			ne = jtr->second;
 	}
+	cnt += symbols_in_interval(nb, ne) - covered;
+	itr->first = nb;
+	itr->second = ne;
+	set.erase(itr + 1, jtr);
 }
 
 bool rrdata_set::_in_set(const instance& b, const instance& e)
 {
 	if(b == e)
 		return true;
-	if(data.empty())
+	//The only candidate is the last interval starting at or before b.
+	auto itr = std::upper_bound(data.begin(), data.end(), b, [](const instance& x,
+		const std::pair<instance, instance>& y) -> bool { return x < y.first; });
+	if(itr == data.begin())
 		return false;
-	auto itr = data.lower_bound(std::make_pair(b, e));
-	if(itr == data.end()) {
-		//If there is anything, it must be the last node.
-		auto r = *data.rbegin();
-		return (r.first <= b && r.second >= e);
-	} else {
-		//It may be this node or the previous one.
-		if(itr->first <= b && itr->second >= e)
-			return true;
-		itr--;
-		return (itr->first <= b && itr->second >= e);
-	}
+	itr--;
+	return (itr->first <= b && itr->second >= e);
 }
 
 std::string rrdata_set::debug_dump()
@@ -463,7 +591,7 @@ std::string rrdata_set::debug_dump()
 	return x.str();
 }
 
-uint64_t rrdata_set::debug_nodecount(std::set<std::pair<instance, instance>>& set)
+uint64_t rrdata_set::debug_nodecount(interval_list& set)
 {
 	uint64_t x = 0;
 	for(auto i : set)
@@ -0,0 +1,438 @@
+#include "scaler.hpp"
+#include "minmax.hpp"
+#include <cstring>
+#include "arch-detect.hpp"
+#if defined(ARCH_IS_I386) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SCALER_X86_ACCEL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+//The row kernels (expanding by integer factor while converting to 24 bits, and blending two rows) go through the
+//fastest implementation the CPU supports. Everything else is shared.
+
+namespace scaler
+{
+namespace
+{
+	//Flipping and rotating goes in tiles of this size.
+	const size_t tile = 32;
+
+	typedef void (*expand_fn_t)(uint8_t* dst, const uint32_t* src, size_t width, unsigned factor);
+	typedef void (*blend_fn_t)(uint32_t* dst, const uint32_t* a, const uint32_t* b, size_t width,
+		unsigned weight);
+
+	inline void put_pixel(uint8_t* dst, uint32_t p)
+	{
+		dst[0] = p >> 16;
+		dst[1] = p >> 8;
+		dst[2] = p;
+	}
+
+	//Weight is of b, 0-256.
+	inline uint32_t lerp(uint32_t a, uint32_t b, unsigned weight)
+	{
+		uint32_t rb = ((a & 0xFF00FF) * (256 - weight) + (b & 0xFF00FF) * weight) >> 8;
+		uint32_t g = ((a & 0xFF00) * (256 - weight) + (b & 0xFF00) * weight) >> 8;
+		return (rb & 0xFF00FF) | (g & 0xFF00);
+	}
+
+	void generic_expand(uint8_t* dst, const uint32_t* src, size_t width, unsigned factor)
+	{
+		for(size_t i = 0; i < width; i++) {
+			uint32_t p = src[i];
+			for(unsigned j = 0; j < factor; j++, dst += 3)
+				put_pixel(dst, p);
+		}
+	}
+
+	void generic_blend(uint32_t* dst, const uint32_t* a, const uint32_t* b, size_t width, unsigned weight)
+	{
+		for(size_t i = 0; i < width; i++)
+			dst[i] = lerp(a[i], b[i], weight);
+	}
+
+#ifdef SCALER_X86_ACCEL
+	//Swap bytes 0 and 2 of each pixel and pack 4 pixels into 12 bytes.
+	__attribute__((target("sse2")))
+	inline void sse2_put4(uint8_t* dst, __m128i v)
+	{
+		const __m128i lo8 = _mm_set1_epi32(0xFF);
+		const __m128i mid8 = _mm_set1_epi32(0xFF00);
+		const __m128i lo24 = _mm_set1_epi64x(0xFFFFFF);
+		const __m128i hi24 = _mm_set1_epi64x(0xFFFFFF000000ULL);
+		__m128i t = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, lo8), 16),
+			_mm_and_si128(v, mid8)), _mm_and_si128(_mm_srli_epi32(v, 16), lo8));
+		//Now 6 bytes in each 64-bit half.
+		t = _mm_or_si128(_mm_and_si128(t, lo24), _mm_and_si128(_mm_srli_epi64(t, 8), hi24));
+		//Move the upper half down to follow the lower.
+		__m128i lo = _mm_and_si128(t, _mm_set_epi64x(0, -1));
+		__m128i hi = _mm_srli_si128(_mm_and_si128(t, _mm_set_epi64x(-1, 0)), 2);
+		t = _mm_or_si128(lo, hi);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), t);
+		uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(t, 8));
+		memcpy(dst + 8, &tail, 4);
+	}
+
+	__attribute__((target("sse2")))
+	void sse2_expand(uint8_t* dst, const uint32_t* src, size_t width, unsigned factor)
+	{
+		if(factor > 4) {
+			generic_expand(dst, src, width, factor);
+			return;
+		}
+		size_t i = 0;
+		for(; i + 4 <= width; i += 4) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			switch(factor) {
+			case 1:
+				sse2_put4(dst, v);
+				break;
+			case 2:
+				sse2_put4(dst, _mm_unpacklo_epi32(v, v));
+				sse2_put4(dst + 12, _mm_unpackhi_epi32(v, v));
+				break;
+			case 3:
+				sse2_put4(dst, _mm_shuffle_epi32(v, 0x40));
+				sse2_put4(dst + 12, _mm_shuffle_epi32(v, 0xA5));
+				sse2_put4(dst + 24, _mm_shuffle_epi32(v, 0xFE));
+				break;
+			case 4:
+				sse2_put4(dst, _mm_shuffle_epi32(v, 0x00));
+				sse2_put4(dst + 12, _mm_shuffle_epi32(v, 0x55));
+				sse2_put4(dst + 24, _mm_shuffle_epi32(v, 0xAA));
+				sse2_put4(dst + 36, _mm_shuffle_epi32(v, 0xFF));
+				break;
+			}
+			dst += 12 * factor;
+		}
+		generic_expand(dst, src + i, width - i, factor);
+	}
+
+	__attribute__((target("sse2")))
+	void sse2_blend(uint32_t* dst, const uint32_t* a, const uint32_t* b, size_t width, unsigned weight)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i wa = _mm_set1_epi16(256 - weight);
+		const __m128i wb = _mm_set1_epi16(weight);
+		size_t i = 0;
+		for(; i + 4 <= width; i += 4) {
+			__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+			__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+			__m128i r = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+		}
+		generic_blend(dst + i, a + i, b + i, width - i, weight);
+	}
+
+	__attribute__((target("avx2")))
+	inline void avx2_put8(uint8_t* dst, __m256i v)
+	{
+		const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+		v = _mm256_shuffle_epi8(v, pack);
+		__m128i lo = _mm256_castsi256_si128(v);
+		__m128i hi = _mm256_extracti128_si256(v, 1);
+		uint32_t tail;
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), lo);
+		tail = _mm_cvtsi128_si32(_mm_srli_si128(lo, 8));
+		memcpy(dst + 8, &tail, 4);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 12), hi);
+		tail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+		memcpy(dst + 20, &tail, 4);
+	}
+
+	__attribute__((target("avx2")))
+	void avx2_expand(uint8_t* dst, const uint32_t* src, size_t width, unsigned factor)
+	{
+		if(factor > 8) {
+			generic_expand(dst, src, width, factor);
+			return;
+		}
+		//Output pixel 8 * j + i comes from input pixel (8 * j + i) / factor.
+		__m256i perm[8];
+		for(unsigned j = 0; j < factor; j++) {
+			int32_t idx[8];
+			for(unsigned i = 0; i < 8; i++)
+				idx[i] = (8 * j + i) / factor;
+			perm[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(idx));
+		}
+		size_t i = 0;
+		for(; i + 8 <= width; i += 8) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			for(unsigned j = 0; j < factor; j++)
+				avx2_put8(dst + 24 * j, _mm256_permutevar8x32_epi32(v, perm[j]));
+			dst += 24 * factor;
+		}
+		generic_expand(dst, src + i, width - i, factor);
+	}
+
+	__attribute__((target("avx2")))
+	void avx2_blend(uint32_t* dst, const uint32_t* a, const uint32_t* b, size_t width, unsigned weight)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i wa = _mm256_set1_epi16(256 - weight);
+		const __m256i wb = _mm256_set1_epi16(weight);
+		size_t i = 0;
+		for(; i + 8 <= width; i += 8) {
+			__m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			//Unpack and pack both work within 128-bit lanes, so the order comes out right.
+			__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+				_mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb));
+			__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+				_mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb));
+			__m256i r = _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), r);
+		}
+		generic_blend(dst + i, a + i, b + i, width - i, weight);
+	}
+
+	struct cpu_features
+	{
+		cpu_features()
+		{
+			unsigned eax, ebx, ecx, edx;
+			sse2 = avx2 = false;
+			if(!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+				return;
+			unsigned maxleaf = eax;
+			__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+			sse2 = (edx >> 26) & 1;
+			bool osxsave = (ecx >> 27) & 1;
+			bool avx = (ecx >> 28) & 1;
+			bool ymm_enabled = false;
+			if(osxsave) {
+				uint32_t xcr0_lo, xcr0_hi;
+				asm volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+				ymm_enabled = ((xcr0_lo & 6) == 6);
+			}
+			if(maxleaf < 7)
+				return;
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			avx2 = avx && ymm_enabled && ((ebx >> 5) & 1);
+		}
+		bool sse2;
+		bool avx2;
+	};
+
+	const cpu_features& get_cpu_features()
+	{
+		static cpu_features f;
+		return f;
+	}
+#endif
+
+	expand_fn_t get_expand_fn(simd level)
+	{
+#ifdef SCALER_X86_ACCEL
+		if(level == SIMD_AVX2)
+			return avx2_expand;
+		if(level == SIMD_SSE2)
+			return sse2_expand;
+#endif
+		return generic_expand;
+	}
+
+	blend_fn_t get_blend_fn(simd level)
+	{
+#ifdef SCALER_X86_ACCEL
+		if(level == SIMD_AVX2)
+			return avx2_blend;
+		if(level == SIMD_SSE2)
+			return sse2_blend;
+#endif
+		return generic_blend;
+	}
+}
+
+simd get_best_simd() throw()
+{
+#ifdef SCALER_X86_ACCEL
+	if(get_cpu_features().avx2)
+		return SIMD_AVX2;
+	if(get_cpu_features().sse2)
+		return SIMD_SSE2;
+#endif
+	return SIMD_NONE;
+}
+
+const char* get_simd_name(simd level) throw()
+{
+	switch(level) {
+	case SIMD_SSE2:		return "SSE2";
+	case SIMD_AVX2:		return "AVX2";
+	default:		return "generic";
+	}
+}
+
+void transform(uint32_t* dst, size_t dstride, const uint32_t* src, size_t sstride, size_t width, size_t height,
+	unsigned orient) throw()
+{
+	size_t width1 = width - 1;
+	size_t height1 = height - 1;
+	bool hflip = orient & HFLIP;
+	bool vflip = orient & VFLIP;
+	if(!(orient & ROTATE)) {
+		//Rows stay rows, so no need for tiles.
+		for(size_t y = 0; y < height; y++) {
+			const uint32_t* in = src + (vflip ? (height1 - y) : y) * sstride;
+			uint32_t* out = dst + y * dstride;
+			if(hflip)
+				for(size_t x = 0; x < width; x++)
+					out[x] = in[width1 - x];
+			else
+				memcpy(out, in, width * sizeof(uint32_t));
+		}
+		return;
+	}
+	for(size_t y0 = 0; y0 < height; y0 += tile) {
+		size_t y1 = min(y0 + tile, height);
+		for(size_t x0 = 0; x0 < width; x0 += tile) {
+			size_t x1 = min(x0 + tile, width);
+			for(size_t y = y0; y < y1; y++) {
+				const uint32_t* in = src + (vflip ? (height1 - y) : y) * sstride;
+				//Source row y becomes destination column height1 - y.
+				uint32_t* out = dst + (height1 - y);
+				if(hflip)
+					for(size_t x = x0; x < x1; x++)
+						out[x * dstride] = in[width1 - x];
+				else
+					for(size_t x = x0; x < x1; x++)
+						out[x * dstride] = in[x];
+			}
+		}
+	}
+}
+
+context::context() throw()
+{
+	level = get_best_simd();
+}
+
+void context::set_simd(simd _level) throw()
+{
+	level = min(_level, get_best_simd());
+}
+
+void context::scale(method m, uint8_t* dst, size_t dstride, size_t dwidth, size_t dheight, const uint32_t* src,
+	size_t sstride, size_t swidth, size_t sheight, unsigned orient) throw(std::bad_alloc)
+{
+	if(!dwidth || !dheight || !swidth || !sheight)
+		return;
+	ptrdiff_t istride = sstride;
+	if(orient & (HFLIP | ROTATE)) {
+		size_t w = (orient & ROTATE) ? sheight : swidth;
+		size_t h = (orient & ROTATE) ? swidth : sheight;
+		scratch.resize(w * h);
+		transform(&scratch[0], w, src, sstride, swidth, sheight, orient);
+		src = &scratch[0];
+		istride = w;
+		swidth = w;
+		sheight = h;
+	} else if(orient & VFLIP) {
+		//Just walk the rows backwards.
+		src += (sheight - 1) * sstride;
+		istride = -istride;
+	}
+	if(m == SHARP_BILINEAR)
+		sharp_bilinear(dst, dstride, dwidth, dheight, src, istride, swidth, sheight);
+	else
+		nearest(dst, dstride, dwidth, dheight, src, istride, swidth, sheight);
+}
+
+void context::make_nearest_taps(std::vector<tap>& taps, size_t ssize, size_t dsize)
+{
+	taps.resize(dsize);
+	for(size_t i = 0; i < dsize; i++) {
+		taps[i].pos = (static_cast<uint64_t>(2 * i + 1) * ssize) / (2 * dsize);
+		taps[i].weight = 0;
+	}
+}
+
+void context::make_sharp_taps(std::vector<tap>& taps, size_t ssize, size_t dsize)
+{
+	//Prescaled size is the largest integer multiple that fits (but at least 1x).
+	size_t factor = max(dsize / ssize, static_cast<size_t>(1));
+	size_t psize = ssize * factor;
+	taps.resize(dsize);
+	for(size_t i = 0; i < dsize; i++) {
+		double u = (i + 0.5) * psize / dsize - 0.5;
+		u = min(max(u, 0.0), psize - 1.0);
+		size_t i0 = u;
+		size_t i1 = min(i0 + 1, psize - 1);
+		taps[i].pos = i0 / factor;
+		//Both taps from same source pixel => no blending needed.
+		taps[i].weight = (i0 / factor == i1 / factor) ? 0 : static_cast<uint32_t>((u - i0) * 256 + 0.5);
+		if(taps[i].weight == 256) {
+			taps[i].pos++;
+			taps[i].weight = 0;
+		}
+	}
+}
+
+void context::nearest(uint8_t* dst, size_t dstride, size_t dwidth, size_t dheight, const uint32_t* src,
+	ptrdiff_t sstride, size_t swidth, size_t sheight)
+{
+	if(dwidth % swidth == 0 && dheight % sheight == 0) {
+		//Integer factors: Expand each row once, and copy it for the rest.
+		expand_fn_t expand = get_expand_fn(level);
+		unsigned xfactor = dwidth / swidth;
+		unsigned yfactor = dheight / sheight;
+		for(size_t y = 0; y < sheight; y++) {
+			uint8_t* row = dst + y * yfactor * dstride;
+			expand(row, src + static_cast<ptrdiff_t>(y) * sstride, swidth, xfactor);
+			for(unsigned j = 1; j < yfactor; j++)
+				memcpy(row + j * dstride, row, 3 * dwidth);
+		}
+		return;
+	}
+	make_nearest_taps(xtaps, swidth, dwidth);
+	make_nearest_taps(ytaps, sheight, dheight);
+	for(size_t y = 0; y < dheight; y++) {
+		uint8_t* row = dst + y * dstride;
+		if(y > 0 && ytaps[y].pos == ytaps[y - 1].pos) {
+			memcpy(row, row - dstride, 3 * dwidth);
+			continue;
+		}
+		const uint32_t* in = src + static_cast<ptrdiff_t>(ytaps[y].pos) * sstride;
+		for(size_t x = 0; x < dwidth; x++)
+			put_pixel(row + 3 * x, in[xtaps[x].pos]);
+	}
+}
+
+void context::sharp_bilinear(uint8_t* dst, size_t dstride, size_t dwidth, size_t dheight, const uint32_t* src,
+	ptrdiff_t sstride, size_t swidth, size_t sheight)
+{
+	blend_fn_t blend = get_blend_fn(level);
+	expand_fn_t expand = get_expand_fn(level);
+	make_sharp_taps(xtaps, swidth, dwidth);
+	make_sharp_taps(ytaps, sheight, dheight);
+	rowbuf.resize(swidth);
+	rowout.resize(dwidth);
+	for(size_t y = 0; y < dheight; y++) {
+		uint8_t* row = dst + y * dstride;
+		const tap& ty = ytaps[y];
+		if(y > 0 && ty.pos == ytaps[y - 1].pos && ty.weight == ytaps[y - 1].weight) {
+			memcpy(row, row - dstride, 3 * dwidth);
+			continue;
+		}
+		const uint32_t* in = src + static_cast<ptrdiff_t>(ty.pos) * sstride;
+		if(ty.weight) {
+			blend(&rowbuf[0], in, in + sstride, swidth, ty.weight);
+			in = &rowbuf[0];
+		}
+		//Resample to 32 bits first, so the conversion to 24 bits can use the SIMD kernel.
+		uint32_t* out = &rowout[0];
+		for(size_t x = 0; x < dwidth; x++) {
+			const tap& tx = xtaps[x];
+			out[x] = tx.weight ? lerp(in[tx.pos], in[tx.pos + 1], tx.weight) : in[tx.pos];
+		}
+		expand(row, out, dwidth, 1);
+	}
+}
+}
@@ -1,13 +1,19 @@
 #include "sha256.hpp"
 #include "hex.hpp"
+#include "minmax.hpp"
 #include <cstdint>
 #include <sstream>
 #include <iostream>
 #include <iomanip>
 #include "arch-detect.hpp"
+#if defined(ARCH_IS_I386) && defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SHA256_X86_ACCEL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
 
-//Since this isn't used for anything too performance-sensitive, just write a implementation, no need to specially
-//optimize.
+//This is used for hashing savestates and ROM images, so full blocks go through the fastest compression function
+//the CPU supports (SHA-NI, or AVX2 for hashing multiple buffers at once), selected at runtime.
 
 namespace
 {
@@ -137,6 +143,217 @@ namespace
 		memset(datablock, 0, 64);
 		blockbytes = 0;
 	}
+
+	inline uint32_t load_be32(const uint8_t* p)
+	{
+		return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+			(static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+	}
+
+	void generic_blocks(uint32_t* state, const uint8_t* data, size_t blocks)
+	{
+		uint32_t datablock[16];
+		unsigned blockbytes;
+		for(size_t i = 0; i < blocks; i++) {
+			for(unsigned j = 0; j < 16; j++)
+				datablock[j] = load_be32(data + 64 * i + 4 * j);
+			compress_sha256(state, datablock, blockbytes);
+		}
+	}
+
+#ifdef SHA256_X86_ACCEL
+	__attribute__((target("sha,sse4.1,ssse3")))
+	void shani_blocks(uint32_t* state, const uint8_t* data, size_t blocks)
+	{
+		const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+		__m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state));
+		__m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4));
+		tmp = _mm_shuffle_epi32(tmp, 0xB1);			//CDAB
+		state1 = _mm_shuffle_epi32(state1, 0x1B);		//EFGH
+		__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);	//ABEF
+		state1 = _mm_blend_epi16(state1, tmp, 0xF0);		//CDGH
+		for(size_t b = 0; b < blocks; b++) {
+			const uint8_t* block = data + 64 * b;
+			__m128i abef = state0;
+			__m128i cdgh = state1;
+			__m128i msg[4];
+			for(unsigned j = 0; j < 4; j++)
+				msg[j] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block +
+					16 * j)), bswap);
+			//16 groups of 4 rounds, extending the message schedule 4 words at a time.
+			for(unsigned i = 0; i < 16; i++) {
+				__m128i& cur = msg[i & 3];
+				__m128i m = _mm_add_epi32(cur, _mm_loadu_si128(reinterpret_cast<const __m128i*>(k + 4 *
+					i)));
+				state1 = _mm_sha256rnds2_epu32(state1, state0, m);
+				if(i >= 3 && i < 15) {
+					__m128i& next = msg[(i + 1) & 3];
+					next = _mm_add_epi32(next, _mm_alignr_epi8(cur, msg[(i + 3) & 3], 4));
+					next = _mm_sha256msg2_epu32(next, cur);
+				}
+				m = _mm_shuffle_epi32(m, 0x0E);
+				state0 = _mm_sha256rnds2_epu32(state0, state1, m);
+				if(i >= 1 && i < 13)
+					msg[(i + 3) & 3] = _mm_sha256msg1_epu32(msg[(i + 3) & 3], cur);
+			}
+			state0 = _mm_add_epi32(state0, abef);
+			state1 = _mm_add_epi32(state1, cdgh);
+		}
+		tmp = _mm_shuffle_epi32(state0, 0x1B);			//FEBA
+		state1 = _mm_shuffle_epi32(state1, 0xB1);		//DCHG
+		state0 = _mm_blend_epi16(tmp, state1, 0xF0);		//DCBA
+		state1 = _mm_alignr_epi8(state1, tmp, 8);		//ABEF
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state), state0);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), state1);
+	}
+
+#define AVX2_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n))
+#define AVX2_XOR3(x, y, z) _mm256_xor_si256(_mm256_xor_si256(x, y), z)
+
+	//Hash up to 8 independent buffers at once, one per 32-bit lane.
+	__attribute__((target("avx2")))
+	void avx2_hash8(uint8_t* const* hashout, const uint8_t* const* data, const size_t* datalen, size_t count)
+	{
+		static const uint8_t zeroblock[64] = {0};
+		uint8_t tails[8][128];
+		size_t fullblocks[8];
+		size_t totalblocks[8];
+		size_t maxblocks = 0;
+		for(size_t l = 0; l < 8; l++) {
+			size_t len = (l < count) ? datalen[l] : 0;
+			fullblocks[l] = len / 64;
+			totalblocks[l] = (l < count) ? (len + 9 + 63) / 64 : 0;
+			if(l >= count)
+				continue;
+			//Build the padded tail (the last 1 or 2 blocks).
+			size_t rem = len % 64;
+			size_t tailsize = 64 * (totalblocks[l] - fullblocks[l]);
+			memset(tails[l], 0, sizeof(tails[l]));
+			if(rem)
+				memcpy(tails[l], data[l] + 64 * fullblocks[l], rem);
+			tails[l][rem] = 0x80;
+			uint64_t bits = static_cast<uint64_t>(len) << 3;
+			for(unsigned j = 0; j < 8; j++)
+				tails[l][tailsize - 1 - j] = bits >> (8 * j);
+			maxblocks = max(maxblocks, totalblocks[l]);
+		}
+		__m256i st[8];
+		for(unsigned j = 0; j < 8; j++)
+			st[j] = _mm256_set1_epi32(sha256_initial_state[j]);
+		for(size_t t = 0; t < maxblocks; t++) {
+			uint32_t w32[16][8] __attribute__((aligned(32)));
+			uint32_t active[8] __attribute__((aligned(32)));
+			for(size_t l = 0; l < 8; l++) {
+				const uint8_t* block;
+				if(t < fullblocks[l])
+					block = data[l] + 64 * t;
+				else if(t < totalblocks[l])
+					block = tails[l] + 64 * (t - fullblocks[l]);
+				else
+					block = zeroblock;
+				active[l] = (t < totalblocks[l]) ? 0xFFFFFFFFU : 0;
+				for(unsigned j = 0; j < 16; j++)
+					w32[j][l] = load_be32(block + 4 * j);
+			}
+			__m256i w[16];
+			for(unsigned j = 0; j < 16; j++)
+				w[j] = _mm256_load_si256(reinterpret_cast<const __m256i*>(w32[j]));
+			__m256i a = st[0], b = st[1], c = st[2], d = st[3];
+			__m256i e = st[4], f = st[5], g = st[6], h = st[7];
+			for(unsigned i = 0; i < 64; i++) {
+				if(i >= 16) {
+					__m256i w1 = w[(i + 1) & 15];
+					__m256i w14 = w[(i + 14) & 15];
+					__m256i s0 = AVX2_XOR3(AVX2_ROTR(w1, 7), AVX2_ROTR(w1, 18), _mm256_srli_epi32(w1, 3));
+					__m256i s1 = AVX2_XOR3(AVX2_ROTR(w14, 17), AVX2_ROTR(w14, 19),
+						_mm256_srli_epi32(w14, 10));
+					w[i & 15] = _mm256_add_epi32(_mm256_add_epi32(w[i & 15], s0),
+						_mm256_add_epi32(s1, w[(i + 9) & 15]));
+				}
+				__m256i S1 = AVX2_XOR3(AVX2_ROTR(e, 6), AVX2_ROTR(e, 11), AVX2_ROTR(e, 25));
+				__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+				__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch,
+					_mm256_add_epi32(_mm256_set1_epi32(k[i]), w[i & 15])));
+				__m256i S0 = AVX2_XOR3(AVX2_ROTR(a, 2), AVX2_ROTR(a, 13), AVX2_ROTR(a, 22));
+				__m256i maj = AVX2_XOR3(_mm256_and_si256(a, b), _mm256_and_si256(a, c),
+					_mm256_and_si256(b, c));
+				h = g;
+				g = f;
+				f = e;
+				e = _mm256_add_epi32(d, t1);
+				d = c;
+				c = b;
+				b = a;
+				a = _mm256_add_epi32(t1, _mm256_add_epi32(S0, maj));
+			}
+			//Only lanes that still have blocks left get updated.
+			__m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(active));
+			__m256i n[8] = {a, b, c, d, e, f, g, h};
+			for(unsigned j = 0; j < 8; j++)
+				st[j] = _mm256_blendv_epi8(st[j], _mm256_add_epi32(st[j], n[j]), mask);
+		}
+		for(unsigned j = 0; j < 8; j++) {
+			uint32_t lanes[8] __attribute__((aligned(32)));
+			_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), st[j]);
+			for(size_t l = 0; l < count; l++)
+				for(unsigned m = 0; m < 4; m++)
+					hashout[l][4 * j + m] = lanes[l] >> (24 - 8 * m);
+		}
+	}
+
+#undef AVX2_ROTR
+#undef AVX2_XOR3
+
+	struct cpu_features
+	{
+		cpu_features()
+		{
+			unsigned eax, ebx, ecx, edx;
+			shani = avx2 = false;
+			if(!__get_cpuid(0, &eax, &ebx, &ecx, &edx) || eax < 7)
+				return;
+			__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+			bool ssse3 = (ecx >> 9) & 1;
+			bool sse41 = (ecx >> 19) & 1;
+			bool osxsave = (ecx >> 27) & 1;
+			bool avx = (ecx >> 28) & 1;
+			bool ymm_enabled = false;
+			if(osxsave) {
+				uint32_t xcr0_lo, xcr0_hi;
+				asm volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+				ymm_enabled = ((xcr0_lo & 6) == 6);
+			}
+			__cpuid_count(7, 0, eax, ebx, ecx, edx);
+			shani = ssse3 && sse41 && ((ebx >> 29) & 1);
+			avx2 = avx && ymm_enabled && ((ebx >> 5) & 1);
+		}
+		bool shani;
+		bool avx2;
+	};
+
+	const cpu_features& get_cpu_features()
+	{
+		static cpu_features f;
+		return f;
+	}
+#endif
+
+	typedef void (*blocks_fn_t)(uint32_t* state, const uint8_t* data, size_t blocks);
+
+	blocks_fn_t get_blocks_fn()
+	{
+#ifdef SHA256_X86_ACCEL
+		if(get_cpu_features().shani)
+			return shani_blocks;
+#endif
+		return generic_blocks;
+	}
+
+	blocks_fn_t blocks_fn()
+	{
+		static blocks_fn_t fn = get_blocks_fn();
+		return fn;
+	}
 }
 
 void sha256::real_init()
@@ -168,46 +385,54 @@ void sha256::real_finish(uint8_t* hash)
 
 void sha256::real_write(const uint8_t* data, size_t datalen)
 {
-#ifdef ARCH_IS_I386
-	//First pad blockbytes to multiple of four.
 	size_t i = 0;
-	while(blockbytes & 3 && i < datalen) {
+	//First fill up any partial block.
+	while(blockbytes && i < datalen) {
 		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
 		blockbytes++;
 		if(blockbytes == 64)
 			compress_sha256(state, datablock, blockbytes);
 		i++;
 	}
-	size_t blocks = (datalen - i) / 4;
-	unsigned ptr = blockbytes / 4;
-	//Then process four bytes ata time.
-	for(size_t j = 0; j < blocks; j++) {
-		uint32_t x = *reinterpret_cast<const uint32_t*>(data + i);
-		asm("bswap %0" : "+r"(x));
-		datablock[ptr] = x;
-		ptr = (ptr + 1) & 15;
-		i += 4;
-		blockbytes += 4;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
+	//Then process whole blocks directly from input.
+	size_t blocks = (datalen - i) / 64;
+	if(blocks) {
+		blocks_fn()(state, data + i, blocks);
+		i += 64 * blocks;
 	}
 	//And finally process tail.
 	while(i < datalen) {
 		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
 		blockbytes++;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
 		i++;
 	}
-#else
-	for(size_t i = 0; i < datalen; i++) {
-		datablock[blockbytes / 4] |= (static_cast<uint32_t>(data[i]) << (24 - blockbytes % 4 * 8));
-		blockbytes++;
-		if(blockbytes == 64)
-			compress_sha256(state, datablock, blockbytes);
+	totalbytes += datalen;
+}
+
+void sha256::hash_multiple(uint8_t* const* hashout, const uint8_t* const* data, const size_t* datalen,
+	size_t count) throw()
+{
+#ifdef SHA256_X86_ACCEL
+	//SHA-NI beats 8-way AVX2, so only use the latter if the former is not there.
+	if(!get_cpu_features().shani && get_cpu_features().avx2) {
+		for(size_t i = 0; i < count; i += 8)
+			avx2_hash8(hashout + i, data + i, datalen + i, min(count - i, (size_t)8));
+		return;
 	}
 #endif
-	totalbytes += datalen;
+	for(size_t i = 0; i < count; i++)
+		hash(hashout[i], data[i], datalen[i]);
+}
+
+const char* sha256::implementation() throw()
+{
+#ifdef SHA256_X86_ACCEL
+	if(get_cpu_features().shani)
+		return "SHA-NI";
+	if(get_cpu_features().avx2)
+		return "generic (AVX2 multi-buffer)";
+#endif
+	return "generic";
 }
 
 #ifdef SHA256_SELFTEST
@@ -232,8 +457,25 @@ int main(int argc, char** argv)
 	gettimeofday(&t2, NULL);
 	uint64_t _t1 = (uint64_t)t1.tv_sec * 1000000 + t1.tv_usec;
 	uint64_t _t2 = (uint64_t)t2.tv_sec * 1000000 + t2.tv_usec;
-	std::cerr << "Hashing performance: " << static_cast<double>(TEST_LOOPS * TEST_DATASET) / (_t2 - _t1)
-		<< "MB/s." << std::endl;
+	std::cerr << "Hashing performance (" << sha256::implementation() << "): "
+		<< static_cast<double>(TEST_LOOPS * TEST_DATASET) / (_t2 - _t1) << "MB/s." << std::endl;
+	uint8_t hashes[8][32];
+	uint8_t* hashptr[8];
+	const uint8_t* dataptr[8];
+	size_t datalen[8];
+	for(unsigned j = 0; j < 8; j++) {
+		hashptr[j] = hashes[j];
+		dataptr[j] = reinterpret_cast<const uint8_t*>(buffer);
+		datalen[j] = TEST_DATASET;
+	}
+	gettimeofday(&t1, NULL);
+	for(unsigned j = 0; j < TEST_LOOPS / 8; j++)
+		sha256::hash_multiple(hashptr, dataptr, datalen, 8);
+	gettimeofday(&t2, NULL);
+	_t1 = (uint64_t)t1.tv_sec * 1000000 + t1.tv_usec;
+	_t2 = (uint64_t)t2.tv_sec * 1000000 + t2.tv_usec;
+	std::cerr << "Multi-buffer hashing performance: " << static_cast<double>(TEST_LOOPS / 8 * 8 * TEST_DATASET) /
+		(_t2 - _t1) << "MB/s." << std::endl;
 }
 
 #endif
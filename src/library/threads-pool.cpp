@@ -0,0 +1,332 @@
+#include "threads-pool.hpp"
+#include "minmax.hpp"
+#include <stdexcept>
+#include <vector>
+
+namespace threads
+{
+namespace
+{
+	//The pool and worker index of calling thread, if it is a worker thread.
+	thread_local pool* current_pool = NULL;
+	thread_local size_t current_worker = 0;
+
+	const unsigned auto_threads_limit = 8;
+
+	unsigned pick_threads(unsigned nthreads, unsigned limit)
+	{
+		if(!nthreads)
+			nthreads = min(thread::hardware_concurrency(), auto_threads_limit);
+		return max(min(nthreads, limit), 1U);
+	}
+
+	void worker_trampoline(pool* p, size_t idx)
+	{
+		p->worker_main(idx);
+	}
+}
+
+task::task(pool& _owner, std::function<void()> _fn)
+	: owner(_owner), fn(_fn)
+{
+	done = false;
+}
+
+bool task::ready()
+{
+	alock h(mlock);
+	return done;
+}
+
+void task::wait()
+{
+	while(true) {
+		{
+			alock h(mlock);
+			if(done)
+				return;
+		}
+		//Help with other tasks. Once nothing is pending, this task is running somewhere.
+		if(owner.run_one())
+			continue;
+		alock h(mlock);
+		while(!done)
+			cond.wait(h);
+		return;
+	}
+}
+
+void task::rethrow()
+{
+	if(error)
+		error.rethrow();
+}
+
+void task::run()
+{
+	try {
+		fn();
+	} catch(std::exception& e) {
+		error = exrethrow::storage(e);
+	} catch(...) {
+		std::runtime_error e("Unknown exception in task");
+		error = exrethrow::storage(e);
+	}
+	//Release anything the function holds.
+	fn = std::function<void()>();
+	alock h(mlock);
+	done = true;
+	cond.notify_all();
+}
+
+pool::pool(unsigned nthreads)
+{
+	pending = 0;
+	quit = false;
+	nworkers = 0;
+	counters.threads = 0;
+	counters.submitted[0] = counters.submitted[1] = 0;
+	counters.executed = 0;
+	counters.steals = 0;
+	counters.sleeps = 0;
+	counters.queued = 0;
+	counters.max_queued = 0;
+	for(unsigned i = 0; i < max_threads; i++)
+		workers[i] = new worker;
+	start_workers(pick_threads(nthreads, max_threads));
+}
+
+pool::~pool()
+{
+	stop_workers();
+	while(run_one());
+	for(unsigned i = 0; i < max_threads; i++)
+		delete workers[i];
+}
+
+pool& pool::global()
+{
+	static pool x;
+	return x;
+}
+
+void pool::set_threads(unsigned nthreads)
+{
+	alock h(workers_lock);
+	nthreads = pick_threads(nthreads, max_threads);
+	if(nthreads == nworkers)
+		return;
+	stop_workers();
+	start_workers(nthreads);
+}
+
+unsigned pool::get_threads()
+{
+	return nworkers;
+}
+
+void pool::start_workers(unsigned nthreads)
+{
+	{
+		alock h(mlock);
+		quit = false;
+		counters.threads = nthreads;
+	}
+	for(unsigned i = 0; i < nthreads; i++)
+		workers[i]->thr = new thread(worker_trampoline, this, i);
+	nworkers = nthreads;
+}
+
+void pool::stop_workers()
+{
+	{
+		alock h(mlock);
+		quit = true;
+		wakeup.notify_all();
+	}
+	for(unsigned i = 0; i < nworkers; i++) {
+		workers[i]->thr->join();
+		delete workers[i]->thr;
+		workers[i]->thr = NULL;
+	}
+	//Whatever the stopped workers still had queued goes to shared queue.
+	alock h(mlock);
+	for(unsigned i = 0; i < nworkers; i++) {
+		alock h2(workers[i]->mlock);
+		for(unsigned j = 0; j < 2; j++) {
+			for(auto& k : workers[i]->queue[j])
+				injected[j].push_back(k);
+			workers[i]->queue[j].clear();
+		}
+	}
+	nworkers = 0;
+}
+
+void pool::enqueue(std::shared_ptr<task> t, pool_lane lane)
+{
+	bool own = (current_pool == this);
+	{
+		alock h(mlock);
+		if(!own)
+			injected[lane].push_back(t);
+		//Count before pushing to own queue, so pending never underflows.
+		pending++;
+		counters.submitted[lane]++;
+		counters.max_queued = max(counters.max_queued, pending);
+	}
+	if(own) {
+		alock h(workers[current_worker]->mlock);
+		workers[current_worker]->queue[lane].push_back(t);
+	}
+	wakeup.notify_one();
+}
+
+template<> future<void> pool::submit<void>(std::function<void()> fn, pool_lane lane)
+{
+	std::shared_ptr<task> t(new task(*this, fn));
+	enqueue(t, lane);
+	return future<void>(t);
+}
+
+std::shared_ptr<task> pool::take(size_t self)
+{
+	std::shared_ptr<task> t;
+	unsigned n = nworkers;
+	bool stolen = false;
+	for(unsigned lane = 0; lane < 2 && !t; lane++) {
+		//Own queue, newest first.
+		if(self < n) {
+			alock h(workers[self]->mlock);
+			auto& q = workers[self]->queue[lane];
+			if(!q.empty()) {
+				t = q.back();
+				q.pop_back();
+				break;
+			}
+		}
+		//Shared queue.
+		{
+			alock h(mlock);
+			if(!pending)
+				return t;
+			auto& q = injected[lane];
+			if(!q.empty()) {
+				t = q.front();
+				q.pop_front();
+				break;
+			}
+		}
+		//Steal oldest from others.
+		for(unsigned i = 1; i <= n && !t; i++) {
+			size_t victim = (self + i) % n;
+			if(victim == self)
+				continue;
+			alock h(workers[victim]->mlock);
+			auto& q = workers[victim]->queue[lane];
+			if(!q.empty()) {
+				t = q.front();
+				q.pop_front();
+				stolen = true;
+			}
+		}
+	}
+	if(t) {
+		alock h(mlock);
+		pending--;
+		if(stolen)
+			counters.steals++;
+	}
+	return t;
+}
+
+bool pool::run_one()
+{
+	std::shared_ptr<task> t = take((current_pool == this) ? current_worker : max_threads);
+	if(!t)
+		return false;
+	t->run();
+	alock h(mlock);
+	counters.executed++;
+	return true;
+}
+
+void pool::worker_main(size_t idx)
+{
+	current_pool = this;
+	current_worker = idx;
+	while(true) {
+		if(run_one())
+			continue;
+		alock h(mlock);
+		if(quit)
+			break;
+		if(pending)
+			continue;
+		counters.sleeps++;
+		wakeup.wait(h);
+	}
+	current_pool = NULL;
+}
+
+void pool::parallel_for(size_t first, size_t last, std::function<void(size_t, size_t)> fn, size_t grain,
+	unsigned max_tasks)
+{
+	if(first >= last)
+		return;
+	if(!grain)
+		grain = 1;
+	size_t chunks = (last - first + grain - 1) / grain;
+	size_t ntasks = min(chunks, (size_t)get_threads() + 1);
+	if(max_tasks)
+		ntasks = min(ntasks, (size_t)max_tasks);
+	if(ntasks <= 1) {
+		fn(first, last);
+		return;
+	}
+	lock claim_lock;
+	size_t next = first;
+	std::function<void()> runner = [&claim_lock, &next, last, grain, &fn]() {
+		while(true) {
+			size_t lo, hi;
+			{
+				alock h(claim_lock);
+				if(next >= last)
+					return;
+				lo = next;
+				hi = min(last, lo + grain);
+				next = hi;
+			}
+			fn(lo, hi);
+		}
+	};
+	std::vector<future<void>> helpers;
+	for(size_t i = 1; i < ntasks; i++)
+		helpers.push_back(submit<void>(runner));
+	exrethrow::storage err;
+	try {
+		runner();
+	} catch(std::exception& e) {
+		err = exrethrow::storage(e);
+	} catch(...) {
+		//Can't be stored, but helpers must still be done before it leaves this frame.
+		for(auto& i : helpers)
+			i.wait();
+		throw;
+	}
+	//Helpers refer to locals here, so all must complete before anything is thrown.
+	for(auto& i : helpers)
+		i.wait();
+	if(err)
+		err.rethrow();
+	for(auto& i : helpers)
+		i.get();
+}
+
+pool::stats pool::get_stats()
+{
+	alock h(mlock);
+	stats s = counters;
+	s.queued = pending;
+	return s;
+}
+}
@@ -1,5 +1,6 @@
 #include "zip.hpp"
 #include "directory.hpp"
+#include "minmax.hpp"
 #include "serialization.hpp"
 
 #include <cstdint>
@@ -20,26 +21,16 @@ namespace zip
 {
 namespace
 {
-	class file_input
+	//Source reading member data from mapped archive. Keeps the mapping alive, so streams remain valid after the
+	//reader is destroyed.
+	class mapped_input
 	{
 	public:
 		typedef char char_type;
 		typedef boost::iostreams::source_tag category;
-		file_input(std::ifstream& _stream, size_t* _refcnt)
-			: stream(_stream), stream_refcnt(*_refcnt)
+		mapped_input(std::shared_ptr<filemap::mapping> _map, const char* _data, size_t _size)
+			: map(_map), data(_data), left(_size)
 		{
-			stream_refcnt++;
-			position = stream.tellg();
-			left_unlimited = true;
-		}
-
-		file_input(std::ifstream& _stream, uint64_t size, size_t* _refcnt)
-			: stream(_stream), stream_refcnt(*_refcnt)
-		{
-			stream_refcnt++;
-			position = stream.tellg();
-			left_unlimited = false;
-			left = size;
 		}
 
 		void close()
@@ -48,49 +39,19 @@ namespace
 
 		std::streamsize read(char* s, std::streamsize n)
 		{
-			stream.clear();
-			stream.seekg(position, std::ios_base::beg);
-			if(stream.fail())
-				throw std::runtime_error("Can't seek ZIP file");
-			if(!left_unlimited && left == 0)
+			if(left == 0)
 				return -1;
-			if(!left_unlimited && n > (int64_t)left)
+			if(static_cast<uint64_t>(n) > left)
 				n = left;
-			stream.read(s, n);
-			std::streamsize r = stream.gcount();
-			if(r == 0 && stream.fail())
-				throw std::runtime_error("Can't read compressed data from ZIP file");
-			if(!stream && r == 0)
-				return -1;
-			position += r;
-			left -= r;
-			return r;
-		}
-
-		~file_input()
-		{
-			if(!--stream_refcnt) {
-				delete &stream;
-				delete &stream_refcnt;
-			}
-		}
-
-		file_input(const file_input& f)
-			: stream(f.stream), stream_refcnt(f.stream_refcnt)
-		{
-			stream_refcnt++;
-			position = f.position;
-			left_unlimited = f.left_unlimited;
-			left = f.left;
+			memcpy(s, data, n);
+			data += n;
+			left -= n;
+			return n;
 		}
-	protected:
-		std::ifstream& stream;
-		size_t& stream_refcnt;
-		std::streamoff position;
-		bool left_unlimited;
-		uint64_t left;
 	private:
-		file_input& operator=(const file_input& f);
+		std::shared_ptr<filemap::mapping> map;
+		const char* data;
+		size_t left;
 	};
 
 	class vector_output
@@ -186,121 +147,169 @@ namespace
 		}
 	};
 
-	struct zipfile_member_info
+	//Check that member is something that can be read.
+	void check_member(uint16_t version_needed, uint16_t flags, uint16_t compression, uint32_t csize,
+		uint32_t usize)
 	{
-		bool central_directory_special;	//Central directory, not real member.
-		uint16_t version_needed;
-		uint16_t flags;
-		uint16_t compression;
-		uint16_t mtime_time;
-		uint16_t mtime_day;
-		uint32_t crc;
-		uint32_t compressed_size;
-		uint32_t uncompressed_size;
-		std::string filename;
-		uint32_t header_offset;
-		uint32_t data_offset;
-		uint32_t next_offset;
-	};
+		if(version_needed > 20 && version_needed != 46) {
+			throw std::runtime_error("Unsupported ZIP feature: Only ZIP versions up to 2.0 supported");
+		}
+		if(flags & 0x2001)
+			throw std::runtime_error("Unsupported ZIP feature: Encryption is not supported");
+		if(flags & 0x8)
+			throw std::runtime_error("Unsupported ZIP feature: Indeterminate length not supported");
+		if(flags & 0x20)
+			throw std::runtime_error("Unsupported ZIP feature: Binary patching is not supported");
+		if(compression != 0 && compression != 8 && compression != 12)
+			throw std::runtime_error("Unsupported ZIP feature: Unsupported compression method");
+		if(compression == 0 && csize != usize)
+			throw std::runtime_error("ZIP archive corrupt: csize ≠ usize for stored member");
+	}
 
-	//Parse member starting from current offset.
-	zipfile_member_info parse_member(std::ifstream& file)
+	//Parse local header at specified offset. Returns false if central directory starts there.
+	bool parse_local_header(const char* base, size_t size, size_t offset, std::string& name,
+		reader::member_info& info)
 	{
-		zipfile_member_info info;
-		info.central_directory_special = false;
-		info.header_offset = file.tellg();
 		//The file header is 30 bytes (this could also hit central header, but that's even larger).
-		unsigned char buffer[30];
-		if(!(file.read(reinterpret_cast<char*>(buffer), 30)))
+		if(offset + 30 > size)
 			throw std::runtime_error("Can't read file header from ZIP file");
-		uint32_t magic = serialization::u32l(buffer);
-		if(magic == 0x02014b50) {
-			info.central_directory_special = true;
-			return info;
-		}
+		const char* h = base + offset;
+		uint32_t magic = serialization::u32l(h);
+		if(magic == 0x02014b50)
+			return false;
 		if(magic != 0x04034b50)
 			throw std::runtime_error("ZIP archive corrupt: Expected file or central directory magic");
-		info.version_needed = serialization::u16l(buffer + 4);
-		info.flags = serialization::u16l(buffer + 6);
-		info.compression = serialization::u16l(buffer + 8);
-		info.mtime_time = serialization::u16l(buffer + 10);
-		info.mtime_day = serialization::u16l(buffer + 12);
-		info.crc = serialization::u32l(buffer + 14);
-		info.compressed_size = serialization::u32l(buffer + 18);
-		info.uncompressed_size = serialization::u32l(buffer + 22);
-		uint16_t filename_len = serialization::u16l(buffer + 26);
-		uint16_t extra_len = serialization::u16l(buffer + 28);
+		uint16_t flags = serialization::u16l(h + 6);
+		info.compression = serialization::u16l(h + 8);
+		info.crc = serialization::u32l(h + 14);
+		info.compressed_size = serialization::u32l(h + 18);
+		info.uncompressed_size = serialization::u32l(h + 22);
+		uint16_t filename_len = serialization::u16l(h + 26);
+		uint16_t extra_len = serialization::u16l(h + 28);
 		if(!filename_len)
 			throw std::runtime_error("Unsupported ZIP feature: Empty filename not allowed");
-		if(info.version_needed > 20 && info.version_needed != 46) {
-			throw std::runtime_error("Unsupported ZIP feature: Only ZIP versions up to 2.0 supported");
-		}
-		if(info.flags & 0x2001)
-			throw std::runtime_error("Unsupported ZIP feature: Encryption is not supported");
-		if(info.flags & 0x8)
-			throw std::runtime_error("Unsupported ZIP feature: Indeterminate length not supported");
-		if(info.flags & 0x20)
-			throw std::runtime_error("Unsupported ZIP feature: Binary patching is not supported");
-		if(info.compression != 0 && info.compression != 8 && info.compression != 12)
-			throw std::runtime_error("Unsupported ZIP feature: Unsupported compression method");
-		if(info.compression == 0 && info.compressed_size != info.uncompressed_size)
-			throw std::runtime_error("ZIP archive corrupt: csize ≠ usize for stored member");
-		std::vector<unsigned char> filename_storage;
-		filename_storage.resize(filename_len);
-		if(!(file.read(reinterpret_cast<char*>(&filename_storage[0]), filename_len)))
+		check_member(serialization::u16l(h + 4), flags, info.compression, info.compressed_size,
+			info.uncompressed_size);
+		if(offset + 30 + filename_len > size)
 			throw std::runtime_error("Can't read file name from zip file");
-		info.filename = std::string(reinterpret_cast<char*>(&filename_storage[0]), filename_len);
-		info.data_offset = info.header_offset + 30 + filename_len + extra_len;
-		info.next_offset = info.data_offset + info.compressed_size;
-		return info;
+		name = std::string(h + 30, filename_len);
+		info.header_offset = offset;
+		info.data_offset = offset + 30 + filename_len + extra_len;
+		return true;
+	}
+
+	//Find end of central directory record. Returns size if not found.
+	size_t find_eocd(const char* base, size_t size)
+	{
+		if(size < 22)
+			return size;
+		//The record is followed by at most 65535 bytes of comment.
+		size_t lowest = (size > 22 + 65535) ? size - 22 - 65535 : 0;
+		for(size_t i = size - 22 + 1; i > lowest; i--)
+			if(serialization::u32l(base + i - 1) == 0x06054b50 &&
+				i - 1 + 22 + serialization::u16l(base + i - 1 + 20) == size)
+				return i - 1;
+		return size;
+	}
+
+	//Inflate raw deflate stream. If line is set, stops early after the first line.
+	void inflate_data(const char* in, size_t insize, std::vector<char>& out, size_t outsize, bool line)
+	{
+		z_stream s;
+		memset(&s, 0, sizeof(s));
+		if(inflateInit2(&s, -MAX_WBITS) != Z_OK)
+			throw std::bad_alloc();
+		out.resize(outsize);
+		s.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+		s.avail_in = insize;
+		size_t done = 0;
+		int r = Z_OK;
+		while(done < outsize && r != Z_STREAM_END) {
+			size_t chunk = line ? min(outsize - done, (size_t)4096) : outsize - done;
+			s.next_out = reinterpret_cast<Bytef*>(&out[done]);
+			s.avail_out = chunk;
+			r = inflate(&s, Z_NO_FLUSH);
+			if(r != Z_OK && r != Z_STREAM_END) {
+				inflateEnd(&s);
+				throw std::runtime_error("ZIP archive corrupt: Bad compressed data");
+			}
+			size_t got = chunk - s.avail_out;
+			bool eol = line && memchr(&out[done], '\n', got);
+			done += got;
+			if(eol)
+				break;
+		}
+		inflateEnd(&s);
+		if(!line && done != outsize)
+			throw std::runtime_error("ZIP archive corrupt: Wrong uncompressed size");
+		out.resize(done);
 	}
 }
 
 bool reader::has_member(const std::string& name) throw()
 {
-	return (offsets.count(name) > 0);
+	return (members.count(name) > 0);
 }
 
 std::string reader::find_first() throw(std::bad_alloc)
 {
-	if(offsets.empty())
+	if(members.empty())
 		return "";
 	else
-		return offsets.begin()->first;
+		return members.begin()->first;
 }
 
 std::string reader::find_next(const std::string& name) throw(std::bad_alloc)
 {
-	auto i = offsets.upper_bound(name);
-	if(i == offsets.end())
+	auto i = members.upper_bound(name);
+	if(i == members.end())
 		return "";
 	else
 		return i->first;
 }
 
-std::istream& reader::operator[](const std::string& name) throw(std::bad_alloc, std::runtime_error)
+reader::member_info& reader::lookup(const std::string& name) throw(std::runtime_error)
 {
-	if(!offsets.count(name))
+	auto i = members.find(name);
+	if(i == members.end())
 		throw std::runtime_error("No such file '" + name + "' in zip archive");
-	zipstream->clear();
-	zipstream->seekg(offsets[name], std::ios::beg);
-	zipfile_member_info info = parse_member(*zipstream);
-	zipstream->clear();
-	zipstream->seekg(info.data_offset, std::ios::beg);
-	if(info.compression == 0) {
-		return *new boost::iostreams::stream<file_input>(*zipstream, info.uncompressed_size, refcnt);
-	} else if(info.compression == 8) {
+	return i->second;
+}
+
+const char* reader::member_data(member_info& m) throw(std::runtime_error)
+{
+	if(!m.data_offset) {
+		//Only the local header has the real extra field length.
+		if((uint64_t)m.header_offset + 30 > map->size())
+			throw std::runtime_error("Can't read file header from ZIP file");
+		const char* h = map->data() + m.header_offset;
+		if(serialization::u32l(h) != 0x04034b50)
+			throw std::runtime_error("ZIP archive corrupt: Expected file magic");
+		m.data_offset = m.header_offset + 30 + serialization::u16l(h + 26) + serialization::u16l(h + 28);
+	}
+	if((uint64_t)m.data_offset + m.compressed_size > map->size())
+		throw std::runtime_error("ZIP archive corrupt: Member extends past end of file");
+	return map->data() + m.data_offset;
+}
+
+std::istream& reader::operator[](const std::string& name) throw(std::bad_alloc, std::runtime_error)
+{
+	member_info& m = lookup(name);
+	const char* data = member_data(m);
+	if(m.compression == 0) {
+		return *new boost::iostreams::stream<mapped_input>(map, data, m.uncompressed_size);
+	} else if(m.compression == 8) {
 		boost::iostreams::filtering_istream* s = new boost::iostreams::filtering_istream();
 		boost::iostreams::zlib_params params;
 		params.noheader = true;
 		s->push(boost::iostreams::zlib_decompressor(params));
-		s->push(file_input(*zipstream, info.compressed_size, refcnt));
+		s->push(mapped_input(map, data, m.compressed_size));
 		return *s;
-	} else if(info.compression == 12) {
+	} else if(m.compression == 12) {
 		//Bzip2 compression.
 		boost::iostreams::filtering_istream* s = new boost::iostreams::filtering_istream();
 		s->push(boost::iostreams::bzip2_decompressor());
-		s->push(file_input(*zipstream, info.compressed_size, refcnt));
+		s->push(mapped_input(map, data, m.compressed_size));
 		return *s;
 	} else
 		throw std::runtime_error("Unsupported ZIP feature: Unsupported compression method");
@@ -308,62 +317,122 @@ std::istream& reader::operator[](const std::string& name) throw(std::bad_alloc,
 
 reader::iterator reader::begin() throw(std::bad_alloc)
 {
-	return iterator(offsets.begin());
+	return iterator(members.begin());
 }
 
 reader::iterator reader::end() throw(std::bad_alloc)
 {
-	return iterator(offsets.end());
+	return iterator(members.end());
 }
 
 reader::riterator reader::rbegin() throw(std::bad_alloc)
 {
-	return riterator(offsets.rbegin());
+	return riterator(members.rbegin());
 }
 
 reader::riterator reader::rend() throw(std::bad_alloc)
 {
-	return riterator(offsets.rend());
+	return riterator(members.rend());
 }
 
 reader::~reader() throw()
 {
-	if(!--*refcnt) {
-		delete zipstream;
-		delete refcnt;
-	}
 }
 
 reader::reader(const std::string& zipfile) throw(std::bad_alloc, std::runtime_error)
 {
 	if(!directory::is_regular(zipfile))
 		throw std::runtime_error("Zipfile '" + zipfile + "' is not regular file");
-	zipstream = NULL;
-	refcnt = NULL;
 	try {
-		zipfile_member_info info;
-		info.next_offset = 0;
-		zipstream = new std::ifstream;
-		zipstream->open(zipfile.c_str(), std::ios::binary);
-		refcnt = new size_t;
-		*refcnt = 1;
-		if(!*zipstream)
-			throw std::runtime_error("Can't open zipfile '" + zipfile + "' for reading");
-		do {
-			zipstream->clear();
-			zipstream->seekg(info.next_offset);
-			if(zipstream->fail())
-				throw std::runtime_error("Can't seek ZIP file");
-			info = parse_member(*zipstream);
-			if(info.central_directory_special)
-				break;
-			offsets[info.filename] = info.header_offset;
-		} while(1);
-	} catch(...) {
-		delete zipstream;
-		delete refcnt;
-		throw;
+		map.reset(new filemap::mapping(zipfile));
+	} catch(std::runtime_error& e) {
+		throw std::runtime_error("Can't open zipfile '" + zipfile + "' for reading");
+	}
+	size_t eocd = find_eocd(map->data(), map->size());
+	if(eocd < map->size())
+		read_central_directory(eocd);
+	else
+		read_local_headers();
+}
+
+void reader::read_central_directory(size_t eocd) throw(std::bad_alloc, std::runtime_error)
+{
+	const char* base = map->data();
+	size_t size = map->size();
+	size_t entries = serialization::u16l(base + eocd + 10);
+	uint64_t ptr = serialization::u32l(base + eocd + 16);
+	for(size_t i = 0; i < entries; i++) {
+		if(ptr + 46 > size)
+			throw std::runtime_error("Can't read central directory from ZIP file");
+		const char* h = base + ptr;
+		if(serialization::u32l(h) != 0x02014b50)
+			throw std::runtime_error("ZIP archive corrupt: Expected central directory magic");
+		member_info info;
+		uint16_t flags = serialization::u16l(h + 8);
+		info.compression = serialization::u16l(h + 10);
+		info.crc = serialization::u32l(h + 16);
+		info.compressed_size = serialization::u32l(h + 20);
+		info.uncompressed_size = serialization::u32l(h + 24);
+		uint16_t filename_len = serialization::u16l(h + 28);
+		uint16_t extra_len = serialization::u16l(h + 30);
+		uint16_t comment_len = serialization::u16l(h + 32);
+		info.header_offset = serialization::u32l(h + 42);
+		info.data_offset = 0;
+		if(!filename_len)
+			throw std::runtime_error("Unsupported ZIP feature: Empty filename not allowed");
+		check_member(serialization::u16l(h + 6), flags, info.compression, info.compressed_size,
+			info.uncompressed_size);
+		if(ptr + 46 + filename_len > size)
+			throw std::runtime_error("Can't read file name from zip file");
+		members[std::string(h + 46, filename_len)] = info;
+		ptr += 46 + filename_len + extra_len + comment_len;
+	}
+}
+
+void reader::read_local_headers() throw(std::bad_alloc, std::runtime_error)
+{
+	//No central directory, walk the members from start.
+	size_t offset = 0;
+	std::string name;
+	member_info info;
+	while(parse_local_header(map->data(), map->size(), offset, name, info)) {
+		members[name] = info;
+		offset = (uint64_t)info.data_offset + info.compressed_size;
+	}
+}
+
+void reader::read_member(const std::string& name, std::vector<char>& out, bool line) throw(std::bad_alloc,
+	std::runtime_error)
+{
+	member_info& m = lookup(name);
+	const char* data = member_data(m);
+	if(m.compression == 0) {
+		size_t size = m.uncompressed_size;
+		if(line) {
+			const char* eol = reinterpret_cast<const char*>(memchr(data, '\n', size));
+			if(eol)
+				size = eol - data;
+		}
+		out.assign(data, data + size);
+	} else if(m.compression == 8) {
+		//Deflate can't expand data more than about 1032 times.
+		if(m.uncompressed_size / 1032 > m.compressed_size + 1)
+			throw std::runtime_error("ZIP archive corrupt: Bad uncompressed size");
+		inflate_data(data, m.compressed_size, out, m.uncompressed_size, line);
+	} else {
+		std::istream& s = (*this)[name];
+		out.clear();
+		try {
+			boost::iostreams::back_insert_device<std::vector<char>> rd(out);
+			boost::iostreams::copy(s, rd);
+			delete &s;
+		} catch(...) {
+			delete &s;
+			throw;
+		}
 	}
+	if(!line && ::crc32(0, reinterpret_cast<const Bytef*>(out.empty() ? NULL : &out[0]), out.size()) != m.crc)
+		throw std::runtime_error("ZIP archive corrupt: CRC mismatch");
 }
 
 bool reader::read_linefile(const std::string& member, std::string& out, bool conditional)
@@ -371,15 +440,11 @@ bool reader::read_linefile(const std::string& member, std::string& out, bool con
 {
 	if(conditional && !has_member(member))
 		return false;
-	std::istream& m = (*this)[member];
-	try {
-		std::getline(m, out);
-		istrip_CR(out);
-		delete &m;
-	} catch(...) {
-		delete &m;
-		throw;
-	}
+	std::vector<char> buf;
+	read_member(member, buf, true);
+	const char* eol = buf.empty() ? NULL : reinterpret_cast<const char*>(memchr(&buf[0], '\n', buf.size()));
+	out = std::string(buf.empty() ? "" : &buf[0], eol ? eol - &buf[0] : buf.size());
+	istrip_CR(out);
 	return true;
 }
 
@@ -387,16 +452,35 @@ void reader::read_raw_file(const std::string& member, std::vector<char>& out) th
 	std::runtime_error)
 {
 	std::vector<char> _out;
-	std::istream& m = (*this)[member];
-	try {
-		boost::iostreams::back_insert_device<std::vector<char>> rd(_out);
-		boost::iostreams::copy(m, rd);
-		delete &m;
-	} catch(...) {
-		delete &m;
-		throw;
+	read_member(member, _out, false);
+	std::swap(out, _out);
+}
+
+struct writer::compressed_member
+{
+	std::vector<char> data;
+	uint32_t crc;
+	uint32_t size;
+};
+
+std::shared_ptr<writer::compressed_member> writer::compress_member(const std::vector<char>& content, bool deflate)
+{
+	std::shared_ptr<compressed_member> c(new compressed_member);
+	boost::iostreams::filtering_ostream s;
+	s.push(size_and_crc_filter(4096));
+	if(deflate) {
+		boost::iostreams::zlib_params params;
+		params.noheader = true;
+		s.push(boost::iostreams::zlib_compressor(params));
 	}
-	out = _out;
+	s.push(vector_output(c->data));
+	if(content.size())
+		s.write(&content[0], content.size());
+	boost::iostreams::close(s);
+	size_and_crc_filter& f = *s.component<size_and_crc_filter>(0);
+	c->size = f.size();
+	c->crc = f.crc32();
+	return c;
 }
 
 writer::writer(const std::string& zipfile, unsigned _compression) throw(std::bad_alloc, std::runtime_error)
@@ -421,6 +505,9 @@ writer::writer(std::ostream& stream, unsigned _compression) throw(std::bad_alloc
 
 writer::~writer() throw()
 {
+	//The compression tasks don't reference the writer, but don't leave them running.
+	for(auto& i : pending)
+		i.data.wait();
 	if(!committed && system_stream)
 		remove(temp_path.c_str());
 	if(system_stream)
@@ -433,6 +520,7 @@ void writer::commit() throw(std::bad_alloc, std::logic_error, std::runtime_error
 		throw std::logic_error("Can't commit twice");
 	if(open_file != "")
 		throw std::logic_error("Can't commit with file open");
+	write_pending(true);
 	std::vector<unsigned char> directory_entry;
 	uint32_t cdirsize = 0;
 	uint32_t cdiroff = zipstream->tellp();
@@ -492,15 +580,10 @@ std::ostream& writer::create_file(const std::string& name) throw(std::bad_alloc,
 		throw std::logic_error("Can't open file with file open");
 	if(name == "")
 		throw std::runtime_error("Bad member name");
-	current_compressed_file.resize(0);
+	//Buffer the member uncompressed, it is compressed when closed.
+	current_file.reset(new std::vector<char>());
 	s = new boost::iostreams::filtering_ostream();
-	s->push(size_and_crc_filter(4096));
-	if(compression) {
-		boost::iostreams::zlib_params params;
-		params.noheader = true;
-		s->push(boost::iostreams::zlib_compressor(params));
-	}
-	s->push(vector_output(current_compressed_file));
+	s->push(vector_output(*current_file));
 	open_file = name;
 	return *s;
 }
@@ -509,42 +592,56 @@ void writer::close_file() throw(std::bad_alloc, std::logic_error, std::runtime_e
 {
 	if(open_file == "")
 		throw std::logic_error("Can't close file with no file open");
-	uint32_t ucs, cs, crc32;
 	boost::iostreams::close(*s);
-	size_and_crc_filter& f = *s->component<size_and_crc_filter>(0);
-	cs = current_compressed_file.size();
-	ucs = f.size();
-	crc32 = f.crc32();
 	delete s;
-
-	base_offset = zipstream->tellp();
-	if(base_offset == (uint32_t)-1)
-		throw std::runtime_error("Can't read current ZIP stream position");
-	unsigned char header[30];
-	memset(header, 0, 30);
-	serialization::u32l(header, 0x04034b50);
-	header[4] = 20;
-	header[6] = 0;
-	header[8] = compression ? 8 : 0;
-	header[12] = 33;
-	header[13] = 40;
-	serialization::u32l(header + 14, crc32);
-	serialization::u32l(header + 18, cs);
-	serialization::u32l(header + 22, ucs);
-	serialization::u16l(header + 26, open_file.length());
-	zipstream->write(reinterpret_cast<char*>(header), 30);
-	zipstream->write(open_file.c_str(), open_file.length());
-	zipstream->write(&current_compressed_file[0], current_compressed_file.size());
-	if(!*zipstream)
-		throw std::runtime_error("Can't write member to ZIP file");
-	current_compressed_file.resize(0);
-	file_info info;
-	info.crc = crc32;
-	info.uncompressed_size = ucs;
-	info.compressed_size = cs;
-	info.offset = base_offset;
-	files[open_file] = info;
+	std::shared_ptr<std::vector<char>> content = current_file;
+	bool deflate = (compression != 0);
+	current_file.reset();
+	pending_member m;
+	m.name = open_file;
 	open_file = "";
+	m.data = threads::pool::global().submit<std::shared_ptr<compressed_member>>([content, deflate]() {
+		return compress_member(*content, deflate);
+	});
+	pending.push_back(m);
+	write_pending(false);
+}
+
+void writer::write_pending(bool all)
+{
+	//Don't let too many members be buffered, whole members are kept in memory until written.
+	size_t max_pending = 2 * threads::pool::global().get_threads() + 2;
+	while(!pending.empty() && (all || pending.size() > max_pending || pending.front().data.ready())) {
+		pending_member m = pending.front();
+		pending.pop_front();
+		std::shared_ptr<compressed_member> c = m.data.get();
+		base_offset = zipstream->tellp();
+		if(base_offset == (uint32_t)-1)
+			throw std::runtime_error("Can't read current ZIP stream position");
+		unsigned char header[30];
+		memset(header, 0, 30);
+		serialization::u32l(header, 0x04034b50);
+		header[4] = 20;
+		header[6] = 0;
+		header[8] = compression ? 8 : 0;
+		header[12] = 33;
+		header[13] = 40;
+		serialization::u32l(header + 14, c->crc);
+		serialization::u32l(header + 18, c->data.size());
+		serialization::u32l(header + 22, c->size);
+		serialization::u16l(header + 26, m.name.length());
+		zipstream->write(reinterpret_cast<char*>(header), 30);
+		zipstream->write(m.name.c_str(), m.name.length());
+		zipstream->write(&c->data[0], c->data.size());
+		if(!*zipstream)
+			throw std::runtime_error("Can't write member to ZIP file");
+		file_info info;
+		info.crc = c->crc;
+		info.uncompressed_size = c->size;
+		info.compressed_size = c->data.size();
+		info.offset = base_offset;
+		files[m.name] = info;
+	}
 }
 
 void writer::write_linefile(const std::string& member, const std::string& value, bool conditional)
@@ -135,6 +135,15 @@ namespace
 		void operator()(struct framebuffer::fb<false>& x) throw() { composite_op(x); }
 		void operator()(struct framebuffer::fb<true>& x) throw() { composite_op(x); }
 		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
+		bool get_bounds(int32_t& _x, int32_t& _y, uint32_t& _w, uint32_t& _h) const throw()
+		{
+			//Only the part [x0, x0 + dw) x [y0, y0 + dh) of bitmap is drawn, at (x, y).
+			_x = x;
+			_y = y;
+			_w = dw;
+			_h = dh;
+			return true;
+		}
 	private:
 		int32_t x;
 		int32_t y;
@@ -33,6 +33,14 @@ namespace
 		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
 		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
 		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
+		bool get_bounds(int32_t& _x, int32_t& _y, uint32_t& _w, uint32_t& _h) const throw()
+		{
+			_x = x;
+			_y = y;
+			_w = width;
+			_h = height;
+			return true;
+		}
 	private:
 		int32_t x;
 		int32_t y;
@@ -3,6 +3,7 @@
 #include "lua/halo.hpp"
 #include "fonts/wrapper.hpp"
 #include "library/framebuffer.hpp"
+#include "library/framebuffer-textcache.hpp"
 #include "library/lua-framebuffer.hpp"
 
 namespace
@@ -16,38 +17,63 @@ namespace
 		~render_object_text() throw() {}
 		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
 		{
-			auto size = main_font.get_metrics(text, x, hdbl, vdbl);
+			uint32_t rx = x + (int32_t)scr.get_origin_x() - 1;
+			uint32_t ry = y + (int32_t)scr.get_origin_y() - 1;
+			//Tabs align relative to x, so with tabs the alignment is part of the key.
+			uint32_t alignx = (text.find('\t') < text.length()) ? (static_cast<uint32_t>(x) % 64) : 0;
+			uint32_t flags = (hdbl ? 1 : 0) | (vdbl ? 2 : 0) | (hl ? 4 : 0) | (alignx << 3);
+			bool halo = hl;
+			std::shared_ptr<const framebuffer::text_cache::mask> m;
+			try {
+				m = framebuffer::text_cache::global().get(&main_font, framebuffer::text_cache::KIND_HALO_TEXT,
+					text, flags, [this, alignx, halo]
+					(framebuffer::text_cache::mask& m) { rasterize(m, alignx, halo); });
+			} catch(std::bad_alloc& e) {
+				return;
+			}
+			framebuffer::color cmap[4] = {bg, fg, hl, fg};
+			if(hl)
+				framebuffer::text_cache::blit(scr, rx, ry, *m, cmap);
+			else
+				framebuffer::text_cache::blit(scr, rx + 1, ry + 1, *m, cmap);
+		}
+		void rasterize(framebuffer::text_cache::mask& m, uint32_t alignx, bool halo)
+		{
+			auto size = main_font.get_metrics(text, alignx, hdbl, vdbl);
 			auto orig_size = size;
 			//Enlarge size by 2 in each dimension, in order to accomodiate halo, if any.
 			//Round up width to multiple of 32.
 			size.first = (size.first + 33) >> 5 << 5;
 			size.second += 2;
-			//The -1 is to accomodiate halo.
 			size_t allocsize = size.first * size.second + 32;
-
-			if(allocsize > 32768) {
-				std::vector<uint8_t> memory;
-				memory.resize(allocsize);
-				op_with(scr, &memory[0], size, orig_size);
-			} else {
-				uint8_t memory[allocsize];
-				op_with(scr, memory, size, orig_size);
-			}
-		}
-		template<bool X> void op_with(struct framebuffer::fb<X>& scr, unsigned char* mem,
-			std::pair<size_t, size_t> size, std::pair<size_t, size_t> orig_size) throw()
-		{
-			uint32_t rx = x + (int32_t)scr.get_origin_x() - 1;
-			uint32_t ry = y + (int32_t)scr.get_origin_y() - 1;
+			std::vector<uint8_t> memory;
+			memory.resize(allocsize);
+			unsigned char* mem = &memory[0];
 			mem += (32 - ((size_t)mem & 31)) & 31;	//Align.
-			memset(mem, 0, size.first * size.second);
-			main_font.render(mem + size.first + 1, size.first, text, x, hdbl, vdbl);
-			halo_blit(scr, mem, size.first, size.second, orig_size.first, orig_size.second, rx, ry, bg,
-				fg, hl);
+			main_font.render(mem + size.first + 1, size.first, text, alignx, hdbl, vdbl);
+			if(halo)
+				render_halo(mem, size.first, size.second);
+			//Only keep the part that is drawn: With halo, the border is included.
+			size_t border = halo ? 0 : 1;
+			m.width = orig_size.first + 2 - 2 * border;
+			m.height = orig_size.second + 2 - 2 * border;
+			m.data.resize(m.width * m.height);
+			for(size_t i = 0; i < m.height; i++)
+				memcpy(&m.data[i * m.width], mem + (i + border) * size.first + border, m.width);
 		}
 		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
 		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
 		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
+		bool get_bounds(int32_t& _x, int32_t& _y, uint32_t& _w, uint32_t& _h) const throw()
+		{
+			auto size = main_font.get_metrics(text, x, hdbl, vdbl);
+			//The halo extends one pixel in each direction.
+			_x = x - 1;
+			_y = y - 1;
+			_w = size.first + 2;
+			_h = size.second + 2;
+			return true;
+		}
 	private:
 		int32_t x;
 		int32_t y;
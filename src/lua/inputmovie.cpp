@@ -254,11 +254,7 @@ namespace
 
 		P(count);
 
-		{
-			portctrl::frame_vector::notify_freeze freeze(v);
-			for(uint64_t i = 0; i < count; i++)
-				v.append(v.blank_frame(true));
-		}
+		v.insert_range(v.size(), count, true);
 		if(&v == core.mlogic->get_mfile().input) {
 			core.supdater->update();
 			core.dispatch->status_update();
@@ -310,6 +306,47 @@ namespace
 		return 0;
 	}
 
+	int _insert_frames(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		uint64_t pos, count;
+		bool sync;
+		portctrl::frame_vector& v = framevector(L, P);
+
+		P(pos, count, P.optional(sync, true));
+
+		if(pos > v.size())
+			throw std::runtime_error("Requested insert position past end of movie");
+		if(&v == core.mlogic->get_mfile().input)
+			check_can_edit(0, 0, 0, pos, true);
+		v.insert_range(pos, count, sync);
+		if(&v == core.mlogic->get_mfile().input) {
+			core.supdater->update();
+			core.dispatch->status_update();
+		}
+		return 0;
+	}
+
+	int _erase_frames(lua::state& L, lua::parameters& P)
+	{
+		auto& core = CORE();
+		uint64_t pos, count;
+		portctrl::frame_vector& v = framevector(L, P);
+
+		P(pos, count);
+
+		if(pos > v.size() || count > v.size() - pos)
+			throw std::runtime_error("Requested erase range not inside movie");
+		if(&v == core.mlogic->get_mfile().input)
+			check_can_edit(0, 0, 0, pos, true);
+		v.erase_range(pos, count);
+		if(&v == core.mlogic->get_mfile().input) {
+			core.supdater->update();
+			core.dispatch->status_update();
+		}
+		return 0;
+	}
+
 	int _edit(lua::state& L, lua::parameters& P)
 	{
 		auto& core = CORE();
@@ -386,15 +423,10 @@ namespace
 			throw std::runtime_error("Can't open file to write output to");
 		if(binary) {
 			uint64_t stride = v.get_stride();
-			uint64_t pageframes = v.get_frames_per_page();
-			uint64_t vsize = v.size();
-			size_t pagenum = 0;
-			while(vsize > 0) {
-				uint64_t count = (vsize > pageframes) ? pageframes : vsize;
-				size_t bytes = count * stride;
-				unsigned char* content = v.get_page_buffer(pagenum++);
-				file.write(reinterpret_cast<char*>(content), bytes);
-				vsize -= count;
+			for(size_t pagenum = 0; pagenum < v.get_page_count(); pagenum++) {
+				size_t bytes = v.get_page_frames(pagenum) * stride;
+				const unsigned char* content = v.get_page_buffer(pagenum);
+				file.write(reinterpret_cast<const char*>(content), bytes);
 			}
 		} else {
 			char buf[MAX_SERIALIZED_SIZE];
@@ -457,6 +489,14 @@ namespace
 		{
 			return _truncate(L, P);
 		}
+		int insert_frames(lua::state& L, lua::parameters& P)
+		{
+			return _insert_frames(L, P);
+		}
+		int erase_frames(lua::state& L, lua::parameters& P)
+		{
+			return _erase_frames(L, P);
+		}
 		int edit(lua::state& L, lua::parameters& P)
 		{
 			return _edit(L, P);
@@ -547,6 +587,16 @@ namespace
 		return _truncate(L, P);
 	}
 
+	int insert_frames(lua::state& L, lua::parameters& P)
+	{
+		return _insert_frames(L, P);
+	}
+
+	int erase_frames(lua::state& L, lua::parameters& P)
+	{
+		return _erase_frames(L, P);
+	}
+
 	int edit(lua::state& L, lua::parameters& P)
 	{
 		return _edit(L, P);
@@ -653,6 +703,8 @@ namespace
 			{"append_frames", &lua_inputmovie::append_frames},
 			{"append_frame", &lua_inputmovie::append_frame},
 			{"truncate", &lua_inputmovie::truncate},
+			{"insert_frames", &lua_inputmovie::insert_frames},
+			{"erase_frames", &lua_inputmovie::erase_frames},
 			{"edit", &lua_inputmovie::edit},
 			{"debugdump", &lua_inputmovie::debugdump},
 			{"copy_frames", &lua_inputmovie::copy_frames},
@@ -683,6 +735,8 @@ namespace
 		{"append_frames", append_frames},
 		{"append_frame", append_frame},
 		{"truncate", truncate},
+		{"insert_frames", insert_frames},
+		{"erase_frames", erase_frames},
 		{"edit", edit},
 		{"copy_frames2", copy_frames2},
 		{"copy_frames", copy_frames},
@@ -1,11 +1,14 @@
 #include "cmdhelp/lua.hpp"
 #include "core/command.hpp"
+#include "core/framerate.hpp"
 #include "core/misc.hpp"
 #include "library/globalwrap.hpp"
 #include "library/keyboard.hpp"
 #include "library/memtracker.hpp"
+#include "library/perfscope.hpp"
 #include "lua/internal.hpp"
 #include "lua/lua.hpp"
+#include "lua/profile.hpp"
 #include "lua/unsaferewind.hpp"
 #include "core/instance.hpp"
 #include "core/mainloop.hpp"
@@ -39,10 +42,16 @@ lua::class_group lua_class_fileio;
 
 namespace
 {
+	perfscope::region perf_callback("lua.callback");
 	const char* lua_vm_id = "Lua VM";
 	typedef settingvar::model_int<32,1024> mb_model;
 	settingvar::supervariable<mb_model> SET_lua_maxmem(lsnes_setgrp, "lua-maxmem",
 		"Lua‣Maximum memory use (MB)", 128);
+	typedef settingvar::model_int<0,1000000> budget_model;
+	settingvar::supervariable<budget_model> SET_lua_frame_budget(lsnes_setgrp, "lua-frame-budget",
+		"Lua‣Callback time budget per frame (us, 0=none)", 0);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_lua_budget_skip_paint(lsnes_setgrp,
+		"lua-budget-skip-paint", "Lua‣Skip paint callbacks over budget", false);
 
 	void pushpair(lua::state& L, std::string key, double value)
 	{
@@ -169,6 +178,8 @@ void lua_state::_listener::on_setting_change(settingvar::group& grp, const setti
 {
 	if(val.get_iname() == "lua-maxmem")
 		obj.set_memory_limit(dynamic_cast<const settingvar::variable<mb_model>*>(&val)->get());
+	if(val.get_iname() == "lua-frame-budget" || val.get_iname() == "lua-budget-skip-paint")
+		obj.profile->set_budget(SET_lua_frame_budget(grp), SET_lua_budget_skip_paint(grp));
 }
 
 void lua_state::set_memory_limit(size_t limit_mb)
@@ -207,6 +218,7 @@ lua_state::lua_state(lua::state& _L, command::group& _command, settingvar::group
 	renderq_saved = NULL;
 	renderq_last = NULL;
 	renderq_redirect = false;
+	profile = new lua_profiler(L);
 
 	on_paint = new lua::state::callback_list(L, "paint", "on_paint");
 	on_video = new lua::state::callback_list(L, "video", "on_video");
@@ -266,12 +278,17 @@ lua_state::~lua_state()
 	delete on_post_rewind;
 	delete on_set_rewind;
 	delete on_latch;
+	delete profile;
 }
 
 void lua_state::callback_do_paint(struct lua::render_context* ctx, bool non_synthetic) throw()
 {
 	run_synchronous_paint(ctx);
+	if(profile->skip_paint())
+		return;
+	uint64_t t = framerate_regulator::get_utime();
 	run_callback(*on_paint, lua::state::store_tag(render_ctx, ctx), lua::state::boolean_tag(non_synthetic));
+	profile->paint_done(framerate_regulator::get_utime() - t);
 }
 
 void lua_state::callback_do_video(struct lua::render_context* ctx, bool& _kill_frame, uint32_t& _hscl,
@@ -289,6 +306,7 @@ void lua_state::callback_do_reset() throw()
 void lua_state::callback_do_frame() throw()
 {
 	run_callback(*on_frame);
+	profile->end_frame();
 }
 
 void lua_state::callback_do_rewind() throw()
@@ -379,6 +397,7 @@ namespace
 
 void lua_state::do_reset()
 {
+	profile->stop();
 	L.reset();
 	luaL_openlibs(L.handle());
 
@@ -585,7 +604,10 @@ template<typename... T> bool lua_state::run_callback(lua::state::callback_list&
 {
 	if(recursive_flag)
 		return true;
+	perfscope::scope t(perf_callback);
 	recursive_flag = true;
+	profile->enter_callback();
+	uint64_t start = framerate_regulator::get_utime();
 	try {
 		if(!list.callback(args...)) {
 			recursive_flag = false;
@@ -594,6 +616,7 @@ template<typename... T> bool lua_state::run_callback(lua::state::callback_list&
 	} catch(std::exception& e) {
 		messages << e.what() << std::endl;
 	}
+	profile->account(list.get_name(), framerate_regulator::get_utime() - start);
 	recursive_flag = false;
 	render_ctx = NULL;
 	if(requests_repaint) {
@@ -0,0 +1,210 @@
+#include "lua/internal.hpp"
+#include "core/instance.hpp"
+#include "core/memorymanip.hpp"
+#include "library/memoryspace.hpp"
+#include "library/memorystruct.hpp"
+#include "library/minmax.hpp"
+
+namespace
+{
+	//Keeps scripts from allocating huge arrays by accident.
+	const uint64_t max_bulk_size = 1 << 28;
+
+	class memory_array
+	{
+	public:
+		memory_array(lua::state& L, uint64_t addr, uint64_t count, uint64_t stride,
+			const std::string& format);
+		static size_t overcommit(uint64_t addr, uint64_t count, uint64_t stride, const std::string& format)
+		{
+			return 0;
+		}
+		static int create(lua::state& L, lua::parameters& P);
+		int refresh(lua::state& L, lua::parameters& P);
+		int count(lua::state& L, lua::parameters& P);
+		int fields(lua::state& L, lua::parameters& P);
+		int get(lua::state& L, lua::parameters& P);
+		int row(lua::state& L, lua::parameters& P);
+		int column(lua::state& L, lua::parameters& P);
+		int columns(lua::state& L, lua::parameters& P);
+		int string(lua::state& L, lua::parameters& P);
+		std::string print()
+		{
+			std::ostringstream x;
+			x << "addr=0x" << std::hex << addr << " count=" << std::dec << rows << " stride=0x" << std::hex
+				<< stride << " size=0x" << layout.get_size();
+			return x.str();
+		}
+	private:
+		void read();
+		void push_column(lua::state& L, size_t field);
+		uint64_t get_row(lua::parameters& P);
+		size_t get_field(lua::parameters& P, size_t dflt);
+		memory_struct layout;
+		uint64_t addr;
+		uint64_t rows;
+		uint64_t stride;
+		int endian;
+		std::vector<char> data;
+	};
+
+	memory_array::memory_array(lua::state& L, uint64_t _addr, uint64_t _count, uint64_t _stride,
+		const std::string& format)
+		: layout(format)
+	{
+		addr = _addr;
+		rows = _count;
+		stride = _stride;
+		endian = 0;
+		if(!layout.get_size() && rows)
+			throw std::runtime_error("Structure format is empty");
+		if(rows > max_bulk_size / max(layout.get_size(), (size_t)1))
+			throw std::runtime_error("Structure array too large");
+		data.resize(rows * layout.get_size());
+		read();
+	}
+
+	void memory_array::read()
+	{
+		if(!rows)
+			return;
+		endian = CORE().memory->read_strided(addr, layout.get_size(), rows, stride, &data[0]);
+	}
+
+	uint64_t memory_array::get_row(lua::parameters& P)
+	{
+		uint64_t i = P.arg<uint64_t>();
+		if(i >= rows)
+			throw std::runtime_error(P.get_fname() + ": Row index out of range");
+		return i;
+	}
+
+	size_t memory_array::get_field(lua::parameters& P, size_t dflt)
+	{
+		size_t f = P.arg_opt<size_t>(dflt);
+		if(f >= layout.get_fields())
+			throw std::runtime_error(P.get_fname() + ": Field index out of range");
+		return f;
+	}
+
+	void memory_array::push_column(lua::state& L, size_t field)
+	{
+		size_t size = layout.get_size();
+		L.createtable(rows, 0);
+		for(uint64_t i = 0; i < rows; i++) {
+			L.pushnumber(i);
+			L.pushnumber(layout.get(&data[i * size], field, endian));
+			L.rawset(-3);
+		}
+	}
+
+	int memory_array::create(lua::state& L, lua::parameters& P)
+	{
+		uint64_t addr, count, stride;
+		std::string format;
+
+		addr = lua_get_read_address(P);
+		P(count, stride, format);
+
+		lua::_class<memory_array>::create(L, addr, count, stride, format);
+		return 1;
+	}
+
+	int memory_array::refresh(lua::state& L, lua::parameters& P)
+	{
+		read();
+		return 0;
+	}
+
+	int memory_array::count(lua::state& L, lua::parameters& P)
+	{
+		L.pushnumber(rows);
+		return 1;
+	}
+
+	int memory_array::fields(lua::state& L, lua::parameters& P)
+	{
+		L.pushnumber(layout.get_fields());
+		return 1;
+	}
+
+	int memory_array::get(lua::state& L, lua::parameters& P)
+	{
+		P(P.skipped());
+		uint64_t i = get_row(P);
+		size_t f = get_field(P, 0);
+		L.pushnumber(layout.get(&data[i * layout.get_size()], f, endian));
+		return 1;
+	}
+
+	int memory_array::row(lua::state& L, lua::parameters& P)
+	{
+		P(P.skipped());
+		uint64_t i = get_row(P);
+		size_t n = layout.get_fields();
+		if(!L.checkstack(n))
+			throw std::runtime_error(P.get_fname() + ": Too many fields");
+		for(size_t j = 0; j < n; j++)
+			L.pushnumber(layout.get(&data[i * layout.get_size()], j, endian));
+		return n;
+	}
+
+	int memory_array::column(lua::state& L, lua::parameters& P)
+	{
+		P(P.skipped());
+		push_column(L, get_field(P, 0));
+		return 1;
+	}
+
+	int memory_array::columns(lua::state& L, lua::parameters& P)
+	{
+		size_t n = layout.get_fields();
+		L.createtable(n, 0);
+		for(size_t j = 0; j < n; j++) {
+			L.pushnumber(j);
+			push_column(L, j);
+			L.rawset(-3);
+		}
+		return 1;
+	}
+
+	int memory_array::string(lua::state& L, lua::parameters& P)
+	{
+		L.pushlstring(data.empty() ? "" : &data[0], data.size());
+		return 1;
+	}
+
+	int readstring(lua::state& L, lua::parameters& P)
+	{
+		uint64_t addr, size;
+
+		addr = lua_get_read_address(P);
+		P(size);
+
+		if(size > max_bulk_size)
+			throw std::runtime_error(P.get_fname() + ": Size too large");
+		std::vector<char> buffer(size);
+		if(size)
+			CORE().memory->read_range(addr, &buffer[0], size);
+		L.pushlstring(buffer.empty() ? "" : &buffer[0], size);
+		return 1;
+	}
+
+	lua::functions LUA_bulk_fns(lua_func_misc, "memory", {
+		{"readstring", readstring},
+	});
+
+	lua::_class<memory_array> LUA_class_memory_array(lua_class_memory, "MEMORY_ARRAY", {
+		{"new", memory_array::create},
+	}, {
+		{"refresh", &memory_array::refresh},
+		{"count", &memory_array::count},
+		{"__len", &memory_array::count},
+		{"fields", &memory_array::fields},
+		{"get", &memory_array::get},
+		{"row", &memory_array::row},
+		{"column", &memory_array::column},
+		{"columns", &memory_array::columns},
+		{"string", &memory_array::string},
+	}, &memory_array::print);
+}
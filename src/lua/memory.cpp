@@ -1,6 +1,7 @@
 #include "cmdhelp/lua.hpp"
 #include "core/command.hpp"
 #include "core/debug.hpp"
+#include "core/framerate.hpp"
 #include "core/instance.hpp"
 #include "core/memorymanip.hpp"
 #include "core/memorywatch.hpp"
@@ -10,6 +11,8 @@
 #include "core/rom.hpp"
 #include "lua/address.hpp"
 #include "lua/internal.hpp"
+#include "lua/lua.hpp"
+#include "lua/profile.hpp"
 #include "library/sha256.hpp"
 #include "library/string.hpp"
 #include "library/skein.hpp"
@@ -194,6 +197,8 @@ namespace
 	}
 
 	char CONST_lua_cb_list_key = 0;
+	const char* profile_names[] = {"memory_read", "memory_write", "memory_execute", "memory_trace",
+		"memory_frame"};
 
 	struct lua_debug_callback2 : public debug_context::callback_base
 	{
@@ -301,6 +306,14 @@ namespace
 
 	void lua_debug_callback2::callback(const debug_context::params& p)
 	{
+		lua_profiler& prof = *CORE().lua2->profile;
+		//Memory callbacks can be very frequent, so these are only accounted when profiling.
+		bool profiling = prof.is_active() && p.type <= debug_context::DEBUG_FRAME;
+		uint64_t t = 0;
+		if(profiling) {
+			prof.enter_callback();
+			t = framerate_regulator::get_utime();
+		}
 		L->pushlightuserdata((char*)this + 1);
 		L->rawget(LUA_REGISTRYINDEX);
 		switch(p.type) {
@@ -327,6 +340,8 @@ namespace
 			L->pop(1);
 			break;
 		}
+		if(profiling)
+			prof.account(profile_names[p.type], framerate_regulator::get_utime() - t);
 	}
 
 	void lua_debug_callback2::killed(uint64_t addr, debug_context::etype type)
@@ -635,10 +650,13 @@ namespace
 		return 1;
 	}
 
+	std::vector<char> hash_state_buffer;
+
 	int hash_state(lua::state& L, lua::parameters& P)
 	{
 		auto& core = CORE();
-		auto x = core.rom->save_core_state();
+		auto& x = hash_state_buffer;
+		core.rom->save_core_state(x);
 		size_t offset = x.size() - 32;
 		L.pushlstring(hex::b_to((uint8_t*)&x[offset], 32));
 		return 1;
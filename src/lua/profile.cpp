@@ -0,0 +1,264 @@
+#include "cmdhelp/lua.hpp"
+#include "core/command.hpp"
+#include "core/framerate.hpp"
+#include "core/instance.hpp"
+#include "core/messages.hpp"
+#include "lua/internal.hpp"
+#include "lua/lua.hpp"
+#include "lua/profile.hpp"
+#include "library/minmax.hpp"
+#include "library/string.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace
+{
+	//Lua hooks have no user data, and there is only one Lua VM anyway.
+	lua_profiler* hooked = NULL;
+	const uint64_t warning_interval = 300;
+	const size_t show_top = 20;
+
+	template<typename T> std::vector<std::pair<std::string, T>> sort_by(const std::map<std::string, T>& m,
+		std::function<uint64_t(const T&)> key)
+	{
+		std::vector<std::pair<std::string, T>> r(m.begin(), m.end());
+		std::sort(r.begin(), r.end(), [key](const std::pair<std::string, T>& a,
+			const std::pair<std::string, T>& b) -> bool { return key(a.second) > key(b.second); });
+		return r;
+	}
+
+	void show_profile(lua_profiler& p)
+	{
+		messages << "Lua profiler is " << (p.is_active() ? "running" : "not running") << std::endl;
+		auto cbs = sort_by<lua_profiler::callback_stats>(p.get_callbacks(),
+			[](const lua_profiler::callback_stats& s) -> uint64_t { return s.total; });
+		for(auto& i : cbs)
+			messages << "Callback " << i.first << ": " << i.second.calls << " calls, " << i.second.total
+				<< "us total, " << i.second.total / max(i.second.calls, (uint64_t)1) << "us mean, "
+				<< i.second.max << "us max" << std::endl;
+		auto fns = sort_by<lua_profiler::function_stats>(p.get_functions(),
+			[](const lua_profiler::function_stats& s) -> uint64_t { return s.time; });
+		for(size_t i = 0; i < fns.size() && i < show_top; i++)
+			messages << "Function " << fns[i].first << ": " << fns[i].second.calls << " calls, "
+				<< fns[i].second.samples << " samples, ~" << fns[i].second.time << "us" << std::endl;
+		if(fns.size() > show_top)
+			messages << "(" << (fns.size() - show_top) << " more functions)" << std::endl;
+		auto b = p.get_budget_stats();
+		if(b.first || b.second)
+			messages << b.first << " frame(s) over budget, " << b.second << " paint(s) skipped" << std::endl;
+	}
+
+	command::fnptr<const std::string&> CMD_lua_profile(lsnes_cmds, CLUA::profile,
+		[](const std::string& args) throw(std::bad_alloc, std::runtime_error) {
+		lua_profiler& p = *CORE().lua2->profile;
+		regex_results r;
+		if(r = regex("start([ \t]+([0-9]+))?[ \t]*", args)) {
+			unsigned interval = (r[2] != "") ? parse_value<unsigned>(r[2]) : 1000;
+			if(!interval)
+				throw std::runtime_error("Sampling interval must be positive");
+			p.start(interval);
+			messages << "Lua profiler started" << std::endl;
+		} else if(regex_match("stop[ \t]*", args)) {
+			p.stop();
+			messages << "Lua profiler stopped" << std::endl;
+		} else if(regex_match("reset[ \t]*", args)) {
+			p.reset();
+		} else if(regex_match("(show)?[ \t]*", args)) {
+			show_profile(p);
+		} else
+			throw std::runtime_error("Syntax: lua-profile [start [<interval>]|stop|show|reset]");
+	});
+
+	int profile_start(lua::state& L, lua::parameters& P)
+	{
+		unsigned interval = 1000;
+
+		P(P.optional(interval, 1000));
+
+		if(!interval)
+			throw std::runtime_error("Sampling interval must be positive");
+		CORE().lua2->profile->start(interval);
+		return 0;
+	}
+
+	int profile_stop(lua::state& L, lua::parameters& P)
+	{
+		CORE().lua2->profile->stop();
+		return 0;
+	}
+
+	int profile_reset(lua::state& L, lua::parameters& P)
+	{
+		CORE().lua2->profile->reset();
+		return 0;
+	}
+
+	int profile_report(lua::state& L, lua::parameters& P)
+	{
+		lua_profiler& p = *CORE().lua2->profile;
+		L.newtable();
+		L.newtable();
+		for(auto& i : p.get_callbacks()) {
+			L.pushlstring(i.first);
+			L.newtable();
+			L.pushnumber(i.second.calls);
+			L.setfield(-2, "calls");
+			L.pushnumber(i.second.total);
+			L.setfield(-2, "total");
+			L.pushnumber(i.second.max);
+			L.setfield(-2, "max");
+			L.settable(-3);
+		}
+		L.setfield(-2, "callbacks");
+		L.newtable();
+		for(auto& i : p.get_functions()) {
+			L.pushlstring(i.first);
+			L.newtable();
+			L.pushnumber(i.second.calls);
+			L.setfield(-2, "calls");
+			L.pushnumber(i.second.samples);
+			L.setfield(-2, "samples");
+			L.pushnumber(i.second.time);
+			L.setfield(-2, "time");
+			L.settable(-3);
+		}
+		L.setfield(-2, "functions");
+		auto b = p.get_budget_stats();
+		L.pushnumber(b.first);
+		L.setfield(-2, "over_budget");
+		L.pushnumber(b.second);
+		L.setfield(-2, "skipped_paints");
+		return 1;
+	}
+
+	lua::functions LUA_profile_fns(lua_func_misc, "profiler", {
+		{"start", profile_start},
+		{"stop", profile_stop},
+		{"reset", profile_reset},
+		{"report", profile_report},
+	});
+}
+
+lua_profiler::lua_profiler(lua::state& _L)
+	: L(_L)
+{
+	active = false;
+	last_sample = 0;
+	budget = 0;
+	skip = false;
+	frame_used = 0;
+	last_paint = 0;
+	skipped_last = false;
+	over_budget = 0;
+	skipped_paints = 0;
+	frames_since_warning = warning_interval;
+}
+
+lua_profiler::~lua_profiler()
+{
+	if(hooked == this)
+		hooked = NULL;
+}
+
+void lua_profiler::start(unsigned interval)
+{
+	if(!L.handle())
+		throw std::runtime_error("Lua VM is not running");
+	hooked = this;
+	active = true;
+	last_sample = framerate_regulator::get_utime();
+	lua_sethook(L.handle(), lua_profiler::hook, LUA_MASKCALL | LUA_MASKCOUNT, interval);
+}
+
+void lua_profiler::stop()
+{
+	if(L.handle())
+		lua_sethook(L.handle(), NULL, 0, 0);
+	active = false;
+	if(hooked == this)
+		hooked = NULL;
+}
+
+void lua_profiler::reset()
+{
+	callbacks.clear();
+	functions.clear();
+	over_budget = 0;
+	skipped_paints = 0;
+}
+
+void lua_profiler::enter_callback()
+{
+	//Time between callbacks is not spent in any Lua function.
+	if(active)
+		last_sample = framerate_regulator::get_utime();
+}
+
+void lua_profiler::account(const std::string& name, uint64_t usecs)
+{
+	callback_stats& s = callbacks[name];
+	s.calls++;
+	s.total += usecs;
+	s.max = max(s.max, usecs);
+	frame_used += usecs;
+}
+
+bool lua_profiler::skip_paint()
+{
+	//Never skip two paints in a row, or scripts that always go over budget would never show anything.
+	if(!budget || !skip || skipped_last || frame_used + last_paint <= budget) {
+		skipped_last = false;
+		return false;
+	}
+	skipped_last = true;
+	skipped_paints++;
+	return true;
+}
+
+void lua_profiler::end_frame()
+{
+	frames_since_warning++;
+	if(budget && frame_used > budget) {
+		over_budget++;
+		if(frames_since_warning >= warning_interval) {
+			messages << "Lua callbacks took " << frame_used << "us in a frame (budget " << budget
+				<< "us, " << over_budget << " frame(s) over budget so far)" << std::endl;
+			frames_since_warning = 0;
+		}
+	}
+	frame_used = 0;
+}
+
+std::string lua_profiler::function_key(lua_State* _L, lua_Debug* ar)
+{
+	if(!lua_getinfo(_L, "Sn", ar))
+		return "?";
+	if(!strcmp(ar->what, "C"))
+		return std::string("[C] ") + (ar->name ? ar->name : "?");
+	return (stringfmt() << ar->short_src << ":" << ar->linedefined).str();
+}
+
+void lua_profiler::hook(lua_State* _L, lua_Debug* ar)
+{
+	lua_profiler* p = hooked;
+	if(!p)
+		return;
+	try {
+		if(ar->event == LUA_HOOKCALL) {
+			p->functions[p->function_key(_L, ar)].calls++;
+		} else if(ar->event == LUA_HOOKCOUNT) {
+			lua_Debug ar2;
+			if(!lua_getstack(_L, 0, &ar2))
+				return;
+			uint64_t now = framerate_regulator::get_utime();
+			function_stats& s = p->functions[p->function_key(_L, &ar2)];
+			s.samples++;
+			s.time += now - p->last_sample;
+			p->last_sample = now;
+		}
+	} catch(...) {
+		//Can't throw through Lua.
+	}
+}
@@ -0,0 +1,120 @@
+#include "lua/internal.hpp"
+#include "core/instance.hpp"
+#include "core/ramrecorder.hpp"
+
+namespace
+{
+	int ramrec_add(lua::state& L, lua::parameters& P)
+	{
+		std::string name, type;
+		uint64_t addr;
+
+		P(name);
+		addr = lua_get_read_address(P);
+		P(type);
+
+		CORE().ramrec->add(name, addr, type);
+		return 0;
+	}
+
+	int ramrec_watch(lua::state& L, lua::parameters& P)
+	{
+		std::string name;
+
+		P(name);
+
+		CORE().ramrec->add_watch(name);
+		return 0;
+	}
+
+	int ramrec_remove(lua::state& L, lua::parameters& P)
+	{
+		std::string name;
+
+		P(name);
+
+		CORE().ramrec->remove(name);
+		return 0;
+	}
+
+	int ramrec_start(lua::state& L, lua::parameters& P)
+	{
+		CORE().ramrec->set_active(true);
+		return 0;
+	}
+
+	int ramrec_stop(lua::state& L, lua::parameters& P)
+	{
+		CORE().ramrec->set_active(false);
+		return 0;
+	}
+
+	int ramrec_clear(lua::state& L, lua::parameters& P)
+	{
+		CORE().ramrec->clear();
+		return 0;
+	}
+
+	int ramrec_columns(lua::state& L, lua::parameters& P)
+	{
+		L.newtable();
+		int idx = 1;
+		for(auto& i : CORE().ramrec->get_columns()) {
+			L.pushnumber(idx++);
+			L.pushlstring(i);
+			L.rawset(-3);
+		}
+		return 1;
+	}
+
+	int ramrec_query(lua::state& L, lua::parameters& P)
+	{
+		std::string name;
+		uint64_t first, last;
+
+		P(name, P.optional(first, 0), P.optional(last, 0xFFFFFFFFFFFFFFFFULL));
+
+		auto v = CORE().ramrec->query(name, first, last);
+		L.createtable(0, v.size());
+		for(auto& i : v) {
+			L.pushnumber(i.first);
+			L.pushnumber(i.second);
+			L.rawset(-3);
+		}
+		return 1;
+	}
+
+	int ramrec_export_csv(lua::state& L, lua::parameters& P)
+	{
+		std::string filename;
+		uint64_t first, last;
+
+		P(filename, P.optional(first, 0), P.optional(last, 0xFFFFFFFFFFFFFFFFULL));
+
+		CORE().ramrec->export_csv(filename, first, last);
+		return 0;
+	}
+
+	int ramrec_export_binary(lua::state& L, lua::parameters& P)
+	{
+		std::string filename;
+
+		P(filename);
+
+		CORE().ramrec->export_binary(filename);
+		return 0;
+	}
+
+	lua::functions LUA_ramrec_fns(lua_func_misc, "ramrecorder", {
+		{"add", ramrec_add},
+		{"watch", ramrec_watch},
+		{"remove", ramrec_remove},
+		{"start", ramrec_start},
+		{"stop", ramrec_stop},
+		{"clear", ramrec_clear},
+		{"columns", ramrec_columns},
+		{"query", ramrec_query},
+		{"export_csv", ramrec_export_csv},
+		{"export_binary", ramrec_export_binary},
+	});
+}
@@ -76,6 +76,7 @@ callback=classes.CALLBACKS_LIST.new();
 memory.mkaddr = classes.ADDRESS.new;
 memory.map_structure=classes.MMAP_STRUCT.new;
 memory.compare_new=classes.COMPARE_OBJ.new;
+memory.readstruct=classes.MEMORY_ARRAY.new;
 zip.create=classes.ZIPWRITER.new;
 gui.tilemap=classes.TILEMAP.new;
 gui.renderq_new=classes.RENDERCTX.new;
@@ -818,8 +818,7 @@ private:
 		void* prev_obj;
 		uint64_t prev_seqno;
 		void update_cache();
-		std::map<uint64_t, uint64_t> subframe_to_frame;
-		uint64_t max_subframe;
+		uint64_t frame_at(uint64_t sfn);
 		frame_controls fcontrols;
 		wxeditor_movie* m;
 		bool requested;
@@ -906,7 +905,6 @@ wxeditor_movie::_moviepanel::_moviepanel(wxeditor_movie* v, emulator_instance& _
 	spos = 0;
 	prev_obj = NULL;
 	prev_seqno = 0;
-	max_subframe = 0;
 	recursing = false;
 	position_locked = true;
 	current_popup = NULL;
@@ -927,35 +925,23 @@ void wxeditor_movie::_moviepanel::update_cache()
 {
 	movie& m = inst.mlogic->get_movie();
 	portctrl::frame_vector& fv = *inst.mlogic->get_mfile().input;
-	if(&m == prev_obj && prev_seqno == m.get_seqno()) {
-		//Just process new subframes if any.
-		for(uint64_t i = max_subframe; i < fv.size(); i++) {
-			uint64_t prev = (i > 0) ? subframe_to_frame[i - 1] : 0;
-			portctrl::frame f = fv[i];
-			if(f.sync())
-				subframe_to_frame[i] = prev + 1;
-			else
-				subframe_to_frame[i] = prev;
-		}
-		max_subframe = fv.size();
+	if(&m == prev_obj && prev_seqno == m.get_seqno())
 		return;
-	}
-	//Reprocess all subframes.
-	for(uint64_t i = 0; i < fv.size(); i++) {
-		uint64_t prev = (i > 0) ? subframe_to_frame[i - 1] : 0;
-		portctrl::frame f = fv[i];
-		if(f.sync())
-			subframe_to_frame[i] = prev + 1;
-		else
-			subframe_to_frame[i] = prev;
-	}
-	max_subframe = fv.size();
 	portctrl::frame model = fv.blank_frame(false);
 	fcontrols.set_types(model);
 	prev_obj = &m;
 	prev_seqno = m.get_seqno();
 }
 
+uint64_t wxeditor_movie::_moviepanel::frame_at(uint64_t sfn)
+{
+	//The number of frames started at or before given subframe.
+	portctrl::frame_vector& fv = *inst.mlogic->get_mfile().input;
+	if(sfn >= fv.size())
+		return 0;
+	return fv.subframe_to_frame(sfn) - (fv[sfn].sync() ? 0 : 1);
+}
+
 int wxeditor_movie::_moviepanel::width(portctrl::frame& f)
 {
 	update_cache();
@@ -982,8 +968,8 @@ void wxeditor_movie::_moviepanel::render_linen(text_framebuffer& fb, portctrl::f
 	text_framebuffer::element e;
 	e.bg = 0xFFFFFF;
 	e.fg = 0x000000;
+	uint64_t fn = frame_at(sfn);
 	for(unsigned i = 0; i < divcnt; i++) {
-		uint64_t fn = subframe_to_frame[sfn];
 		e.ch = (fn >= divsl[i]) ? (((fn / divs[i]) % 10) + 48) : 32;
 		_fb[y * fbstride + i] = e;
 	}
@@ -997,11 +983,11 @@ void wxeditor_movie::_moviepanel::render_linen(text_framebuffer& fb, portctrl::f
 	int past = -1;
 	if(!inst.mlogic->get_movie().readonly_mode())
 		past = 1;
-	else if(subframe_to_frame[sfn] < curframe)
+	else if(fn < curframe)
 		past = 1;
-	else if(subframe_to_frame[sfn] > curframe)
+	else if(fn > curframe)
 		past = 0;
-	bool now = (subframe_to_frame[sfn] == curframe);
+	bool now = (fn == curframe);
 	unsigned xcord = 32768;
 	if(pressed)
 		xcord = press_x;
@@ -1102,8 +1088,6 @@ void wxeditor_movie::_moviepanel::do_toggle_buttons(unsigned idx, uint64_t row1,
 		}
 	});
 	recursing = false;
-	if(idx == 0)
-		max_subframe = _press_line;	//Reparse.
 	signal_repaint();
 }
 
@@ -1265,18 +1249,8 @@ void wxeditor_movie::_moviepanel::do_insert_frame_after(uint64_t row, bool multi
 			nframe++;
 		if(nframe < fedit)
 			return;
-		portctrl::frame_vector::notify_freeze freeze(fv);
-		for(uint64_t k = 0; k < multicount; k++)
-			fv.append(fv.blank_frame(true));
-		if(nframe < vsize) {
-			//Okay, gotta copy all data after this point. nframe has to be at least 1.
-			for(uint64_t i = vsize - 1; i >= nframe; i--)
-				fv[i + multicount] = fv[i];
-			for(uint64_t k = 0; k < multicount; k++)
-				fv[nframe + k] = fv.blank_frame(true);
-		}
+		fv.insert_range(nframe, multicount, true);
 	});
-	max_subframe = row;
 	recursing = false;
 	signal_repaint();
 }
@@ -1318,9 +1292,8 @@ void wxeditor_movie::_moviepanel::do_delete_frame(uint64_t row1, uint64_t row2,
 				if(fv[i].sync())
 					frames_tonuke++;
 			//Nuke from fsf to lsf.
-			for(uint64_t i = fsf; i < vsize - tonuke; i++)
-				fv[i] = fv[i + tonuke];
-			fv.resize(vsize - tonuke);
+			if(fsf < lsf && lsf <= vsize)
+				fv.erase_range(fsf, tonuke);
 		} else {
 			if(row2 < real_first_editable(*_fcontrols, 0))
 				return;		//Nothing to do.
@@ -1340,15 +1313,12 @@ void wxeditor_movie::_moviepanel::do_delete_frame(uint64_t row1, uint64_t row2,
 			if(inherit_sync) frames_tonuke--;
 			//Nuke the subframes.
 			uint64_t tonuke = row2 - row1 + 1;
-			for(uint64_t i = row1; i < vsize - tonuke; i++)
-				fv[i] = fv[i + tonuke];
-			fv.resize(vsize - tonuke);
+			fv.erase_range(row1, tonuke);
 			//Next subframe inherits the sync flag.
 			if(inherit_sync)
 				fv[row1].sync(true);
 		}
 	});
-	max_subframe = _row1;
 	recursing = false;
 	signal_repaint();
 }
@@ -1371,7 +1341,6 @@ void wxeditor_movie::_moviepanel::do_truncate(uint64_t row)
 				delete_count--;
 		fv.resize(_row);
 	});
-	max_subframe = row;
 	recursing = false;
 	signal_repaint();
 }
@@ -1539,20 +1508,10 @@ void wxeditor_movie::_moviepanel::do_scroll_to_frame()
 		wxMessageBox(wxT("Invalid value"), _T("Error"), wxICON_EXCLAMATION | wxOK, m);
 		return;
 	}
-	uint64_t wouldbe = 0;
-	uint64_t low = 0;
-	uint64_t high = max_subframe;
-	while(low < high) {
-		wouldbe = (low + high) / 2;
-		if(subframe_to_frame[wouldbe] < frame)
-			low = wouldbe;
-		else if(subframe_to_frame[wouldbe] > frame)
-			high = wouldbe;
-		else
-			break;
-	}
-	while(wouldbe > 1 && subframe_to_frame[wouldbe - 1] == frame)
-		wouldbe--;
+	portctrl::frame_vector& fv = *inst.mlogic->get_mfile().input;
+	int64_t wouldbe = fv.find_frame(frame);
+	if(wouldbe < 0)
+		wouldbe = (frame && fv.size()) ? fv.size() - 1 : 0;
 	moviepos = wouldbe;
 	signal_repaint();
 }
@@ -1804,13 +1763,14 @@ void wxeditor_movie::_moviepanel::on_popup_menu(wxCommandEvent& e)
 uint64_t wxeditor_movie::_moviepanel::first_editable(unsigned index)
 {
 	uint64_t cffs = cached_cffs;
-	if(!subframe_to_frame.count(cffs))
+	uint64_t vsize = inst.mlogic->get_mfile().input->size();
+	if(cffs >= vsize)
 		return cffs;
-	uint64_t f = subframe_to_frame[cffs];
+	uint64_t f = frame_at(cffs);
 	portctrl::counters& pv = inst.mlogic->get_movie().get_pollcounters();
 	uint32_t pc = fcontrols.read_pollcount(pv, index);
 	for(uint32_t i = 1; i < pc; i++)
-		if(!subframe_to_frame.count(cffs + i) || subframe_to_frame[cffs + i] > f)
+		if(cffs + i >= vsize || frame_at(cffs + i) > f)
 				return cffs + i;
 	return cffs + pc;
 }
@@ -1818,11 +1778,12 @@ uint64_t wxeditor_movie::_moviepanel::first_editable(unsigned index)
 uint64_t wxeditor_movie::_moviepanel::first_nextframe()
 {
 	uint64_t base = first_editable(0);
-	if(!subframe_to_frame.count(cached_cffs))
+	uint64_t vsize = inst.mlogic->get_mfile().input->size();
+	if(cached_cffs >= vsize)
 		return cached_cffs;
-	uint64_t f = subframe_to_frame[cached_cffs];
+	uint64_t f = frame_at(cached_cffs);
 	for(uint32_t i = 0;; i++)
-		if(!subframe_to_frame.count(base + i) || subframe_to_frame[base + i] > f)
+		if(base + i >= vsize || frame_at(base + i) > f)
 			return base + i;
 }
 
@@ -2207,10 +2168,7 @@ void wxeditor_movie::_moviepanel::do_paste(uint64_t row, bool append)
 			return;
 		portctrl::frame_vector::notify_freeze freeze(fv);
 		if(append) gapstart = vsize;
-		for(uint64_t i = 0; i < gaplen; i++)
-			fv.append(fv.blank_frame(false));
-		for(uint64_t i = vsize - 1; i >= gapstart && i <= vsize; i--)
-			fv[i + gaplen] = fv[i];
+		fv.insert_range(gapstart, gaplen, false);
 		//Write the pasted frames.
 		{
 			std::istringstream y(cliptext);
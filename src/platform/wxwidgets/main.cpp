@@ -583,6 +583,7 @@ bool lsnes_app::OnInit()
 			wxeditor_plugin_manager_notify_fail(libname);
 	});
 	messages << "Saving per-user data to: " << get_config_path() << std::endl;
+	open_rom_hash_index();
 	messages << "--- Loading configuration --- " << std::endl;
 	load_configuration();
 	messages << "--- End running lsnesrc --- " << std::endl;
@@ -4,6 +4,7 @@
 #include "platform/wxwidgets/menu_dump.hpp"
 #include "platform/wxwidgets/menu_upload.hpp"
 #include "platform/wxwidgets/platform.hpp"
+#include "platform/wxwidgets/presenter.hpp"
 #include "platform/wxwidgets/loadsave.hpp"
 #include "platform/wxwidgets/window_mainwindow.hpp"
 #include "platform/wxwidgets/window_messages.hpp"
@@ -164,15 +165,12 @@ namespace
 	std::string last_volume = "0dB";
 	std::string last_volume_record = "0dB";
 	std::string last_volume_voice = "0dB";
-	unsigned char* screen_buffer;
-	struct SwsContext* sws_ctx;
-	uint32_t* rotate_buffer;
+	wxwin_presenter* presenter;
+	runuifun_once_ctx presented_once;
+	wxBitmap* presented_bitmap;
+	uint64_t presented_serial;
 	uint32_t old_width;
 	uint32_t old_height;
-	int old_flags = SWS_POINT;
-	bool old_hflip = false;
-	bool old_vflip = false;
-	bool old_rotate = false;
 	bool main_window_dirty;
 	bool is_fs = false;
 	bool hashing_in_progress = false;
@@ -679,9 +677,9 @@ namespace
 		try {
 			bool ans = false;
 			s = &zip::openrel(filename, "");
-			char buf[6] = {0};
+			char buf[5] = {0};
 			s->read(buf, 5);
-			if(*s && !strcmp(buf, "lsmv\x1A"))
+			if(*s && moviefile::is_binary_magic(buf))
 				ans = true;
 			delete s;
 			if(ans) return true;
@@ -897,6 +895,29 @@ std::pair<double, double> calc_scale_factors(double factor, bool ar, double par)
 	}
 }
 
+namespace
+{
+	wxwin_presenter::params presentation_params(emulator_instance& inst)
+	{
+		wxwin_presenter::params p;
+		auto sfactors = calc_scale_factors(video_scale_factor, arcorrect_enabled, inst.rom->get_PAR());
+		p.xscale = sfactors.first;
+		p.yscale = sfactors.second;
+		p.fit_width = 0;
+		p.fit_height = 0;
+		if(is_fs) {
+			wxSize screen = main_window->GetSize();
+			p.fit_width = screen.GetWidth();
+			p.fit_height = screen.GetHeight();
+		}
+		p.flags = scaling_flags;
+		p.hflip = hflip_enabled;
+		p.vflip = vflip_enabled;
+		p.rotate = rotate_enabled;
+		return p;
+	}
+}
+
 void wxwin_mainwindow::panel::on_paint(wxPaintEvent& e)
 {
 	CHECK_UI_THREAD;
@@ -904,34 +925,28 @@ void wxwin_mainwindow::panel::on_paint(wxPaintEvent& e)
 		//Leave fullscreen mode.
 		main_window->enter_or_leave_fullscreen(false);
 	}
-	inst.fbuf->render_framebuffer();
-	uint8_t* srcp[1];
-	int srcs[1];
-	uint8_t* dstp[1];
-	int dsts[1];
 	wxPaintDC dc(this);
-	uint32_t tw, th;
-	bool aux = hflip_enabled || vflip_enabled || rotate_enabled;
-	auto sfactors = calc_scale_factors(video_scale_factor, arcorrect_enabled, inst.rom->get_PAR());
-	if(rotate_enabled) {
-		tw = inst.fbuf->main_screen.get_height() * sfactors.second + 0.5;
-		th = inst.fbuf->main_screen.get_width() * sfactors.first + 0.5;
-	} else {
-		tw = inst.fbuf->main_screen.get_width() * sfactors.first + 0.5;
-		th = inst.fbuf->main_screen.get_height() * sfactors.second + 0.5;
-	}
+	//Rendering and scaling happen in presenter thread, this just picks up the latest frame.
+	presenter->set_params(presentation_params(inst));
+	wxwin_presenter::frame& f = presenter->get_read();
+	uint32_t tw = f.width;
+	uint32_t th = f.height;
 	if(!tw || !th) {
+		presenter->put_read();
 		main_window_dirty = false;
 		return;
 	}
-	//Scale this to fullscreen.
+	if(!presented_bitmap || f.serial != presented_serial) {
+		//Only convert new frames, repaints of the same frame just blit.
+		delete presented_bitmap;
+		presented_bitmap = new wxBitmap(wxImage(tw, th, &f.pixels[0], true));
+		presented_serial = f.serial;
+		presenter->displayed(f.serial);
+	}
+	presenter->put_read();
 	unsigned dx = 0, dy = 0;
 	if(is_fs) {
 		wxSize screen = main_window->GetSize();
-
-		double fss = min(1.0 * screen.GetWidth() / tw, 1.0 * screen.GetHeight() / th);
-		tw *= fss;
-		th *= fss;
 		if((signed)tw < screen.GetWidth())
 			dx = (screen.GetWidth() - tw) / 2;
 		if((signed)th < screen.GetHeight())
@@ -954,87 +969,16 @@ void wxwin_mainwindow::panel::on_paint(wxPaintEvent& e)
 		if(dx2 < screen.GetWidth()) dc.DrawRectangle(dx2, 0, screen.GetWidth() - dx2, screen.GetHeight());
 		if(dy2 < screen.GetHeight()) dc.DrawRectangle(0, dy2, screen.GetWidth(), screen.GetHeight() - dy2);
 	}
-
-	if(!screen_buffer || tw != old_width || th != old_height || scaling_flags != old_flags ||
-		hflip_enabled != old_hflip || vflip_enabled != old_vflip || rotate_enabled != old_rotate) {
-		if(screen_buffer) {
-			delete[] screen_buffer;
-			screen_buffer = NULL;
-		}
-		if(rotate_buffer) {
-			delete[] rotate_buffer;
-			rotate_buffer = NULL;
-		}
-		old_height = th;
+	if(tw != old_width || th != old_height) {
 		old_width = tw;
-		old_flags = scaling_flags;
-		old_hflip = hflip_enabled;
-		old_vflip = vflip_enabled;
-		old_rotate = rotate_enabled;
-		uint32_t w = inst.fbuf->main_screen.get_width();
-		uint32_t h = inst.fbuf->main_screen.get_height();
-		if(w && h)
-			sws_ctx = sws_getCachedContext(sws_ctx, rotate_enabled ? h : w, rotate_enabled ? w : h,
-				AV_PIX_FMT_RGBA, tw, th, AV_PIX_FMT_BGR24, scaling_flags, NULL, NULL, NULL);
-		tw = max(tw, static_cast<uint32_t>(128));
-		th = max(th, static_cast<uint32_t>(112));
-		screen_buffer = new unsigned char[tw * th * 3 + 64];
-		if(aux)
-			rotate_buffer = new uint32_t[inst.fbuf->main_screen.get_width() *
-				inst.fbuf->main_screen.get_height()];
+		old_height = th;
 		if(!is_fs) {
 			//This is not preformed in fullscreen mode.
-			SetMinSize(wxSize(tw, th));
+			SetMinSize(wxSize(max(tw, static_cast<uint32_t>(128)), max(th, static_cast<uint32_t>(112))));
 			signal_resize_needed();
 		}
 	}
-	if(aux) {
-		//Hflip, Vflip or rotate active.
-		size_t width = inst.fbuf->main_screen.get_width();
-		size_t height = inst.fbuf->main_screen.get_height();
-		size_t width1 = width - 1;
-		size_t height1 = height - 1;
-		size_t stride = inst.fbuf->main_screen.rowptr(1) - inst.fbuf->main_screen.rowptr(0);
-		uint32_t* pixels = inst.fbuf->main_screen.rowptr(0);
-		if(rotate_enabled) {
-			for(unsigned y = 0; y < height; y++) {
-				uint32_t* pixels2 = pixels + (vflip_enabled ? (height1 - y) : y) * stride;
-				uint32_t* dpixels = rotate_buffer + (height1 - y);
-				if(hflip_enabled)
-					for(unsigned x = 0; x < width; x++)
-						dpixels[x * height] = pixels2[width1 - x];
-				else
-					for(unsigned x = 0; x < width; x++)
-						dpixels[x * height] = pixels2[x];
-			}
-		} else {
-			for(unsigned y = 0; y < height; y++) {
-				uint32_t* pixels2 = pixels + (vflip_enabled ? (height1 - y) : y) * stride;
-				uint32_t* dpixels = rotate_buffer + y * width;
-				if(hflip_enabled)
-					for(unsigned x = 0; x < width; x++)
-						dpixels[x] = pixels2[width1 - x];
-				else
-					for(unsigned x = 0; x < width; x++)
-						dpixels[x] = pixels2[x];
-			}
-		}
-	}
-	if(aux)
-		srcs[0] = 4 * (rotate_enabled ? inst.fbuf->main_screen.get_height() :
-			inst.fbuf->main_screen.get_width());
-	else
-		srcs[0] = 4 * inst.fbuf->main_screen.get_stride();
-	dsts[0] = 3 * tw;
-	srcp[0] = reinterpret_cast<unsigned char*>(aux ? rotate_buffer : inst.fbuf->main_screen.rowptr(0));
-	dstp[0] = screen_buffer;
-	memset(screen_buffer, 0, tw * th * 3);
-	if(inst.fbuf->main_screen.get_width() && inst.fbuf->main_screen.get_height())
-		sws_scale(sws_ctx, srcp, srcs, 0, rotate_enabled ? inst.fbuf->main_screen.get_width() :
-			inst.fbuf->main_screen.get_height(),
-		dstp, dsts);
-	wxBitmap bmp(wxImage(tw, th, screen_buffer, true));
-	dc.DrawBitmap(bmp, dx, dy, false);
+	dc.DrawBitmap(*presented_bitmap, dx, dy, false);
 	main_window_dirty = false;
 	main_window->update_statusbar();
 }
@@ -1072,8 +1016,14 @@ wxwin_mainwindow::wxwin_mainwindow(emulator_instance& _inst, bool fscreen)
 {
 	CHECK_UI_THREAD;
 	download_in_progress = NULL;
+	status_shown = false;
+	for(unsigned i = 0; i < _lsnes_status::F_COUNT; i++)
+		status_seen[i] = 0;
 	Centre();
 	mwindow = NULL;
+	presenter = new wxwin_presenter(inst, []() {
+		runuifun(presented_once, []() { if(main_window) main_window->notify_presented(); });
+	});
 	toplevel = new wxFlexGridSizer(1, 2, 0, 0);
 	toplevel->Add(gpanel = new panel(this, inst), 1, wxGROW);
 	toplevel->Add(spanel = new wxwin_status::panel(this, inst, gpanel, 20), 1, wxGROW);
@@ -1249,9 +1199,10 @@ wxwin_mainwindow::wxwin_mainwindow(emulator_instance& _inst, bool fscreen)
 wxwin_mainwindow::~wxwin_mainwindow()
 {
 	CHECK_UI_THREAD;
-	if(sws_ctx) sws_freeContext(sws_ctx);
-	if(screen_buffer) delete[] screen_buffer;
-	if(rotate_buffer) delete[] rotate_buffer;
+	delete presenter;
+	presenter = NULL;
+	delete presented_bitmap;
+	presented_bitmap = NULL;
 	focus_timer->Stop();
 	delete focus_timer;
 	status_timer->Stop();
@@ -1273,6 +1224,13 @@ void wxwin_mainwindow::on_close(wxCloseEvent& e)
 }
 
 void wxwin_mainwindow::notify_update() throw()
+{
+	CHECK_UI_THREAD;
+	presenter->set_params(presentation_params(inst));
+	presenter->request();
+}
+
+void wxwin_mainwindow::notify_presented() throw()
 {
 	CHECK_UI_THREAD;
 	if(!main_window_dirty) {
@@ -1318,6 +1276,7 @@ void wxwin_mainwindow::update_statusbar()
 	CHECK_UI_THREAD;
 	if(download_in_progress) {
 		statusbar->SetStatusText(towxstring(download_in_progress->statusmsg()));
+		status_shown = false;
 		return;
 	}
 	if(hashing_in_progress) {
@@ -1326,6 +1285,7 @@ void wxwin_mainwindow::update_statusbar()
 		s << "Hashing ROMs, approximately " << ((hashing_left + 524288) >> 20) << " of "
 			<< ((hashing_total + 524288) >> 20) << "MB left...";
 		statusbar->SetStatusText(towxstring(s.str()));
+		status_shown = false;
 		return;
 	}
 	auto& vars = inst.status->get_read();
@@ -1333,6 +1293,14 @@ void wxwin_mainwindow::update_statusbar()
 		inst.status->put_read();
 		return;
 	}
+	//Only rebuild the text if something shown in it has changed.
+	const uint32_t shown_groups = (1UL << _lsnes_status::F_COUNTERS) | (1UL << _lsnes_status::F_STATE) |
+		(1UL << _lsnes_status::F_SLOT) | (1UL << _lsnes_status::F_MBRANCH) | (1UL << _lsnes_status::F_MACROS);
+	if(!(vars.changed_since(status_seen) & shown_groups) && status_shown) {
+		inst.status->put_read();
+		return;
+	}
+	status_shown = true;
 	try {
 		std::ostringstream s;
 		bool recording = (vars.mode == 'R');
@@ -1902,4 +1870,24 @@ namespace
 					main_window->enter_or_leave_fullscreen(false);
 			});
 		});
+
+	struct command::stub _presentation_stats = {"show-presentation-stats", "Show screen presentation statistics",
+		"Syntax: show-presentation-stats\nShow statistics of rendering and scaling the main screen.\n"};
+	command::fnptr<> presentation_stats(lsnes_cmds, _presentation_stats,
+		[]() throw(std::bad_alloc, std::runtime_error) {
+			runuifun([]() {
+				if(!presenter)
+					return;
+				auto st = presenter->get_stats();
+				uint64_t n = max(st.frames, static_cast<uint64_t>(1));
+				messages << "Frames presented: " << st.frames << " (" << st.skipped << " never shown)"
+					<< std::endl;
+				messages << "Render: " << st.render_total / n << "us avg, " << st.render_max << "us max"
+					<< std::endl;
+				messages << "Scale: " << st.scale_total / n << "us avg, " << st.scale_max << "us max"
+					<< std::endl;
+				messages << "Latency: " << st.latency_total / n << "us avg, " << st.latency_max
+					<< "us max" << std::endl;
+			});
+		});
 }
@@ -0,0 +1,214 @@
+#include "platform/wxwidgets/presenter.hpp"
+#include "core/framebuffer.hpp"
+#include "core/framerate.hpp"
+#include "core/instance.hpp"
+#include "library/minmax.hpp"
+#include "library/perfscope.hpp"
+#include "library/scaler.hpp"
+
+extern "C"
+{
+#ifndef UINT64_C
+#define UINT64_C(val) val##ULL
+#endif
+#include <libswscale/swscale.h>
+}
+
+namespace
+{
+	perfscope::region PR_present_render("present.render");
+	perfscope::region PR_present_scale("present.scale");
+}
+
+bool wxwin_presenter::params::operator==(const params& p) const
+{
+	return xscale == p.xscale && yscale == p.yscale && fit_width == p.fit_width && fit_height == p.fit_height &&
+		flags == p.flags && hflip == p.hflip && vflip == p.vflip && rotate == p.rotate;
+}
+
+wxwin_presenter::wxwin_presenter(emulator_instance& _inst, std::function<void()> _on_ready)
+	: inst(_inst), on_ready(_on_ready), buffers(A, B, C)
+{
+	pending = false;
+	quit = false;
+	requested_at = 0;
+	current.xscale = 1;
+	current.yscale = 1;
+	current.fit_width = 0;
+	current.fit_height = 0;
+	current.flags = SWS_POINT;
+	current.hflip = false;
+	current.vflip = false;
+	current.rotate = false;
+	memset(&st, 0, sizeof(st));
+	last_displayed = 0;
+	A.width = A.height = A.serial = 0;
+	B.width = B.height = B.serial = 0;
+	C.width = C.height = C.serial = 0;
+	sws_ctx = NULL;
+	serial = 0;
+	thread = new threads::thread(worker_entry, this);
+}
+
+wxwin_presenter::~wxwin_presenter()
+{
+	{
+		threads::alock h(lock);
+		quit = true;
+		cond.notify_all();
+	}
+	thread->join();
+	delete thread;
+	if(sws_ctx)
+		sws_freeContext(sws_ctx);
+}
+
+void wxwin_presenter::request()
+{
+	threads::alock h(lock);
+	if(!pending)
+		requested_at = framerate_regulator::get_utime();
+	pending = true;
+	cond.notify_all();
+}
+
+void wxwin_presenter::set_params(const params& p)
+{
+	threads::alock h(lock);
+	if(current == p)
+		return;
+	current = p;
+	if(!pending)
+		requested_at = framerate_regulator::get_utime();
+	pending = true;
+	cond.notify_all();
+}
+
+void wxwin_presenter::displayed(uint64_t s)
+{
+	threads::alock h(lock);
+	if(s > last_displayed + 1 && last_displayed)
+		st.skipped += s - last_displayed - 1;
+	if(s > last_displayed)
+		last_displayed = s;
+}
+
+wxwin_presenter::stats wxwin_presenter::get_stats()
+{
+	threads::alock h(lock);
+	return st;
+}
+
+void wxwin_presenter::worker_entry(wxwin_presenter* p)
+{
+	p->worker();
+}
+
+void wxwin_presenter::worker()
+{
+	threads::alock h(lock);
+	while(true) {
+		while(!pending && !quit)
+			cond.wait(h);
+		if(quit)
+			break;
+		pending = false;
+		params p = current;
+		uint64_t req = requested_at;
+		h.unlock();
+		try {
+			present(p);
+		} catch(std::bad_alloc& e) {
+			//Out of memory. Skip the frame, the next one might work.
+		}
+		uint64_t t1 = framerate_regulator::get_utime();
+		h.lock();
+		st.latency_total += t1 - req;
+		st.latency_max = max(st.latency_max, t1 - req);
+		h.unlock();
+		on_ready();
+		h.lock();
+	}
+}
+
+void wxwin_presenter::present(const params& p)
+{
+	auto& screen = inst.fbuf->main_screen;
+	uint64_t t0 = framerate_regulator::get_utime();
+	{
+		perfscope::scope ps(PR_present_render);
+		inst.fbuf->render_framebuffer();
+	}
+	uint64_t t1 = framerate_regulator::get_utime();
+	perfscope::scope ps(PR_present_scale);
+	uint32_t sw = screen.get_width();
+	uint32_t sh = screen.get_height();
+	uint32_t tw, th;
+	if(p.rotate) {
+		tw = sh * p.yscale + 0.5;
+		th = sw * p.xscale + 0.5;
+	} else {
+		tw = sw * p.xscale + 0.5;
+		th = sh * p.yscale + 0.5;
+	}
+	if(tw && th && p.fit_width && p.fit_height) {
+		double fss = min(1.0 * p.fit_width / tw, 1.0 * p.fit_height / th);
+		tw *= fss;
+		th *= fss;
+	}
+	frame& f = buffers.get_write();
+	if(!tw || !th) {
+		f.width = f.height = 0;
+		f.serial = ++serial;
+		buffers.put_write();
+		return;
+	}
+	//The buffers are reused, so this only allocates when size grows.
+	f.pixels.resize(tw * th * 3);
+	unsigned orient = (p.hflip ? scaler::HFLIP : 0) | (p.vflip ? scaler::VFLIP : 0) |
+		(p.rotate ? scaler::ROTATE : 0);
+	if(p.flags & (SWS_POINT | SHARP_BILINEAR)) {
+		//Native scalers do flipping, rotating and conversion in one go.
+		native.scale((p.flags & SHARP_BILINEAR) ? scaler::SHARP_BILINEAR : scaler::NEAREST, &f.pixels[0],
+			3 * tw, tw, th, screen.rowptr(0), screen.get_stride(), sw, sh, orient);
+		finish_frame(f, tw, th, t0, t1);
+		return;
+	}
+	bool aux = (orient != 0);
+	sws_ctx = sws_getCachedContext(sws_ctx, p.rotate ? sh : sw, p.rotate ? sw : sh, AV_PIX_FMT_RGBA, tw, th,
+		AV_PIX_FMT_BGR24, p.flags, NULL, NULL, NULL);
+	if(aux) {
+		rotate_buffer.resize(sw * sh);
+		scaler::transform(&rotate_buffer[0], p.rotate ? sh : sw, screen.rowptr(0), screen.get_stride(), sw,
+			sh, orient);
+	}
+	const uint8_t* srcp[1];
+	int srcs[1];
+	uint8_t* dstp[1];
+	int dsts[1];
+	srcp[0] = reinterpret_cast<const uint8_t*>(aux ? &rotate_buffer[0] : screen.rowptr(0));
+	srcs[0] = aux ? 4 * (p.rotate ? sh : sw) : 4 * screen.get_stride();
+	dstp[0] = &f.pixels[0];
+	dsts[0] = 3 * tw;
+	//Scaling covers the whole destination, so no need to clear it first.
+	if(sws_ctx)
+		sws_scale(sws_ctx, srcp, srcs, 0, p.rotate ? sw : sh, dstp, dsts);
+	else
+		memset(&f.pixels[0], 0, f.pixels.size());
+	finish_frame(f, tw, th, t0, t1);
+}
+
+void wxwin_presenter::finish_frame(frame& f, uint32_t width, uint32_t height, uint64_t t0, uint64_t t1)
+{
+	f.width = width;
+	f.height = height;
+	f.serial = ++serial;
+	buffers.put_write();
+	uint64_t t2 = framerate_regulator::get_utime();
+	threads::alock h(lock);
+	st.frames++;
+	st.render_total += t1 - t0;
+	st.render_max = max(st.render_max, t1 - t0);
+	st.scale_total += t2 - t1;
+	st.scale_max = max(st.scale_max, t2 - t1);
+}
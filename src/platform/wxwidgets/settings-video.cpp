@@ -11,8 +11,9 @@ namespace
 		wxID_ORIENT = wxID_HIGHEST + 4,
 	};
 
+	//Choice n is scaling flag 1 << n. The last one is native (wxwin_presenter::SHARP_BILINEAR).
 	const char* scalealgo_choices[] = {"Fast Bilinear", "Bilinear", "Bicubic", "Experimential", "Point", "Area",
-		"Bicubic-Linear", "Gauss", "Sinc", "Lanczos", "Spline"};
+		"Bicubic-Linear", "Gauss", "Sinc", "Lanczos", "Spline", "Sharp bilinear"};
 	const char* orientations[] = {"Normal", "Rotate 90° left", "Rotate 90° right", "Rotate 180°",
 		"Flip horizontal", "Flip vertical", "Transpose", "Transpose other"};
 	unsigned orientation_flags[] = {0, 7, 1, 6, 2, 4, 5, 3};
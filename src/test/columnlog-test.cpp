@@ -0,0 +1,70 @@
+#include "columnlog.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+//Checks column_log against a plain vector, and prints how well typical RAM values compress.
+
+namespace
+{
+	bool check(const column_log& c, const std::vector<int64_t>& model)
+	{
+		if(c.size() != model.size())
+			return false;
+		for(unsigned i = 0; i < 200; i++) {
+			uint64_t first = model.empty() ? 0 : rand() % model.size();
+			uint64_t n = rand() % 700;
+			std::vector<int64_t> out(n + 1);
+			c.read(first, n, &out[0]);
+			for(uint64_t j = 0; j < n; j++)
+				if(out[j] != ((first + j < model.size()) ? model[first + j] : 0))
+					return false;
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	column_log c;
+	std::vector<int64_t> model;
+	const int64_t extremes[] = {0, 1, -1, INT64_MAX, INT64_MIN, INT64_MAX, 0, INT64_MIN};
+	for(auto v : extremes) {
+		c.append(v);
+		model.push_back(v);
+	}
+	for(unsigned i = 0; i < 5000; i++) {
+		int64_t v = (rand() % 4) ? model.back() + rand() % 5 - 2 : (int64_t)rand() * rand();
+		c.append(v);
+		model.push_back(v);
+	}
+	if(!check(c, model)) {
+		std::cerr << "FAIL: Read after append" << std::endl;
+		failures++;
+	}
+	for(uint64_t n : {4000, 3840, 3839, 1, 0}) {
+		c.truncate(n);
+		model.resize(n);
+		for(unsigned i = 0; i < 300; i++) {
+			int64_t v = rand() % 1000;
+			c.append(v);
+			model.push_back(v);
+		}
+		if(!check(c, model)) {
+			std::cerr << "FAIL: Truncate to " << n << std::endl;
+			failures++;
+		}
+	}
+
+	column_log pos;
+	int64_t x = 0x1000;
+	for(unsigned i = 0; i < 100000; i++)
+		pos.append(x += rand() % 3);
+	std::cout << "Slowly changing value: " << (double)pos.get_bytes() / pos.size() << " bytes/frame" << std::endl;
+	if(failures)
+		std::cerr << failures << " failures" << std::endl;
+	else
+		std::cout << "All tests passed" << std::endl;
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,81 @@
+#include "framebuffer.hpp"
+#include "test-timing.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+//Compares loading the .hex font with using the precompiled binary font, and checks they have the same glyphs.
+//Build with font.cpp made by buildaux/hex2font font_bin_data <hexfile>.
+//Usage: font-bench <hexfile>
+
+extern const uint32_t font_bin_data[];
+extern const size_t font_bin_data_words;
+
+namespace
+{
+	size_t get_rss()
+	{
+		std::ifstream statm("/proc/self/statm");
+		size_t size = 0, rss = 0;
+		statm >> size >> rss;
+		return rss * sysconf(_SC_PAGESIZE);
+	}
+
+	uint64_t lookups(framebuffer::font& f, unsigned rounds)
+	{
+		std::string text = "Frame: 123456 Lag: 42 Rerecords: 98765 Ã¤Ã¶Ã¼ Î±Î²Î³ ã‚ã„ã†";
+		uint64_t t0 = get_utime();
+		uint32_t w = 0;
+		for(unsigned i = 0; i < rounds; i++)
+			w += f.get_width(text);
+		uint64_t t = get_utime() - t0;
+		if(!w)
+			std::cout << "";
+		return t;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2) {
+		std::cerr << "Usage: font-bench <hexfile>" << std::endl;
+		return 1;
+	}
+	std::ifstream in(argv[1], std::ios::binary);
+	std::ostringstream s;
+	s << in.rdbuf();
+	std::string hex = s.str();
+
+	framebuffer::font binfont;
+	size_t r0 = get_rss();
+	uint64_t t0 = get_utime();
+	binfont.load_binary(font_bin_data, font_bin_data_words);
+	uint64_t t1 = get_utime();
+	size_t r1 = get_rss();
+	framebuffer::font hexfont;
+	uint64_t t2 = get_utime();
+	hexfont.load_hex(hex.c_str(), hex.length());
+	uint64_t t3 = get_utime();
+	size_t r2 = get_rss();
+
+	auto glyphs = hexfont.get_glyphs_set();
+	if(glyphs != binfont.get_glyphs_set()) {
+		std::cout << "FAIL: Glyph sets differ" << std::endl;
+		return 1;
+	}
+	for(auto i : glyphs) {
+		auto a = hexfont.get_glyph(i);
+		auto b = binfont.get_glyph(i);
+		if(a.wide != b.wide || memcmp(a.data, b.data, (a.wide ? 8 : 4) * sizeof(uint32_t))) {
+			std::cout << "FAIL: Glyph " << i << " differs" << std::endl;
+			return 1;
+		}
+	}
+	std::cout << glyphs.size() << " glyphs, binary font is " << 4 * font_bin_data_words << " bytes" << std::endl;
+	std::cout << "load_hex: " << (t3 - t2) << "us, " << (r2 - r1) / 1024 << "kB resident" << std::endl;
+	std::cout << "load_binary: " << (t1 - t0) << "us, " << (r1 - r0) / 1024 << "kB resident" << std::endl;
+	std::cout << "1M string widths: " << lookups(binfont, 1000000) << "us" << std::endl;
+	return 0;
+}
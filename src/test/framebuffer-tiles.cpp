@@ -0,0 +1,131 @@
+#include "framebuffer.hpp"
+#include "range.hpp"
+#include "string.hpp"
+#include "test-timing.hpp"
+#include <cstring>
+#include <iostream>
+
+//Benchmark/consistency check for tiled render queue execution.
+//Usage: framebuffer-tiles [<objects> [<threads> [<rounds>]]]
+
+namespace
+{
+	struct bench_pixel : public framebuffer::object
+	{
+		bench_pixel(int32_t _x, int32_t _y, framebuffer::color _c) : x(_x), y(_y), c(_c) {}
+		~bench_pixel() throw() {}
+		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		{
+			int32_t _x = x + scr.get_origin_x();
+			int32_t _y = y + scr.get_origin_y();
+			if(_x < 0 || static_cast<uint32_t>(_x) >= scr.get_width())
+				return;
+			if(_y < 0 || static_cast<uint32_t>(_y) >= scr.get_height())
+				return;
+			c.apply(scr.rowptr(_y)[_x]);
+		}
+		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
+		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
+		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
+		bool get_bounds(int32_t& _x, int32_t& _y, uint32_t& _w, uint32_t& _h) const throw()
+		{
+			_x = x;
+			_y = y;
+			_w = _h = 1;
+			return true;
+		}
+		int32_t x, y;
+		framebuffer::color c;
+	};
+
+	struct bench_rect : public framebuffer::object
+	{
+		bench_rect(int32_t _x, int32_t _y, uint32_t _w, uint32_t _h, framebuffer::color _c, bool _bounded)
+			: x(_x), y(_y), w(_w), h(_h), c(_c), bounded(_bounded) {}
+		~bench_rect() throw() {}
+		template<bool X> void op(struct framebuffer::fb<X>& scr) throw()
+		{
+			uint32_t oX = x + scr.get_origin_x();
+			uint32_t oY = y + scr.get_origin_y();
+			range bX = (range::make_w(scr.get_width()) - oX) & range::make_w(w);
+			range bY = (range::make_w(scr.get_height()) - oY) & range::make_w(h);
+			for(uint32_t r = bY.low(); r != bY.high(); r++) {
+				typename framebuffer::fb<X>::element_t* rptr = scr.rowptr(oY + r);
+				for(uint32_t i = bX.low(); i != bX.high(); i++)
+					c.apply(rptr[oX + i]);
+			}
+		}
+		void operator()(struct framebuffer::fb<true>& scr) throw()  { op(scr); }
+		void operator()(struct framebuffer::fb<false>& scr) throw() { op(scr); }
+		void clone(framebuffer::queue& q) const throw(std::bad_alloc) { q.clone_helper(this); }
+		bool get_bounds(int32_t& _x, int32_t& _y, uint32_t& _w, uint32_t& _h) const throw()
+		{
+			_x = x;
+			_y = y;
+			_w = w;
+			_h = h;
+			return bounded;
+		}
+		int32_t x, y;
+		uint32_t w, h;
+		framebuffer::color c;
+		bool bounded;
+	};
+
+	void fill_queue(framebuffer::queue& q, size_t objects)
+	{
+		uint32_t seed = 12345;
+		auto rnd = [&seed]() -> uint32_t { seed = seed * 1103515245 + 12345; return seed >> 8; };
+		for(size_t i = 0; i < objects; i++) {
+			uint32_t kind = rnd() % 100;
+			int32_t x = (int32_t)(rnd() % 600) - 40;
+			int32_t y = (int32_t)(rnd() % 540) - 40;
+			framebuffer::color c((int64_t)(rnd() & 0x7FFFFFFF));
+			if(kind < 60)
+				q.create_add<bench_pixel>(x, y, c);
+			else if(kind < 99)
+				q.create_add<bench_rect>(x, y, rnd() % 48 + 1, rnd() % 16 + 1, c, true);
+			else
+				//Unbounded objects force a sequential step.
+				q.create_add<bench_rect>(x, y, rnd() % 100 + 1, rnd() % 100 + 1, c, false);
+		}
+	}
+
+	uint64_t run(framebuffer::queue& q, framebuffer::fb<false>& scr, unsigned threads, unsigned rounds)
+	{
+		framebuffer::queue::set_threads(threads);
+		uint64_t t = get_utime();
+		for(unsigned i = 0; i < rounds; i++) {
+			for(size_t y = 0; y < scr.get_height(); y++)
+				memset(scr.rowptr(y), 0, 4 * scr.get_width());
+			q.run(scr);
+		}
+		return get_utime() - t;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t objects = (argc > 1) ? parse_value<size_t>(argv[1]) : 20000;
+	unsigned threads = (argc > 2) ? parse_value<unsigned>(argv[2]) : 4;
+	unsigned rounds = (argc > 3) ? parse_value<unsigned>(argv[3]) : 20;
+	framebuffer::queue q;
+	fill_queue(q, objects);
+	framebuffer::fb<false> s1, s2;
+	s1.reallocate(528, 464);
+	s2.reallocate(528, 464);
+	s1.set_origin(8, 8);
+	s2.set_origin(8, 8);
+	uint64_t t1 = run(q, s1, 0, rounds);
+	uint64_t t2 = run(q, s2, threads, rounds);
+	for(size_t y = 0; y < s1.get_height(); y++)
+		if(memcmp(s1.rowptr(y), s2.rowptr(y), 4 * s1.get_width())) {
+			std::cerr << "Tiled rendering differs on row " << y << "!" << std::endl;
+			return 1;
+		}
+	std::cout << objects << " objects, " << rounds << " rounds" << std::endl;
+	std::cout << "Sequential: " << t1 / rounds << "us/frame" << std::endl;
+	std::cout << "Tiled (" << threads << " threads): " << t2 / rounds << "us/frame" << std::endl;
+	framebuffer::queue::set_threads(0);
+	return 0;
+}
@@ -4,9 +4,9 @@
 #include <sstream>
 #include <iomanip>
 #include <cstdlib>
-#include <sys/time.h>
 
 #include "../src/emulation/bsnes-legacy/ports.inc"
+#include "test-timing.hpp"
 
 const char* ports_json = "{"
 "\"buttons\":{"
@@ -169,13 +169,6 @@ void test_port(portctrl::type* p, unsigned bits)
 
 }
 
-uint64_t get_utime()
-{
-	struct timeval tv;
-	gettimeofday(&tv, NULL);
-	return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
-}
-
 int main()
 {
 
@@ -0,0 +1,129 @@
+#include "json.hpp"
+#include "json-document.hpp"
+#include "test-timing.hpp"
+#include <iostream>
+#include <sstream>
+#include <malloc.h>
+
+//Compares loading a large project-like document as node, as document and only parsing it, and checks that node
+//and document agree.
+//Usage: json-bench [<entries>]
+
+namespace
+{
+	size_t heap_used()
+	{
+		return mallinfo2().uordblks;
+	}
+
+	class null_handler : public JSON::sax_handler
+	{
+	public:
+		null_handler() : values(0) {}
+		void null_value() { values++; }
+		void boolean_value(bool v) { values++; }
+		void number_value(const JSON::number_holder& n) { values++; }
+		void string_value(const char* str, size_t len) { values++; }
+		void array_begin() { values++; }
+		void array_end() {}
+		void object_begin() { values++; }
+		void object_key(const char* str, size_t len) {}
+		void object_end() {}
+		uint64_t values;
+	};
+
+	std::string make_document(unsigned entries)
+	{
+		std::ostringstream s;
+		uint32_t seed = 1;
+		s << "{\"projectid\":\"0123456789abcdef\",\"branches\":{\"1\":\"Main\",\"2\":\"Tëst \\\"alt\\\"\"},\n";
+		s << "\"watches\":[";
+		for(unsigned i = 0; i < entries; i++) {
+			seed = seed * 1103515245 + 12345;
+			if(i) s << ",\n";
+			s << "{\"name\":\"watch" << i << "\",\"expr\":\"WRAM+0x" << std::hex << (seed >> 16) << std::dec
+				<< "\",\"enabled\":" << ((seed >> 8) & 1 ? "true" : "false") << ",\"bytes\":["
+				<< (seed & 255) << "," << ((seed >> 8) & 255) << "," << -(int)((seed >> 16) & 255)
+				<< "],\"scale\":" << (seed >> 20) / 64.0 << ",\"comment\":"
+				<< ((seed >> 12) & 3 ? "null" : "\"α\\tβ\"") << "}";
+		}
+		s << "]}\n";
+		return s.str();
+	}
+
+	//Large objects are looked up through index sorted by key. It must agree with scanning the fields, including
+	//on duplicate keys and keys that are prefixes of each other.
+	bool check_large_object()
+	{
+		std::ostringstream s;
+		s << "{";
+		for(unsigned i = 0; i < 300; i++)
+			s << (i ? "," : "") << "\"k" << (i * 7919 % 101) << "\":" << i;
+		s << "}";
+		JSON::document d(s.str());
+		const JSON::document::value& o = d.root();
+		for(unsigned j = 0; j <= 101; j++) {
+			std::ostringstream k;
+			k << "k" << j;
+			std::vector<uint64_t> expected;
+			for(size_t i = 0; i < o.field_count(); i++)
+				if(o.key(i) == k.str())
+					expected.push_back(o.field_value(i).as_uint());
+			if(o.field_count(k.str()) != expected.size())
+				return false;
+			for(size_t i = 0; i < expected.size(); i++)
+				if(o.field(k.str(), i).as_uint() != expected[i])
+					return false;
+			try {
+				o.field(k.str(), expected.size());
+				return false;
+			} catch(JSON::error& e) {
+				if(e.get_code() != (expected.empty() ? JSON::ERR_KEY_INVALID : JSON::ERR_INSTANCE_INVALID))
+					return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned entries = (argc > 1) ? atoi(argv[1]) : 100000;
+	std::string doc = make_document(entries);
+	double mb = doc.length() / 1048576.0;
+	std::cout << "Document of " << doc.length() / 1024 << "kB" << std::endl;
+
+	size_t m0 = heap_used();
+	uint64_t t0 = get_utime();
+	JSON::node* n = new JSON::node(doc);
+	uint64_t t1 = get_utime();
+	size_t m1 = heap_used();
+	JSON::document* d = new JSON::document(doc);
+	uint64_t t2 = get_utime();
+	size_t m2 = heap_used();
+	null_handler h;
+	JSON::sax_parse(doc, h);
+	uint64_t t3 = get_utime();
+
+	if(d->root().to_node() != *n) {
+		std::cout << "FAIL: document and node differ" << std::endl;
+		return 1;
+	}
+	const JSON::document::value& w = d->root().field("watches");
+	if(w.index_count() != entries || w.index(entries - 1).field("name").as_string8() !=
+		n->field("watches").index(entries - 1).field("name").as_string8()) {
+		std::cout << "FAIL: Bad document lookup" << std::endl;
+		return 1;
+	}
+	if(!check_large_object()) {
+		std::cout << "FAIL: Bad lookup in large object" << std::endl;
+		return 1;
+	}
+	std::cout << "Consistency check passed." << std::endl;
+	std::cout << "node: " << mb / ((t1 - t0) / 1e6) << "MB/s, " << (m1 - m0) / 1024 << "kB" << std::endl;
+	std::cout << "document: " << mb / ((t2 - t1) / 1e6) << "MB/s, " << (m2 - m1) / 1024 << "kB" << std::endl;
+	std::cout << "sax_parse: " << mb / ((t3 - t2) / 1e6) << "MB/s, " << h.values << " values" << std::endl;
+	delete d;
+	delete n;
+	return 0;
+}
@@ -0,0 +1,168 @@
+#include "memoryspace.hpp"
+#include "memorystruct.hpp"
+#include "int24.hpp"
+#include "string.hpp"
+#include "test-timing.hpp"
+#include <cstdlib>
+#include <iostream>
+
+//Consistency check and benchmark of bulk structure reads against reading each field separately.
+//Usage: memorystruct-bench [<rounds> [<objects>]]
+//The per-element figures do not include the cost of crossing from Lua for each read, so scripts save more than this.
+
+namespace
+{
+	//A typical object table entry: type, flags, padding, x, y, x speed, y speed, padding, timer, id.
+	const char* format = "BBxxwwbbxxDQ";
+	const uint64_t base = 0x7E0000;
+	const uint64_t table = base + 0x1000;
+	const uint64_t stride = 32;
+
+	double read_field(memory_space& m, uint64_t addr, const memory_struct::field& f)
+	{
+		//This is what a script does with memory.read*().
+		switch(f.type) {
+		case 'b': return m.read<int8_t>(addr + f.offset);
+		case 'B': return m.read<uint8_t>(addr + f.offset);
+		case 'w': return m.read<int16_t>(addr + f.offset);
+		case 'W': return m.read<uint16_t>(addr + f.offset);
+		case 'h': return (int32_t)m.read<ss_int24_t>(addr + f.offset);
+		case 'H': return (uint32_t)m.read<ss_uint24_t>(addr + f.offset);
+		case 'd': return m.read<int32_t>(addr + f.offset);
+		case 'D': return m.read<uint32_t>(addr + f.offset);
+		case 'q': return m.read<int64_t>(addr + f.offset);
+		case 'Q': return m.read<uint64_t>(addr + f.offset);
+		case 'f': return m.read<float>(addr + f.offset);
+		case 'F': return m.read<double>(addr + f.offset);
+		default: return 0;
+		}
+	}
+
+	//Region read through callback, like I/O regions of cores.
+	struct region_callback : public memory_space::region
+	{
+		region_callback(uint64_t _base, size_t _size)
+		{
+			name = "IO";
+			base = _base;
+			size = _size;
+			endian = -1;
+			readonly = true;
+			special = true;
+			direct_map = NULL;
+			overrun = false;
+		}
+		void read(uint64_t offset, void* buffer, size_t tsize)
+		{
+			if(offset + tsize > size)
+				overrun = true;
+			for(size_t i = 0; i < tsize; i++)
+				reinterpret_cast<unsigned char*>(buffer)[i] = (offset + i) | 0x80;
+		}
+		bool overrun;
+	};
+
+	bool check_format(const std::string& fmt, size_t size, size_t fields)
+	{
+		try {
+			memory_struct s(fmt);
+			return s.get_size() == size && s.get_fields() == fields;
+		} catch(std::exception& e) {
+			return size == 0;
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t rounds = (argc > 1) ? parse_value<uint64_t>(argv[1]) : 2000;
+	uint64_t objects = (argc > 2) ? parse_value<uint64_t>(argv[2]) : 128;
+	int failures = 0;
+
+	if(!check_format("BBxxwwbbxxD>Q", 24, 8) || !check_format("4W 2x<d", 14, 5) || !check_format("", 0, 0) ||
+		!check_format("3", 0, 0) || !check_format("Z", 0, 0) || !check_format("hHfF", 18, 4)) {
+		std::cerr << "FAIL: Format parsing" << std::endl;
+		failures++;
+	}
+
+	std::vector<unsigned char> wram(0x20000);
+	for(size_t i = 0; i < wram.size(); i++)
+		wram[i] = rand();
+	memory_space m;
+	std::list<memory_space::region*> regions;
+	regions.push_back(new memory_space::region_direct("WRAM", base, -1, &wram[0], wram.size()));
+	region_callback* io = new region_callback(0x2100, 0x40);
+	regions.push_back(io);
+	m.set_regions(regions);
+	memory_struct s(format);
+
+	memory_struct e("W>W<W=W");
+	const char ebytes[] = {0x12, 0x34, 0x12, 0x34, 0x12, 0x34, 0x12, 0x34};
+	if(e.get(ebytes, 0, -1) != 0x3412 || e.get(ebytes, 1, -1) != 0x1234 || e.get(ebytes, 2, 1) != 0x3412 ||
+		e.get(ebytes, 3, 1) != 0x1234) {
+		std::cerr << "FAIL: Endianess" << std::endl;
+		failures++;
+	}
+
+	//Both paths must agree, including on structures running off the end of the region.
+	std::vector<char> buf(s.get_size() * objects);
+	uint64_t edge = base + wram.size() - 3 * stride - 5;
+	for(uint64_t addr : {table, edge}) {
+		int endian = m.read_strided(addr, s.get_size(), objects, stride, &buf[0]);
+		for(uint64_t i = 0; i < objects; i++) {
+			uint64_t oaddr = addr + i * stride;
+			for(size_t j = 0; j < s.get_fields(); j++) {
+				//Per-element reads return 0 for values crossing the end.
+				if(oaddr + s[j].offset + 8 > base + wram.size())
+					continue;
+				if(s.get(&buf[i * s.get_size()], j, endian) != read_field(m, oaddr, s[j])) {
+					std::cerr << "FAIL: Object " << i << " field " << j << " at " << std::hex
+						<< oaddr << std::dec << std::endl;
+					failures++;
+				}
+			}
+		}
+	}
+
+	//Rows running off the end of callback region read as zeroes without calling it past the end.
+	{
+		unsigned char iobuf[6 * 4];
+		m.read_strided(0x2100 + 0x31, 4, 6, 5, iobuf);
+		bool ok = !io->overrun;
+		for(size_t i = 0; i < sizeof(iobuf); i++) {
+			uint64_t off = 0x31 + (i / 4) * 5 + (i % 4);
+			ok = ok && iobuf[i] == ((off < 0x40) ? (off | 0x80) : 0);
+		}
+		if(!ok) {
+			std::cerr << "FAIL: Strided read past end of callback region" << std::endl;
+			failures++;
+		}
+	}
+
+	double sum1 = 0, sum2 = 0;
+	uint64_t t1 = get_utime();
+	for(uint64_t r = 0; r < rounds; r++)
+		for(uint64_t i = 0; i < objects; i++)
+			for(size_t j = 0; j < s.get_fields(); j++)
+				sum1 += read_field(m, table + i * stride, s[j]);
+	uint64_t t2 = get_utime();
+	for(uint64_t r = 0; r < rounds; r++) {
+		int endian = m.read_strided(table, s.get_size(), objects, stride, &buf[0]);
+		for(uint64_t i = 0; i < objects; i++)
+			for(size_t j = 0; j < s.get_fields(); j++)
+				sum2 += s.get(&buf[i * s.get_size()], j, endian);
+	}
+	uint64_t t3 = get_utime();
+	if(sum1 != sum2) {
+		std::cerr << "FAIL: Checksums differ" << std::endl;
+		failures++;
+	}
+	uint64_t reads = rounds * objects * s.get_fields();
+	std::cout << reads << " field reads: per-element " << (t2 - t1) << "us (" << 1000.0 * (t2 - t1) / reads
+		<< "ns/read), bulk " << (t3 - t2) << "us (" << 1000.0 * (t3 - t2) / reads << "ns/read)" << std::endl;
+	if(failures)
+		std::cerr << failures << " failures" << std::endl;
+	else
+		std::cout << "All tests passed" << std::endl;
+	return failures ? 1 : 0;
+}
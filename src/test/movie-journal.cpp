@@ -0,0 +1,169 @@
+#include "portctrl-data.hpp"
+#include "movie-journal.hpp"
+#include "test-timing.hpp"
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+//Checks that replaying the journal onto the base gives the journaled state, including when the last batch was
+//torn, and measures the cost of syncing a few seconds of recording into a long movie.
+//Usage: movie-journal [<subframes>]
+
+namespace
+{
+	struct test_type : public portctrl::type
+	{
+		test_type() : portctrl::type("test", "Test", 12)
+		{
+			set.legal_for.insert(0);
+			controller_info = &set;
+		}
+		portctrl::controller_set set;
+	};
+
+	typedef std::map<std::string, portctrl::frame_vector> branchmap;
+	typedef std::map<std::string, std::string> metamap;
+
+	std::vector<unsigned char> contents(const portctrl::frame_vector& v)
+	{
+		std::vector<unsigned char> r;
+		for(size_t i = 0; i < v.get_page_count(); i++) {
+			const unsigned char* p = v.get_page_buffer(i);
+			r.insert(r.end(), p, p + v.get_page_frames(i) * v.get_stride());
+		}
+		return r;
+	}
+
+	bool same(branchmap& a, branchmap& b)
+	{
+		if(a.size() != b.size())
+			return false;
+		for(auto& i : a) {
+			if(!b.count(i.first))
+				return false;
+			portctrl::frame_vector& w = b.find(i.first)->second;
+			if(contents(i.second) != contents(w) || i.second.count_frames() != w.count_frames())
+				return false;
+		}
+		return true;
+	}
+
+	//Set byte of subframe through the page buffers.
+	void poke(portctrl::frame_vector& v, size_t subframe, size_t offset, unsigned char value)
+	{
+		for(size_t i = 0; i < v.get_page_count(); i++) {
+			if(subframe < v.get_page_frames(i)) {
+				v.get_page_buffer(i)[subframe * v.get_stride() + offset] = value;
+				return;
+			}
+			subframe -= v.get_page_frames(i);
+		}
+	}
+
+	uint32_t seed = 1;
+
+	void record(portctrl::frame_vector& v, unsigned subframes)
+	{
+		for(unsigned i = 0; i < subframes; i++) {
+			seed = seed * 1103515245 + 12345;
+			portctrl::frame f = v.blank_frame((seed >> 20) & 3);
+			v.append(f);
+			poke(v, v.size() - 1, 1 + (seed >> 24) % 11, seed >> 8);
+		}
+	}
+
+	bool check(const char* what, const std::string& file, const std::string& base, branchmap& start,
+		metamap& startmeta, branchmap& expect, metamap& expectmeta, const portctrl::type_set& ts,
+		uint64_t batches)
+	{
+		branchmap b = start;
+		metamap m = startmeta;
+		movie_journal j;
+		uint64_t got = j.recover(file, base, b, ts, m);
+		if(got != batches || !same(b, expect) || m != expectmeta) {
+			std::cout << "FAIL: " << what << " (" << got << " batches)" << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t subframes = (argc > 1) ? atoi(argv[1]) : 1000000;
+	test_type t;
+	portctrl::type_set& ts = portctrl::type_set::make({&t}, portctrl::index_map());
+	char tmpname[] = "/tmp/movie-journal-XXXXXX";
+	int fd = mkstemp(tmpname);
+	if(fd < 0) {
+		std::cout << "FAIL: Can't create temporary file" << std::endl;
+		return 1;
+	}
+	close(fd);
+	std::string file = tmpname;
+
+	//Base: one branch of given length.
+	branchmap branches;
+	metamap meta;
+	branches.insert(std::make_pair("", portctrl::frame_vector(ts)));
+	record(branches[""], subframes);
+	meta["gamename"] = "Test";
+	branchmap base_branches = branches;
+	metamap base_meta = meta;
+
+	movie_journal j;
+	j.start(file, "base1", branches, meta);
+	//Five seconds of recording at a time.
+	uint64_t worst = 0, total = 0;
+	for(unsigned i = 0; i < 20; i++) {
+		record(branches[""], 300);
+		uint64_t t1 = get_utime();
+		j.sync(branches, meta);
+		uint64_t t2 = get_utime();
+		worst = std::max(worst, t2 - t1);
+		total += t2 - t1;
+	}
+	//Edit in the middle, new branch, metadata changes.
+	poke(branches[""], subframes / 2, 3, 0x55);
+	branches.insert(std::make_pair("alt", branches[""]));
+	record(branches["alt"], 1000);
+	meta["gamename"] = "Test 2";
+	meta["branch"] = "alt";
+	j.sync(branches, meta);
+	//Truncation and branch removal.
+	branches[""].resize(subframes / 3);
+	branches.erase("alt");
+	meta.erase("branch");
+	j.sync(branches, meta);
+	uint64_t size = j.get_size();
+	j.close();
+
+	if(!check("Replay", file, "base1", base_branches, base_meta, branches, meta, ts, 22))
+		return 1;
+	if(!check("Replay with wrong base", file, "base2", base_branches, base_meta, base_branches, base_meta, ts, 0))
+		return 1;
+	//Tear the last batch: it must be ignored, and writing continues from the previous batch.
+	branchmap before_last = base_branches;
+	metamap before_last_meta = base_meta;
+	if(truncate(file.c_str(), size - 3) < 0) {
+		std::cout << "FAIL: Can't truncate" << std::endl;
+		return 1;
+	}
+	j.recover(file, "base1", before_last, ts, before_last_meta);
+	if(before_last.size() != 2 || before_last_meta["branch"] != "alt") {
+		std::cout << "FAIL: Torn batch was not ignored" << std::endl;
+		return 1;
+	}
+	record(before_last[""], 500);
+	j.sync(before_last, before_last_meta);
+	j.close();
+	if(!check("Replay after torn batch", file, "base1", base_branches, base_meta, before_last, before_last_meta,
+		ts, 22))
+		return 1;
+	unlink(file.c_str());
+
+	std::cout << "Consistency check passed." << std::endl;
+	std::cout << subframes << " subframes, journal " << size / 1024 << "kB, sync of 300 subframes: "
+		<< total / 20 << "us average, " << worst << "us max" << std::endl;
+	return 0;
+}
@@ -0,0 +1,132 @@
+#include "portctrl-data.hpp"
+#include "portctrl-chunked.hpp"
+#include "binarystream.hpp"
+#include "threads-pool.hpp"
+#include "test-timing.hpp"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+//Checks that chunked input survives save and load, that frames are found from the right chunks, and measures
+//encoding, encoding again after appending frames and decoding.
+//Usage: portctrl-chunked [<subframes> [<threads>]]
+
+namespace
+{
+	struct test_type : public portctrl::type
+	{
+		test_type() : portctrl::type("test", "Test", 12)
+		{
+			set.legal_for.insert(0);
+			controller_info = &set;
+		}
+		portctrl::controller_set set;
+	};
+
+	std::vector<unsigned char> contents(const portctrl::frame_vector& v)
+	{
+		std::vector<unsigned char> r;
+		for(size_t i = 0; i < v.get_page_count(); i++) {
+			const unsigned char* p = v.get_page_buffer(i);
+			r.insert(r.end(), p, p + v.get_page_frames(i) * v.get_stride());
+		}
+		return r;
+	}
+
+	//Mostly unchanging input, with some subframes.
+	void fill(portctrl::frame_vector& v, size_t subframes)
+	{
+		uint32_t seed = 1;
+		unsigned char state[12] = {0};
+		v.resize(subframes);
+		for(size_t i = 0; i < v.get_page_count(); i++) {
+			unsigned char* p = v.get_page_buffer(i);
+			for(size_t j = 0; j < v.get_page_frames(i); j++) {
+				seed = seed * 1103515245 + 12345;
+				if(((seed >> 16) & 15) == 0)
+					state[1 + (seed >> 28) % 11] ^= 1 << ((seed >> 24) & 7);
+				memcpy(p + j * 12, state, 12);
+				p[j * 12] = ((seed >> 20) & 7) ? 1 : 0;
+			}
+		}
+		v.recount_frames();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t subframes = (argc > 1) ? atoi(argv[1]) : 1000000;
+	if(argc > 2)
+		threads::pool::global().set_threads(atoi(argv[2]));
+	test_type t;
+	portctrl::type_set& ts = portctrl::type_set::make({&t}, portctrl::index_map());
+	portctrl::frame_vector v(ts);
+	fill(v, subframes);
+
+	portctrl::chunked_input c;
+	uint64_t t0 = get_utime();
+	c.encode(v, 6);
+	uint64_t t1 = get_utime();
+	for(unsigned i = 0; i < 5000; i++)
+		v.append(v.blank_frame(true));
+	c.encode(v, 6);
+	uint64_t t2 = get_utime();
+
+	char tmpname[] = "/tmp/portctrl-chunked-XXXXXX";
+	int fd = mkstemp(tmpname);
+	if(fd < 0) {
+		std::cout << "FAIL: Can't create temporary file" << std::endl;
+		return 1;
+	}
+	unlink(tmpname);
+	{
+		binarystream::output out(fd);
+		out.extension(1, [&c](binarystream::output& s) { c.save(s); }, true, c.binary_size());
+	}
+	lseek(fd, 0, SEEK_SET);
+	portctrl::frame_vector w(ts);
+	portctrl::chunked_input c2;
+	uint64_t t3 = 0, t4 = 0;
+	{
+		binarystream::input in(fd);
+		in.extension({{1, [&](binarystream::input& s) {
+			c2.load(s);
+			t3 = get_utime();
+			c2.decode(w);
+			t4 = get_utime();
+		}}}, binarystream::null_default);
+	}
+	close(fd);
+	if(contents(v) != contents(w) || v.count_frames() != w.count_frames()) {
+		std::cout << "FAIL: Input differs after save and load" << std::endl;
+		return 1;
+	}
+	uint64_t count = w.count_frames();
+	uint64_t frames[] = {1, count / 3, count / 2, count};
+	for(auto f : frames) {
+		if(f < 1 || f > count)
+			continue;
+		size_t idx = c2.find_frame(f);
+		if(idx >= c2.get_chunk_count()) {
+			std::cout << "FAIL: Frame " << f << " not found" << std::endl;
+			return 1;
+		}
+		const portctrl::chunked_input::chunk_info& i = c2.get_chunk(idx);
+		uint64_t sf = w.find_frame(f);
+		if(sf < i.first_subframe || sf >= i.first_subframe + i.subframes) {
+			std::cout << "FAIL: Frame " << f << " not in chunk " << idx << std::endl;
+			return 1;
+		}
+	}
+	if(c2.find_frame(count + 1) != c2.get_chunk_count()) {
+		std::cout << "FAIL: Found frame past the end" << std::endl;
+		return 1;
+	}
+	std::cout << "Consistency check passed." << std::endl;
+	std::cout << subframes << " subframes: " << v.binary_size() / 1024 << "kB raw, " << c.binary_size() / 1024
+		<< "kB in " << c.get_chunk_count() << " chunks" << std::endl;
+	std::cout << "encode: " << (t1 - t0) / 1000 << "ms, again after append: " << (t2 - t1) / 1000
+		<< "ms, decode: " << (t4 - t3) / 1000 << "ms" << std::endl;
+	return 0;
+}
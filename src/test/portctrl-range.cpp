@@ -0,0 +1,180 @@
+#include "portctrl-data.hpp"
+#include "minmax.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+//Checks insert_range() and erase_range() of frame_vector against a plain vector of subframes, at page boundaries,
+//across several pages, on empty ranges and vectors, and with random edits. Lookups by frame are compared against a
+//vector built from the same subframes by resizing.
+//Usage: portctrl-range [<edits>]
+
+namespace
+{
+	const size_t stride = 12;
+
+	struct test_type : public portctrl::type
+	{
+		test_type() : portctrl::type("test", "Test", stride)
+		{
+			set.legal_for.insert(0);
+			controller_info = &set;
+		}
+		portctrl::controller_set set;
+	};
+
+	uint32_t seed = 1;
+
+	uint32_t rnd()
+	{
+		seed = seed * 1103515245 + 12345;
+		return seed >> 8;
+	}
+
+	//The model: stride bytes per subframe, first byte is the sync flag.
+	typedef std::vector<unsigned char> model;
+
+	//Give subframes [pos, pos + count) distinct contents, in both the vector and the model.
+	void scribble(portctrl::frame_vector& v, model& m, size_t pos, size_t count)
+	{
+		size_t first = 0;
+		for(size_t i = 0; i < v.get_page_count(); i++) {
+			size_t n = v.get_page_frames(i);
+			unsigned char* p = v.get_page_buffer(i);
+			for(size_t j = 0; j < n; j++)
+				if(first + j >= pos && first + j < pos + count) {
+					unsigned char* f = &m[(first + j) * stride];
+					for(size_t k = 0; k < stride; k++)
+						f[k] = rnd();
+					f[0] = (rnd() % 3) ? 0 : 1;
+					memcpy(p + j * stride, f, stride);
+				}
+			first += n;
+		}
+		v.recount_frames();
+	}
+
+	void insert(portctrl::frame_vector& v, model& m, size_t pos, size_t count, bool sync)
+	{
+		v.insert_range(pos, count, sync);
+		model blank(count * stride, 0);
+		for(size_t i = 0; i < count; i++)
+			blank[i * stride] = sync ? 1 : 0;
+		m.insert(m.begin() + pos * stride, blank.begin(), blank.end());
+	}
+
+	void erase(portctrl::frame_vector& v, model& m, size_t pos, size_t count)
+	{
+		v.erase_range(pos, count);
+		m.erase(m.begin() + pos * stride, m.begin() + (pos + count) * stride);
+	}
+
+	bool check(portctrl::frame_vector& v, const model& m, const char* what)
+	{
+		bool ok = (v.size() * stride == m.size());
+		model got;
+		for(size_t i = 0; ok && i < v.get_page_count(); i++) {
+			size_t n = v.get_page_frames(i);
+			//Pages are never empty or overfull.
+			ok = ok && n && n <= v.get_frames_per_page();
+			const unsigned char* p = const_cast<const portctrl::frame_vector&>(v).get_page_buffer(i);
+			got.insert(got.end(), p, p + n * stride);
+		}
+		ok = ok && got == m;
+		portctrl::frame_vector ref(v.get_types());
+		ref.resize(m.size() / stride);
+		size_t first = 0;
+		for(size_t i = 0; i < ref.get_page_count(); i++) {
+			size_t n = ref.get_page_frames(i);
+			if(n)
+				memcpy(ref.get_page_buffer(i), &m[first * stride], n * stride);
+			first += n;
+		}
+		ref.recount_frames();
+		ok = ok && v.count_frames() == ref.count_frames();
+		for(unsigned i = 0; ok && i < 64; i++) {
+			size_t x = v.size() ? rnd() % v.size() : 0;
+			uint64_t f = rnd() % (ref.count_frames() + 2);
+			ok = ok && v.walk_sync(x) == ref.walk_sync(x);
+			ok = ok && v.subframe_to_frame(x) == ref.subframe_to_frame(x);
+			ok = ok && v.find_frame(f) == ref.find_frame(f);
+			ok = ok && (!v.size() || v[x].sync() == ref[x].sync());
+		}
+		if(!ok)
+			std::cout << "FAIL: " << what << std::endl;
+		return ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned edits = (argc > 1) ? atoi(argv[1]) : 2000;
+	test_type t;
+	portctrl::type_set& ts = portctrl::type_set::make({&t}, portctrl::index_map());
+	portctrl::frame_vector v(ts);
+	model m;
+	size_t fpp = v.get_frames_per_page();
+
+	//Empty ranges and vectors.
+	insert(v, m, 0, 0, true);
+	erase(v, m, 0, 0);
+	if(!check(v, m, "Empty range on empty vector")) return 1;
+	insert(v, m, 0, 5, true);
+	if(!check(v, m, "Insert to empty vector")) return 1;
+	erase(v, m, 0, 5);
+	if(!check(v, m, "Erase everything")) return 1;
+	insert(v, m, 0, 3 * fpp, false);
+	scribble(v, m, 0, 3 * fpp);
+	insert(v, m, fpp, 0, true);
+	erase(v, m, 2 * fpp, 0);
+	erase(v, m, v.size(), 0);
+	if(!check(v, m, "Empty range")) return 1;
+
+	//Invalid ranges are rejected without changes.
+	unsigned threw = 0;
+	try { v.insert_range(v.size() + 1, 1, true); } catch(std::runtime_error& e) { threw++; }
+	try { v.erase_range(v.size(), 1); } catch(std::runtime_error& e) { threw++; }
+	try { v.erase_range(1, v.size()); } catch(std::runtime_error& e) { threw++; }
+	if(threw != 3) {
+		std::cout << "FAIL: Invalid range accepted" << std::endl;
+		return 1;
+	}
+	if(!check(v, m, "Invalid range")) return 1;
+
+	//At and around page boundaries, and splitting a page into several.
+	size_t points[] = {0, 1, fpp - 1, fpp, fpp + 1, 2 * fpp};
+	for(auto p : points) {
+		insert(v, m, p, 1, true);
+		if(!check(v, m, "Insert subframe at page boundary")) return 1;
+		insert(v, m, p, 2 * fpp + 7, false);
+		scribble(v, m, p, 2 * fpp + 7);
+		if(!check(v, m, "Insert pages at page boundary")) return 1;
+		erase(v, m, p, 2 * fpp + 8);
+		if(!check(v, m, "Erase pages at page boundary")) return 1;
+		erase(v, m, p, 1);
+		if(!check(v, m, "Erase subframe at page boundary")) return 1;
+	}
+	insert(v, m, v.size(), fpp + 3, true);
+	if(!check(v, m, "Append")) return 1;
+	erase(v, m, v.size() - fpp - 5, fpp + 5);
+	if(!check(v, m, "Erase tail")) return 1;
+
+	//Random edits, mostly small ones.
+	for(unsigned i = 0; i < edits; i++) {
+		size_t maxcount = (rnd() % 8) ? 16 : 3 * fpp;
+		size_t pos = rnd() % (v.size() + 1);
+		if((rnd() & 1) || v.size() < fpp) {
+			size_t count = rnd() % maxcount;
+			insert(v, m, pos, count, rnd() & 1);
+			if(count && (rnd() & 1))
+				scribble(v, m, pos, count);
+		} else
+			erase(v, m, pos, rnd() % (min(maxcount, v.size() - pos) + 1));
+		if(!check(v, m, "Random edit")) {
+			std::cout << "After " << i + 1 << " edits" << std::endl;
+			return 1;
+		}
+	}
+	std::cout << "Consistency check passed." << std::endl;
+	return 0;
+}
@@ -0,0 +1,116 @@
+#include "rrdata.hpp"
+#include "directory.hpp"
+#include "string.hpp"
+#include "test-timing.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+
+//Benchmark/consistency check for rrdata project files.
+//Usage: rrdata-bench [<rerecords> [<branch-every>]]
+
+namespace
+{
+	rrdata_set::instance random_instance()
+	{
+		unsigned char buf[RRDATA_BYTES];
+		for(unsigned i = 0; i < RRDATA_BYTES; i++)
+			buf[i] = rand();
+		//Leave room for runs not to wrap.
+		buf[0] &= 0x7F;
+		return rrdata_set::instance(buf);
+	}
+
+	bool check_random()
+	{
+		//Compare against trivial model on small ID space.
+		for(unsigned round = 0; round < 200; round++) {
+			rrdata_set s;
+			std::set<unsigned> model;
+			rrdata_set::instance base;
+			for(unsigned i = 0; i < 50; i++) {
+				unsigned b = rand() % 200;
+				unsigned l = rand() % 10;
+				s.debug_add(base + b, base + (b + l));
+				for(unsigned j = b; j < b + l; j++)
+					model.insert(j);
+			}
+			if(s.count() != (model.empty() ? 0 : model.size() - 1))
+				return false;
+			for(unsigned i = 0; i < 220; i++)
+				if(s.debug_in_set(base + i) != (model.count(i) != 0))
+					return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t records = (argc > 1) ? parse_value<uint64_t>(argv[1]) : 2000000;
+	uint64_t branch = (argc > 2) ? parse_value<uint64_t>(argv[2]) : 1000;
+	std::string project = "rrdata-bench.tmp";
+	remove(project.c_str());
+	remove(rrdata_set::checkpoint_name(project).c_str());
+
+	if(!check_random()) {
+		std::cerr << "Interval set does not match model!" << std::endl;
+		return 1;
+	}
+
+	uint64_t t1 = get_utime();
+	{
+		rrdata_set s;
+		s.read_base(project, false);
+		rrdata_set::instance i = random_instance();
+		for(uint64_t j = 0; j < records; j++) {
+			if(branch && j % branch == 0)
+				i = random_instance();
+			s.add(i++);
+		}
+		//Leave tail not covered by checkpoint, like after a crash.
+	}
+	uint64_t t2 = get_utime();
+	uint64_t count1, count2, intervals;
+	std::string dump1;
+	{
+		rrdata_set s;
+		s.read_base(project, false);
+		count1 = s.count();
+		intervals = s.interval_count();
+		dump1 = s.debug_dump();
+		s.close();
+	}
+	uint64_t t3 = get_utime();
+	{
+		rrdata_set s;
+		s.read_base(project, false);
+		count2 = s.count();
+		if(s.debug_dump() != dump1) {
+			std::cerr << "Checkpointed load does not match!" << std::endl;
+			return 1;
+		}
+	}
+	uint64_t t4 = get_utime();
+	remove(rrdata_set::checkpoint_name(project).c_str());
+	uint64_t t5 = get_utime();
+	{
+		rrdata_set s;
+		s.read_base(project, false);
+		if(s.debug_dump() != dump1) {
+			std::cerr << "Full replay does not match!" << std::endl;
+			return 1;
+		}
+	}
+	uint64_t t6 = get_utime();
+	std::cout << "Records: " << records << ", intervals: " << intervals << ", rerecords: " << count1 << "/"
+		<< count2 << std::endl;
+	std::cout << "Record: " << (t2 - t1) / 1000 << "ms" << std::endl;
+	std::cout << "Open (partial checkpoint): " << (t3 - t2) / 1000 << "ms" << std::endl;
+	std::cout << "Open (checkpoint): " << (t4 - t3) / 1000 << "ms" << std::endl;
+	std::cout << "Open (full replay): " << (t6 - t5) / 1000 << "ms" << std::endl;
+	remove(project.c_str());
+	remove(rrdata_set::checkpoint_name(project).c_str());
+	return (count1 == count2) ? 0 : 1;
+}
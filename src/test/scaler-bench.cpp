@@ -0,0 +1,186 @@
+#include "scaler.hpp"
+#include "test-timing.hpp"
+#include <cstring>
+#include <iostream>
+#ifdef WITH_SWSCALE
+extern "C"
+{
+#ifndef UINT64_C
+#define UINT64_C(val) val##ULL
+#endif
+#include <libswscale/swscale.h>
+}
+#endif
+
+//Consistency check and benchmark of native scalers (and swscale, if built with -DWITH_SWSCALE).
+//Usage: scaler-bench [<rounds>]
+
+namespace
+{
+	struct resolution
+	{
+		const char* name;
+		size_t w;
+		size_t h;
+	} resolutions[] = {
+		{"GB", 160, 144},
+		{"SNES", 256, 224},
+		{"SNES overscan", 256, 239},
+		{"SNES hires", 512, 448},
+		{"SNES hires overscan", 512, 478},
+	};
+
+	void fill(std::vector<uint32_t>& img, size_t n)
+	{
+		uint32_t x = 12345;
+		img.resize(n);
+		for(size_t i = 0; i < n; i++) {
+			x = x * 1103515245 + 12345;
+			img[i] = x >> 4;
+		}
+	}
+
+	//Straightforward nearest neighbor.
+	void reference(std::vector<uint8_t>& out, size_t dw, size_t dh, const std::vector<uint32_t>& img, size_t sw,
+		size_t sh, unsigned orient)
+	{
+		size_t w = (orient & scaler::ROTATE) ? sh : sw;
+		size_t h = (orient & scaler::ROTATE) ? sw : sh;
+		out.resize(3 * dw * dh);
+		for(size_t y = 0; y < dh; y++)
+			for(size_t x = 0; x < dw; x++) {
+				//Coordinates in rotated image.
+				size_t rx = ((2 * x + 1) * w) / (2 * dw);
+				size_t ry = ((2 * y + 1) * h) / (2 * dh);
+				//Coordinates in flipped image.
+				size_t fx = (orient & scaler::ROTATE) ? ry : rx;
+				size_t fy = (orient & scaler::ROTATE) ? (sh - 1 - rx) : ry;
+				if(orient & scaler::HFLIP) fx = sw - 1 - fx;
+				if(orient & scaler::VFLIP) fy = sh - 1 - fy;
+				uint32_t p = img[fy * sw + fx];
+				out[3 * (y * dw + x) + 0] = p >> 16;
+				out[3 * (y * dw + x) + 1] = p >> 8;
+				out[3 * (y * dw + x) + 2] = p;
+			}
+	}
+
+	bool check(const char* what, const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+	{
+		if(a == b)
+			return true;
+		std::cout << "FAIL: " << what << std::endl;
+		return false;
+	}
+
+	bool consistency()
+	{
+		bool ok = true;
+		std::vector<uint32_t> img;
+		size_t sw = 61, sh = 37;
+		fill(img, sw * sh);
+		size_t sizes[][2] = {{61, 37}, {122, 74}, {183, 111}, {244, 148}, {305, 185}, {549, 333}, {100, 50},
+			{37, 61}, {74, 122}, {111, 183}, {90, 130}};
+		std::vector<uint8_t> ref, out, sharp0;
+		for(unsigned orient = 0; orient < 8; orient++)
+			for(auto& s : sizes) {
+				reference(ref, s[0], s[1], img, sw, sh, orient);
+				for(int level = scaler::SIMD_NONE; level <= scaler::get_best_simd(); level++) {
+					scaler::context ctx;
+					ctx.set_simd(static_cast<scaler::simd>(level));
+					out.resize(3 * s[0] * s[1]);
+					ctx.scale(scaler::NEAREST, &out[0], 3 * s[0], s[0], s[1], &img[0], sw, sw, sh,
+						orient);
+					ok &= check("nearest", ref, out);
+					ctx.scale(scaler::SHARP_BILINEAR, &out[0], 3 * s[0], s[0], s[1], &img[0], sw, sw, sh,
+						orient);
+					if(level == scaler::SIMD_NONE)
+						sharp0 = out;
+					else
+						ok &= check("sharp bilinear (SIMD vs. generic)", sharp0, out);
+					//Integer sizes are the same as nearest.
+					bool integer = (s[0] % ((orient & scaler::ROTATE) ? sh : sw) == 0) &&
+						(s[1] % ((orient & scaler::ROTATE) ? sw : sh) == 0);
+					if(integer)
+						ok &= check("sharp bilinear (integer)", ref, out);
+				}
+			}
+		return ok;
+	}
+
+	template<typename T> void bench(const char* name, size_t pixels, unsigned rounds, T fn)
+	{
+		uint64_t t0 = get_utime();
+		for(unsigned i = 0; i < rounds; i++)
+			fn();
+		uint64_t t = get_utime() - t0;
+		std::cout << "\t" << name << ": " << t / rounds << "us/frame, " << 1000.0 * t / rounds / pixels
+			<< "ns/output pixel" << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned rounds = (argc > 1) ? atoi(argv[1]) : 200;
+	if(!consistency()) {
+		std::cout << "Consistency check failed." << std::endl;
+		return 1;
+	}
+	std::cout << "Consistency check passed. Best SIMD: " << scaler::get_simd_name(scaler::get_best_simd())
+		<< std::endl;
+	std::vector<uint32_t> img;
+	std::vector<uint8_t> out;
+	for(auto& r : resolutions) {
+		fill(img, r.w * r.h);
+		for(unsigned factor = 2; factor <= 4; factor++) {
+			size_t dw = r.w * factor;
+			size_t dh = r.h * factor;
+			out.resize(3 * dw * dh);
+			std::cout << r.name << " " << r.w << "x" << r.h << " => " << dw << "x" << dh << std::endl;
+			for(int level = scaler::SIMD_NONE; level <= scaler::get_best_simd(); level++) {
+				scaler::context ctx;
+				ctx.set_simd(static_cast<scaler::simd>(level));
+				std::string name = std::string("nearest ") + scaler::get_simd_name(ctx.get_simd());
+				bench(name.c_str(), dw * dh, rounds, [&]() {
+					ctx.scale(scaler::NEAREST, &out[0], 3 * dw, dw, dh, &img[0], r.w, r.w, r.h, 0);
+				});
+				name = std::string("nearest rotated ") + scaler::get_simd_name(ctx.get_simd());
+				bench(name.c_str(), dw * dh, rounds, [&]() {
+					ctx.scale(scaler::NEAREST, &out[0], 3 * dh, dh, dw, &img[0], r.w, r.w, r.h,
+						scaler::ROTATE);
+				});
+				//Sharp bilinear to a non-integer size, as with AR correction.
+				size_t sdw = dw * 8 / 7;
+				out.resize(3 * sdw * dh);
+				name = std::string("sharp bilinear 8:7 ") + scaler::get_simd_name(ctx.get_simd());
+				bench(name.c_str(), sdw * dh, rounds, [&]() {
+					ctx.scale(scaler::SHARP_BILINEAR, &out[0], 3 * sdw, sdw, dh, &img[0], r.w, r.w,
+						r.h, 0);
+				});
+			}
+#ifdef WITH_SWSCALE
+			SwsContext* sws = sws_getContext(r.w, r.h, AV_PIX_FMT_RGBA, dw, dh, AV_PIX_FMT_BGR24, SWS_POINT,
+				NULL, NULL, NULL);
+			bench("swscale point", dw * dh, rounds, [&]() {
+				const uint8_t* srcp[1] = {reinterpret_cast<const uint8_t*>(&img[0])};
+				int srcs[1] = {static_cast<int>(4 * r.w)};
+				uint8_t* dstp[1] = {&out[0]};
+				int dsts[1] = {static_cast<int>(3 * dw)};
+				sws_scale(sws, srcp, srcs, 0, r.h, dstp, dsts);
+			});
+			sws_freeContext(sws);
+			size_t sdw = dw * 8 / 7;
+			sws = sws_getContext(r.w, r.h, AV_PIX_FMT_RGBA, sdw, dh, AV_PIX_FMT_BGR24, SWS_BILINEAR,
+				NULL, NULL, NULL);
+			bench("swscale bilinear 8:7", sdw * dh, rounds, [&]() {
+				const uint8_t* srcp[1] = {reinterpret_cast<const uint8_t*>(&img[0])};
+				int srcs[1] = {static_cast<int>(4 * r.w)};
+				uint8_t* dstp[1] = {&out[0]};
+				int dsts[1] = {static_cast<int>(3 * sdw)};
+				sws_scale(sws, srcp, srcs, 0, r.h, dstp, dsts);
+			});
+			sws_freeContext(sws);
+#endif
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include "settingvar.hpp"
+#include "test-timing.hpp"
+#include <iostream>
+
+//Compares reading settings through supervariables and through cached handles, and checks that handles follow
+//changes of the setting.
+//Usage: settingvar-bench [<reads>]
+
+namespace
+{
+	settingvar::set setgrp;
+	settingvar::supervariable<settingvar::model_int<0, 9>> SET_level(setgrp, "level", "Test‣Level", 7);
+	settingvar::supervariable<settingvar::model_bool<settingvar::yes_no>> SET_flag(setgrp, "flag",
+		"Test‣Flag", false);
+	//Some other settings, so the lookup is not from a trivial map.
+	settingvar::supervariable<settingvar::model_int<0, 99>> SET_a(setgrp, "aaaa", "Test‣A", 0);
+	settingvar::supervariable<settingvar::model_int<0, 99>> SET_b(setgrp, "bbbb", "Test‣B", 0);
+	settingvar::supervariable<settingvar::model_int<0, 99>> SET_c(setgrp, "cccc", "Test‣C", 0);
+	settingvar::supervariable<settingvar::model_int<0, 99>> SET_m(setgrp, "mmmm", "Test‣M", 0);
+	settingvar::supervariable<settingvar::model_int<0, 99>> SET_z(setgrp, "zzzz", "Test‣Z", 0);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned reads = (argc > 1) ? atoi(argv[1]) : 10000000;
+	settingvar::group grp;
+	//Handle created before the settings exist, as in emulator instance.
+	settingvar::handle<settingvar::model_int<0, 9>> level(SET_level, grp);
+	settingvar::handle<settingvar::model_bool<settingvar::yes_no>> flag(SET_flag, grp);
+	grp.add_set(setgrp);
+
+	bool ok = true;
+	ok &= (level() == 7 && !flag());
+	SET_level(grp, 3);
+	grp["flag"].str("yes");
+	ok &= (level() == 3 && flag());
+	grp["level"].str("5");
+	ok &= (level() == 5);
+	if(!ok) {
+		std::cout << "FAIL: Handle does not follow setting" << std::endl;
+		return 1;
+	}
+	std::cout << "Consistency check passed." << std::endl;
+
+	uint64_t sum = 0;
+	uint64_t t0 = get_utime();
+	for(unsigned i = 0; i < reads; i++)
+		sum += SET_level(grp);
+	uint64_t t1 = get_utime();
+	for(unsigned i = 0; i < reads; i++)
+		sum += level();
+	uint64_t t2 = get_utime();
+	std::cout << "supervariable: " << 1000.0 * (t1 - t0) / reads << "ns/read" << std::endl;
+	std::cout << "handle: " << 1000.0 * (t2 - t1) / reads << "ns/read" << std::endl;
+	return (sum == 10ULL * reads) ? 0 : 1;
+}
@@ -0,0 +1,17 @@
+#ifndef _test__test_timing__hpp__included__
+#define _test__test_timing__hpp__included__
+
+#include <cstdint>
+#include <sys/time.h>
+
+/**
+ * Get current wall clock time in microseconds, for timing the benchmark parts of tests.
+ */
+inline uint64_t get_utime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+#endif
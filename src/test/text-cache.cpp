@@ -0,0 +1,160 @@
+#include "framebuffer.hpp"
+#include "framebuffer-textcache.hpp"
+#include "test-timing.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+//Checks that text drawn through the text cache matches drawing glyph by glyph, and compares speed.
+//Usage: text-cache <hexfile>
+
+namespace
+{
+	//Glyph by glyph drawing, as before the cache.
+	void reference(framebuffer::fb<false>& scr, framebuffer::font& f, int32_t x, int32_t y, const std::string& text,
+		framebuffer::color fg, framebuffer::color bg, bool hdbl, bool vdbl)
+	{
+		f.for_each_glyph(text, x, hdbl, vdbl, [&](uint32_t lx, uint32_t ly, const framebuffer::font::glyph& g,
+			bool hdbl, bool vdbl) {
+			uint32_t w = (g.wide ? 16 : 8) << (hdbl ? 1 : 0);
+			uint32_t h = 16 << (vdbl ? 1 : 0);
+			for(uint32_t i = 0; i < h; i++) {
+				int32_t sy = y + (int32_t)(ly + i);
+				if(sy < 0 || sy >= (int32_t)scr.get_height())
+					continue;
+				uint32_t* r = scr.rowptr(sy);
+				uint32_t _y = i >> (vdbl ? 1 : 0);
+				uint32_t d = g.data[_y >> (g.wide ? 1 : 2)];
+				if(g.wide)
+					d >>= 16 - ((_y & 1) << 4);
+				else
+					d >>= 24 - ((_y & 3) << 3);
+				for(uint32_t j = 0; j < w; j++) {
+					int32_t sx = x + (int32_t)(lx + j);
+					if(sx < 0 || sx >= (int32_t)scr.get_width())
+						continue;
+					uint32_t b = (g.wide ? 15 : 7) - (j >> (hdbl ? 1 : 0));
+					if((d >> b) & 1)
+						fg.apply(r[sx]);
+					else
+						bg.apply(r[sx]);
+				}
+			}
+		});
+	}
+
+	void fill(framebuffer::fb<false>& scr)
+	{
+		uint32_t s = 12345;
+		for(size_t i = 0; i < scr.get_height(); i++)
+			for(size_t j = 0; j < scr.get_width(); j++) {
+				s = s * 1103515245 + 12345;
+				scr.rowptr(i)[j] = s >> 8;
+			}
+	}
+
+	bool same(framebuffer::fb<false>& a, framebuffer::fb<false>& b)
+	{
+		for(size_t i = 0; i < a.get_height(); i++)
+			if(memcmp(a.rowptr(i), b.rowptr(i), 4 * a.get_width()))
+				return false;
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2) {
+		std::cerr << "Usage: text-cache <hexfile>" << std::endl;
+		return 1;
+	}
+	std::ifstream in(argv[1], std::ios::binary);
+	std::ostringstream s;
+	s << in.rdbuf();
+	std::string hex = s.str();
+	framebuffer::font f;
+	f.load_hex(hex.c_str(), hex.length());
+
+	const size_t w = 512, h = 448;
+	std::vector<uint32_t> mem1(w * h + 4), mem2(w * h + 4);
+	framebuffer::fb<false> a, b;
+	a.set(&mem1[0], w, h, w);
+	b.set(&mem2[0], w, h, w);
+	a.set_palette(16, 8, 0);
+	b.set_palette(16, 8, 0);
+
+	std::string texts[] = {"Frame: 12345", "Lag: 1\nRerecords: 98765\n\tTabbed", "ÄÖÜ αβγ あいう", "x\ty\tz", ""};
+	int32_t positions[][2] = {{0, 0}, {17, 33}, {-5, -7}, {500, 440}, {-100, 200}, {63, 64}, {65, 1}};
+	framebuffer::color colors[][2] = {{0xFFFFFF, 0x000000}, {0x80FF0000, 0x00FF00}, {0x00FFFF, -1},
+		{0x40123456, 0xC0654321}};
+	unsigned failures = 0;
+	for(auto& t : texts)
+		for(auto& p : positions)
+			for(auto& c : colors)
+				for(unsigned dbl = 0; dbl < 4; dbl++) {
+					c[0].set_palette(a);
+					c[1].set_palette(a);
+					fill(a);
+					fill(b);
+					reference(a, f, p[0], p[1], t, c[0], c[1], dbl & 1, dbl & 2);
+					f.render(b, p[0], p[1], t, c[0], c[1], dbl & 1, dbl & 2);
+					if(!same(a, b)) {
+						std::cout << "FAIL: '" << t << "' at " << p[0] << "," << p[1] << std::endl;
+						failures++;
+					}
+				}
+	//gui.text caches masks with a different layout for the same font, and with halo its flags equal those of
+	//font::render() for text aligned at 1. Draw the same string through both paths, in both orders.
+	std::string tabbed = "a\tb";
+	auto halo_text = [&f, &tabbed]() {
+		return framebuffer::text_cache::global().get(&f, framebuffer::text_cache::KIND_HALO_TEXT, tabbed, 4,
+			[](framebuffer::text_cache::mask& m) {
+				m.width = m.height = 3;
+				m.data.resize(9, 2);
+			});
+	};
+	framebuffer::color fg(0xFFFFFF), bg(0x000000);
+	fg.set_palette(a);
+	bg.set_palette(a);
+	for(unsigned order = 0; order < 2; order++) {
+		framebuffer::text_cache::global().clear();
+		if(order == 0)
+			halo_text();
+		fill(a);
+		fill(b);
+		reference(a, f, 1, 0, tabbed, fg, bg, false, false);
+		f.render(b, 1, 0, tabbed, fg, bg, false, false);
+		if(!same(a, b)) {
+			std::cout << "FAIL: font::render() got gui.text mask" << std::endl;
+			failures++;
+		}
+		if(halo_text()->width != 3) {
+			std::cout << "FAIL: gui.text got font::render() mask" << std::endl;
+			failures++;
+		}
+	}
+	if(failures)
+		return 1;
+	std::cout << "Consistency check passed." << std::endl;
+
+	//A typical frame of status text.
+	bg = framebuffer::color(0x80000000);
+	bg.set_palette(a);
+	const unsigned rounds = 2000;
+	uint64_t t0 = get_utime();
+	for(unsigned i = 0; i < rounds; i++)
+		for(unsigned j = 0; j < 20; j++)
+			reference(a, f, 0, 16 * j, "Watch: 0x7E0010 = 12345 (0x3039)", fg, bg, false, false);
+	uint64_t t1 = get_utime();
+	for(unsigned i = 0; i < rounds; i++)
+		for(unsigned j = 0; j < 20; j++)
+			f.render(a, 0, 16 * j, "Watch: 0x7E0010 = 12345 (0x3039)", fg, bg, false, false);
+	uint64_t t2 = get_utime();
+	auto st = framebuffer::text_cache::global().get_stats();
+	std::cout << "20 lines glyph by glyph: " << (t1 - t0) / rounds << "us/frame" << std::endl;
+	std::cout << "20 lines cached: " << (t2 - t1) / rounds << "us/frame" << std::endl;
+	std::cout << "Cache: " << st.hits << " hits, " << st.misses << " misses, " << st.entries << " entries, "
+		<< st.bytes << " bytes" << std::endl;
+	return 0;
+}
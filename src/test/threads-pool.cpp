@@ -0,0 +1,142 @@
+#include "threads-pool.hpp"
+#include "string.hpp"
+#include "test-timing.hpp"
+#include <iostream>
+#include <stdexcept>
+
+//Benchmark/consistency check for the shared task pool.
+//Usage: threads-pool [<threads> [<tasks>]]
+
+namespace
+{
+	uint64_t fib(threads::pool& p, unsigned n)
+	{
+		if(n < 16) {
+			uint64_t a = 0, b = 1;
+			for(unsigned i = 0; i < n; i++) {
+				uint64_t c = a + b;
+				a = b;
+				b = c;
+			}
+			return a;
+		}
+		auto f = p.submit<uint64_t>([&p, n]() -> uint64_t { return fib(p, n - 1); });
+		uint64_t x = fib(p, n - 2);
+		return x + f.get();
+	}
+
+	bool check(bool ok, const std::string& what)
+	{
+		std::cout << what << ": " << (ok ? "OK" : "FAILED") << std::endl;
+		return ok;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned nthreads = (argc > 1) ? parse_value<unsigned>(argv[1]) : 4;
+	size_t ntasks = (argc > 2) ? parse_value<size_t>(argv[2]) : 100000;
+	bool ok = true;
+	threads::pool p(nthreads);
+
+	uint64_t t = get_utime();
+	std::vector<threads::future<size_t>> futures;
+	for(size_t i = 0; i < ntasks; i++)
+		futures.push_back(p.submit<size_t>([i]() -> size_t { return i * 3; }));
+	uint64_t sum = 0;
+	for(auto& i : futures)
+		sum += i.get();
+	t = get_utime() - t;
+	ok &= check(sum == 3 * (uint64_t)ntasks * (ntasks - 1) / 2, "submit/get");
+	std::cout << "  " << 1000.0 * t / ntasks << "ns/task" << std::endl;
+
+	std::vector<uint64_t> data(10000000);
+	for(size_t i = 0; i < data.size(); i++)
+		data[i] = i * 7 + 1;
+	t = get_utime();
+	threads::lock slock;
+	uint64_t psum = 0;
+	p.parallel_for(0, data.size(), [&data, &slock, &psum](size_t lo, size_t hi) {
+		uint64_t s = 0;
+		for(size_t i = lo; i < hi; i++)
+			s += data[i];
+		threads::alock h(slock);
+		psum += s;
+	}, 65536);
+	t = get_utime() - t;
+	uint64_t ssum = 0;
+	for(auto i : data)
+		ssum += i;
+	ok &= check(psum == ssum, "parallel_for");
+	std::cout << "  " << t << "us" << std::endl;
+
+	t = get_utime();
+	ok &= check(fib(p, 30) == 832040, "nested tasks");
+	std::cout << "  " << get_utime() - t << "us" << std::endl;
+
+	bool thrown = false;
+	try {
+		p.parallel_for(0, 100, [](size_t lo, size_t hi) {
+			if(lo <= 50 && hi > 50)
+				throw std::runtime_error("Test");
+		});
+	} catch(std::runtime_error& e) {
+		thrown = true;
+	}
+	ok &= check(thrown, "exception transport");
+
+	//Exception that is not std::exception, thrown on the calling thread: All subranges the helpers started must
+	//be done before it gets here.
+	threads::id caller = threads::this_id();
+	threads::lock alock;
+	unsigned active = 0;
+	thrown = false;
+	try {
+		p.parallel_for(0, 64, [caller, &alock, &active](size_t lo, size_t hi) {
+			{
+				threads::alock h(alock);
+				active++;
+			}
+			uint64_t until = get_utime() + 1000;
+			while(get_utime() < until);
+			{
+				threads::alock h(alock);
+				active--;
+			}
+			if(threads::this_id() == caller)
+				throw 42;
+		});
+	} catch(int x) {
+		thrown = true;
+	}
+	ok &= check(thrown && !active, "foreign exception waits for helpers");
+
+	//Fill the pool with slow normal tasks, then check a latency task overtakes the rest.
+	threads::lock olock;
+	std::vector<int> order;
+	std::vector<threads::future<void>> slow;
+	for(unsigned i = 0; i < 4 * nthreads + 8; i++)
+		slow.push_back(p.submit<void>([&olock, &order]() {
+			uint64_t until = get_utime() + 2000;
+			while(get_utime() < until);
+			threads::alock h(olock);
+			order.push_back(0);
+		}));
+	auto fast = p.submit<void>([&olock, &order]() {
+		threads::alock h(olock);
+		order.push_back(1);
+	}, threads::LANE_LATENCY);
+	fast.wait();
+	for(auto& i : slow)
+		i.wait();
+	size_t pos = 0;
+	while(pos < order.size() && !order[pos])
+		pos++;
+	ok &= check(pos < order.size() && pos <= 2 * nthreads, "latency lane");
+
+	threads::pool::stats s = p.get_stats();
+	std::cout << "threads=" << s.threads << " submitted=" << s.submitted[0] << "+" << s.submitted[1]
+		<< " executed=" << s.executed << " steals=" << s.steals << " sleeps=" << s.sleeps
+		<< " max_queued=" << s.max_queued << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+#include "zip.hpp"
+#include "threads-pool.hpp"
+#include "minmax.hpp"
+#include "test-timing.hpp"
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+//Benchmark of writing and reading movie-like ZIP archives, and check that the result does not depend on number
+//of threads and reads back correctly.
+//Usage: zip-bench [<frames> [<output>]]
+
+namespace
+{
+	//Input in text format, somewhat compressible.
+	std::string make_input(unsigned frames, uint32_t seed)
+	{
+		std::ostringstream s;
+		for(unsigned i = 0; i < frames; i++) {
+			seed = seed * 1103515245 + 12345;
+			s << "F.|";
+			for(unsigned j = 0; j < 12; j++)
+				s << ((seed >> (j + 8)) & 1 ? "BYsSudlrAXLR"[j] : '.');
+			s << "|" << (seed >> 28) << " " << (seed >> 24 & 15) << "\n";
+		}
+		return s.str();
+	}
+
+	std::vector<char> make_blob(size_t size, uint32_t seed)
+	{
+		std::vector<char> x(size);
+		for(size_t i = 0; i < size; i++) {
+			seed = seed * 1103515245 + 12345;
+			//Mostly repeats, like savestates.
+			x[i] = ((seed >> 16) & 7) ? (i & 0xFF) : (seed >> 24);
+		}
+		return x;
+	}
+
+	void write_movie(zip::writer& w, const std::string& input, const std::vector<std::string>& branches,
+		const std::vector<char>& savestate, const std::vector<char>& sram, const std::vector<char>& screenshot)
+	{
+		w.write_linefile("gametype", "snes_ntsc");
+		w.write_linefile("systemid", "lsnes-rr1");
+		w.write_linefile("controlsversion", "0");
+		w.write_linefile("coreversion", "bsnes v085 (Compatibility core)");
+		w.write_linefile("projectid", "0123456789abcdef");
+		w.write_numeric_file("rerecords", 123456);
+		for(unsigned i = 0; i < 40; i++)
+			w.write_linefile((stringfmt() << "setting." << i).str(), "1");
+		w.write_raw_file("savestate", savestate);
+		w.write_raw_file("moviesram.srm", sram);
+		w.write_raw_file("screenshot", screenshot);
+		std::ostream& m = w.create_file("input");
+		m.write(input.c_str(), input.length());
+		w.close_file();
+		for(size_t i = 0; i < branches.size(); i++) {
+			std::ostream& b = w.create_file((stringfmt() << "branch" << (i + 1)).str());
+			b.write(branches[i].c_str(), branches[i].length());
+			w.close_file();
+		}
+	}
+
+	//What loading slot information reads.
+	void read_brief(zip::reader& r, std::string& projectid, uint64_t& rerecords)
+	{
+		std::string tmp;
+		r.read_linefile("systemid", tmp);
+		r.read_linefile("gametype", tmp);
+		r.read_linefile("coreversion", tmp);
+		r.read_linefile("projectid", projectid);
+		r.read_numeric_file("rerecords", rerecords);
+		r.read_linefile("rom.sha256", tmp, true);
+		r.read_linefile("rom.hint", tmp, true);
+	}
+
+	bool check_read(const std::string& file, const std::string& input, const std::vector<char>& savestate)
+	{
+		zip::reader r(file);
+		std::string projectid;
+		uint64_t rerecords;
+		read_brief(r, projectid, rerecords);
+		if(projectid != "0123456789abcdef" || rerecords != 123456)
+			return false;
+		std::vector<char> x;
+		r.read_raw_file("savestate", x);
+		if(x != savestate)
+			return false;
+		r.read_raw_file("input", x);
+		if(std::string(x.begin(), x.end()) != input)
+			return false;
+		std::istream& s = r["input"];
+		std::ostringstream y;
+		y << s.rdbuf();
+		delete &s;
+		return (y.str() == input);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned frames = (argc > 1) ? atoi(argv[1]) : 500000;
+	std::string input = make_input(frames, 1);
+	std::vector<std::string> branches;
+	for(unsigned i = 0; i < 6; i++)
+		branches.push_back(make_input(frames / 2, i + 2));
+	std::vector<char> savestate = make_blob(4 << 20, 7);
+	std::vector<char> sram = make_blob(128 << 10, 8);
+	std::vector<char> screenshot = make_blob(512 * 448 * 3, 9);
+	size_t total = input.length() + savestate.size() + sram.size() + screenshot.size();
+	for(auto& i : branches)
+		total += i.length();
+	std::cout << "Movie of " << total / 1024 << "kB in " << (branches.size() + 50) << " members" << std::endl;
+
+	std::string reference;
+	unsigned maxthreads = max(threads::pool::global().get_threads(), 4U);
+	for(unsigned threads = 1; threads <= maxthreads; threads *= 2) {
+		threads::pool::global().set_threads(threads);
+		std::ostringstream out;
+		uint64_t t0 = get_utime();
+		{
+			zip::writer w(out, 6);
+			write_movie(w, input, branches, savestate, sram, screenshot);
+			w.commit();
+		}
+		uint64_t t = get_utime() - t0;
+		std::string archive = out.str();
+		std::cout << threads << " threads: " << t / 1000 << "ms, " << archive.length() / 1024 << "kB" << std::endl;
+		if(reference == "")
+			reference = archive;
+		else if(archive != reference) {
+			std::cout << "FAIL: Archive differs from single-threaded one" << std::endl;
+			return 1;
+		}
+	}
+	std::string file = (argc > 2) ? argv[2] : "zip-bench.tmp.zip";
+	for(unsigned level = 0; level <= 6; level += 6) {
+		{
+			zip::writer w(file, level);
+			write_movie(w, input, branches, savestate, sram, screenshot);
+			w.commit();
+		}
+		if(!check_read(file, input, savestate)) {
+			std::cout << "FAIL: Archive does not read back correctly (level " << level << ")" << std::endl;
+			return 1;
+		}
+		const unsigned rounds = 1000;
+		uint64_t t0 = get_utime();
+		for(unsigned i = 0; i < rounds; i++) {
+			zip::reader r(file);
+			std::string projectid;
+			uint64_t rerecords;
+			read_brief(r, projectid, rerecords);
+		}
+		uint64_t t1 = get_utime();
+		for(unsigned i = 0; i < rounds / 100; i++) {
+			zip::reader r(file);
+			std::vector<char> x;
+			r.read_raw_file("savestate", x);
+		}
+		uint64_t t2 = get_utime();
+		std::cout << "Level " << level << ": Brief info " << (t1 - t0) / rounds << "us, savestate "
+			<< (t2 - t1) / (rounds / 100) << "us" << std::endl;
+	}
+	if(argc <= 2)
+		remove(file.c_str());
+	return 0;
+}
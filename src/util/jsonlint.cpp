@@ -2,8 +2,27 @@
 #include <iostream>
 #include <fstream>
 #include <list>
+#include <sstream>
 #include <string>
 
+namespace
+{
+	//Only checks the syntax, nothing is built.
+	class null_handler : public JSON::sax_handler
+	{
+	public:
+		void null_value() {}
+		void boolean_value(bool v) {}
+		void number_value(const JSON::number_holder& n) {}
+		void string_value(const char* str, size_t len) {}
+		void array_begin() {}
+		void array_end() {}
+		void object_begin() {}
+		void object_key(const char* str, size_t len) {}
+		void object_end() {}
+	};
+}
+
 int main(int argc, char** argv)
 {
 	int ret = 0;
@@ -31,16 +50,17 @@ int main(int argc, char** argv)
 				std::ifstream strm(i, std::ios::binary);
 				if(!strm)
 					throw std::runtime_error("Can't open");
-				while(strm) {
-					std::string line;
-					std::getline(strm, line);
-					doc = doc + line + "\n";
-				}
+				std::ostringstream s;
+				s << strm.rdbuf();
+				doc = s.str();
 			}
-			JSON::node n(doc);
 			if(print_parsed) {
+				JSON::node n(doc);
 				JSON::printer_indenting ip;
 				std::cout << n.serialize(&ip) << std::endl;
+			} else {
+				null_handler h;
+				JSON::sax_parse(doc, h);
 			}
 		} catch(JSON::error& e) {
 			std::cerr << i << ": " << e.extended_error(doc) << std::endl;
@@ -0,0 +1,176 @@
+#include "lsnes.hpp"
+
+#include "core/dispatch.hpp"
+#include "core/framebuffer.hpp"
+#include "core/instance.hpp"
+#include "core/loadlib.hpp"
+#include "core/mainloop.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/moviedata.hpp"
+#include "core/random.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "core/window.hpp"
+#include "interface/romtype.hpp"
+#include "lua/lua.hpp"
+#include "library/crandom.hpp"
+#include "library/minmax.hpp"
+#include "library/perfscope.hpp"
+#include "library/string.hpp"
+
+#include <fstream>
+#include <sys/time.h>
+
+//Replays a movie as fast as possible and reports where the time went.
+//Usage: lsnes-bench [--frames=<n>] [--json=<file>] [--trace=<file>] [--no-render] [<options>] <movie>
+//
+//Per-frame statistics of each timed region are written as JSON to <file> (default standard output). With --trace,
+//every timed scope is also written to <file> in Chrome trace event format (load in chrome://tracing or Perfetto).
+//Options are as for lsnes-dumpavi (--rom=, --setting-foo=, --lua=, --load-library=, ...).
+
+namespace
+{
+	double get_time()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return tv.tv_sec + tv.tv_usec / 1000000.0;
+	}
+
+	void write_file(const std::string& filename, const std::string& content)
+	{
+		std::ofstream f(filename, std::ios::binary);
+		if(!f)
+			throw std::runtime_error("Can't open '" + filename + "' for writing");
+		f << content;
+		if(!f)
+			throw std::runtime_error("Can't write '" + filename + "'");
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return 1;
+	}
+	reached_main();
+
+	std::vector<std::string> cmdline;
+	std::string movfn;
+	std::string jsonfile;
+	std::string tracefile;
+	uint64_t frames = 0;
+	bool render = true;
+	for(int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		regex_results r;
+		cmdline.push_back(a);
+		if(r = regex("--frames=(.*)", a)) {
+			try {
+				frames = parse_value<uint64_t>(r[1]);
+			} catch(std::exception& e) {
+				std::cerr << "Bad --frames: " << e.what() << std::endl;
+				return 1;
+			}
+		} else if(r = regex("--json=(.*)", a))
+			jsonfile = r[1];
+		else if(r = regex("--trace=(.*)", a))
+			tracefile = r[1];
+		else if(a == "--no-render")
+			render = false;
+		else if(a.length() > 0 && a[0] != '-')
+			movfn = a;
+	}
+	if(movfn == "") {
+		std::cerr << "Syntax: lsnes-bench [--frames=<n>] [--json=<file>] [--trace=<file>] [--no-render] "
+			"[<options>] <movie>" << std::endl;
+		return 1;
+	}
+
+	set_random_seed();
+	platform::init();
+	init_lua(lsnes_instance);
+	autoload_libraries();
+	for(auto i : cmdline) {
+		regex_results r;
+		try {
+			if(r = regex("--load-library=(.*)", i)) {
+				with_loaded_library(*new loadlib::module(loadlib::library(r[1])));
+				handle_post_loadlibrary();
+			}
+			if(r = regex("--firmware-path=(.*)", i))
+				lsnes_instance.setcache->set("firmwarepath", r[1]);
+			if(r = regex("--setting-(.*)=(.*)", i))
+				lsnes_instance.setcache->set(r[1], r[2]);
+			if(r = regex("--lua=(.*)", i))
+				lsnes_instance.lua2->add_startup_script(r[1]);
+		} catch(std::exception& e) {
+			std::cerr << "Bad option '" << i << "': " << e.what() << std::endl;
+			return 1;
+		}
+	}
+	//The point is to measure the output path too.
+	lsnes_instance.setcache->set("seek-skip-output", "no");
+	init_main_callbacks();
+
+	//There is no window to present to, so render the queue whenever a new screen is ready.
+	dispatch::target<> screenupdate;
+	if(render)
+		screenupdate.set(lsnes_instance.dispatch->screen_update, []() {
+			lsnes_instance.fbuf->render_framebuffer();
+		});
+
+	double start = 0, end = 0;
+	try {
+		struct loaded_rom r;
+		std::map<std::string, std::string> tmp;
+		r = construct_rom(movfn, cmdline);
+		r.load(tmp, 1000000000, 0);
+		moviefile* movie = new moviefile(movfn, r.get_internal_rom_type());
+		*lsnes_instance.rom = r;
+		lsnes_instance.rom->set_internal_region(movie->gametype->get_region());
+		lsnes_instance.rom->load(movie->settings, movie->movie_rtc_second, movie->movie_rtc_subsecond);
+		if(!frames)
+			frames = movie->get_frame_count();
+		if(!frames)
+			throw std::runtime_error("Movie is empty");
+		messages << "Benchmarking " << frames << " frames with " << lsnes_instance.rom->get_core_identifier()
+			<< std::endl;
+		perfscope::enable(true, tracefile != "");
+		start = get_time();
+		set_quit_at_frame(frames, [&end]() {
+			end = get_time();
+			perfscope::enable(false);
+		});
+		main_loop(r, *movie, true);
+		if(!end)
+			throw std::runtime_error("Emulation stopped before end of benchmark");
+	} catch(std::bad_alloc& e) {
+		OOM_panic();
+	} catch(std::exception& e) {
+		messages << "FATAL: " << e.what() << std::endl;
+		quit_lua(lsnes_instance);
+		fatal_error();
+		return 1;
+	}
+	quit_lua(lsnes_instance);
+
+	std::cerr << frames << " frames in " << (end - start) << "s (" << frames / max(end - start, 1e-9)
+		<< " fps)" << std::endl;
+	try {
+		if(jsonfile != "")
+			write_file(jsonfile, perfscope::report_json());
+		else
+			std::cout << perfscope::report_json() << std::endl;
+		if(tracefile != "")
+			write_file(tracefile, perfscope::trace_json());
+	} catch(std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -339,6 +339,7 @@ int main(int argc, char** argv)
 	init_lua(lsnes_instance);
 	lsnes_instance.mdumper->set_output(&messages.getstream());
 	set_hasher_callback(hash_callback);
+	open_rom_hash_index();
 
 	messages << "lsnes version: lsnes rr" << lsnes_version << std::endl;
 	messages << "Command line is: ";
@@ -0,0 +1,245 @@
+#include "lsnes.hpp"
+
+#include "core/instance.hpp"
+#include "core/loadlib.hpp"
+#include "core/mainloop.hpp"
+#include "core/messages.hpp"
+#include "core/misc.hpp"
+#include "core/moviedata.hpp"
+#include "core/random.hpp"
+#include "core/rom.hpp"
+#include "core/settings.hpp"
+#include "core/window.hpp"
+#include "interface/romtype.hpp"
+#include "lua/lua.hpp"
+#include "library/crandom.hpp"
+#include "library/json.hpp"
+#include "library/minmax.hpp"
+#include "library/sha256.hpp"
+#include "library/string.hpp"
+#include "library/threads.hpp"
+
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//Replays movies to the end in parallel worker processes and reports the results as JSON.
+//Usage: lsnes-verify [--jobs=<n>] [--verbose] [<options>] <movie>...
+//
+//Each movie is replayed by its own forked process, since the emulator state is global. At most <n> processes run
+//at once (default one per CPU). Options are as for lsnes-dumpavi (--rom=, --setting-foo=, --load-library=, ...).
+
+namespace
+{
+	double get_time()
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return tv.tv_sec + tv.tv_usec / 1000000.0;
+	}
+
+	void apply_options(const std::vector<std::string>& cmdline)
+	{
+		for(auto i : cmdline) {
+			regex_results r;
+			if(r = regex("--load-library=(.*)", i)) {
+				with_loaded_library(*new loadlib::module(loadlib::library(r[1])));
+				handle_post_loadlibrary();
+			}
+			if(r = regex("--firmware-path=(.*)", i))
+				lsnes_instance.setcache->set("firmwarepath", r[1]);
+			if(r = regex("--setting-(.*)=(.*)", i))
+				lsnes_instance.setcache->set(r[1], r[2]);
+		}
+	}
+
+	//Replay a movie in this process. Never returns.
+	void run_movie(const std::string& movfn, const std::vector<std::string>& cmdline, int fd, bool verbose)
+	{
+		JSON::node result(JSON::object);
+		result.insert("movie", JSON::s(movfn));
+		if(!verbose) {
+			int null = open("/dev/null", O_WRONLY);
+			if(null >= 0) {
+				dup2(null, 1);
+				dup2(null, 2);
+				close(null);
+			}
+		}
+		bool ok = false;
+		try {
+			set_random_seed();
+			platform::init();
+			init_lua(lsnes_instance);
+			autoload_libraries();
+			apply_options(cmdline);
+			init_main_callbacks();
+
+			struct loaded_rom r;
+			std::map<std::string, std::string> tmp;
+			r = construct_rom(movfn, cmdline);
+			r.load(tmp, 1000000000, 0);
+			moviefile* movie = new moviefile(movfn, r.get_internal_rom_type());
+			*lsnes_instance.rom = r;
+			lsnes_instance.rom->set_internal_region(movie->gametype->get_region());
+			lsnes_instance.rom->load(movie->settings, movie->movie_rtc_second, movie->movie_rtc_subsecond);
+			uint64_t frames = movie->get_frame_count();
+			if(!frames)
+				throw std::runtime_error("Movie is empty");
+			result.insert("core", JSON::s(lsnes_instance.rom->get_core_identifier()));
+
+			double start = get_time();
+			set_quit_at_frame(frames, [&result, &ok, frames]() {
+				auto& core = CORE();
+				result.insert("frames", JSON::u(frames));
+				result.insert("lag", JSON::u(core.mlogic->get_movie().get_lag_frames()));
+				result.insert("hash", JSON::s(sha256::hash(core.rom->save_core_state(true))));
+				ok = true;
+			});
+			main_loop(r, *movie, true);
+			result.insert("time", JSON::f(get_time() - start));
+			if(!ok)
+				throw std::runtime_error("Emulation stopped before end of movie");
+		} catch(std::exception& e) {
+			result.insert("error", JSON::s(e.what()));
+		}
+		std::string out = result.serialize();
+		const char* ptr = out.c_str();
+		size_t left = out.length();
+		while(left) {
+			ssize_t w = write(fd, ptr, left);
+			if(w <= 0)
+				break;
+			ptr += w;
+			left -= w;
+		}
+		//Tearing down the emulator properly buys nothing here.
+		_exit(ok ? 0 : 1);
+	}
+
+	struct job
+	{
+		size_t index;
+		int fd;
+		double start;
+	};
+
+	JSON::node collect(const std::string& movfn, int fd, int status, double walltime)
+	{
+		std::string out;
+		char buf[4096];
+		ssize_t r;
+		while((r = read(fd, buf, sizeof(buf))) > 0)
+			out.append(buf, r);
+		close(fd);
+		try {
+			if(out != "")
+				return JSON::node(out);
+		} catch(JSON::error& e) {
+		}
+		JSON::node result(JSON::object);
+		result.insert("movie", JSON::s(movfn));
+		if(WIFSIGNALED(status))
+			result.insert("error", JSON::s((stringfmt() << "Worker killed by signal " << WTERMSIG(status))
+				.str()));
+		else
+			result.insert("error", JSON::s("Worker exited without result"));
+		result.insert("time", JSON::f(walltime));
+		return result;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		crandom::init();
+	} catch(std::exception& e) {
+		std::cerr << "Error initializing system RNG" << std::endl;
+		return 1;
+	}
+	reached_main();
+
+	std::vector<std::string> cmdline;
+	std::vector<std::string> movies;
+	unsigned jobs = 0;
+	bool verbose = false;
+	for(int i = 1; i < argc; i++) {
+		std::string a = argv[i];
+		regex_results r;
+		cmdline.push_back(a);
+		if(r = regex("--jobs=(.*)", a)) {
+			try {
+				jobs = parse_value<unsigned>(r[1]);
+			} catch(std::exception& e) {
+				std::cerr << "Bad --jobs: " << e.what() << std::endl;
+				return 1;
+			}
+		} else if(a == "--verbose")
+			verbose = true;
+		else if(a.length() > 0 && a[0] != '-')
+			movies.push_back(a);
+	}
+	if(movies.empty()) {
+		std::cerr << "Syntax: lsnes-verify [--jobs=<n>] [--verbose] [<options>] <movie>..." << std::endl;
+		return 1;
+	}
+	if(!jobs)
+		jobs = max(threads::thread::hardware_concurrency(), 1U);
+
+	double start = get_time();
+	std::vector<JSON::node> results(movies.size());
+	std::map<pid_t, job> running;
+	size_t next = 0;
+	bool failed = false;
+	while(next < movies.size() || !running.empty()) {
+		while(next < movies.size() && running.size() < jobs) {
+			int fds[2];
+			if(pipe(fds) < 0) {
+				std::cerr << "Can't create pipe" << std::endl;
+				return 1;
+			}
+			pid_t pid = fork();
+			if(pid < 0) {
+				std::cerr << "Can't fork worker" << std::endl;
+				return 1;
+			}
+			if(pid == 0) {
+				close(fds[0]);
+				for(auto& i : running)
+					close(i.second.fd);
+				run_movie(movies[next], cmdline, fds[1], verbose);
+			}
+			close(fds[1]);
+			job j;
+			j.index = next++;
+			j.fd = fds[0];
+			j.start = get_time();
+			running[pid] = j;
+		}
+		int status;
+		pid_t pid = wait(&status);
+		if(pid < 0)
+			break;
+		if(!running.count(pid))
+			continue;
+		job j = running[pid];
+		running.erase(pid);
+		results[j.index] = collect(movies[j.index], j.fd, status, get_time() - j.start);
+		if(results[j.index].field_exists("error"))
+			failed = true;
+		std::cerr << "[" << (next - running.size()) << "/" << movies.size() << "] " << movies[j.index]
+			<< (results[j.index].field_exists("error") ? ": FAILED" : ": OK") << std::endl;
+	}
+
+	JSON::node out(JSON::object);
+	out.insert("jobs", JSON::u(jobs));
+	out.insert("time", JSON::f(get_time() - start));
+	JSON::node& arr = out.insert("results", JSON::node(JSON::array));
+	for(auto& i : results)
+		arr.append(i);
+	JSON::printer_indenting ip;
+	std::cout << out.serialize(&ip) << std::endl;
+	return failed ? 1 : 0;
+}